@@ -42,7 +42,7 @@ typedef struct HHPlayerContext
 	/* Audio */
 	struct SwrContext	*audioConvertor;	// Audio resampler
 	/* Create software resample context */
-	int64_t				outChannelLayout;	// TODO(whan) add comment
+	int64_t				outChannelLayout;	// Layout of the audio device
 	enum AVSampleFormat outSampleFormat;
 	int					outSampleRate;
 	int64_t				inChannelLayout;
@@ -922,10 +922,17 @@ int main(int argc, char **argv)
 		obtain.freq, obtain.format, obtain.channels, obtain.samples, (unsigned long)obtain.callback, (unsigned long)obtain.userdata);
 
 	/* Create software resample context */
-	hhplayerContext.outChannelLayout	= av_get_default_channel_layout(hhplayerContext.aCodec->channels);;
+	// The device gets the layout SDL uses for its channel count, the decoder's
+	// own layout is kept unless it is missing or disagrees with its channel count.
+	hhplayerContext.outChannelLayout	= av_get_default_channel_layout(obtain.channels);
 	hhplayerContext.outSampleFormat		= AV_SAMPLE_FMT_S16;
 	hhplayerContext.outSampleRate		= hhplayerContext.aCodec->sample_rate;
-	hhplayerContext.inChannelLayout		= av_get_default_channel_layout(hhplayerContext.aCodec->channels);
+	hhplayerContext.inChannelLayout		= hhplayerContext.aCodec->channel_layout;
+	if (hhplayerContext.inChannelLayout == 0 ||
+		av_get_channel_layout_nb_channels(hhplayerContext.inChannelLayout) != hhplayerContext.aCodec->channels)
+	{
+		hhplayerContext.inChannelLayout = av_get_default_channel_layout(hhplayerContext.aCodec->channels);
+	}
 	hhplayerContext.inSampleFormat		= hhplayerContext.aCodec->sample_fmt;
 	hhplayerContext.inSampleRate		= hhplayerContext.aCodec->sample_rate;
 
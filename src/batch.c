@@ -0,0 +1,470 @@
+#include <string.h>
+#include <ctype.h>
+
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+#include "batch.h"
+#include "pool.h"
+#include "thread.h"
+#include "wav.h"
+
+// Blocks rendered by one mix task, and decoded ahead by one decode round.
+#define BATCH_CHUNK_BLOCKS 16
+
+struct BatchContext;
+
+typedef struct BatchDecodeTask
+{
+    struct BatchJob *Job;
+    int32 InputIndex;
+} BatchDecodeTask;
+
+// One mix of the manifest. Chunks go through decode -> mix -> encode; the
+// decode of chunk i+1 overlaps the encode of chunk i, and two chunk buffers
+// let mixing run one chunk ahead of the writer.
+typedef struct BatchJob
+{
+    struct BatchContext *Batch;
+    char *Line;
+    char **Args;                // Args[0] is the output, the rest are inputs.
+    int32 ArgCount;
+
+    MixerContext *Mixer;
+    BatchDecodeTask *DecodeTasks;
+    FILE *OutFile;
+    int64 DataSize;
+    float32 *Chunk[2];
+    int32 ChunkSamples[2];
+
+    Mutex Lock;
+    int32 NextDecode;           // Next chunk to decode / mix / encode.
+    int32 NextMix;
+    int32 NextEncode;
+    int32 DecodeRunning;
+    int32 MixRunning;
+    int32 EncodeRunning;
+    volatile int32 DecodePending;
+    int32 Ended;
+    int32 Failed;
+    int32 Finished;
+
+    int64 StartTime;
+    int64 EndTime;
+} BatchJob;
+
+typedef struct BatchContext
+{
+    MixerConfig Config;
+    ThreadPool *Pool;
+    BatchJob *Jobs;
+    int32 JobCount;
+    volatile int32 NextJob;
+    volatile int32 FailedCount;
+} BatchContext;
+
+static void JobOpenTask(void *Arg);
+static void JobDecodeTask(void *Arg);
+static void JobMixTask(void *Arg);
+static void JobEncodeTask(void *Arg);
+
+void BatchParseClip(char *Arg, int32 SampleRate, MixerClipInfo *Clip)
+{
+    memset(Clip, 0, sizeof(MixerClipInfo));
+    Clip->FileName = Arg;
+    Clip->Gain = 1.0f;
+
+    // start, gain, trim, length. The text after the last '@' is only a clip
+    // spec when it is up to four numbers, so "take@2.wav" stays a file name.
+    char *At = strrchr(Arg, '@');
+    if (At == NULL) return;
+    float64 Fields[4] = { 0.0, 1.0, 0.0, 0.0 };
+    char *Text = At + 1;
+    for (int32 Field = 0; ; Field++)
+    {
+        char *End = Text;
+        if (Field == 4) return;
+        if (*Text != ',' && *Text != '\0') Fields[Field] = strtod(Text, &End);
+        if (End == Text && *Text != ',' && *Text != '\0') return;
+        if (*End == '\0') break;
+        if (*End != ',') return;
+        Text = End + 1;
+    }
+    *At = '\0';
+    Clip->StartSample = (int64)(Fields[0]*SampleRate + 0.5);
+    Clip->Gain = (float32)Fields[1];
+    Clip->TrimSample = (int64)(Fields[2]*SampleRate + 0.5);
+    Clip->LengthSample = (int64)(Fields[3]*SampleRate + 0.5);
+}
+
+// Split Line in place into whitespace separated, optionally quoted, tokens.
+static int32 Tokenize(char *Line, char ***Args)
+{
+    int32 Count = 0;
+    int32 Capacity = 0;
+    char **Tokens = NULL;
+
+    char *Cursor = Line;
+    for (;;)
+    {
+        while (*Cursor && isspace((unsigned char)*Cursor)) Cursor++;
+        if (*Cursor == '\0') break;
+
+        char *Token = Cursor;
+        if (*Cursor == '"')
+        {
+            Token = ++Cursor;
+            while (*Cursor && *Cursor != '"') Cursor++;
+        }
+        else
+        {
+            while (*Cursor && !isspace((unsigned char)*Cursor)) Cursor++;
+        }
+        if (*Cursor) *Cursor++ = '\0';
+
+        if (Count == Capacity)
+        {
+            Capacity = Capacity ? Capacity*2 : 8;
+            char **Grown = av_realloc_array(Tokens, Capacity, sizeof(char *));
+            if (Grown == NULL)
+            {
+                av_free(Tokens);
+                return -1;
+            }
+            Tokens = Grown;
+        }
+        Tokens[Count++] = Token;
+    }
+
+    *Args = Tokens;
+    return Count;
+}
+
+static int32 LoadManifest(BatchContext *Batch, const char *ManifestFileName)
+{
+    FILE *File = fopen(ManifestFileName, "r");
+    if (File == NULL)
+    {
+        DEBUG(stderr, "ERROR when open manifest %s\n", ManifestFileName);
+        return MIXER_ERR_OPEN;
+    }
+
+    int32 Capacity = 0;
+    char Line[8192];
+    while (fgets(Line, sizeof(Line), File) != NULL)
+    {
+        char *Start = Line;
+        while (isspace((unsigned char)*Start)) Start++;
+        if (*Start == '\0' || *Start == '#') continue;
+
+        if (Batch->JobCount == Capacity)
+        {
+            Capacity = Capacity ? Capacity*2 : 64;
+            BatchJob *Jobs = av_realloc_array(Batch->Jobs, Capacity, sizeof(BatchJob));
+            if (Jobs == NULL)
+            {
+                fclose(File);
+                return MIXER_ERR_NOMEM;
+            }
+            Batch->Jobs = Jobs;
+        }
+
+        BatchJob *Job = &Batch->Jobs[Batch->JobCount];
+        memset(Job, 0, sizeof(BatchJob));
+        Job->Line = av_strdup(Start);
+        if (Job->Line == NULL || (Job->ArgCount = Tokenize(Job->Line, &Job->Args)) < 0)
+        {
+            av_free(Job->Line);
+            fclose(File);
+            return MIXER_ERR_NOMEM;
+        }
+        if (Job->ArgCount < 2)
+        {
+            DEBUG(stderr, "ERROR manifest line without inputs: %s", Start);
+            av_free(Job->Args);
+            av_free(Job->Line);
+            continue;
+        }
+        Batch->JobCount++;
+    }
+
+    fclose(File);
+    return MIXER_OK;
+}
+
+// Start whatever stage of Job can run now. Called with Job->Lock held.
+// Returns 1 when the job has nothing left to do and must be finished.
+static int32 JobAdvance(BatchJob *Job)
+{
+    ThreadPool *Pool = Job->Batch->Pool;
+
+    if (!Job->Failed && !Job->Ended)
+    {
+        // Decode chunk i once chunk i-1 is mixed, decoding and mixing both touch the inputs.
+        if (!Job->DecodeRunning && !Job->MixRunning && Job->NextDecode == Job->NextMix)
+        {
+            int32 InputCount = MixerGetInputCount(Job->Mixer);
+            Job->DecodeRunning = 1;
+            AtomicStore(&Job->DecodePending, InputCount);
+            for (int32 Index = 0; Index < InputCount; Index++)
+            {
+                Job->DecodeTasks[Index].Job = Job;
+                Job->DecodeTasks[Index].InputIndex = Index;
+                PoolSubmit(Pool, JobDecodeTask, &Job->DecodeTasks[Index]);
+            }
+            if (InputCount == 0)
+            {
+                Job->DecodeRunning = 0;
+                Job->NextDecode++;
+            }
+        }
+        // Mix chunk i once it is decoded and its buffer (chunk i-2) is written.
+        if (!Job->MixRunning && Job->NextMix < Job->NextDecode && Job->NextMix < Job->NextEncode + 2)
+        {
+            Job->MixRunning = 1;
+            PoolSubmit(Pool, JobMixTask, Job);
+        }
+    }
+
+    // Encode chunks in order.
+    if (!Job->Failed && !Job->EncodeRunning && Job->NextEncode < Job->NextMix)
+    {
+        Job->EncodeRunning = 1;
+        PoolSubmit(Pool, JobEncodeTask, Job);
+    }
+
+    if (Job->Finished || Job->DecodeRunning || Job->MixRunning || Job->EncodeRunning) return 0;
+    if (Job->Failed || (Job->Ended && Job->NextEncode == Job->NextMix))
+    {
+        Job->Finished = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static void JobFinish(BatchJob *Job)
+{
+    BatchContext *Batch = Job->Batch;
+
+    MixerClose(&Job->Mixer);
+    if (Job->OutFile != NULL)
+    {
+        fseek(Job->OutFile, 0, SEEK_SET);
+        WavWriteHeader(Job->OutFile, Batch->Config.SampleRate, Batch->Config.ChannelCount, Job->DataSize);
+        fclose(Job->OutFile);
+        Job->OutFile = NULL;
+    }
+    av_freep(&Job->Chunk[0]);
+    av_freep(&Job->Chunk[1]);
+    av_freep(&Job->DecodeTasks);
+    MutexDestroy(&Job->Lock);
+    if (Job->Failed)
+    {
+        DEBUG(stderr, "ERROR job %s failed\n", Job->Args[0]);
+        AtomicAdd(&Batch->FailedCount, 1);
+    }
+    Job->EndTime = av_gettime_relative();
+
+    // Keep the number of open jobs bounded, start the next one as this one leaves.
+    int32 Next = AtomicAdd(&Batch->NextJob, 1) - 1;
+    if (Next < Batch->JobCount) PoolSubmit(Batch->Pool, JobOpenTask, &Batch->Jobs[Next]);
+}
+
+static void JobUpdate(BatchJob *Job)
+{
+    int32 Finish = JobAdvance(Job);
+    MutexUnlock(&Job->Lock);
+    if (Finish) JobFinish(Job);
+}
+
+static void JobOpenTask(void *Arg)
+{
+    BatchJob *Job = (BatchJob *)Arg;
+    BatchContext *Batch = Job->Batch;
+    MixerConfig *Config = &Batch->Config;
+
+    Job->StartTime = av_gettime_relative();
+    MutexInit(&Job->Lock);
+
+    int32 Ret = MixerOpen(&Job->Mixer, Config);
+    for (int32 ArgIndex = 1; Ret == MIXER_OK && ArgIndex < Job->ArgCount; ArgIndex++)
+    {
+        MixerClipInfo Clip;
+        BatchParseClip(Job->Args[ArgIndex], Config->SampleRate, &Clip);
+        Ret = MixerAddClip(Job->Mixer, &Clip);
+        if (Ret < 0) DEBUG(stderr, "ERROR when MixerAddClip(%s): %s\n", Clip.FileName, MixerErrorString(Ret));
+        else Ret = MIXER_OK;
+    }
+
+    int32 ChunkFloats = Config->BlockSize*BATCH_CHUNK_BLOCKS*Config->ChannelCount;
+    if (Ret == MIXER_OK)
+    {
+        Job->DecodeTasks = av_mallocz_array(Job->ArgCount, sizeof(BatchDecodeTask));
+        Job->Chunk[0] = av_malloc(ChunkFloats*sizeof(float32));
+        Job->Chunk[1] = av_malloc(ChunkFloats*sizeof(float32));
+        if (Job->DecodeTasks == NULL || Job->Chunk[0] == NULL || Job->Chunk[1] == NULL) Ret = MIXER_ERR_NOMEM;
+    }
+    if (Ret == MIXER_OK)
+    {
+        Job->OutFile = fopen(Job->Args[0], "wb");
+        if (Job->OutFile == NULL)
+        {
+            DEBUG(stderr, "ERROR when open %s\n", Job->Args[0]);
+            Ret = MIXER_ERR_OPEN;
+        }
+        else WavWriteHeader(Job->OutFile, Config->SampleRate, Config->ChannelCount, 0);
+    }
+
+    MutexLock(&Job->Lock);
+    if (Ret < 0) Job->Failed = 1;
+    JobUpdate(Job);
+}
+
+static void JobDecodeTask(void *Arg)
+{
+    BatchDecodeTask *Task = (BatchDecodeTask *)Arg;
+    BatchJob *Job = Task->Job;
+    int32 ChunkSize = Job->Batch->Config.BlockSize*BATCH_CHUNK_BLOCKS;
+
+    int32 Ret = MixerPrefetchInput(Job->Mixer, Task->InputIndex, ChunkSize);
+    if (Ret < 0)
+    {
+        DEBUG(stderr, "ERROR when MixerPrefetchInput(%s): %s\n", Job->Args[0], MixerErrorString(Ret));
+        MutexLock(&Job->Lock);
+        Job->Failed = 1;
+        MutexUnlock(&Job->Lock);
+    }
+
+    if (AtomicAdd(&Job->DecodePending, -1) == 0)
+    {
+        MutexLock(&Job->Lock);
+        Job->DecodeRunning = 0;
+        Job->NextDecode++;
+        JobUpdate(Job);
+    }
+}
+
+static void JobMixTask(void *Arg)
+{
+    BatchJob *Job = (BatchJob *)Arg;
+    MixerConfig *Config = &Job->Batch->Config;
+    int32 Slot = Job->NextMix % 2;
+    float32 *Chunk = Job->Chunk[Slot];
+
+    int32 Ret = MIXER_OK;
+    int32 Total = 0;
+    for (int32 Block = 0; Block < BATCH_CHUNK_BLOCKS; Block++)
+    {
+        int32 SampleCount = 0;
+        Ret = MixerRenderBlock(Job->Mixer, Chunk + Total*Config->ChannelCount, &SampleCount);
+        if (Ret != MIXER_OK) break;
+        Total += SampleCount;
+    }
+    Job->ChunkSamples[Slot] = Total;
+
+    MutexLock(&Job->Lock);
+    if (Ret < 0)
+    {
+        DEBUG(stderr, "ERROR when MixerRenderBlock(%s): %s\n", Job->Args[0], MixerErrorString(Ret));
+        Job->Failed = 1;
+    }
+    if (Ret == MIXER_EOF) Job->Ended = 1;
+    Job->MixRunning = 0;
+    Job->NextMix++;
+    JobUpdate(Job);
+}
+
+static void JobEncodeTask(void *Arg)
+{
+    BatchJob *Job = (BatchJob *)Arg;
+    MixerConfig *Config = &Job->Batch->Config;
+    int32 Slot = Job->NextEncode % 2;
+    int64 FrameSize = sizeof(float32)*Config->ChannelCount;
+
+    int64 Written = fwrite(Job->Chunk[Slot], FrameSize, Job->ChunkSamples[Slot], Job->OutFile);
+
+    MutexLock(&Job->Lock);
+    if (Written != Job->ChunkSamples[Slot])
+    {
+        DEBUG(stderr, "ERROR when write %s\n", Job->Args[0]);
+        Job->Failed = 1;
+    }
+    Job->DataSize += Written*FrameSize;
+    Job->EncodeRunning = 0;
+    Job->NextEncode++;
+    JobUpdate(Job);
+}
+
+static int CompareFloat64(const void *A, const void *B)
+{
+    float64 X = *(const float64 *)A;
+    float64 Y = *(const float64 *)B;
+    return (X > Y) - (X < Y);
+}
+
+static float64 Percentile(const float64 *Sorted, int32 Count, float64 Fraction)
+{
+    if (Count == 0) return 0.0;
+    int32 Index = (int32)(Fraction*(Count - 1) + 0.5);
+    return Sorted[Index];
+}
+
+int32 BatchRun(const char *ManifestFileName, const MixerConfig *Config, int32 ThreadCount, BatchStats *Stats)
+{
+    memset(Stats, 0, sizeof(BatchStats));
+
+    BatchContext Batch;
+    memset(&Batch, 0, sizeof(Batch));
+    Batch.Config = *Config;
+
+    int32 Ret = LoadManifest(&Batch, ManifestFileName);
+    if (Ret == MIXER_OK && PoolCreate(&Batch.Pool, ThreadCount) != 0) Ret = MIXER_ERR_NOMEM;
+
+    int64 StartTime = av_gettime_relative();
+    if (Ret == MIXER_OK)
+    {
+        // Two jobs per worker keep every core busy while jobs wait on each other's stages.
+        int32 InFlight = 2*PoolThreadCount(Batch.Pool);
+        if (InFlight > Batch.JobCount) InFlight = Batch.JobCount;
+        for (int32 Index = 0; Index < Batch.JobCount; Index++) Batch.Jobs[Index].Batch = &Batch;
+        AtomicStore(&Batch.NextJob, InFlight);
+        for (int32 Index = 0; Index < InFlight; Index++)
+        {
+            PoolSubmit(Batch.Pool, JobOpenTask, &Batch.Jobs[Index]);
+        }
+        PoolWait(Batch.Pool);
+    }
+    int64 EndTime = av_gettime_relative();
+    PoolDestroy(&Batch.Pool);
+
+    if (Ret == MIXER_OK)
+    {
+        float64 *Latencies = av_malloc_array(Batch.JobCount ? Batch.JobCount : 1, sizeof(float64));
+        if (Latencies != NULL)
+        {
+            for (int32 Index = 0; Index < Batch.JobCount; Index++)
+            {
+                Latencies[Index] = (Batch.Jobs[Index].EndTime - Batch.Jobs[Index].StartTime)/1e6;
+            }
+            qsort(Latencies, Batch.JobCount, sizeof(float64), CompareFloat64);
+            Stats->LatencyP50 = Percentile(Latencies, Batch.JobCount, 0.50);
+            Stats->LatencyP90 = Percentile(Latencies, Batch.JobCount, 0.90);
+            Stats->LatencyP99 = Percentile(Latencies, Batch.JobCount, 0.99);
+            Stats->LatencyMax = Batch.JobCount ? Latencies[Batch.JobCount - 1] : 0.0;
+            av_free(Latencies);
+        }
+        Stats->JobCount = Batch.JobCount;
+        Stats->FailedCount = Batch.FailedCount;
+        Stats->Seconds = (EndTime - StartTime)/1e6;
+        Stats->JobsPerSecond = Stats->Seconds > 0 ? Batch.JobCount/Stats->Seconds : 0.0;
+    }
+
+    for (int32 Index = 0; Index < Batch.JobCount; Index++)
+    {
+        av_free(Batch.Jobs[Index].Args);
+        av_free(Batch.Jobs[Index].Line);
+    }
+    av_free(Batch.Jobs);
+
+    return Ret;
+}
@@ -0,0 +1,37 @@
+#ifndef MIXER_BATCH_H
+#define MIXER_BATCH_H
+
+#include "mixer.h"
+
+// Batch mode renders a manifest of independent mixes, one per line:
+//
+//     output.wav clip clip ...
+//
+// where every clip is "file[@start[,gain[,trim[,length]]]]" with times in
+// seconds, see BatchParseClip().
+//
+// Blank lines and lines starting with '#' are skipped, paths containing
+// spaces can be double quoted. Every job is split into decode, mix and
+// encode tasks that run on one work-stealing pool, so tasks from different
+// jobs interleave and FFmpeg is initialised once for the whole batch.
+
+typedef struct BatchStats
+{
+    int32 JobCount;
+    int32 FailedCount;
+    float64 Seconds;            // Wall time of the whole batch.
+    float64 JobsPerSecond;
+    float64 LatencyP50;         // Per job, from open to output closed, in seconds.
+    float64 LatencyP90;
+    float64 LatencyP99;
+    float64 LatencyMax;
+} BatchStats;
+
+// Parse "file[@start[,gain[,trim[,length]]]]" into Clip. Arg is cut in place
+// and Clip->FileName points into it.
+void BatchParseClip(char *Arg, int32 SampleRate, MixerClipInfo *Clip);
+
+// ThreadCount <= 0 uses one worker per CPU.
+int32 BatchRun(const char *ManifestFileName, const MixerConfig *Config, int32 ThreadCount, BatchStats *Stats);
+
+#endif
@@ -0,0 +1,948 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <libavutil/avstring.h>
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+#include "batch.h"
+#include "bench.h"
+#include "decoder.h"
+#include "kernel.h"
+#include "limiter.h"
+#include "loudness.h"
+#include "pack.h"
+#include "peaks.h"
+#include "reverb.h"
+
+typedef struct BenchMix
+{
+    MixerConfig Config;
+    MixerClipInfo *Clips;
+    int32 ClipCount;
+} BenchMix;
+
+// Open a fresh context for every run so no run profits from the decoding of
+// the one before.
+static int32 BenchOpen(const BenchMix *Mix, MixerContext **Mixer)
+{
+    int32 Ret = MixerOpen(Mixer, &Mix->Config);
+    if (Ret < 0) return Ret;
+
+    for (int32 Index = 0; Index < Mix->ClipCount; Index++)
+    {
+        Ret = MixerAddClip(*Mixer, &Mix->Clips[Index]);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when MixerAddClip(%s): %s\n", Mix->Clips[Index].FileName, MixerErrorString(Ret));
+            MixerClose(Mixer);
+            return Ret;
+        }
+    }
+    return MIXER_OK;
+}
+
+// Render until the context ends and return the wall time in seconds.
+static int32 BenchRender(MixerContext *Mixer, const MixerConfig *Config, float64 *Seconds)
+{
+    float32 *Block = av_malloc(Config->BlockSize*Config->ChannelCount*sizeof(float32));
+    if (Block == NULL) return MIXER_ERR_NOMEM;
+
+    int64 StartTime = av_gettime_relative();
+    int32 SampleCount = 0;
+    int32 Ret;
+    while ((Ret = MixerRenderBlock(Mixer, Block, &SampleCount)) == MIXER_OK);
+    *Seconds = (av_gettime_relative() - StartTime)/1e6;
+
+    av_free(Block);
+    return Ret < 0 ? Ret : MIXER_OK;
+}
+
+// Render Length samples from Start. Without Seek the mix is rendered from
+// the beginning and everything before Start thrown away, which is what a
+// preview cost before inputs could seek.
+static int32 BenchRange(const BenchMix *Mix, int64 Start, int64 Length, int32 Seek, float64 *Seconds)
+{
+    MixerContext *Mixer = NULL;
+    int32 Ret = BenchOpen(Mix, &Mixer);
+    if (Ret < 0) return Ret;
+
+    Ret = Seek ? MixerSetRange(Mixer, Start, Length) : MixerSetRange(Mixer, 0, Start + Length);
+    if (Ret >= 0) Ret = BenchRender(Mixer, &Mix->Config, Seconds);
+
+    MixerClose(&Mixer);
+    return Ret;
+}
+
+static int32 BenchRangeRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    MixerContext *Mixer = NULL;
+    int32 Ret = BenchOpen(Mix, &Mixer);
+    if (Ret < 0) return Ret;
+    int64 MixLength = MixerGetLength(Mixer);
+    MixerClose(&Mixer);
+    if (MixLength < 0)
+    {
+        DEBUG(stderr, "ERROR: mix length is unknown\n");
+        return MIXER_ERR_ARG;
+    }
+
+    int32 SampleRate = Mix->Config.SampleRate;
+    int64 Window = (int64)(WindowSeconds*SampleRate);
+    int64 Middle = MixLength/2 > Window/2 ? MixLength/2 - Window/2 : 0;
+    DEBUG(stdout, ">>> Range bench: mix %.1f s, window %.1f s at 0 s and %.1f s\n",
+          (float64)MixLength/SampleRate, WindowSeconds, (float64)Middle/SampleRate);
+
+    float64 StartSeconds, MiddleSeconds, DecodeSeconds;
+    if ((Ret = BenchRange(Mix, 0, Window, 1, &StartSeconds)) < 0) return Ret;
+    if ((Ret = BenchRange(Mix, Middle, Window, 1, &MiddleSeconds)) < 0) return Ret;
+    if ((Ret = BenchRange(Mix, Middle, Window, 0, &DecodeSeconds)) < 0) return Ret;
+
+    DEBUG(stdout, ">>> start of mix:                %9.1f ms\n", StartSeconds*1e3);
+    DEBUG(stdout, ">>> middle of mix, seeking:      %9.1f ms\n", MiddleSeconds*1e3);
+    DEBUG(stdout, ">>> middle of mix, from start:   %9.1f ms\n", DecodeSeconds*1e3);
+
+    return MIXER_OK;
+}
+
+// Cold render with the block cache, then change the gain of one clip twice
+// and render again after each change.
+static int32 BenchRerenderRun(BenchMix *Mix)
+{
+    MixerContext *Mixer = NULL;
+    int32 Ret = BenchOpen(Mix, &Mixer);
+    if (Ret < 0) return Ret;
+
+    float64 ColdSeconds, FirstSeconds, SecondSeconds, UncachedSeconds;
+    float32 Gain = Mix->Clips[0].Gain;
+    Ret = MixerSetCache(Mixer, 1);
+    if (Ret >= 0) Ret = BenchRender(Mixer, &Mix->Config, &ColdSeconds);
+    if (Ret >= 0) Ret = MixerSetClipGain(Mixer, 0, Gain*0.5f);
+    if (Ret >= 0) Ret = MixerSeek(Mixer, 0);
+    if (Ret >= 0) Ret = BenchRender(Mixer, &Mix->Config, &FirstSeconds);
+    if (Ret >= 0) Ret = MixerSetClipGain(Mixer, 0, Gain*0.25f);
+    if (Ret >= 0) Ret = MixerSeek(Mixer, 0);
+    if (Ret >= 0) Ret = BenchRender(Mixer, &Mix->Config, &SecondSeconds);
+    MixerClose(&Mixer);
+    if (Ret < 0) return Ret;
+
+    // What every edit cost before: a full render of a fresh context.
+    if ((Ret = BenchRange(Mix, 0, 0, 1, &UncachedSeconds)) < 0) return Ret;
+
+    DEBUG(stdout, ">>> Rerender bench: %d clips, gain of clip 0 changed twice\n", Mix->ClipCount);
+    DEBUG(stdout, ">>> cold render, filling cache:  %9.1f ms\n", ColdSeconds*1e3);
+    DEBUG(stdout, ">>> after first edit:            %9.1f ms\n", FirstSeconds*1e3);
+    DEBUG(stdout, ">>> after second edit:           %9.1f ms\n", SecondSeconds*1e3);
+    DEBUG(stdout, ">>> uncached render:             %9.1f ms\n", UncachedSeconds*1e3);
+
+    return MIXER_OK;
+}
+
+// Stand-in for a real bus effect: a cascade of one-pole low-passes, enough
+// work per sample for the scheduling to matter.
+#define BENCH_FILTER_STAGES 8
+
+typedef struct BenchFilter
+{
+    float32 State[MIXER_MAX_CHANNELS][BENCH_FILTER_STAGES];
+} BenchFilter;
+
+static void BenchFilterProcess(void *Arg, float32 **Channels, int32 ChannelCount, int32 SampleCount)
+{
+    BenchFilter *Filter = (BenchFilter *)Arg;
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        float32 *State = Filter->State[Channel];
+        float32 *Samples = Channels[Channel];
+        for (int32 Index = 0; Index < SampleCount; Index++)
+        {
+            float32 Value = Samples[Index];
+            for (int32 Stage = 0; Stage < BENCH_FILTER_STAGES; Stage++)
+            {
+                State[Stage] += 0.25f*(Value - State[Stage]);
+                Value = State[Stage];
+            }
+            Samples[Index] = Value;
+        }
+    }
+}
+
+// Render a window of a graph with BusCount buses, each playing one clip
+// through a filter into the master.
+static int32 BenchGraph(const BenchMix *Mix, int32 BusCount, int32 ThreadCount, int64 Window, float64 *Seconds)
+{
+    MixerConfig Config = Mix->Config;
+    Config.ThreadCount = ThreadCount;
+    MixerContext *Mixer = NULL;
+    int32 Ret = MixerOpen(&Mixer, &Config);
+    if (Ret < 0) return Ret;
+
+    BenchFilter *Filters = av_mallocz_array(BusCount, sizeof(BenchFilter));
+    if (Filters == NULL) Ret = MIXER_ERR_NOMEM;
+    for (int32 Index = 0; Ret >= 0 && Index < BusCount; Index++)
+    {
+        int32 Bus = MixerAddBus(Mixer, MIXER_MASTER_BUS, 1.0f/BusCount);
+        int32 Clip = Bus < 0 ? Bus : MixerAddClip(Mixer, &Mix->Clips[Index % Mix->ClipCount]);
+        Ret = Clip < 0 ? Clip : MixerSetClipBus(Mixer, Clip, Bus);
+        if (Ret >= 0) Ret = MixerAddEffect(Mixer, Bus, BenchFilterProcess, &Filters[Index]);
+    }
+    if (Ret >= 0) Ret = MixerSetRange(Mixer, 0, Window);
+    if (Ret >= 0) Ret = BenchRender(Mixer, &Config, Seconds);
+
+    MixerClose(&Mixer);
+    av_free(Filters);
+    return Ret;
+}
+
+static int32 BenchGraphRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    static const int32 BusCounts[] = {8, 32, 128};
+    int32 ThreadCount = Mix->Config.ThreadCount > 1 ? Mix->Config.ThreadCount : av_cpu_count();
+    int64 Window = (int64)(WindowSeconds*Mix->Config.SampleRate);
+
+    DEBUG(stdout, ">>> Graph bench: %.1f s window, one clip and one filter per bus, 1 vs %d threads\n", WindowSeconds, ThreadCount);
+    for (int32 Index = 0; Index < (int32)(sizeof(BusCounts)/sizeof(BusCounts[0])); Index++)
+    {
+        float64 SerialSeconds, ParallelSeconds;
+        int32 Ret = BenchGraph(Mix, BusCounts[Index], 1, Window, &SerialSeconds);
+        if (Ret >= 0) Ret = BenchGraph(Mix, BusCounts[Index], ThreadCount, Window, &ParallelSeconds);
+        if (Ret < 0) return Ret;
+        DEBUG(stdout, ">>> %4d buses: %9.1f ms serial, %9.1f ms parallel, %.2fx\n",
+              BusCounts[Index], SerialSeconds*1e3, ParallelSeconds*1e3,
+              ParallelSeconds > 0 ? SerialSeconds/ParallelSeconds : 0.0);
+    }
+
+    return MIXER_OK;
+}
+
+// Render a window of TrackCount clips all playing at once, each with its own
+// pan and a gain that moves every block, with the kernels Flags allows.
+static int32 BenchTracks(const BenchMix *Mix, int32 TrackCount, int32 Flags, int64 Window, float64 *Seconds)
+{
+    av_force_cpu_flags(Flags);
+    MixerContext *Mixer = NULL;
+    int32 Ret = MixerOpen(&Mixer, &Mix->Config);
+    av_force_cpu_flags(-1);
+    if (Ret < 0) return Ret;
+
+    for (int32 Index = 0; Ret >= 0 && Index < TrackCount; Index++)
+    {
+        MixerClipInfo Clip = Mix->Clips[Index % Mix->ClipCount];
+        Clip.StartSample = 0;
+        Ret = MixerAddClip(Mixer, &Clip);
+        if (Ret >= 0) Ret = MixerSetClipPan(Mixer, Index, (Index % 9 - 4)/4.0f);
+    }
+    if (Ret >= 0) Ret = MixerSetRange(Mixer, 0, Window);
+
+    float32 *Block = av_malloc(Mix->Config.BlockSize*Mix->Config.ChannelCount*sizeof(float32));
+    if (Block == NULL && Ret >= 0) Ret = MIXER_ERR_NOMEM;
+    int64 StartTime = av_gettime_relative();
+    for (int32 BlockIndex = 0; Ret == MIXER_OK; BlockIndex++)
+    {
+        for (int32 Index = 0; Index < TrackCount; Index++)
+        {
+            MixerSetClipGain(Mixer, Index, (1 + ((BlockIndex + Index) & 7))/(8.0f*TrackCount));
+        }
+        int32 SampleCount = 0;
+        Ret = MixerRenderBlock(Mixer, Block, &SampleCount);
+    }
+    *Seconds = (av_gettime_relative() - StartTime)/1e6;
+
+    av_free(Block);
+    MixerClose(&Mixer);
+    return Ret < 0 ? Ret : MIXER_OK;
+}
+
+static int32 BenchTracksRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    static const int32 TrackCounts[] = {64, 256, 1024};
+    int64 Window = (int64)(WindowSeconds*Mix->Config.SampleRate);
+
+    // Decode the window once up front so that both runs find the files in the page cache.
+    float64 Seconds;
+    int32 Ret = BenchTracks(Mix, Mix->ClipCount, -1, Window, &Seconds);
+    if (Ret < 0) return Ret;
+
+    DEBUG(stdout, ">>> Tracks bench: %.1f s window, gain ramp every block, track-seconds mixed per second\n", WindowSeconds);
+    for (int32 Index = 0; Index < (int32)(sizeof(TrackCounts)/sizeof(TrackCounts[0])); Index++)
+    {
+        int32 TrackCount = TrackCounts[Index];
+        float64 PlainSeconds, BestSeconds;
+        Ret = BenchTracks(Mix, TrackCount, 0, Window, &PlainSeconds);
+        if (Ret >= 0) Ret = BenchTracks(Mix, TrackCount, -1, Window, &BestSeconds);
+        if (Ret < 0) return Ret;
+        DEBUG(stdout, ">>> %5d tracks: c %10.0f, %s %10.0f, %.2fx\n", TrackCount,
+              TrackCount*WindowSeconds/PlainSeconds, KernelSelect()->Name, TrackCount*WindowSeconds/BestSeconds,
+              PlainSeconds/BestSeconds);
+    }
+
+    return MIXER_OK;
+}
+
+// Mix TrackCount clips for Window samples, each with a breakpoint every 10 ms
+// alternating linear and exponential segments plus equal power fades when
+// Automate is set.
+static int32 BenchAutomation(const BenchMix *Mix, int32 TrackCount, int32 Flags, int32 Automate, int64 Window,
+                             float64 *Seconds)
+{
+    av_force_cpu_flags(Flags);
+    MixerContext *Mixer = NULL;
+    int32 Ret = MixerOpen(&Mixer, &Mix->Config);
+    av_force_cpu_flags(-1);
+    if (Ret < 0) return Ret;
+
+    int32 Spacing = Mix->Config.SampleRate/100;
+    int32 PointCount = (int32)(Window/Spacing) + 1;
+    MixerEnvelopePoint *Points = av_malloc_array(PointCount, sizeof(MixerEnvelopePoint));
+    if (Points == NULL) Ret = MIXER_ERR_NOMEM;
+    for (int32 Index = 0; Ret >= 0 && Index < TrackCount; Index++)
+    {
+        MixerClipInfo Clip = Mix->Clips[Index % Mix->ClipCount];
+        Clip.StartSample = 0;
+        Clip.Gain = 1.0f/TrackCount;
+        Ret = MixerAddClip(Mixer, &Clip);
+        if (Ret < 0 || !Automate) continue;
+
+        for (int32 Point = 0; Point < PointCount; Point++)
+        {
+            Points[Point].Sample = (int64)Point*Spacing;
+            Points[Point].Gain = 0.25f + ((Point + Index) & 3)*0.25f;
+            Points[Point].Curve = Point & 1 ? MIXER_CURVE_EXPONENTIAL : MIXER_CURVE_LINEAR;
+        }
+        Ret = MixerSetClipEnvelope(Mixer, Index, Points, PointCount);
+        if (Ret >= 0) Ret = MixerSetClipFades(Mixer, Index, Window/4, Window/4, MIXER_CURVE_EQUAL_POWER);
+    }
+    av_free(Points);
+    if (Ret >= 0) Ret = MixerSetRange(Mixer, 0, Window);
+
+    float32 *Block = av_malloc(Mix->Config.BlockSize*Mix->Config.ChannelCount*sizeof(float32));
+    if (Block == NULL && Ret >= 0) Ret = MIXER_ERR_NOMEM;
+    int64 StartTime = av_gettime_relative();
+    while (Ret == MIXER_OK)
+    {
+        int32 SampleCount = 0;
+        Ret = MixerRenderBlock(Mixer, Block, &SampleCount);
+    }
+    *Seconds = (av_gettime_relative() - StartTime)/1e6;
+
+    av_free(Block);
+    MixerClose(&Mixer);
+    return Ret < 0 ? Ret : MIXER_OK;
+}
+
+static int32 BenchAutomationRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    static const int32 TrackCounts[] = {64, 256};
+    int64 Window = (int64)(WindowSeconds*Mix->Config.SampleRate);
+
+    // Decode the window once up front so that every run finds the files in the page cache.
+    float64 Seconds;
+    int32 Ret = BenchAutomation(Mix, Mix->ClipCount, -1, 0, Window, &Seconds);
+    if (Ret < 0) return Ret;
+
+    DEBUG(stdout, ">>> Automation bench: %.1f s window, breakpoint every 10 ms and fades on every track\n", WindowSeconds);
+    for (int32 Index = 0; Index < (int32)(sizeof(TrackCounts)/sizeof(TrackCounts[0])); Index++)
+    {
+        int32 TrackCount = TrackCounts[Index];
+        float64 TrackSamples = (float64)TrackCount*Window;
+        for (int32 Best = 0; Best < 2; Best++)
+        {
+            int32 Flags = Best ? -1 : 0;
+            float64 PlainSeconds, AutomatedSeconds;
+            Ret = BenchAutomation(Mix, TrackCount, Flags, 0, Window, &PlainSeconds);
+            if (Ret >= 0) Ret = BenchAutomation(Mix, TrackCount, Flags, 1, Window, &AutomatedSeconds);
+            if (Ret < 0) return Ret;
+            DEBUG(stdout, ">>> %5d tracks %-5s: static %.2f ns/sample, automated %.2f ns/sample, +%.2f ns/sample\n",
+                  TrackCount, Best ? KernelSelect()->Name : "c", PlainSeconds*1e9/TrackSamples,
+                  AutomatedSeconds*1e9/TrackSamples, (AutomatedSeconds - PlainSeconds)*1e9/TrackSamples);
+        }
+    }
+
+    return MIXER_OK;
+}
+
+static int32 BenchResampleRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    static const int32 Qualities[] = {MIXER_RESAMPLE_SWR, MIXER_RESAMPLE_FAST, MIXER_RESAMPLE_NORMAL, MIXER_RESAMPLE_HIGH};
+    static const char *Names[] = {"swr", "fast", "normal", "high"};
+    int64 Window = (int64)(WindowSeconds*Mix->Config.SampleRate);
+    BenchMix Run = *Mix;
+
+    DEBUG(stdout, ">>> Resample bench: %d clips to %d Hz, %.1f s window\n", Mix->ClipCount, Mix->Config.SampleRate, WindowSeconds);
+    for (int32 Index = 0; Index < (int32)(sizeof(Qualities)/sizeof(Qualities[0])); Index++)
+    {
+        Run.Config.ResampleQuality = Qualities[Index];
+        MixerContext *Mixer = NULL;
+        int64 StartTime = av_gettime_relative();
+        int32 Ret = BenchOpen(&Run, &Mixer);
+        if (Ret < 0) return Ret;
+        float64 OpenSeconds = (av_gettime_relative() - StartTime)/1e6;
+
+        float64 Seconds = 0;
+        Ret = MixerSetRange(Mixer, 0, Window);
+        if (Ret >= 0) Ret = BenchRender(Mixer, &Run.Config, &Seconds);
+        MixerClose(&Mixer);
+        if (Ret < 0) return Ret;
+        DEBUG(stdout, ">>> %-6s: open %8.2f ms, render %.3f s, %.1fx realtime\n", Names[Index], OpenSeconds*1e3,
+              Seconds, WindowSeconds/Seconds);
+    }
+
+    return MIXER_OK;
+}
+
+// Mix TrackCount clips for Window samples through strips with the first
+// Parts of high pass, shelves and compressor, as a dialog chain would.
+static int32 BenchStrip(const BenchMix *Mix, int32 TrackCount, int32 Flags, int32 Parts, int64 Window, float64 *Seconds)
+{
+    av_force_cpu_flags(Flags);
+    MixerContext *Mixer = NULL;
+    int32 Ret = MixerOpen(&Mixer, &Mix->Config);
+    av_force_cpu_flags(-1);
+    if (Ret < 0) return Ret;
+
+    MixerStripInfo Strip = {0};
+    Strip.Ratio = 1.0f;
+    if (Parts > 0) Strip.HighPassHz = 80.0f;
+    if (Parts > 1)
+    {
+        Strip.LowShelfHz = 250.0f;
+        Strip.LowShelfDb = -3.0f;
+        Strip.HighShelfHz = 5000.0f;
+        Strip.HighShelfDb = 2.0f;
+    }
+    if (Parts > 2)
+    {
+        Strip.ThresholdDb = -24.0f;
+        Strip.Ratio = 3.0f;
+        Strip.AttackMs = 5.0f;
+        Strip.ReleaseMs = 120.0f;
+        Strip.MakeupDb = 6.0f;
+    }
+    for (int32 Index = 0; Ret >= 0 && Index < TrackCount; Index++)
+    {
+        MixerClipInfo Clip = Mix->Clips[Index % Mix->ClipCount];
+        Clip.StartSample = 0;
+        Clip.Gain = 1.0f/TrackCount;
+        Ret = MixerAddClip(Mixer, &Clip);
+        if (Ret >= 0 && Parts > 0) Ret = MixerSetClipStrip(Mixer, Index, &Strip);
+    }
+    if (Ret >= 0) Ret = MixerSetRange(Mixer, 0, Window);
+    if (Ret >= 0) Ret = BenchRender(Mixer, &Mix->Config, Seconds);
+
+    MixerClose(&Mixer);
+    return Ret;
+}
+
+static int32 BenchStripRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    static const int32 TrackCounts[] = {64, 256};
+    static const char *Names[] = {"high pass", "shelves", "compressor"};
+    int64 Window = (int64)(WindowSeconds*Mix->Config.SampleRate);
+
+    // Decode the window once up front so that every run finds the files in the page cache.
+    float64 Seconds;
+    int32 Ret = BenchStrip(Mix, Mix->ClipCount, -1, 0, Window, &Seconds);
+    if (Ret < 0) return Ret;
+
+    DEBUG(stdout, ">>> Strip bench: %.1f s window, %d channels, ns per track-sample added by each part of the strip\n",
+          WindowSeconds, Mix->Config.ChannelCount);
+    for (int32 Index = 0; Index < (int32)(sizeof(TrackCounts)/sizeof(TrackCounts[0])); Index++)
+    {
+        int32 TrackCount = TrackCounts[Index];
+        float64 TrackSamples = (float64)TrackCount*Window;
+        for (int32 Best = 0; Best < 2; Best++)
+        {
+            int32 Flags = Best ? -1 : 0;
+            float64 Previous;
+            Ret = BenchStrip(Mix, TrackCount, Flags, 0, Window, &Previous);
+            if (Ret < 0) return Ret;
+            DEBUG(stdout, ">>> %5d tracks %-5s: plain %.2f ns/sample", TrackCount, Best ? KernelSelect()->Name : "c",
+                  Previous*1e9/TrackSamples);
+            for (int32 Parts = 1; Parts <= 3; Parts++)
+            {
+                Ret = BenchStrip(Mix, TrackCount, Flags, Parts, Window, &Seconds);
+                if (Ret < 0) return Ret;
+                DEBUG(stdout, ", %s %+.2f", Names[Parts - 1], (Seconds - Previous)*1e9/TrackSamples);
+                Previous = Seconds;
+            }
+            DEBUG(stdout, "\n");
+        }
+    }
+
+    return MIXER_OK;
+}
+
+// Render a window of the mix with a limiter on the master, or without one
+// when Flags is negative.
+static int32 BenchLimiter(const BenchMix *Mix, int32 Flags, int64 Window, float64 *Seconds)
+{
+    MixerContext *Mixer = NULL;
+    Limiter *Lim = NULL;
+    int32 Ret = BenchOpen(Mix, &Mixer);
+    if (Ret < 0) return Ret;
+
+    if (Flags >= 0)
+    {
+        Ret = LimiterOpen(&Lim, Mix->Config.SampleRate, Mix->Config.ChannelCount, -1.0f, 5.0f, 50.0f, Flags);
+        if (Ret >= 0) Ret = MixerAddTimedEffect(Mixer, MIXER_MASTER_BUS, LimiterProcess, Lim, LimiterLatency(Lim), 0);
+    }
+    if (Ret >= 0) Ret = MixerSetRange(Mixer, 0, Window);
+    if (Ret >= 0) Ret = BenchRender(Mixer, &Mix->Config, Seconds);
+
+    MixerClose(&Mixer);
+    LimiterClose(&Lim);
+    return Ret;
+}
+
+static int32 BenchLimiterRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    static const int32 Flags[] = {-1, 0, LIMITER_TRUE_PEAK};
+    static const char *Names[] = {"none", "sample peak", "true peak"};
+    int64 Window = (int64)(WindowSeconds*Mix->Config.SampleRate);
+
+    DEBUG(stdout, ">>> Limiter bench: %d clips, %.1f s window, -1 dB ceiling, 5 ms lookahead\n", Mix->ClipCount, WindowSeconds);
+    float64 Plain = 0;
+    for (int32 Index = 0; Index < (int32)(sizeof(Flags)/sizeof(Flags[0])); Index++)
+    {
+        float64 Seconds = 0;
+        int32 Ret = BenchLimiter(Mix, Flags[Index], Window, &Seconds);
+        if (Ret < 0) return Ret;
+        if (Index == 0) Plain = Seconds;
+        DEBUG(stdout, ">>> %-11s: %.3f s, %.1fx realtime, %+.2f ns per sample\n", Names[Index], Seconds,
+              WindowSeconds/Seconds, (Seconds - Plain)*1e9/Window);
+    }
+
+    return MIXER_OK;
+}
+
+// Render a window of the mix reading uncompressed inputs natively and through
+// libavformat, twice each so that the page cache is warm for both unless the
+// files are larger than memory.
+static int32 BenchReadRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    static const char *Names[] = {"ffmpeg", "native"};
+    int64 Window = (int64)(WindowSeconds*Mix->Config.SampleRate);
+    BenchMix Run = *Mix;
+
+    DEBUG(stdout, ">>> Read bench: %d clips, %.1f s window\n", Mix->ClipCount, WindowSeconds);
+    float64 Best[2] = {0, 0};
+    for (int32 Pass = 0; Pass < 4; Pass++)
+    {
+        Run.Config.NativeInput = Pass & 1;
+        MixerContext *Mixer = NULL;
+        int32 Ret = BenchOpen(&Run, &Mixer);
+        if (Ret < 0) return Ret;
+
+        float64 Seconds = 0;
+        Ret = MixerSetRange(Mixer, 0, Window);
+        if (Ret >= 0) Ret = BenchRender(Mixer, &Run.Config, &Seconds);
+        MixerClose(&Mixer);
+        if (Ret < 0) return Ret;
+        if (Best[Pass & 1] == 0 || Seconds < Best[Pass & 1]) Best[Pass & 1] = Seconds;
+        DEBUG(stdout, ">>> %-6s: %.3f s, %.1fx realtime, %.1f M input samples/s\n", Names[Pass & 1], Seconds,
+              WindowSeconds/Seconds, Mix->ClipCount*(float64)Window*Mix->Config.ChannelCount/Seconds/1e6);
+    }
+    DEBUG(stdout, ">>> native reader %.2fx faster\n", Best[0]/Best[1]);
+
+    return MIXER_OK;
+}
+
+// Drop FileName from the page cache so that the next run reads it from the
+// disk. Only clean pages go, which is all an input has.
+static void BenchEvict(const char *FileName)
+{
+#ifndef _WIN32
+    int File = open(FileName, O_RDONLY);
+    if (File < 0) return;
+    posix_fadvise(File, 0, 0, POSIX_FADV_DONTNEED);
+    close(File);
+#else
+    (void)FileName;
+#endif
+}
+
+// Open and render a window of the mix with every input read cold, once with
+// blocking reads and once through io_uring with Depth reads in flight per
+// input. Every input goes through libavformat, uncompressed ones included.
+static int32 BenchIoRun(BenchMix *Mix, float64 WindowSeconds, int32 Depth)
+{
+    static const char *Names[] = {"read", "io_uring"};
+    int64 Window = (int64)(WindowSeconds*Mix->Config.SampleRate);
+    BenchMix Run = *Mix;
+    Run.Config.NativeInput = 0;
+
+    DEBUG(stdout, ">>> I/O bench: %d clips, %.1f s window, cold cache, depth %d\n", Mix->ClipCount, WindowSeconds, Depth);
+    for (int32 Mode = 0; Mode < 2; Mode++)
+    {
+        Run.Config.IoDepth = Mode ? Depth : 0;
+        for (int32 Index = 0; Index < Mix->ClipCount; Index++)
+        {
+            BenchEvict(Mix->Clips[Index].FileName);
+        }
+
+        MixerContext *Mixer = NULL;
+        int64 StartTime = av_gettime_relative();
+        int32 Ret = BenchOpen(&Run, &Mixer);
+        if (Ret < 0) return Ret;
+        float64 OpenSeconds = (av_gettime_relative() - StartTime)/1e6;
+
+        float64 Seconds = 0;
+        Ret = MixerSetRange(Mixer, 0, Window);
+        if (Ret >= 0) Ret = BenchRender(Mixer, &Run.Config, &Seconds);
+        MixerClose(&Mixer);
+        if (Ret < 0) return Ret;
+        DEBUG(stdout, ">>> %-8s: open %8.2f ms, render %.3f s, %.1fx realtime\n", Names[Mode], OpenSeconds*1e3,
+              Seconds, WindowSeconds/Seconds);
+    }
+
+    return MIXER_OK;
+}
+
+// Open and close the mix four times with no idle decoders kept and four
+// times with one per clip, every input through libavformat. The first pooled
+// round opens the decoders the later ones reuse.
+static int32 BenchOpenRun(BenchMix *Mix)
+{
+    BenchMix Run = *Mix;
+    Run.Config.NativeInput = 0;
+    DecoderStats Before;
+    DecoderPoolGetStats(&Before);
+
+    DEBUG(stdout, ">>> Open bench: %d clips\n", Mix->ClipCount);
+    for (int32 Pooled = 0; Pooled < 2; Pooled++)
+    {
+        DecoderPoolResize(Pooled ? Mix->ClipCount : 0);
+        for (int32 Round = 0; Round < 4; Round++)
+        {
+            MixerContext *Mixer = NULL;
+            DecoderStats Stats;
+            int64 StartTime = av_gettime_relative();
+            int32 Ret = BenchOpen(&Run, &Mixer);
+            float64 Seconds = (av_gettime_relative() - StartTime)/1e6;
+            if (Ret < 0) return Ret;
+            MixerClose(&Mixer);
+
+            DecoderPoolGetStats(&Stats);
+            DEBUG(stdout, ">>> %-8s %d: %.3f ms per clip, %d decoders opened, %d reused\n", Pooled ? "pool" : "no pool",
+                  Round, Seconds*1e3/Mix->ClipCount, Stats.OpenCount - Before.OpenCount,
+                  Stats.ReuseCount - Before.ReuseCount);
+            Before = Stats;
+        }
+    }
+
+    return MIXER_OK;
+}
+
+// Render the whole mix without and with peak building, which removes the
+// sidecars first so every input builds them, then draw 1000 pixels of each
+// input's overview zoomed out fully, to 10 s and to 0.1 s.
+static int32 BenchPeaksRun(BenchMix *Mix)
+{
+    static const float64 Zooms[] = {0, 10, 0.1};
+    BenchMix Run = *Mix;
+
+    DEBUG(stdout, ">>> Peaks bench: %d clips, whole mix\n", Mix->ClipCount);
+    float64 Plain = 0;
+    for (int32 Pass = 0; Pass < 2; Pass++)
+    {
+        for (int32 Index = 0; Pass && Index < Mix->ClipCount; Index++)
+        {
+            char *PeakName = av_asprintf("%s%s", Mix->Clips[Index].FileName, PEAK_SUFFIX);
+            if (PeakName == NULL) return MIXER_ERR_NOMEM;
+            remove(PeakName);
+            av_free(PeakName);
+        }
+        Run.Config.Peaks = Pass;
+        MixerContext *Mixer = NULL;
+        int32 Ret = BenchOpen(&Run, &Mixer);
+        if (Ret < 0) return Ret;
+
+        float64 Seconds = 0;
+        Ret = BenchRender(Mixer, &Run.Config, &Seconds);
+        MixerClose(&Mixer);
+        if (Ret < 0) return Ret;
+        if (Pass == 0) Plain = Seconds;
+        DEBUG(stdout, ">>> %-8s: %.3f s, %+.1f%%\n", Pass ? "peaks" : "no peaks", Seconds, (Seconds/Plain - 1)*100);
+    }
+
+    PeakBucket Pixels[1000];
+    for (int32 Index = 0; Index < Mix->ClipCount; Index++)
+    {
+        char *PeakName = av_asprintf("%s%s", Mix->Clips[Index].FileName, PEAK_SUFFIX);
+        if (PeakName == NULL) return MIXER_ERR_NOMEM;
+        PeakFile *File = NULL;
+        int32 Ret = PeakFileLoad(&File, PeakName);
+        av_free(PeakName);
+        if (Ret < 0) continue;
+
+        DEBUG(stdout, ">>> %s: %.1f s,", Mix->Clips[Index].FileName, (float64)File->SampleCount/File->SampleRate);
+        for (int32 Zoom = 0; Zoom < (int32)(sizeof(Zooms)/sizeof(Zooms[0])); Zoom++)
+        {
+            int64 Length = Zooms[Zoom] > 0 ? (int64)(Zooms[Zoom]*File->SampleRate) : File->SampleCount;
+            int64 Start = (File->SampleCount - Length)/2;
+            int64 StartTime = av_gettime_relative();
+            for (int32 Channel = 0; Channel < File->ChannelCount; Channel++)
+            {
+                PeakQuery(File, Channel, Start, Start + Length, 1000, Pixels);
+            }
+            DEBUG(stdout, " %s %.1f us", Zooms[Zoom] > 0 ? (Zooms[Zoom] >= 1 ? "10 s" : "0.1 s") : "all",
+                  (av_gettime_relative() - StartTime)/1.0);
+        }
+        DEBUG(stdout, "\n");
+        PeakFileFree(&File);
+    }
+
+    return MIXER_OK;
+}
+
+// Render a window of the mix through a reverb of Impulse on the master, or
+// without one when Impulse is NULL.
+static int32 BenchReverb(const BenchMix *Mix, const ReverbImpulse *Impulse, int64 Window, float64 *Seconds)
+{
+    MixerContext *Mixer = NULL;
+    Reverb *Rev = NULL;
+    int32 Ret = BenchOpen(Mix, &Mixer);
+    if (Ret < 0) return Ret;
+
+    if (Impulse != NULL)
+    {
+        Ret = ReverbOpen(&Rev, Impulse, Mix->Config.BlockSize, 1.0f, 0.3f);
+        if (Ret >= 0) Ret = MixerAddTimedEffect(Mixer, MIXER_MASTER_BUS, ReverbProcess, Rev, ReverbLatency(Rev), ReverbTail(Rev));
+    }
+    if (Ret >= 0) Ret = MixerSetRange(Mixer, 0, Window);
+    if (Ret >= 0) Ret = BenchRender(Mixer, &Mix->Config, Seconds);
+
+    MixerClose(&Mixer);
+    ReverbClose(&Rev);
+    return Ret;
+}
+
+// Exponentially decaying noise stands in for a measured response.
+static int32 BenchReverbRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    static const int32 Lengths[] = {1, 4, 10};
+    static const int32 MaxPartitions[] = {REVERB_PARTITION, REVERB_MAX_PARTITION};
+    static const char *Names[] = {"uniform", "non-uniform"};
+    int32 SampleRate = Mix->Config.SampleRate;
+    int32 ChannelCount = Mix->Config.ChannelCount;
+    int64 Window = (int64)(WindowSeconds*SampleRate);
+
+    DEBUG(stdout, ">>> Reverb bench: %d clips, %.1f s window, %d channels, %s kernels, ms per second of audio\n",
+          Mix->ClipCount, WindowSeconds, ChannelCount, KernelSelect()->Name);
+    float64 Plain = 0;
+    int32 Ret = BenchReverb(Mix, NULL, Window, &Plain);
+    float32 *Samples[MIXER_MAX_CHANNELS] = {NULL};
+    for (int32 Index = 0; Ret >= 0 && Index < (int32)(sizeof(Lengths)/sizeof(Lengths[0])); Index++)
+    {
+        int64 Length = (int64)Lengths[Index]*SampleRate;
+        uint32_t Seed = 1;
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            Samples[Channel] = av_malloc(Length*sizeof(float32));
+            if (Samples[Channel] == NULL)
+            {
+                Ret = MIXER_ERR_NOMEM;
+                break;
+            }
+            for (int64 Sample = 0; Sample < Length; Sample++)
+            {
+                Seed = Seed*1664525 + 1013904223;
+                Samples[Channel][Sample] = ((int32)Seed/2147483648.0f)*expf(-6.9f*Sample/Length)*0.05f;
+            }
+        }
+        for (int32 Scheme = 0; Ret >= 0 && Scheme < 2; Scheme++)
+        {
+            ReverbImpulse *Impulse = NULL;
+            int64 StartTime = av_gettime_relative();
+            Ret = ReverbImpulseCreate(&Impulse, Samples, ChannelCount, Length, SampleRate, MaxPartitions[Scheme]);
+            float64 Design = (av_gettime_relative() - StartTime)/1e6;
+            float64 Seconds = 0;
+            if (Ret >= 0) Ret = BenchReverb(Mix, Impulse, Window, &Seconds);
+            if (Ret >= 0)
+            {
+                DEBUG(stdout, ">>> %2d s IR %-11s: %7.2f ms/s, %.1fx realtime, spectra in %.1f ms\n", Lengths[Index],
+                      Names[Scheme], (Seconds - Plain)*1e3/WindowSeconds, WindowSeconds/Seconds, Design*1e3);
+            }
+            ReverbImpulseFree(Impulse);
+        }
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            av_freep(&Samples[Channel]);
+        }
+    }
+
+    return Ret;
+}
+
+// Render a window of the mix, metering the master when Meter is set.
+static int32 BenchLoudness(const BenchMix *Mix, LoudnessMeter *Meter, int64 Window, float64 *Seconds)
+{
+    MixerContext *Mixer = NULL;
+    int32 Ret = BenchOpen(Mix, &Mixer);
+    if (Ret < 0) return Ret;
+
+    if (Meter != NULL) Ret = MixerAddEffect(Mixer, MIXER_MASTER_BUS, LoudnessProcess, Meter);
+    if (Ret >= 0) Ret = MixerSetRange(Mixer, 0, Window);
+    if (Ret >= 0) Ret = BenchRender(Mixer, &Mix->Config, Seconds);
+
+    MixerClose(&Mixer);
+    return Ret;
+}
+
+static int32 BenchLoudnessRun(BenchMix *Mix, float64 WindowSeconds)
+{
+    int64 Window = (int64)(WindowSeconds*Mix->Config.SampleRate);
+    LoudnessMeter Meter;
+    int32 Ret = LoudnessInit(&Meter, Mix->Config.SampleRate, Mix->Config.ChannelCount);
+    if (Ret < 0) return Ret;
+
+    DEBUG(stdout, ">>> Loudness bench: %d clips, %.1f s window, %s kernels\n", Mix->ClipCount, WindowSeconds,
+          KernelSelect()->Name);
+    float64 Plain = 0, Metered = 0;
+    Ret = BenchLoudness(Mix, NULL, Window, &Plain);
+    if (Ret >= 0) Ret = BenchLoudness(Mix, &Meter, Window, &Metered);
+    if (Ret >= 0)
+    {
+        DEBUG(stdout, ">>> plain %.3f s, metered %.3f s, %+.1f%%, %.1f LUFS\n", Plain, Metered,
+              Plain > 0 ? (Metered - Plain)*100/Plain : 0.0, LoudnessIntegrated(&Meter));
+    }
+    LoudnessFree(&Meter);
+
+    // Every input analysed, then looked up again.
+    LoudnessCache Cache = {0};
+    for (int32 Pass = 0; Ret >= 0 && Pass < 2; Pass++)
+    {
+        int64 StartTime = av_gettime_relative();
+        for (int32 Index = 0; Ret >= 0 && Index < Mix->ClipCount; Index++)
+        {
+            float64 Lufs;
+            Ret = LoudnessAnalyze(&Mix->Config, Mix->Clips[Index].FileName, &Cache, &Lufs);
+        }
+        float64 Seconds = (av_gettime_relative() - StartTime)/1e6;
+        if (Ret >= 0) DEBUG(stdout, ">>> input analysis %s: %.3f ms\n", Pass ? "cached" : "cold  ", Seconds*1e3);
+    }
+    LoudnessCacheFree(&Cache);
+
+    return Ret;
+}
+
+// Pack one second of interleaved output per round until a second has passed,
+// in samples per nanosecond across all channels.
+static int32 BenchPack(const MixerConfig *Config, const float32 *In, void *Out, int32 Format, int32 Dither, int32 Flags,
+                       float64 *SamplesPerNs)
+{
+    av_force_cpu_flags(Flags);
+    PackState Packer;
+    int32 Ret = PackInit(&Packer, Format, Config->ChannelCount, Dither);
+    av_force_cpu_flags(-1);
+    if (Ret < 0) return Ret;
+
+    int64 Samples = 0;
+    int64 StartTime = av_gettime_relative();
+    int64 Elapsed = 0;
+    while (Elapsed < 1000000)
+    {
+        PackInterleaved(&Packer, Out, In, Config->SampleRate);
+        Samples += (int64)Config->SampleRate*Config->ChannelCount;
+        Elapsed = av_gettime_relative() - StartTime;
+    }
+    *SamplesPerNs = Samples/(Elapsed*1e3);
+    return MIXER_OK;
+}
+
+static int32 BenchPackRun(const MixerConfig *Config)
+{
+    static const int32 Formats[] = {PACK_S16, PACK_S24, PACK_S32};
+    static const char *FormatNames[] = {"s16", "s24", "s32"};
+    static const char *DitherNames[] = {"none", "tpdf", "shaped"};
+    int32 Count = Config->SampleRate*Config->ChannelCount;
+    float32 *In = av_malloc(Count*sizeof(float32));
+    void *Out = av_malloc(Count*sizeof(int32));
+    if (In == NULL || Out == NULL)
+    {
+        av_free(In);
+        av_free(Out);
+        return MIXER_ERR_NOMEM;
+    }
+    // A loud mix, some of it past full scale so that clipping is exercised.
+    uint32_t Seed = 1;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        Seed = Seed*1664525 + 1013904223;
+        In[Index] = (Seed >> 8)*(2.4f/16777216) - 1.2f;
+    }
+
+    DEBUG(stdout, ">>> Pack bench: %d channels, samples per ns\n", Config->ChannelCount);
+    int32 Ret = MIXER_OK;
+    for (int32 Format = 0; Ret >= 0 && Format < (int32)(sizeof(Formats)/sizeof(Formats[0])); Format++)
+    {
+        for (int32 Dither = PACK_DITHER_NONE; Ret >= 0 && Dither <= PACK_DITHER_SHAPED; Dither++)
+        {
+            float64 Plain, Best;
+            Ret = BenchPack(Config, In, Out, Formats[Format], Dither, 0, &Plain);
+            if (Ret >= 0) Ret = BenchPack(Config, In, Out, Formats[Format], Dither, -1, &Best);
+            if (Ret < 0) break;
+            DEBUG(stdout, ">>> %s dither %-6s: c %6.3f, %s %6.3f, %.2fx\n", FormatNames[Format], DitherNames[Dither],
+                  Plain, KernelSelect()->Name, Best, Best/Plain);
+        }
+    }
+
+    av_free(In);
+    av_free(Out);
+    return Ret;
+}
+
+int32 BenchRun(const char *Name, const MixerConfig *Config, int32 ArgCount, char **Args)
+{
+    BenchMix Mix = {0};
+    Mix.Config = *Config;
+    float64 WindowSeconds = 30;
+    int32 Depth = 4;
+
+    // Benches of the output stage need no input.
+    if (strcmp(Name, "pack") == 0) return BenchPackRun(Config);
+
+    int32 ArgIndex = 0;
+    for (; ArgIndex + 1 < ArgCount && Args[ArgIndex][0] == '-'; ArgIndex += 2)
+    {
+        if (strcmp(Args[ArgIndex], "-window") == 0) WindowSeconds = atof(Args[ArgIndex + 1]);
+        else if (strcmp(Args[ArgIndex], "-depth") == 0) Depth = atoi(Args[ArgIndex + 1]);
+        else return MIXER_ERR_ARG;
+    }
+    if (ArgIndex >= ArgCount || WindowSeconds <= 0) return MIXER_ERR_ARG;
+
+    Mix.ClipCount = ArgCount - ArgIndex;
+    Mix.Clips = av_malloc_array(Mix.ClipCount, sizeof(MixerClipInfo));
+    if (Mix.Clips == NULL) return MIXER_ERR_NOMEM;
+    for (int32 Index = 0; Index < Mix.ClipCount; Index++)
+    {
+        BatchParseClip(Args[ArgIndex + Index], Config->SampleRate, &Mix.Clips[Index]);
+    }
+
+    int32 Ret = MIXER_ERR_ARG;
+    if (strcmp(Name, "range") == 0) Ret = BenchRangeRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "rerender") == 0) Ret = BenchRerenderRun(&Mix);
+    else if (strcmp(Name, "graph") == 0) Ret = BenchGraphRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "tracks") == 0) Ret = BenchTracksRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "automation") == 0) Ret = BenchAutomationRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "strip") == 0) Ret = BenchStripRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "resample") == 0) Ret = BenchResampleRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "limiter") == 0) Ret = BenchLimiterRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "loudness") == 0) Ret = BenchLoudnessRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "reverb") == 0) Ret = BenchReverbRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "read") == 0) Ret = BenchReadRun(&Mix, WindowSeconds);
+    else if (strcmp(Name, "io") == 0) Ret = BenchIoRun(&Mix, WindowSeconds, Depth);
+    else if (strcmp(Name, "peaks") == 0) Ret = BenchPeaksRun(&Mix);
+    else if (strcmp(Name, "open") == 0) Ret = BenchOpenRun(&Mix);
+
+    av_free(Mix.Clips);
+    return Ret;
+}
@@ -0,0 +1,61 @@
+#ifndef MIXER_BENCH_H
+#define MIXER_BENCH_H
+
+#include "mixer.h"
+
+// Benchmarks run from the command line as
+//
+//     mixer -bench name [options] clip...
+//
+// with clips given as in single mix mode. Each one renders the mix into
+// memory and prints its timings to stdout:
+//
+//     range [-window seconds]     Render a window at the start and in the
+//                                 middle of the mix, with and without seeking.
+//     rerender                    Render with the block cache, then again
+//                                 after each of two gain changes to clip 0.
+//     graph [-window seconds]     Render 8, 32 and 128 buses feeding the
+//                                 master, on one thread and on -threads.
+//     tracks [-window seconds]    Mix 64, 256 and 1024 simultaneous clips with
+//                                 gain ramps, with C and with SIMD kernels.
+//     automation [-window seconds]
+//                                 Mix 64 and 256 clips with and without dense
+//                                 gain envelopes and fades, per track-sample.
+//     strip [-window seconds]     Mix 64 and 256 clips with C and with SIMD
+//                                 kernels, adding a high pass, two shelves and
+//                                 a compressor to every clip one at a time.
+//     resample [-window seconds]  Open and render the mix with swresample and
+//                                 with each polyphase quality. Running it
+//                                 again with -rate at the inputs' rate gives
+//                                 the cost without resampling.
+//     limiter [-window seconds]   Render the mix without a limiter on the
+//                                 master, with a sample peak and with a true
+//                                 peak limiter.
+//     loudness [-window seconds]  Render the mix with and without the loudness
+//                                 meter on the master, then analyse every
+//                                 input, once cold and once from the cache.
+//     reverb [-window seconds]    Render the mix with a convolution reverb on
+//                                 the master, for 1, 4 and 10 s responses
+//                                 partitioned uniformly and non-uniformly.
+//     read [-window seconds]      Render the mix with uncompressed inputs read
+//                                 natively and through libavformat. A single
+//                                 long WAV shows the raw input throughput.
+//     io [-window seconds] [-depth N]
+//                                 Evict the inputs from the page cache, then
+//                                 open and render the mix with blocking reads
+//                                 and with N io_uring reads in flight per
+//                                 input (default 4). Meant for many inputs,
+//                                 e.g. 200 files.
+//     peaks                       Render the whole mix with and without
+//                                 building peak sidecars, then time drawing
+//                                 1000 pixels of each input's overview at
+//                                 three zoom levels.
+//     open                        Open and close the mix repeatedly with and
+//                                 without reusing decoders, per clip. Meant
+//                                 for many short compressed clips.
+//     pack                        Convert float samples to s16, s24 and s32
+//                                 with each dither, no clips needed.
+
+int32 BenchRun(const char *Name, const MixerConfig *Config, int32 ArgCount, char **Args);
+
+#endif
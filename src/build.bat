@@ -6,8 +6,14 @@ pushd ..\build
 rem Compiler Switches
 rem /Zi -- Enable debug
 rem /FC -- Display full path of source code files passed to cl.exe in diagnostic text
+rem /c  -- Compile only, the objects are packed into mixer.lib
 
+set MIXER_SRC=..\src\mixer.c ..\src\source.c ..\src\thread.c ..\src\pool.c ..\src\batch.c ..\src\wav.c ..\src\bench.c ..\src\segment.c ..\src\kernel.c ..\src\remix.c ..\src\resample.c ..\src\pack.c ..\src\limiter.c ..\src\loudness.c ..\src\strip.c ..\src\duck.c ..\src\reverb.c ..\src\pcmfile.c ..\src\ioreader.c ..\src\writer.c ..\src\scan.c ..\src\peaks.c ..\src\decoder.c
+set MIXER_OBJ=mixer.obj source.obj thread.obj pool.obj batch.obj wav.obj bench.obj segment.obj kernel.obj remix.obj resample.obj pack.obj limiter.obj loudness.obj strip.obj duck.obj reverb.obj pcmfile.obj ioreader.obj writer.obj scan.obj peaks.obj decoder.obj
 
-cl /FC /Zi /Femixer /I ..\src\include ..\src\main.c /link /LIBPATH:..\src\lib avutil.lib swscale.lib swresample.lib avcodec.lib avformat.lib avdevice.lib avfilter.lib
+cl /FC /Zi /c /I ..\src\include %MIXER_SRC%
+lib /OUT:mixer.lib %MIXER_OBJ%
+
+cl /FC /Zi /Femixer /I ..\src\include ..\src\main.c mixer.lib /link /LIBPATH:..\src\lib avutil.lib swscale.lib swresample.lib avcodec.lib avformat.lib avdevice.lib avfilter.lib
 
 popd
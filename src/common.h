@@ -0,0 +1,13 @@
+#ifndef MIXER_COMMON_H
+#define MIXER_COMMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEBUG fprintf
+#define int32 int
+#define int64 long long
+#define float32 float
+#define float64 double
+
+#endif
@@ -0,0 +1,319 @@
+#include <string.h>
+
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+#include "decoder.h"
+#include "thread.h"
+
+// An opened decoder with the parameters it was opened for and the output
+// format it reported after opening.
+typedef struct DecoderEntry
+{
+    AVCodecContext *Context;
+    AVCodecParameters *Params;
+    int32 SampleRate;
+    int32 ChannelCount;
+    int64 ChannelLayout;
+    int32 SampleFormat;
+} DecoderEntry;
+
+typedef struct DecoderPool
+{
+    Mutex Lock;
+    int32 Ready;
+    DecoderEntry *Idle;         // Oldest first.
+    int32 IdleCount;
+    int32 Capacity;
+    DecoderEntry *Busy;         // Handed out, found again by context.
+    int32 BusyCount;
+    int32 BusyCapacity;
+    DecoderStats Stats;
+} DecoderPool;
+
+static DecoderPool Pool;
+
+static void DecoderEntryFree(DecoderEntry *Entry)
+{
+    avcodec_free_context(&Entry->Context);
+    avcodec_parameters_free(&Entry->Params);
+}
+
+// Xiph headers of Vorbis extradata, in either of the layouts libavcodec
+// reads: a lacing count of 2 with two laced sizes, or three sizes of 16 bits
+// each before their header. 0 if it is neither.
+static int32 DecoderXiphSplit(const uint8_t *Data, int32 Size, const uint8_t *Headers[3], int32 Sizes[3])
+{
+    if (Size >= 6 && Data[0] == 0 && Data[1] == 30)
+    {
+        for (int32 Index = 0; Index < 3; Index++)
+        {
+            if (Size < 2) return 0;
+            Sizes[Index] = Data[0] << 8 | Data[1];
+            Data += 2;
+            Size -= 2;
+            if (Sizes[Index] > Size) return 0;
+            Headers[Index] = Data;
+            Data += Sizes[Index];
+            Size -= Sizes[Index];
+        }
+        return 1;
+    }
+    if (Size < 3 || Data[0] != 2) return 0;
+    int32 Offset = 1;
+    int32 Total = 0;
+    for (int32 Index = 0; Index < 2; Index++)
+    {
+        Sizes[Index] = 0;
+        while (Offset < Size && Data[Offset] == 0xff) Sizes[Index] += Data[Offset++];
+        if (Offset >= Size) return 0;
+        Sizes[Index] += Data[Offset++];
+        Total += Sizes[Index];
+    }
+    if (Total > Size - Offset) return 0;
+    Sizes[2] = Size - Offset - Total;
+    Headers[0] = Data + Offset;
+    Headers[1] = Headers[0] + Sizes[0];
+    Headers[2] = Headers[1] + Sizes[1];
+    return 1;
+}
+
+static int32 DecoderSameBytes(const uint8_t *A, int32 SizeA, const uint8_t *B, int32 SizeB)
+{
+    return SizeA == SizeB && (SizeA == 0 || memcmp(A, B, SizeA) == 0);
+}
+
+// Decoders opened for A and B start out the same. The key is what
+// avcodec_parameters_to_context() hands an audio decoder, less what differs
+// from file to file without reaching it: the bit rate, which only the WMA
+// and G.726 decoders derive their setup from, the encoder's padding and
+// preroll, which decoders don't read, and the comment header of Vorbis.
+static int32 DecoderMatch(const AVCodecParameters *A, const AVCodecParameters *B)
+{
+    if (A->codec_id != B->codec_id || A->codec_tag != B->codec_tag || A->format != B->format ||
+        A->bits_per_coded_sample != B->bits_per_coded_sample || A->bits_per_raw_sample != B->bits_per_raw_sample ||
+        A->profile != B->profile || A->level != B->level || A->channel_layout != B->channel_layout ||
+        A->channels != B->channels || A->sample_rate != B->sample_rate || A->block_align != B->block_align ||
+        A->frame_size != B->frame_size)
+    {
+        return 0;
+    }
+    if ((A->codec_id == AV_CODEC_ID_WMAV1 || A->codec_id == AV_CODEC_ID_WMAV2 ||
+         A->codec_id == AV_CODEC_ID_ADPCM_G726 || A->codec_id == AV_CODEC_ID_ADPCM_G726LE) && A->bit_rate != B->bit_rate)
+    {
+        return 0;
+    }
+
+    const uint8_t *HeadersA[3], *HeadersB[3];
+    int32 SizesA[3], SizesB[3];
+    if (A->codec_id == AV_CODEC_ID_VORBIS && DecoderXiphSplit(A->extradata, A->extradata_size, HeadersA, SizesA) &&
+        DecoderXiphSplit(B->extradata, B->extradata_size, HeadersB, SizesB))
+    {
+        return DecoderSameBytes(HeadersA[0], SizesA[0], HeadersB[0], SizesB[0]) &&
+               DecoderSameBytes(HeadersA[2], SizesA[2], HeadersB[2], SizesB[2]);
+    }
+    return DecoderSameBytes(A->extradata, A->extradata_size, B->extradata, B->extradata_size);
+}
+
+void DecoderPoolInit(int32 Capacity)
+{
+    MutexInit(&Pool.Lock);
+    MutexLock(&Pool.Lock);
+    Pool.Capacity = Capacity > 0 ? Capacity : 0;
+    if (Pool.Capacity > 0) Pool.Idle = av_malloc_array(Pool.Capacity, sizeof(DecoderEntry));
+    if (Pool.Idle == NULL) Pool.Capacity = 0;
+    MutexUnlock(&Pool.Lock);
+    Pool.Ready = 1;
+}
+
+void DecoderPoolResize(int32 Capacity)
+{
+    if (!Pool.Ready) return;
+    if (Capacity < 0) Capacity = 0;
+    MutexLock(&Pool.Lock);
+    int32 Drop = Pool.IdleCount > Capacity ? Pool.IdleCount - Capacity : 0;
+    for (int32 Index = 0; Index < Drop; Index++)
+    {
+        DecoderEntryFree(&Pool.Idle[Index]);
+    }
+    Pool.IdleCount -= Drop;
+    memmove(Pool.Idle, Pool.Idle + Drop, Pool.IdleCount*sizeof(DecoderEntry));
+    DecoderEntry *Idle = Capacity > 0 ? av_realloc_array(Pool.Idle, Capacity, sizeof(DecoderEntry)) : Pool.Idle;
+    if (Idle != NULL)
+    {
+        Pool.Idle = Idle;
+        Pool.Capacity = Capacity;
+    }
+    else
+    {
+        Pool.Capacity = Pool.IdleCount;
+    }
+    MutexUnlock(&Pool.Lock);
+}
+
+void DecoderPoolFree(void)
+{
+    if (!Pool.Ready) return;
+    for (int32 Index = 0; Index < Pool.IdleCount; Index++)
+    {
+        DecoderEntryFree(&Pool.Idle[Index]);
+    }
+    for (int32 Index = 0; Index < Pool.BusyCount; Index++)
+    {
+        avcodec_parameters_free(&Pool.Busy[Index].Params);
+    }
+    av_freep(&Pool.Idle);
+    av_freep(&Pool.Busy);
+    MutexDestroy(&Pool.Lock);
+    memset(&Pool, 0, sizeof(Pool));
+}
+
+void DecoderPoolGetStats(DecoderStats *Stats)
+{
+    memset(Stats, 0, sizeof(DecoderStats));
+    if (!Pool.Ready) return;
+    MutexLock(&Pool.Lock);
+    *Stats = Pool.Stats;
+    MutexUnlock(&Pool.Lock);
+}
+
+static int32 DecoderOpenNew(AVCodecContext **Result, AVCodec *Codec, const AVCodecParameters *Params)
+{
+    // Allocate codec context for the decoder.
+    if ((*Result = avcodec_alloc_context3(Codec)) == NULL)
+    {
+        DEBUG(stderr, "ERROR when avcodec_alloc_context3()\n");
+        return MIXER_ERR_NOMEM;
+    }
+    // Init codec context using input stream.
+    if (avcodec_parameters_to_context(*Result, Params) < 0)
+    {
+        DEBUG(stderr, "ERROR when avcodec_parameters_to_context()\n");
+        avcodec_free_context(Result);
+        return MIXER_ERR_CODEC;
+    }
+    // Open codec.
+    if (avcodec_open2(*Result, Codec, NULL) < 0)
+    {
+        DEBUG(stderr, "ERROR when open decoder\n");
+        avcodec_free_context(Result);
+        return MIXER_ERR_CODEC;
+    }
+    return MIXER_OK;
+}
+
+int32 DecoderOpen(AVCodecContext **Result, AVCodec *Codec, const AVCodecParameters *Params)
+{
+    *Result = NULL;
+    if (!Pool.Ready) return DecoderOpenNew(Result, Codec, Params);
+
+    int64 StartTime = av_gettime_relative();
+    DecoderEntry Entry = {0};
+    MutexLock(&Pool.Lock);
+    // DecoderPoolResize() may change the capacity from another thread.
+    int32 Capacity = Pool.Capacity;
+    for (int32 Index = Pool.IdleCount - 1; Index >= 0; Index--)
+    {
+        if (Pool.Idle[Index].Context->codec != Codec || !DecoderMatch(Pool.Idle[Index].Params, Params)) continue;
+        Entry = Pool.Idle[Index];
+        memmove(Pool.Idle + Index, Pool.Idle + Index + 1, (Pool.IdleCount - Index - 1)*sizeof(DecoderEntry));
+        Pool.IdleCount--;
+        break;
+    }
+    MutexUnlock(&Pool.Lock);
+
+    int32 Reused = Entry.Context != NULL;
+    if (!Reused)
+    {
+        int32 Ret = DecoderOpenNew(&Entry.Context, Codec, Params);
+        if (Ret < 0) return Ret;
+        // Only worth tracking when it can go back into the pool.
+        if (Capacity > 0 && (Entry.Params = avcodec_parameters_alloc()) != NULL &&
+            avcodec_parameters_copy(Entry.Params, Params) < 0)
+        {
+            avcodec_parameters_free(&Entry.Params);
+        }
+        Entry.SampleRate = Entry.Context->sample_rate;
+        Entry.ChannelCount = Entry.Context->channels;
+        Entry.ChannelLayout = Entry.Context->channel_layout;
+        Entry.SampleFormat = Entry.Context->sample_fmt;
+    }
+
+    float64 Seconds = (av_gettime_relative() - StartTime)/1e6;
+    MutexLock(&Pool.Lock);
+    if (Reused)
+    {
+        Pool.Stats.ReuseCount++;
+        Pool.Stats.ReuseSeconds += Seconds;
+    }
+    else
+    {
+        Pool.Stats.OpenCount++;
+        Pool.Stats.OpenSeconds += Seconds;
+    }
+    if (Entry.Params != NULL && Pool.BusyCount == Pool.BusyCapacity)
+    {
+        int32 Grown = Pool.BusyCapacity ? 2*Pool.BusyCapacity : 64;
+        DecoderEntry *Busy = av_realloc_array(Pool.Busy, Grown, sizeof(DecoderEntry));
+        if (Busy != NULL)
+        {
+            Pool.Busy = Busy;
+            Pool.BusyCapacity = Grown;
+        }
+    }
+    // Untracked decoders are simply closed by DecoderClose().
+    if (Entry.Params != NULL && Pool.BusyCount < Pool.BusyCapacity) Pool.Busy[Pool.BusyCount++] = Entry;
+    else avcodec_parameters_free(&Entry.Params);
+    MutexUnlock(&Pool.Lock);
+
+    *Result = Entry.Context;
+    return MIXER_OK;
+}
+
+void DecoderClose(AVCodecContext **Result)
+{
+    AVCodecContext *Context = *Result;
+    if (Context == NULL) return;
+    *Result = NULL;
+    if (!Pool.Ready)
+    {
+        avcodec_free_context(&Context);
+        return;
+    }
+
+    DecoderEntry Entry = {0};
+    MutexLock(&Pool.Lock);
+    int32 Capacity = Pool.Capacity;
+    for (int32 Index = 0; Index < Pool.BusyCount; Index++)
+    {
+        if (Pool.Busy[Index].Context != Context) continue;
+        Entry = Pool.Busy[Index];
+        Pool.Busy[Index] = Pool.Busy[--Pool.BusyCount];
+        break;
+    }
+    MutexUnlock(&Pool.Lock);
+
+    int32 Keep = Entry.Context != NULL && Capacity > 0 && Context->sample_rate == Entry.SampleRate &&
+                 Context->channels == Entry.ChannelCount && (int64)Context->channel_layout == Entry.ChannelLayout &&
+                 Context->sample_fmt == Entry.SampleFormat;
+    if (!Keep)
+    {
+        avcodec_parameters_free(&Entry.Params);
+        avcodec_free_context(&Context);
+        return;
+    }
+    avcodec_flush_buffers(Context);
+
+    // The oldest idle decoder makes room when the pool is full.
+    DecoderEntry Evicted = {0};
+    MutexLock(&Pool.Lock);
+    if (Pool.IdleCount == Pool.Capacity && Pool.Capacity > 0)
+    {
+        Evicted = Pool.Idle[0];
+        memmove(Pool.Idle, Pool.Idle + 1, (--Pool.IdleCount)*sizeof(DecoderEntry));
+    }
+    if (Pool.IdleCount < Pool.Capacity) Pool.Idle[Pool.IdleCount++] = Entry;
+    else Evicted = Entry;
+    MutexUnlock(&Pool.Lock);
+    DecoderEntryFree(&Evicted);
+}
@@ -0,0 +1,44 @@
+#ifndef MIXER_DECODER_H
+#define MIXER_DECODER_H
+
+#include <libavcodec/avcodec.h>
+
+#include "mixer.h"
+
+// Opening a decoder builds its tables and parses its setup (AAC, Vorbis and
+// Opus take far longer to open than to decode a short clip), so closed
+// decoders are kept opened in a process-wide pool and handed to the next
+// input with the same codec parameters, flushed with avcodec_flush_buffers().
+// A decoder whose output format changed while decoding, e.g. AAC finding
+// SBR, is closed instead of pooled since it would not start out like a fresh
+// one.
+//
+// DecoderPoolInit() must run before any thread opens an input. Without it
+// DecoderOpen() and DecoderClose() open and close every decoder.
+
+typedef struct DecoderStats
+{
+    int32 OpenCount;            // Decoders opened.
+    int32 ReuseCount;           // Taken from the pool instead.
+    float64 OpenSeconds;        // Spent in DecoderOpen() for each kind.
+    float64 ReuseSeconds;
+} DecoderStats;
+
+// Keep up to Capacity idle decoders, 0 keeps none but still counts opens.
+void DecoderPoolInit(int32 Capacity);
+
+// Change the capacity, closing the oldest idle decoders beyond it.
+void DecoderPoolResize(int32 Capacity);
+
+void DecoderPoolFree(void);
+
+void DecoderPoolGetStats(DecoderStats *Stats);
+
+// Open a decoder of Codec for Params, or take a matching one from the pool.
+int32 DecoderOpen(AVCodecContext **Result, AVCodec *Codec, const AVCodecParameters *Params);
+
+// Flush *Result into the pool, or close it when it cannot be reused or the
+// pool is full.
+void DecoderClose(AVCodecContext **Result);
+
+#endif
@@ -0,0 +1,135 @@
+#include <math.h>
+#include <string.h>
+
+#include <libavutil/mem.h>
+
+#include "duck.h"
+
+int32 DuckerInit(Ducker *Duck, const MixerDuckInfo *Info, int32 Key, int32 SampleRate, int32 BlockSize)
+{
+    memset(Duck, 0, sizeof(Ducker));
+    if (Info->DepthDb > 0 || Info->AttackMs <= 0 || Info->ReleaseMs <= 0 || Info->HoldMs < 0 || Info->LookaheadMs < 0)
+    {
+        return MIXER_ERR_ARG;
+    }
+    Duck->Lookahead = (int32)(Info->LookaheadMs*1e-3f*SampleRate + 0.5f);
+    if (Duck->Lookahead > BlockSize) return MIXER_ERR_ARG;
+
+    Duck->Kernels = KernelSelect();
+    Duck->Key = Key;
+    Duck->Threshold = powf(10.0f, Info->ThresholdDb/20);
+    Duck->Depth = powf(10.0f, Info->DepthDb/20);
+    Duck->Attack = 1.0f - expf(-1.0f/(Info->AttackMs*1e-3f*SampleRate));
+    Duck->Release = 1.0f - expf(-1.0f/(Info->ReleaseMs*1e-3f*SampleRate));
+    Duck->Hold = (int32)(Info->HoldMs*1e-3f*SampleRate + 0.5f);
+    Duck->Gains = av_malloc(BlockSize*sizeof(float32));
+    Duck->Peak = av_malloc(BlockSize*sizeof(float32));
+    if (Duck->Gains == NULL || Duck->Peak == NULL)
+    {
+        DuckerFree(Duck);
+        return MIXER_ERR_NOMEM;
+    }
+    DuckerReset(Duck);
+
+    return MIXER_OK;
+}
+
+void DuckerFree(Ducker *Duck)
+{
+    av_freep(&Duck->Gains);
+    av_freep(&Duck->Peak);
+}
+
+void DuckerReset(Ducker *Duck)
+{
+    Duck->Gain = 1.0f;
+    Duck->HoldLeft = 0;
+    Duck->Active = 0;
+}
+
+void DuckerKey(Ducker *Duck, float32 *const *Channels, int32 ChannelCount, int32 SampleCount)
+{
+    memset(Duck->Peak, 0, SampleCount*sizeof(float32));
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        Duck->Kernels->Peak(Duck->Peak, Channels[Channel], SampleCount);
+    }
+
+    float32 Gain = Duck->Gain;
+    int32 HoldLeft = Duck->HoldLeft;
+    int32 Active = 0;
+    for (int32 Index = 0; Index < SampleCount; Index++)
+    {
+        float32 Target = 1.0f;
+        if (Duck->Peak[Index] > Duck->Threshold)
+        {
+            HoldLeft = Duck->Hold;
+            Target = Duck->Depth;
+        }
+        else if (HoldLeft > 0)
+        {
+            HoldLeft--;
+            Target = Duck->Depth;
+        }
+        Gain += (Target - Gain)*(Target < Gain ? Duck->Attack : Duck->Release);
+        // Settle on exactly 1 so blocks after the release skip the scaling.
+        if (Gain > 0.99999f && Target == 1.0f) Gain = 1.0f;
+        Active |= Gain != 1.0f;
+        Duck->Gains[Index] = Gain;
+    }
+    Duck->Gain = Gain;
+    Duck->HoldLeft = HoldLeft;
+    Duck->Active = Active;
+}
+
+void DuckerApply(Ducker *Duck, float32 *const *Channels, int32 ChannelCount, int32 SampleCount)
+{
+    if (!Duck->Active) return;
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        Duck->Kernels->Scale(Channels[Channel], Channels[Channel], Duck->Gains, SampleCount);
+    }
+}
+
+int32 DelayInit(DelayLine *Delay, int32 Length, int32 ChannelCount, int32 BlockSize)
+{
+    memset(Delay, 0, sizeof(DelayLine));
+    Delay->Length = Length;
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        Delay->History[Channel] = av_mallocz((Length + BlockSize)*sizeof(float32));
+        if (Delay->History[Channel] == NULL)
+        {
+            DelayFree(Delay);
+            return MIXER_ERR_NOMEM;
+        }
+    }
+    return MIXER_OK;
+}
+
+void DelayFree(DelayLine *Delay)
+{
+    for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+    {
+        av_freep(&Delay->History[Channel]);
+    }
+}
+
+void DelayReset(DelayLine *Delay, int32 ChannelCount)
+{
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        memset(Delay->History[Channel], 0, Delay->Length*sizeof(float32));
+    }
+}
+
+void DelayProcess(DelayLine *Delay, float32 *const *Channels, int32 ChannelCount, int32 SampleCount)
+{
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        float32 *History = Delay->History[Channel];
+        memcpy(History + Delay->Length, Channels[Channel], SampleCount*sizeof(float32));
+        memcpy(Channels[Channel], History, SampleCount*sizeof(float32));
+        memmove(History, History + SampleCount, Delay->Length*sizeof(float32));
+    }
+}
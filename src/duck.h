@@ -0,0 +1,59 @@
+#ifndef MIXER_DUCK_H
+#define MIXER_DUCK_H
+
+#include "kernel.h"
+#include "mixer.h"
+
+// Sidechain ducking, see MixerAddDucker(). The key bus computes the gains of
+// a block from its own output, before its delay, and the ducked bus applies
+// them after its delay, so the gain at each sample already knows the key
+// Lookahead samples ahead.
+
+typedef struct Ducker
+{
+    const KernelTable *Kernels;
+    int32 Key;              // Bus the gains follow.
+    float32 Threshold;      // Linear key peak the ducking starts at.
+    float32 Depth;          // Linear gain while ducked.
+    float32 Attack;         // Fraction of the distance to the target gain covered per sample.
+    float32 Release;
+    int32 Hold;             // Samples the gain stays down after the key falls under the threshold.
+    int32 Lookahead;
+
+    float32 Gain;
+    int32 HoldLeft;
+    int32 Active;           // Gains of the block are not all 1.
+    float32 *Gains;         // Of the current block.
+    float32 *Peak;          // Scratch, the key peak across channels.
+} Ducker;
+
+// Delay of a bus's output by whole samples.
+typedef struct DelayLine
+{
+    int32 Length;
+    float32 *History[MIXER_MAX_CHANNELS];   // The last Length samples, then room for a block.
+} DelayLine;
+
+int32 DuckerInit(Ducker *Duck, const MixerDuckInfo *Info, int32 Key, int32 SampleRate, int32 BlockSize);
+
+void DuckerFree(Ducker *Duck);
+
+// Back to no reduction.
+void DuckerReset(Ducker *Duck);
+
+// Compute the gains of the block from the key bus's output.
+void DuckerKey(Ducker *Duck, float32 *const *Channels, int32 ChannelCount, int32 SampleCount);
+
+// Scale the ducked bus's delayed output by the gains of the block.
+void DuckerApply(Ducker *Duck, float32 *const *Channels, int32 ChannelCount, int32 SampleCount);
+
+int32 DelayInit(DelayLine *Delay, int32 Length, int32 ChannelCount, int32 BlockSize);
+
+void DelayFree(DelayLine *Delay);
+
+// Back to silence.
+void DelayReset(DelayLine *Delay, int32 ChannelCount);
+
+void DelayProcess(DelayLine *Delay, float32 *const *Channels, int32 ChannelCount, int32 SampleCount);
+
+#endif
@@ -0,0 +1,400 @@
+#include <errno.h>
+#include <string.h>
+
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavformat/avio.h>
+
+#include "ioreader.h"
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup     425
+#define __NR_io_uring_enter     426
+#endif
+
+#define IO_IDLE                 0
+#define IO_PENDING              1
+#define IO_DONE                 2
+
+typedef struct IoSlot
+{
+    uint8_t *Data;
+    int64 Offset;           // File position of Data[0].
+    int32 Want;             // Bytes the read covers, IO_WINDOW but at the end of the file.
+    int32 Filled;           // Bytes read so far.
+    int32 Error;            // Negative errno of a failed read.
+    int32 State;            // IO_*.
+    struct iovec Vector;
+} IoSlot;
+
+struct IoReader
+{
+    int File;
+    int64 FileSize;
+    int64 Position;         // Next byte IoReaderRead() returns.
+    int64 Ahead;            // File position the next read started covers.
+    int32 Depth;
+    int32 Head;             // Slot holding Position, the others follow in file order.
+    IoSlot Slots[IO_MAX_DEPTH];
+    int32 InFlight;
+    int32 Queued;           // Submissions not yet passed to the kernel.
+
+    // The rings, mapped from the kernel.
+    int Ring;
+    void *SqRing;
+    size_t SqRingSize;
+    void *CqRing;
+    size_t CqRingSize;
+    struct io_uring_sqe *Sqes;
+    size_t SqesSize;
+    unsigned *SqTail;
+    unsigned *SqMask;
+    unsigned *SqArray;
+    unsigned *CqHead;
+    unsigned *CqTail;
+    unsigned *CqMask;
+    struct io_uring_cqe *Cqes;
+};
+
+static int32 IoSetup(IoReader *Reader, int32 Entries)
+{
+    struct io_uring_params Params;
+    memset(&Params, 0, sizeof(Params));
+    Reader->Ring = (int)syscall(__NR_io_uring_setup, Entries, &Params);
+    if (Reader->Ring < 0) return MIXER_ERR_OPEN;
+
+    Reader->SqRingSize = Params.sq_off.array + Params.sq_entries*sizeof(unsigned);
+    Reader->CqRingSize = Params.cq_off.cqes + Params.cq_entries*sizeof(struct io_uring_cqe);
+    int32 Single = (Params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (Single && Reader->CqRingSize > Reader->SqRingSize) Reader->SqRingSize = Reader->CqRingSize;
+
+    Reader->SqRing = mmap(NULL, Reader->SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Reader->Ring,
+                          IORING_OFF_SQ_RING);
+    if (Reader->SqRing == MAP_FAILED)
+    {
+        Reader->SqRing = NULL;
+        return MIXER_ERR_OPEN;
+    }
+    if (Single) Reader->CqRing = Reader->SqRing;
+    else
+    {
+        Reader->CqRing = mmap(NULL, Reader->CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Reader->Ring,
+                              IORING_OFF_CQ_RING);
+        if (Reader->CqRing == MAP_FAILED)
+        {
+            Reader->CqRing = NULL;
+            return MIXER_ERR_OPEN;
+        }
+    }
+    Reader->SqesSize = Params.sq_entries*sizeof(struct io_uring_sqe);
+    Reader->Sqes = mmap(NULL, Reader->SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Reader->Ring,
+                        IORING_OFF_SQES);
+    if (Reader->Sqes == MAP_FAILED)
+    {
+        Reader->Sqes = NULL;
+        return MIXER_ERR_OPEN;
+    }
+
+    uint8_t *Sq = Reader->SqRing;
+    uint8_t *Cq = Reader->CqRing;
+    Reader->SqTail = (unsigned *)(Sq + Params.sq_off.tail);
+    Reader->SqMask = (unsigned *)(Sq + Params.sq_off.ring_mask);
+    Reader->SqArray = (unsigned *)(Sq + Params.sq_off.array);
+    Reader->CqHead = (unsigned *)(Cq + Params.cq_off.head);
+    Reader->CqTail = (unsigned *)(Cq + Params.cq_off.tail);
+    Reader->CqMask = (unsigned *)(Cq + Params.cq_off.ring_mask);
+    Reader->Cqes = (struct io_uring_cqe *)(Cq + Params.cq_off.cqes);
+
+    return MIXER_OK;
+}
+
+// Queue the rest of the read of slot Index. Slots never outnumber the ring
+// entries, so there is always room.
+static void IoQueue(IoReader *Reader, int32 Index)
+{
+    IoSlot *Slot = &Reader->Slots[Index];
+    Slot->Vector.iov_base = Slot->Data + Slot->Filled;
+    Slot->Vector.iov_len = Slot->Want - Slot->Filled;
+
+    unsigned Tail = *Reader->SqTail;
+    unsigned Entry = Tail & *Reader->SqMask;
+    struct io_uring_sqe *Sqe = &Reader->Sqes[Entry];
+    memset(Sqe, 0, sizeof(*Sqe));
+    Sqe->opcode = IORING_OP_READV;
+    Sqe->fd = Reader->File;
+    Sqe->addr = (uint64_t)(uintptr_t)&Slot->Vector;
+    Sqe->len = 1;
+    Sqe->off = Slot->Offset + Slot->Filled;
+    Sqe->user_data = Index;
+    Reader->SqArray[Entry] = Entry;
+    __atomic_store_n(Reader->SqTail, Tail + 1, __ATOMIC_RELEASE);
+    Reader->Queued++;
+    Reader->InFlight++;
+}
+
+// Start the read of slot Index at Offset, or leave it idle past the end.
+static void IoStart(IoReader *Reader, int32 Index, int64 Offset)
+{
+    IoSlot *Slot = &Reader->Slots[Index];
+    if (Offset >= Reader->FileSize)
+    {
+        Slot->State = IO_IDLE;
+        return;
+    }
+    Slot->Offset = Offset;
+    Slot->Want = Reader->FileSize - Offset < IO_WINDOW ? (int32)(Reader->FileSize - Offset) : IO_WINDOW;
+    Slot->Filled = 0;
+    Slot->Error = 0;
+    Slot->State = IO_PENDING;
+    IoQueue(Reader, Index);
+}
+
+static void IoReap(IoReader *Reader)
+{
+    unsigned Head = *Reader->CqHead;
+    unsigned Tail = __atomic_load_n(Reader->CqTail, __ATOMIC_ACQUIRE);
+    for (; Head != Tail; Head++)
+    {
+        const struct io_uring_cqe *Cqe = &Reader->Cqes[Head & *Reader->CqMask];
+        int32 Index = (int32)Cqe->user_data;
+        int32 Result = Cqe->res;
+        IoSlot *Slot = &Reader->Slots[Index];
+        Reader->InFlight--;
+        if (Result == -EAGAIN || Result == -EINTR) IoQueue(Reader, Index);
+        else if (Result < 0)
+        {
+            Slot->Error = Result;
+            Slot->State = IO_DONE;
+        }
+        else
+        {
+            // Short reads continue where they stopped, none at all means
+            // the file was truncated under us.
+            Slot->Filled += Result;
+            if (Result > 0 && Slot->Filled < Slot->Want) IoQueue(Reader, Index);
+            else Slot->State = IO_DONE;
+        }
+    }
+    __atomic_store_n(Reader->CqHead, Head, __ATOMIC_RELEASE);
+}
+
+// Pass queued reads to the kernel and collect completions, waiting for at
+// least one when Wait.
+static int32 IoEnter(IoReader *Reader, int32 Wait)
+{
+    for (;;)
+    {
+        int32 Submit = Reader->Queued;
+        if (Submit == 0 && !Wait) break;
+        int Ret = (int)syscall(__NR_io_uring_enter, Reader->Ring, Submit, Wait ? 1 : 0,
+                               Wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (Ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) return AVERROR(errno);
+        if (Ret > 0) Reader->Queued -= Ret;
+        if (Ret >= 0 && Reader->Queued == 0) break;
+    }
+    IoReap(Reader);
+    // Requeued short reads go out right away.
+    if (Reader->Queued > 0) return IoEnter(Reader, 0);
+    return 0;
+}
+
+// Done with the head slot, reuse it for the read after the window. A seek
+// skips slots whose reads are still in flight, their completions would count
+// toward the new read, so those are waited for first.
+static int32 IoAdvance(IoReader *Reader)
+{
+    int32 Index = Reader->Head;
+    while (Reader->Slots[Index].State == IO_PENDING)
+    {
+        int32 Ret = IoEnter(Reader, 1);
+        if (Ret < 0) return Ret;
+    }
+    IoStart(Reader, Index, Reader->Ahead);
+    if (Reader->Slots[Index].State == IO_PENDING) Reader->Ahead += Reader->Slots[Index].Want;
+    Reader->Head = (Index + 1) % Reader->Depth;
+    return 0;
+}
+
+// Drop the window and fill a new one from Offset, rounded down to a page.
+static int32 IoRestart(IoReader *Reader, int64 Offset)
+{
+    while (Reader->InFlight > 0)
+    {
+        int32 Ret = IoEnter(Reader, 1);
+        if (Ret < 0) return Ret;
+    }
+    Reader->Head = 0;
+    Reader->Ahead = Offset & ~(int64)4095;
+    for (int32 Index = 0; Index < Reader->Depth; Index++)
+    {
+        IoStart(Reader, Index, Reader->Ahead);
+        if (Reader->Slots[Index].State == IO_PENDING) Reader->Ahead += Reader->Slots[Index].Want;
+    }
+    return IoEnter(Reader, 0);
+}
+
+int32 IoReaderOpen(IoReader **Result, const char *FileName, int32 Depth)
+{
+    IoReader *Reader = av_mallocz(sizeof(IoReader));
+    if (Reader == NULL) return MIXER_ERR_NOMEM;
+    *Result = Reader;
+    Reader->Ring = -1;
+    Reader->Depth = Depth < 1 ? 1 : Depth > IO_MAX_DEPTH ? IO_MAX_DEPTH : Depth;
+
+    struct stat Info;
+    Reader->File = open(FileName, O_RDONLY);
+    if (Reader->File < 0 || fstat(Reader->File, &Info) != 0 || !S_ISREG(Info.st_mode) || IoSetup(Reader, Reader->Depth) < 0)
+    {
+        IoReaderClose(Result);
+        return MIXER_ERR_OPEN;
+    }
+    Reader->FileSize = Info.st_size;
+
+    for (int32 Index = 0; Index < Reader->Depth; Index++)
+    {
+        if ((Reader->Slots[Index].Data = av_malloc(IO_WINDOW)) == NULL)
+        {
+            IoReaderClose(Result);
+            return MIXER_ERR_NOMEM;
+        }
+    }
+    if (IoRestart(Reader, 0) < 0)
+    {
+        IoReaderClose(Result);
+        return MIXER_ERR_OPEN;
+    }
+
+    return MIXER_OK;
+}
+
+void IoReaderClose(IoReader **Result)
+{
+    IoReader *Reader = *Result;
+    if (Reader == NULL) return;
+
+    // The kernel writes into the buffers until every read is back.
+    while (Reader->InFlight > 0 && IoEnter(Reader, 1) >= 0);
+    if (Reader->Sqes) munmap(Reader->Sqes, Reader->SqesSize);
+    if (Reader->CqRing && Reader->CqRing != Reader->SqRing) munmap(Reader->CqRing, Reader->CqRingSize);
+    if (Reader->SqRing) munmap(Reader->SqRing, Reader->SqRingSize);
+    if (Reader->Ring >= 0) close(Reader->Ring);
+    if (Reader->File >= 0) close(Reader->File);
+    for (int32 Index = 0; Index < IO_MAX_DEPTH; Index++)
+    {
+        av_freep(&Reader->Slots[Index].Data);
+    }
+    av_freep(Result);
+}
+
+int IoReaderRead(void *Opaque, uint8_t *Buffer, int Size)
+{
+    IoReader *Reader = Opaque;
+    int Done = 0;
+    while (Done < Size)
+    {
+        IoSlot *Slot = &Reader->Slots[Reader->Head];
+        if (Slot->State == IO_IDLE) break;
+        // Only wait for the disk when there is nothing to return yet.
+        if (Slot->State == IO_PENDING && Done > 0) break;
+        while (Slot->State == IO_PENDING)
+        {
+            int32 Ret = IoEnter(Reader, 1);
+            if (Ret < 0) return Ret;
+        }
+        if (Slot->Error < 0) return Done > 0 ? Done : AVERROR(-Slot->Error);
+
+        int64 Left = Slot->Offset + Slot->Filled - Reader->Position;
+        if (Left <= 0) break;
+        int32 Count = Left < Size - Done ? (int32)Left : Size - Done;
+        memcpy(Buffer + Done, Slot->Data + (Reader->Position - Slot->Offset), Count);
+        Done += Count;
+        Reader->Position += Count;
+        if (Reader->Position == Slot->Offset + Slot->Want)
+        {
+            int32 Ret = IoAdvance(Reader);
+            if (Ret < 0) return Done;
+        }
+    }
+    if (Reader->Queued > 0)
+    {
+        int32 Ret = IoEnter(Reader, 0);
+        if (Ret < 0 && Done == 0) return Ret;
+    }
+    return Done > 0 ? Done : AVERROR_EOF;
+}
+
+int64_t IoReaderSeek(void *Opaque, int64_t Offset, int Whence)
+{
+    IoReader *Reader = Opaque;
+    if (Whence & AVSEEK_SIZE) return Reader->FileSize;
+
+    Whence &= ~AVSEEK_FORCE;
+    if (Whence == SEEK_CUR) Offset += Reader->Position;
+    else if (Whence == SEEK_END) Offset += Reader->FileSize;
+    else if (Whence != SEEK_SET) return AVERROR(EINVAL);
+    if (Offset < 0) return AVERROR(EINVAL);
+
+    // Forward within the window skips whole reads, anything else starts over.
+    IoSlot *Slot = &Reader->Slots[Reader->Head];
+    if (Slot->State != IO_IDLE && Offset >= Slot->Offset && Offset < Reader->Ahead)
+    {
+        while (Offset >= Reader->Slots[Reader->Head].Offset + Reader->Slots[Reader->Head].Want)
+        {
+            int32 Ret = IoAdvance(Reader);
+            if (Ret < 0) return Ret;
+        }
+        int32 Ret = IoEnter(Reader, 0);
+        if (Ret < 0) return Ret;
+    }
+    else
+    {
+        int32 Ret = IoRestart(Reader, Offset);
+        if (Ret < 0) return Ret;
+    }
+    Reader->Position = Offset;
+
+    return Offset;
+}
+
+#else
+
+int32 IoReaderOpen(IoReader **Result, const char *FileName, int32 Depth)
+{
+    (void)FileName;
+    (void)Depth;
+    *Result = NULL;
+    return MIXER_ERR_OPEN;
+}
+
+void IoReaderClose(IoReader **Result)
+{
+    *Result = NULL;
+}
+
+int IoReaderRead(void *Opaque, uint8_t *Buffer, int Size)
+{
+    (void)Opaque;
+    (void)Buffer;
+    (void)Size;
+    return AVERROR(ENOSYS);
+}
+
+int64_t IoReaderSeek(void *Opaque, int64_t Offset, int Whence)
+{
+    (void)Opaque;
+    (void)Offset;
+    (void)Whence;
+    return AVERROR(ENOSYS);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef MIXER_IOREADER_H
+#define MIXER_IOREADER_H
+
+#include <stdint.h>
+
+#include "mixer.h"
+
+// Input file read through io_uring, the I/O of an AVIOContext. The reader
+// keeps a window of Depth reads of IO_WINDOW bytes in flight ahead of the
+// position the demuxer reads at, and only waits when the read holding that
+// position has not completed yet. Every input has its own ring, so with many
+// inputs open the reads of all of them are queued at the device at once
+// instead of one blocking read() at a time, and a decoder stalls on the
+// disk only when it outruns its whole window.
+//
+// Only available on Linux, elsewhere and on kernels without io_uring
+// IoReaderOpen() fails and the input is read by libavformat as usual.
+
+// Bytes per read, the window of an input is Depth times this.
+#define IO_WINDOW               (128*1024)
+
+#define IO_MAX_DEPTH            32
+
+// Buffer the AVIOContext reads into from the window.
+#define IO_BUFFER_SIZE          (32*1024)
+
+typedef struct IoReader IoReader;
+
+// Open FileName with Depth reads in flight, at most IO_MAX_DEPTH. Returns
+// MIXER_ERR_OPEN when the file or io_uring is not available.
+int32 IoReaderOpen(IoReader **Result, const char *FileName, int32 Depth);
+
+void IoReaderClose(IoReader **Result);
+
+// The read_packet and seek callbacks of avio_alloc_context(), Opaque is the
+// IoReader.
+int IoReaderRead(void *Opaque, uint8_t *Buffer, int Size);
+
+int64_t IoReaderSeek(void *Opaque, int64_t Offset, int Whence);
+
+#endif
@@ -0,0 +1,1024 @@
+#include <math.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "kernel.h"
+#include "mixer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_HAVE_AVX2 1
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define KERNEL_HAVE_AVX2 1
+#define KERNEL_TARGET_AVX2
+#endif
+
+#ifdef KERNEL_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+static void MixC(float32 *Dst, const float32 *Src, int32 Count, float32 Gain, float32 GainStep)
+{
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        Dst[Index] += (Gain + Index*GainStep)*Src[Index];
+    }
+}
+
+static void TrackGainsC(float32 **Target, const float32 *Gain, const float32 *Pan, const float32 *Audible,
+                        int32 Count, int32 ChannelCount)
+{
+    for (int32 Track = 0; Track < Count; Track++)
+    {
+        float32 Level = Gain[Track]*Audible[Track];
+        if (ChannelCount == 2)
+        {
+            Target[0][Track] = Level*(Pan[Track] > 0.0f ? 1.0f - Pan[Track] : 1.0f);
+            Target[1][Track] = Level*(Pan[Track] < 0.0f ? 1.0f + Pan[Track] : 1.0f);
+            continue;
+        }
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            Target[Channel][Track] = Level;
+        }
+    }
+}
+
+static void MixEnvelopeC(float32 *Dst, const float32 *Src, const float32 *Envelope, int32 Count,
+                         float32 Gain, float32 GainStep)
+{
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        Dst[Index] += (Gain + Index*GainStep)*Envelope[Index]*Src[Index];
+    }
+}
+
+static void RampC(float32 *Out, int32 Count, float32 Start, float32 Step)
+{
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        Out[Index] = Start + Index*Step;
+    }
+}
+
+static void RampExpC(float32 *Out, int32 Count, float32 Start, float32 Ratio)
+{
+    float32 Value = Start;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        Out[Index] = Value;
+        Value *= Ratio;
+    }
+}
+
+static void CurveC(float32 *Out, int32 Count, const float32 *Table, int32 Size, float32 Position, float32 Step)
+{
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        float32 X = Position + Index*Step;
+        X = X < 0.0f ? 0.0f : X > 1.0f ? 1.0f : X;
+        X *= Size;
+        int32 Point = (int32)X;
+        if (Point >= Size) Point = Size - 1;
+        float32 Fraction = X - Point;
+        Out[Index] *= Table[Point] + Fraction*(Table[Point + 1] - Table[Point]);
+    }
+}
+
+static void PolyphaseC(float32 *Out, int32 Count, const float32 *In, const float32 *Filter,
+                       int32 TapCount, int32 PhaseCount, int32 Step, int32 Phase)
+{
+    // A division per output would cost more than a short filter.
+    int32 Advance = Step/PhaseCount;
+    Step %= PhaseCount;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        const float32 *Taps = Filter + Phase*TapCount;
+        float32 Sum = 0.0f;
+        for (int32 Tap = 0; Tap < TapCount; Tap++)
+        {
+            Sum += Taps[Tap]*In[Tap];
+        }
+        Out[Index] = Sum;
+        In += Advance;
+        Phase += Step;
+        if (Phase >= PhaseCount)
+        {
+            Phase -= PhaseCount;
+            In++;
+        }
+    }
+}
+
+// Triangular noise in [-1, 1) from one xorshift32 step, the sum of its two
+// 16 bit halves.
+static float32 DitherNext(uint32_t *Seed)
+{
+    uint32_t X = *Seed;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    *Seed = X;
+    return ((X & 0xFFFF) + (X >> 16))*(1.0f/65536) - 1.0f;
+}
+
+// Scale, dither and clip one sample to [Low, High], rounding to nearest even
+// like the vector conversion.
+static int32 PackSample(float32 Sample, float32 Scale, float32 Low, float32 High, float32 Dither, uint32_t *Seed)
+{
+    float32 Value = Sample*Scale;
+    if (Dither != 0.0f) Value += Dither*DitherNext(Seed);
+    Value = Value < Low ? Low : Value > High ? High : Value;
+    return (int32)lrintf(Value);
+}
+
+static void PackS16C(void *Out, const float32 *In, int32 Count, float32 Dither, uint32_t *Seed)
+{
+    int16_t *Dst = Out;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        Dst[Index] = (int16_t)PackSample(In[Index], 32768.0f, -32768.0f, 32767.0f, Dither, &Seed[Index & 7]);
+    }
+}
+
+static void PackS24C(void *Out, const float32 *In, int32 Count, float32 Dither, uint32_t *Seed)
+{
+    uint8_t *Dst = Out;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        int32 Value = PackSample(In[Index], 8388608.0f, -8388608.0f, 8388607.0f, Dither, &Seed[Index & 7]);
+        Dst[3*Index] = (uint8_t)Value;
+        Dst[3*Index + 1] = (uint8_t)(Value >> 8);
+        Dst[3*Index + 2] = (uint8_t)(Value >> 16);
+    }
+}
+
+// 2147483520 is the largest float below 2^31.
+static void PackS32C(void *Out, const float32 *In, int32 Count, float32 Dither, uint32_t *Seed)
+{
+    int32_t *Dst = Out;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        Dst[Index] = PackSample(In[Index], 2147483648.0f, -2147483648.0f, 2147483520.0f, Dither, &Seed[Index & 7]);
+    }
+}
+
+static void PeakC(float32 *Peak, const float32 *In, int32 Count)
+{
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        float32 Value = fabsf(In[Index]);
+        if (Value > Peak[Index]) Peak[Index] = Value;
+    }
+}
+
+static float64 RangeC(float32 *Range, const float32 *In, int32 Count)
+{
+    float32 Low = Range[0], High = Range[1];
+    float64 Energy = 0.0;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        float32 Value = In[Index];
+        Low = Value < Low ? Value : Low;
+        High = Value > High ? Value : High;
+        Energy += Value*Value;
+    }
+    Range[0] = Low;
+    Range[1] = High;
+    return Energy;
+}
+
+static void ScaleC(float32 *Out, const float32 *In, const float32 *Gain, int32 Count)
+{
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        Out[Index] = In[Index]*Gain[Index];
+    }
+}
+
+// Matrix layout: the outputs of four samples as a sum of state columns
+// (0..15) and input columns (16..31), the state after them the same way
+// (32..47, 48..63), then A, B, C and D for single samples (64..88).
+void KernelStateMatrix(float64 *Matrix, const float64 *A, const float64 *B, const float64 *C, float64 D)
+{
+    memset(Matrix, 0, KERNEL_STATE_MATRIX*sizeof(float64));
+    float64 Power[16];      // A^Step.
+    float64 Response[4];    // Impulse response, D then C A^k B.
+    memset(Power, 0, sizeof(Power));
+    for (int32 Index = 0; Index < 4; Index++) Power[Index*5] = 1.0;
+    for (int32 Step = 0; Step < 4; Step++)
+    {
+        for (int32 Column = 0; Column < 4; Column++)
+        {
+            float64 Value = 0.0;
+            for (int32 Inner = 0; Inner < 4; Inner++) Value += C[Inner]*Power[Inner*4 + Column];
+            Matrix[Column*4 + Step] = Value;
+        }
+        float64 Next[16];
+        for (int32 RowIndex = 0; RowIndex < 4; RowIndex++)
+        {
+            for (int32 Column = 0; Column < 4; Column++)
+            {
+                Next[RowIndex*4 + Column] = 0.0;
+                for (int32 Inner = 0; Inner < 4; Inner++) Next[RowIndex*4 + Column] += Power[RowIndex*4 + Inner]*A[Inner*4 + Column];
+            }
+        }
+        // Input 3 - Step reaches the state after the four samples as A^Step B.
+        for (int32 RowIndex = 0; RowIndex < 4; RowIndex++)
+        {
+            float64 Value = 0.0;
+            for (int32 Inner = 0; Inner < 4; Inner++) Value += Power[RowIndex*4 + Inner]*B[Inner];
+            Matrix[48 + (3 - Step)*4 + RowIndex] = Value;
+        }
+        memcpy(Power, Next, sizeof(Power));
+    }
+    // Power is A^4 now.
+    for (int32 RowIndex = 0; RowIndex < 4; RowIndex++)
+    {
+        for (int32 Column = 0; Column < 4; Column++) Matrix[32 + Column*4 + RowIndex] = Power[RowIndex*4 + Column];
+    }
+    // Output k gets input j through D when j = k and C A^(k-j-1) B before.
+    Response[0] = D;
+    for (int32 Step = 1; Step < 4; Step++)
+    {
+        float64 Value = 0.0;
+        for (int32 Inner = 0; Inner < 4; Inner++) Value += Matrix[Inner*4 + Step - 1]*B[Inner];
+        Response[Step] = Value;
+    }
+    for (int32 Input = 0; Input < 4; Input++)
+    {
+        for (int32 Step = Input; Step < 4; Step++) Matrix[16 + Input*4 + Step] = Response[Step - Input];
+    }
+    memcpy(Matrix + 64, A, 16*sizeof(float64));
+    memcpy(Matrix + 80, B, 4*sizeof(float64));
+    memcpy(Matrix + 84, C, 4*sizeof(float64));
+    Matrix[88] = D;
+}
+
+// Single samples, for the tail of the blocked kernels.
+static float64 StateEnergyStep(const float32 *In, int32 Count, float64 *State, const float64 *Matrix)
+{
+    const float64 *A = Matrix + 64;
+    const float64 *B = Matrix + 80;
+    const float64 *C = Matrix + 84;
+    float64 D = Matrix[88];
+    float64 S0 = State[0], S1 = State[1], S2 = State[2], S3 = State[3];
+    float64 Sum = 0.0;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        float64 X = In[Index];
+        float64 Y = C[0]*S0 + C[1]*S1 + C[2]*S2 + C[3]*S3 + D*X;
+        float64 N0 = A[0]*S0 + A[1]*S1 + A[2]*S2 + A[3]*S3 + B[0]*X;
+        float64 N1 = A[4]*S0 + A[5]*S1 + A[6]*S2 + A[7]*S3 + B[1]*X;
+        float64 N2 = A[8]*S0 + A[9]*S1 + A[10]*S2 + A[11]*S3 + B[2]*X;
+        float64 N3 = A[12]*S0 + A[13]*S1 + A[14]*S2 + A[15]*S3 + B[3]*X;
+        S0 = N0;
+        S1 = N1;
+        S2 = N2;
+        S3 = N3;
+        Sum += Y*Y;
+    }
+    State[0] = S0;
+    State[1] = S1;
+    State[2] = S2;
+    State[3] = S3;
+    return Sum;
+}
+
+static float64 StateEnergyC(const float32 *In, int32 Count, float64 *State, const float64 *Matrix)
+{
+    float64 S[4] = {State[0], State[1], State[2], State[3]};
+    float64 Sum[4] = {0.0, 0.0, 0.0, 0.0};
+    int32 Index = 0;
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        float64 Y[4] = {0.0, 0.0, 0.0, 0.0};
+        float64 N[4] = {0.0, 0.0, 0.0, 0.0};
+        for (int32 Column = 0; Column < 4; Column++)
+        {
+            float64 X = In[Index + Column];
+            for (int32 Lane = 0; Lane < 4; Lane++)
+            {
+                Y[Lane] += S[Column]*Matrix[Column*4 + Lane] + X*Matrix[16 + Column*4 + Lane];
+                N[Lane] += S[Column]*Matrix[32 + Column*4 + Lane] + X*Matrix[48 + Column*4 + Lane];
+            }
+        }
+        for (int32 Lane = 0; Lane < 4; Lane++)
+        {
+            S[Lane] = N[Lane];
+            Sum[Lane] += Y[Lane]*Y[Lane];
+        }
+    }
+    memcpy(State, S, sizeof(S));
+    return Sum[0] + Sum[1] + Sum[2] + Sum[3] + StateEnergyStep(In + Index, Count - Index, State, Matrix);
+}
+
+static void InterleaveLanesC(float32 *Data, float32 *const *Planar, int32 Count)
+{
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++)
+        {
+            Data[Index*KERNEL_LANES + Lane] = Planar[Lane][Index];
+        }
+    }
+}
+
+static void DeinterleaveLanesC(float32 *const *Planar, const float32 *Data, int32 Count)
+{
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++)
+        {
+            Planar[Lane][Index] = Data[Index*KERNEL_LANES + Lane];
+        }
+    }
+}
+
+static void BiquadLanesC(float32 *Data, int32 Count, const float32 *Coefficients, float32 *State, int32 StageCount)
+{
+    for (int32 Stage = 0; Stage < StageCount; Stage++)
+    {
+        const float32 *C = Coefficients + Stage*5*KERNEL_LANES;
+        float32 *S = State + Stage*2*KERNEL_LANES;
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++)
+        {
+            float32 B0 = C[Lane], B1 = C[KERNEL_LANES + Lane], B2 = C[2*KERNEL_LANES + Lane];
+            float32 A1 = C[3*KERNEL_LANES + Lane], A2 = C[4*KERNEL_LANES + Lane];
+            float32 S1 = S[Lane], S2 = S[KERNEL_LANES + Lane];
+            for (int32 Index = 0; Index < Count; Index++)
+            {
+                float32 X = Data[Index*KERNEL_LANES + Lane];
+                float32 Y = B0*X + S1;
+                S1 = B1*X - A1*Y + S2;
+                S2 = B2*X - A2*Y;
+                Data[Index*KERNEL_LANES + Lane] = Y;
+            }
+            S[Lane] = S1;
+            S[KERNEL_LANES + Lane] = S2;
+        }
+    }
+}
+
+typedef union KernelBits
+{
+    float32 Float;
+    int32 Int;
+} KernelBits;
+
+// log2(X) for X > 0 from the exponent and an atanh series of the mantissa
+// taken in [sqrt(1/2), sqrt(2)), within 1e-6.
+static float32 Log2C(float32 X)
+{
+    KernelBits Bits;
+    Bits.Float = X;
+    int32 Exponent = ((Bits.Int >> 23) & 0xFF) - 127;
+    Bits.Int = (Bits.Int & 0x7FFFFF) | 0x3F800000;
+    if (Bits.Float > 1.41421356f)
+    {
+        Bits.Float *= 0.5f;
+        Exponent++;
+    }
+    float32 T = (Bits.Float - 1.0f)/(Bits.Float + 1.0f);
+    float32 T2 = T*T;
+    return Exponent + T*(2.88539008f + T2*(0.96179669f + T2*(0.57707802f + T2*0.41219858f)));
+}
+
+// 2^X from the nearest integer and a series of the rest, within 1e-6
+// relative. X is clamped to the normal range.
+static float32 Exp2C(float32 X)
+{
+    X = X < -126.0f ? -126.0f : (X > 126.0f ? 126.0f : X);
+    float32 Whole = floorf(X + 0.5f);
+    float32 F = X - Whole;
+    KernelBits Bits;
+    Bits.Int = ((int32)Whole + 127) << 23;
+    return Bits.Float*(1.0f + F*(0.69314718f + F*(0.24022651f + F*(0.05550411f + F*(0.00961813f + F*0.00133336f)))));
+}
+
+static void CompressLanesC(float32 *const *Data, int32 ChannelCount, int32 Count, const float32 *Params, float32 *Envelope)
+{
+    for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++)
+    {
+        float32 Threshold = Params[Lane], Makeup = Params[KERNEL_LANES + Lane], Slope = Params[2*KERNEL_LANES + Lane];
+        float32 Attack = Params[3*KERNEL_LANES + Lane], Release = Params[4*KERNEL_LANES + Lane];
+        float32 Level = Envelope[Lane];
+        for (int32 Index = 0; Index < Count; Index++)
+        {
+            float32 Peak = 0.0f;
+            for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+            {
+                float32 Value = fabsf(Data[Channel][Index*KERNEL_LANES + Lane]);
+                Peak = Value > Peak ? Value : Peak;
+            }
+            Level += (Peak - Level)*(Peak > Level ? Attack : Release);
+            float32 Over = Log2C(Level + 1e-30f) - Threshold;
+            float32 Gain = Exp2C(Makeup - Slope*(Over > 0.0f ? Over : 0.0f));
+            for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+            {
+                Data[Channel][Index*KERNEL_LANES + Lane] *= Gain;
+            }
+        }
+        Envelope[Lane] = Level;
+    }
+}
+
+static void SpectrumSumC(float32 *Out, const float32 *const *X, const float32 *const *H, int32 TermCount, int32 Stride)
+{
+    memset(Out, 0, 2*Stride*sizeof(float32));
+    for (int32 Term = 0; Term < TermCount; Term++)
+    {
+        const float32 *XRe = X[Term], *XIm = X[Term] + Stride;
+        const float32 *HRe = H[Term], *HIm = H[Term] + Stride;
+        for (int32 Bin = 0; Bin < Stride; Bin++)
+        {
+            Out[Bin] += XRe[Bin]*HRe[Bin] - XIm[Bin]*HIm[Bin];
+            Out[Stride + Bin] += XRe[Bin]*HIm[Bin] + XIm[Bin]*HRe[Bin];
+        }
+    }
+}
+
+static const KernelTable KernelsC = {"c", MixC, TrackGainsC, MixEnvelopeC, RampC, RampExpC, CurveC, PolyphaseC,
+                                     PackS16C, PackS24C, PackS32C, PeakC, ScaleC, StateEnergyC, InterleaveLanesC,
+                                     DeinterleaveLanesC, BiquadLanesC, CompressLanesC, SpectrumSumC, RangeC};
+
+#ifdef KERNEL_HAVE_AVX2
+KERNEL_TARGET_AVX2
+static void MixAvx2(float32 *Dst, const float32 *Src, int32 Count, float32 Gain, float32 GainStep)
+{
+    __m256 Ramp = _mm256_add_ps(_mm256_set1_ps(Gain),
+                                _mm256_mul_ps(_mm256_set1_ps(GainStep), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 Step = _mm256_set1_ps(8*GainStep);
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        __m256 Sum = _mm256_fmadd_ps(Ramp, _mm256_loadu_ps(Src + Index), _mm256_loadu_ps(Dst + Index));
+        _mm256_storeu_ps(Dst + Index, Sum);
+        Ramp = _mm256_add_ps(Ramp, Step);
+    }
+    MixC(Dst + Index, Src + Index, Count - Index, Gain + Index*GainStep, GainStep);
+}
+
+// Eight tracks per instruction.
+KERNEL_TARGET_AVX2
+static void TrackGainsAvx2(float32 **Target, const float32 *Gain, const float32 *Pan, const float32 *Audible,
+                           int32 Count, int32 ChannelCount)
+{
+    __m256 One = _mm256_set1_ps(1.0f);
+    int32 Track = 0;
+    for (; Track + 8 <= Count; Track += 8)
+    {
+        __m256 Level = _mm256_mul_ps(_mm256_loadu_ps(Gain + Track), _mm256_loadu_ps(Audible + Track));
+        if (ChannelCount == 2)
+        {
+            __m256 Balance = _mm256_loadu_ps(Pan + Track);
+            _mm256_storeu_ps(Target[0] + Track, _mm256_mul_ps(Level, _mm256_min_ps(One, _mm256_sub_ps(One, Balance))));
+            _mm256_storeu_ps(Target[1] + Track, _mm256_mul_ps(Level, _mm256_min_ps(One, _mm256_add_ps(One, Balance))));
+            continue;
+        }
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            _mm256_storeu_ps(Target[Channel] + Track, Level);
+        }
+    }
+
+    float32 *Rest[MIXER_MAX_CHANNELS];
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        Rest[Channel] = Target[Channel] + Track;
+    }
+    TrackGainsC(Rest, Gain + Track, Pan + Track, Audible + Track, Count - Track, ChannelCount);
+}
+
+KERNEL_TARGET_AVX2
+static void MixEnvelopeAvx2(float32 *Dst, const float32 *Src, const float32 *Envelope, int32 Count,
+                            float32 Gain, float32 GainStep)
+{
+    __m256 Ramp = _mm256_add_ps(_mm256_set1_ps(Gain),
+                                _mm256_mul_ps(_mm256_set1_ps(GainStep), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 Step = _mm256_set1_ps(8*GainStep);
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        __m256 Scale = _mm256_mul_ps(Ramp, _mm256_loadu_ps(Envelope + Index));
+        __m256 Sum = _mm256_fmadd_ps(Scale, _mm256_loadu_ps(Src + Index), _mm256_loadu_ps(Dst + Index));
+        _mm256_storeu_ps(Dst + Index, Sum);
+        Ramp = _mm256_add_ps(Ramp, Step);
+    }
+    MixEnvelopeC(Dst + Index, Src + Index, Envelope + Index, Count - Index, Gain + Index*GainStep, GainStep);
+}
+
+KERNEL_TARGET_AVX2
+static void RampAvx2(float32 *Out, int32 Count, float32 Start, float32 Step)
+{
+    __m256 Ramp = _mm256_add_ps(_mm256_set1_ps(Start),
+                                _mm256_mul_ps(_mm256_set1_ps(Step), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 Step8 = _mm256_set1_ps(8*Step);
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        _mm256_storeu_ps(Out + Index, Ramp);
+        Ramp = _mm256_add_ps(Ramp, Step8);
+    }
+    RampC(Out + Index, Count - Index, Start + Index*Step, Step);
+}
+
+KERNEL_TARGET_AVX2
+static void RampExpAvx2(float32 *Out, int32 Count, float32 Start, float32 Ratio)
+{
+    // Lanes hold Start*Ratio^0..7 and advance by Ratio^8.
+    float32 Lanes[8];
+    RampExpC(Lanes, 8, Start, Ratio);
+    __m256 Value = _mm256_loadu_ps(Lanes);
+    float32 Ratio2 = Ratio*Ratio;
+    float32 Ratio4 = Ratio2*Ratio2;
+    __m256 Ratio8 = _mm256_set1_ps(Ratio4*Ratio4);
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        _mm256_storeu_ps(Out + Index, Value);
+        Value = _mm256_mul_ps(Value, Ratio8);
+    }
+    _mm256_storeu_ps(Lanes, Value);
+    RampExpC(Out + Index, Count - Index, Lanes[0], Ratio);
+}
+
+// The table lookup is a gather of both neighbours of eight positions.
+KERNEL_TARGET_AVX2
+static void CurveAvx2(float32 *Out, int32 Count, const float32 *Table, int32 Size, float32 Position, float32 Step)
+{
+    __m256 X = _mm256_add_ps(_mm256_set1_ps(Position),
+                             _mm256_mul_ps(_mm256_set1_ps(Step), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 Step8 = _mm256_set1_ps(8*Step);
+    __m256 Zero = _mm256_setzero_ps();
+    __m256 One = _mm256_set1_ps(1.0f);
+    __m256 Scale = _mm256_set1_ps((float32)Size);
+    __m256i Last = _mm256_set1_epi32(Size - 1);
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        __m256 Clamped = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(X, Zero), One), Scale);
+        __m256i Point = _mm256_min_epi32(_mm256_cvttps_epi32(Clamped), Last);
+        __m256 Fraction = _mm256_sub_ps(Clamped, _mm256_cvtepi32_ps(Point));
+        __m256 Left = _mm256_i32gather_ps(Table, Point, 4);
+        __m256 Right = _mm256_i32gather_ps(Table + 1, Point, 4);
+        __m256 Value = _mm256_fmadd_ps(Fraction, _mm256_sub_ps(Right, Left), Left);
+        _mm256_storeu_ps(Out + Index, _mm256_mul_ps(_mm256_loadu_ps(Out + Index), Value));
+        X = _mm256_add_ps(X, Step8);
+    }
+    CurveC(Out + Index, Count - Index, Table, Size, Position + Index*Step, Step);
+}
+
+// Two accumulators hide the FMA latency, the taps of one output are summed
+// across lanes once at the end.
+KERNEL_TARGET_AVX2
+static void PolyphaseAvx2(float32 *Out, int32 Count, const float32 *In, const float32 *Filter,
+                          int32 TapCount, int32 PhaseCount, int32 Step, int32 Phase)
+{
+    // A division per output would cost more than a short filter.
+    int32 Advance = Step/PhaseCount;
+    Step %= PhaseCount;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        const float32 *Taps = Filter + Phase*TapCount;
+        __m256 Sum0 = _mm256_setzero_ps();
+        __m256 Sum1 = _mm256_setzero_ps();
+        int32 Tap = 0;
+        for (; Tap + 16 <= TapCount; Tap += 16)
+        {
+            Sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(Taps + Tap), _mm256_loadu_ps(In + Tap), Sum0);
+            Sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(Taps + Tap + 8), _mm256_loadu_ps(In + Tap + 8), Sum1);
+        }
+        if (Tap < TapCount) Sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(Taps + Tap), _mm256_loadu_ps(In + Tap), Sum0);
+        __m256 Sum = _mm256_add_ps(Sum0, Sum1);
+        __m128 Half = _mm_add_ps(_mm256_castps256_ps128(Sum), _mm256_extractf128_ps(Sum, 1));
+        Half = _mm_add_ps(Half, _mm_movehl_ps(Half, Half));
+        Half = _mm_add_ss(Half, _mm_shuffle_ps(Half, Half, 1));
+        Out[Index] = _mm_cvtss_f32(Half);
+        In += Advance;
+        Phase += Step;
+        if (Phase >= PhaseCount)
+        {
+            Phase -= PhaseCount;
+            In++;
+        }
+    }
+}
+
+// Eight samples scaled, dithered from the eight generators in Seed and
+// clipped, as rounded integers.
+KERNEL_TARGET_AVX2
+static __m256i PackConvert(const float32 *In, __m256 Scale, __m256 Low, __m256 High, __m256 Dither, __m256i *Seed)
+{
+    __m256 Value = _mm256_mul_ps(_mm256_loadu_ps(In), Scale);
+    if (_mm256_movemask_ps(_mm256_cmp_ps(Dither, _mm256_setzero_ps(), _CMP_NEQ_OQ)))
+    {
+        __m256i X = *Seed;
+        X = _mm256_xor_si256(X, _mm256_slli_epi32(X, 13));
+        X = _mm256_xor_si256(X, _mm256_srli_epi32(X, 17));
+        X = _mm256_xor_si256(X, _mm256_slli_epi32(X, 5));
+        *Seed = X;
+        __m256i Mask = _mm256_set1_epi32(0xFFFF);
+        __m256i Sum = _mm256_add_epi32(_mm256_and_si256(X, Mask), _mm256_srli_epi32(X, 16));
+        __m256 Noise = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(Sum), _mm256_set1_ps(1.0f/65536)), _mm256_set1_ps(1.0f));
+        Value = _mm256_fmadd_ps(Dither, Noise, Value);
+    }
+    Value = _mm256_min_ps(_mm256_max_ps(Value, Low), High);
+    return _mm256_cvtps_epi32(Value);
+}
+
+KERNEL_TARGET_AVX2
+static void PackS16Avx2(void *Out, const float32 *In, int32 Count, float32 Dither, uint32_t *Seed)
+{
+    int16_t *Dst = Out;
+    __m256 Scale = _mm256_set1_ps(32768.0f);
+    __m256 Low = _mm256_set1_ps(-32768.0f);
+    __m256 High = _mm256_set1_ps(32767.0f);
+    __m256 Amount = _mm256_set1_ps(Dither);
+    __m256i Lanes = _mm256_loadu_si256((const __m256i *)Seed);
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        __m256i Value = PackConvert(In + Index, Scale, Low, High, Amount, &Lanes);
+        __m128i Packed = _mm_packs_epi32(_mm256_castsi256_si128(Value), _mm256_extracti128_si256(Value, 1));
+        _mm_storeu_si128((__m128i *)(Dst + Index), Packed);
+    }
+    _mm256_storeu_si256((__m256i *)Seed, Lanes);
+    PackS16C(Dst + Index, In + Index, Count - Index, Dither, Seed);
+}
+
+KERNEL_TARGET_AVX2
+static void PackS24Avx2(void *Out, const float32 *In, int32 Count, float32 Dither, uint32_t *Seed)
+{
+    uint8_t *Dst = Out;
+    __m256 Scale = _mm256_set1_ps(8388608.0f);
+    __m256 Low = _mm256_set1_ps(-8388608.0f);
+    __m256 High = _mm256_set1_ps(8388607.0f);
+    __m256 Amount = _mm256_set1_ps(Dither);
+    __m256i Lanes = _mm256_loadu_si256((const __m256i *)Seed);
+    // Drop the top byte of every sample, leaving twelve bytes per half.
+    __m256i Shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                       0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int32 Index = 0;
+    // Each half is stored as 16 bytes, the last store spills into the next two samples.
+    for (; Index + 10 <= Count; Index += 8)
+    {
+        __m256i Value = _mm256_shuffle_epi8(PackConvert(In + Index, Scale, Low, High, Amount, &Lanes), Shuffle);
+        _mm_storeu_si128((__m128i *)(Dst + 3*Index), _mm256_castsi256_si128(Value));
+        _mm_storeu_si128((__m128i *)(Dst + 3*Index + 12), _mm256_extracti128_si256(Value, 1));
+    }
+    _mm256_storeu_si256((__m256i *)Seed, Lanes);
+    PackS24C(Dst + 3*Index, In + Index, Count - Index, Dither, Seed);
+}
+
+KERNEL_TARGET_AVX2
+static void PackS32Avx2(void *Out, const float32 *In, int32 Count, float32 Dither, uint32_t *Seed)
+{
+    int32_t *Dst = Out;
+    __m256 Scale = _mm256_set1_ps(2147483648.0f);
+    __m256 Low = _mm256_set1_ps(-2147483648.0f);
+    __m256 High = _mm256_set1_ps(2147483520.0f);
+    __m256 Amount = _mm256_set1_ps(Dither);
+    __m256i Lanes = _mm256_loadu_si256((const __m256i *)Seed);
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        __m256i Value = PackConvert(In + Index, Scale, Low, High, Amount, &Lanes);
+        _mm256_storeu_si256((__m256i *)(Dst + Index), Value);
+    }
+    _mm256_storeu_si256((__m256i *)Seed, Lanes);
+    PackS32C(Dst + Index, In + Index, Count - Index, Dither, Seed);
+}
+
+KERNEL_TARGET_AVX2
+static void PeakAvx2(float32 *Peak, const float32 *In, int32 Count)
+{
+    __m256 SignMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        __m256 Value = _mm256_and_ps(_mm256_loadu_ps(In + Index), SignMask);
+        _mm256_storeu_ps(Peak + Index, _mm256_max_ps(_mm256_loadu_ps(Peak + Index), Value));
+    }
+    PeakC(Peak + Index, In + Index, Count - Index);
+}
+
+// Sixteen samples a step in two sets of sums. The squares add up in single
+// precision per call, which covers the few hundred samples of a peak bucket.
+KERNEL_TARGET_AVX2
+static float64 RangeAvx2(float32 *Range, const float32 *In, int32 Count)
+{
+    __m256 Low = _mm256_set1_ps(Range[0]), High = _mm256_set1_ps(Range[1]);
+    __m256 Energy = _mm256_setzero_ps(), EnergyOdd = _mm256_setzero_ps();
+    int32 Index = 0;
+    for (; Index + 16 <= Count; Index += 16)
+    {
+        __m256 Value = _mm256_loadu_ps(In + Index), ValueOdd = _mm256_loadu_ps(In + Index + 8);
+        Low = _mm256_min_ps(Low, _mm256_min_ps(Value, ValueOdd));
+        High = _mm256_max_ps(High, _mm256_max_ps(Value, ValueOdd));
+        Energy = _mm256_fmadd_ps(Value, Value, Energy);
+        EnergyOdd = _mm256_fmadd_ps(ValueOdd, ValueOdd, EnergyOdd);
+    }
+    float32 Lows[8], Highs[8], Sums[8];
+    _mm256_storeu_ps(Lows, Low);
+    _mm256_storeu_ps(Highs, High);
+    _mm256_storeu_ps(Sums, _mm256_add_ps(Energy, EnergyOdd));
+    float64 Sum = 0.0;
+    for (int32 Lane = 0; Lane < 8; Lane++)
+    {
+        Range[0] = Lows[Lane] < Range[0] ? Lows[Lane] : Range[0];
+        Range[1] = Highs[Lane] > Range[1] ? Highs[Lane] : Range[1];
+        Sum += Sums[Lane];
+    }
+    return Sum + RangeC(Range, In + Index, Count - Index);
+}
+
+KERNEL_TARGET_AVX2
+static void ScaleAvx2(float32 *Out, const float32 *In, const float32 *Gain, int32 Count)
+{
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        _mm256_storeu_ps(Out + Index, _mm256_mul_ps(_mm256_loadu_ps(In + Index), _mm256_loadu_ps(Gain + Index)));
+    }
+    ScaleC(Out + Index, In + Index, Gain + Index, Count - Index);
+}
+
+// Four samples per step, lanes are samples for the outputs and state
+// variables for the state.
+KERNEL_TARGET_AVX2
+static float64 StateEnergyAvx2(const float32 *In, int32 Count, float64 *State, const float64 *Matrix)
+{
+    __m256d S = _mm256_loadu_pd(State);
+    __m256d Sum = _mm256_setzero_pd();
+    int32 Index = 0;
+    for (; Index + 4 <= Count; Index += 4)
+    {
+        __m256d X = _mm256_cvtps_pd(_mm_loadu_ps(In + Index));
+        __m256d X0 = _mm256_permute4x64_pd(X, 0x00);
+        __m256d X1 = _mm256_permute4x64_pd(X, 0x55);
+        __m256d X2 = _mm256_permute4x64_pd(X, 0xAA);
+        __m256d X3 = _mm256_permute4x64_pd(X, 0xFF);
+        __m256d Y = _mm256_mul_pd(X0, _mm256_loadu_pd(Matrix + 16));
+        Y = _mm256_fmadd_pd(X1, _mm256_loadu_pd(Matrix + 20), Y);
+        Y = _mm256_fmadd_pd(X2, _mm256_loadu_pd(Matrix + 24), Y);
+        Y = _mm256_fmadd_pd(X3, _mm256_loadu_pd(Matrix + 28), Y);
+        __m256d N = _mm256_mul_pd(X0, _mm256_loadu_pd(Matrix + 48));
+        N = _mm256_fmadd_pd(X1, _mm256_loadu_pd(Matrix + 52), N);
+        N = _mm256_fmadd_pd(X2, _mm256_loadu_pd(Matrix + 56), N);
+        N = _mm256_fmadd_pd(X3, _mm256_loadu_pd(Matrix + 60), N);
+
+        __m256d S0 = _mm256_permute4x64_pd(S, 0x00);
+        __m256d S1 = _mm256_permute4x64_pd(S, 0x55);
+        __m256d S2 = _mm256_permute4x64_pd(S, 0xAA);
+        __m256d S3 = _mm256_permute4x64_pd(S, 0xFF);
+        __m256d Ya = _mm256_fmadd_pd(S0, _mm256_loadu_pd(Matrix + 0), Y);
+        __m256d Yb = _mm256_mul_pd(S1, _mm256_loadu_pd(Matrix + 4));
+        Ya = _mm256_fmadd_pd(S2, _mm256_loadu_pd(Matrix + 8), Ya);
+        Yb = _mm256_fmadd_pd(S3, _mm256_loadu_pd(Matrix + 12), Yb);
+        __m256d Na = _mm256_fmadd_pd(S0, _mm256_loadu_pd(Matrix + 32), N);
+        __m256d Nb = _mm256_mul_pd(S1, _mm256_loadu_pd(Matrix + 36));
+        Na = _mm256_fmadd_pd(S2, _mm256_loadu_pd(Matrix + 40), Na);
+        Nb = _mm256_fmadd_pd(S3, _mm256_loadu_pd(Matrix + 44), Nb);
+        Y = _mm256_add_pd(Ya, Yb);
+        S = _mm256_add_pd(Na, Nb);
+        Sum = _mm256_fmadd_pd(Y, Y, Sum);
+    }
+    _mm256_storeu_pd(State, S);
+    __m128d Half = _mm_add_pd(_mm256_castpd256_pd128(Sum), _mm256_extractf128_pd(Sum, 1));
+    float64 Total = _mm_cvtsd_f64(_mm_add_sd(Half, _mm_unpackhi_pd(Half, Half)));
+    return Total + StateEnergyStep(In + Index, Count - Index, State, Matrix);
+}
+
+// Rows[r] = column r of the 8x8 block in Rows.
+KERNEL_TARGET_AVX2
+static inline void TransposeAvx2(__m256 *Rows)
+{
+    __m256 Low01 = _mm256_unpacklo_ps(Rows[0], Rows[1]), High01 = _mm256_unpackhi_ps(Rows[0], Rows[1]);
+    __m256 Low23 = _mm256_unpacklo_ps(Rows[2], Rows[3]), High23 = _mm256_unpackhi_ps(Rows[2], Rows[3]);
+    __m256 Low45 = _mm256_unpacklo_ps(Rows[4], Rows[5]), High45 = _mm256_unpackhi_ps(Rows[4], Rows[5]);
+    __m256 Low67 = _mm256_unpacklo_ps(Rows[6], Rows[7]), High67 = _mm256_unpackhi_ps(Rows[6], Rows[7]);
+    __m256 Quad0 = _mm256_shuffle_ps(Low01, Low23, 0x44), Quad1 = _mm256_shuffle_ps(Low01, Low23, 0xEE);
+    __m256 Quad2 = _mm256_shuffle_ps(High01, High23, 0x44), Quad3 = _mm256_shuffle_ps(High01, High23, 0xEE);
+    __m256 Quad4 = _mm256_shuffle_ps(Low45, Low67, 0x44), Quad5 = _mm256_shuffle_ps(Low45, Low67, 0xEE);
+    __m256 Quad6 = _mm256_shuffle_ps(High45, High67, 0x44), Quad7 = _mm256_shuffle_ps(High45, High67, 0xEE);
+    Rows[0] = _mm256_permute2f128_ps(Quad0, Quad4, 0x20);
+    Rows[1] = _mm256_permute2f128_ps(Quad1, Quad5, 0x20);
+    Rows[2] = _mm256_permute2f128_ps(Quad2, Quad6, 0x20);
+    Rows[3] = _mm256_permute2f128_ps(Quad3, Quad7, 0x20);
+    Rows[4] = _mm256_permute2f128_ps(Quad0, Quad4, 0x31);
+    Rows[5] = _mm256_permute2f128_ps(Quad1, Quad5, 0x31);
+    Rows[6] = _mm256_permute2f128_ps(Quad2, Quad6, 0x31);
+    Rows[7] = _mm256_permute2f128_ps(Quad3, Quad7, 0x31);
+}
+
+KERNEL_TARGET_AVX2
+static void InterleaveLanesAvx2(float32 *Data, float32 *const *Planar, int32 Count)
+{
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        __m256 Rows[KERNEL_LANES];
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++) Rows[Lane] = _mm256_loadu_ps(Planar[Lane] + Index);
+        TransposeAvx2(Rows);
+        for (int32 Row = 0; Row < 8; Row++) _mm256_storeu_ps(Data + (Index + Row)*KERNEL_LANES, Rows[Row]);
+    }
+    for (; Index < Count; Index++)
+    {
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++) Data[Index*KERNEL_LANES + Lane] = Planar[Lane][Index];
+    }
+}
+
+KERNEL_TARGET_AVX2
+static void DeinterleaveLanesAvx2(float32 *const *Planar, const float32 *Data, int32 Count)
+{
+    int32 Index = 0;
+    for (; Index + 8 <= Count; Index += 8)
+    {
+        __m256 Rows[KERNEL_LANES];
+        for (int32 Row = 0; Row < 8; Row++) Rows[Row] = _mm256_loadu_ps(Data + (Index + Row)*KERNEL_LANES);
+        TransposeAvx2(Rows);
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++) _mm256_storeu_ps(Planar[Lane] + Index, Rows[Lane]);
+    }
+    for (; Index < Count; Index++)
+    {
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++) Planar[Lane][Index] = Data[Index*KERNEL_LANES + Lane];
+    }
+}
+
+KERNEL_TARGET_AVX2
+static void BiquadLaneAvx2(float32 *Data, int32 Count, const float32 *Coefficients, float32 *State)
+{
+    __m256 B0 = _mm256_loadu_ps(Coefficients), B1 = _mm256_loadu_ps(Coefficients + KERNEL_LANES);
+    __m256 B2 = _mm256_loadu_ps(Coefficients + 2*KERNEL_LANES), A1 = _mm256_loadu_ps(Coefficients + 3*KERNEL_LANES);
+    __m256 A2 = _mm256_loadu_ps(Coefficients + 4*KERNEL_LANES);
+    __m256 S1 = _mm256_loadu_ps(State), S2 = _mm256_loadu_ps(State + KERNEL_LANES);
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        __m256 X = _mm256_loadu_ps(Data + Index*KERNEL_LANES);
+        __m256 Y = _mm256_fmadd_ps(B0, X, S1);
+        S1 = _mm256_fnmadd_ps(A1, Y, _mm256_fmadd_ps(B1, X, S2));
+        S2 = _mm256_fnmadd_ps(A2, Y, _mm256_mul_ps(B2, X));
+        _mm256_storeu_ps(Data + Index*KERNEL_LANES, Y);
+    }
+    _mm256_storeu_ps(State, S1);
+    _mm256_storeu_ps(State + KERNEL_LANES, S2);
+}
+
+// Three stages per pass over the frames, so the recursions of the stages
+// overlap instead of each one waiting on its own feedback. Two stages run as
+// three with the last one passing through.
+KERNEL_TARGET_AVX2
+static void BiquadLanesAvx2(float32 *Data, int32 Count, const float32 *Coefficients, float32 *State, int32 StageCount)
+{
+    for (; StageCount == 1 || StageCount > 3; StageCount--)
+    {
+        BiquadLaneAvx2(Data, Count, Coefficients, State);
+        Coefficients += 5*KERNEL_LANES;
+        State += 2*KERNEL_LANES;
+    }
+    if (StageCount == 0) return;
+
+    const float32 *C = Coefficients;
+    __m256 Pass = _mm256_setzero_ps();
+    __m256 B0a = _mm256_loadu_ps(C), B1a = _mm256_loadu_ps(C + 8), B2a = _mm256_loadu_ps(C + 16);
+    __m256 A1a = _mm256_loadu_ps(C + 24), A2a = _mm256_loadu_ps(C + 32);
+    __m256 B0b = _mm256_loadu_ps(C + 40), B1b = _mm256_loadu_ps(C + 48), B2b = _mm256_loadu_ps(C + 56);
+    __m256 A1b = _mm256_loadu_ps(C + 64), A2b = _mm256_loadu_ps(C + 72);
+    __m256 B0c = StageCount == 3 ? _mm256_loadu_ps(C + 80) : _mm256_set1_ps(1.0f);
+    __m256 B1c = StageCount == 3 ? _mm256_loadu_ps(C + 88) : Pass;
+    __m256 B2c = StageCount == 3 ? _mm256_loadu_ps(C + 96) : Pass;
+    __m256 A1c = StageCount == 3 ? _mm256_loadu_ps(C + 104) : Pass;
+    __m256 A2c = StageCount == 3 ? _mm256_loadu_ps(C + 112) : Pass;
+    __m256 S1a = _mm256_loadu_ps(State), S2a = _mm256_loadu_ps(State + 8);
+    __m256 S1b = _mm256_loadu_ps(State + 16), S2b = _mm256_loadu_ps(State + 24);
+    __m256 S1c = StageCount == 3 ? _mm256_loadu_ps(State + 32) : Pass;
+    __m256 S2c = StageCount == 3 ? _mm256_loadu_ps(State + 40) : Pass;
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        __m256 X = _mm256_loadu_ps(Data + Index*KERNEL_LANES);
+        __m256 Ya = _mm256_fmadd_ps(B0a, X, S1a);
+        S1a = _mm256_fnmadd_ps(A1a, Ya, _mm256_fmadd_ps(B1a, X, S2a));
+        S2a = _mm256_fnmadd_ps(A2a, Ya, _mm256_mul_ps(B2a, X));
+        __m256 Yb = _mm256_fmadd_ps(B0b, Ya, S1b);
+        S1b = _mm256_fnmadd_ps(A1b, Yb, _mm256_fmadd_ps(B1b, Ya, S2b));
+        S2b = _mm256_fnmadd_ps(A2b, Yb, _mm256_mul_ps(B2b, Ya));
+        __m256 Yc = _mm256_fmadd_ps(B0c, Yb, S1c);
+        S1c = _mm256_fnmadd_ps(A1c, Yc, _mm256_fmadd_ps(B1c, Yb, S2c));
+        S2c = _mm256_fnmadd_ps(A2c, Yc, _mm256_mul_ps(B2c, Yb));
+        _mm256_storeu_ps(Data + Index*KERNEL_LANES, Yc);
+    }
+    _mm256_storeu_ps(State, S1a);
+    _mm256_storeu_ps(State + 8, S2a);
+    _mm256_storeu_ps(State + 16, S1b);
+    _mm256_storeu_ps(State + 24, S2b);
+    if (StageCount < 3) return;
+    _mm256_storeu_ps(State + 32, S1c);
+    _mm256_storeu_ps(State + 40, S2c);
+}
+
+// Same approximations as Log2C() and Exp2C().
+KERNEL_TARGET_AVX2
+static __m256 Log2Avx2(__m256 X)
+{
+    __m256i Bits = _mm256_castps_si256(X);
+    __m256 Exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(Bits, 23), _mm256_set1_epi32(127)));
+    __m256 Mantissa = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(Bits, _mm256_set1_epi32(0x7FFFFF)),
+                                                          _mm256_set1_epi32(0x3F800000)));
+    __m256 High = _mm256_cmp_ps(Mantissa, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+    Mantissa = _mm256_blendv_ps(Mantissa, _mm256_mul_ps(Mantissa, _mm256_set1_ps(0.5f)), High);
+    Exponent = _mm256_add_ps(Exponent, _mm256_and_ps(High, _mm256_set1_ps(1.0f)));
+    __m256 One = _mm256_set1_ps(1.0f);
+    __m256 T = _mm256_div_ps(_mm256_sub_ps(Mantissa, One), _mm256_add_ps(Mantissa, One));
+    __m256 T2 = _mm256_mul_ps(T, T);
+    __m256 Series = _mm256_fmadd_ps(T2, _mm256_set1_ps(0.41219858f), _mm256_set1_ps(0.57707802f));
+    Series = _mm256_fmadd_ps(T2, Series, _mm256_set1_ps(0.96179669f));
+    Series = _mm256_fmadd_ps(T2, Series, _mm256_set1_ps(2.88539008f));
+    return _mm256_fmadd_ps(T, Series, Exponent);
+}
+
+KERNEL_TARGET_AVX2
+static __m256 Exp2Avx2(__m256 X)
+{
+    X = _mm256_min_ps(_mm256_max_ps(X, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(126.0f));
+    __m256 Whole = _mm256_floor_ps(_mm256_add_ps(X, _mm256_set1_ps(0.5f)));
+    __m256 F = _mm256_sub_ps(X, Whole);
+    __m256 Series = _mm256_fmadd_ps(F, _mm256_set1_ps(0.00133336f), _mm256_set1_ps(0.00961813f));
+    Series = _mm256_fmadd_ps(F, Series, _mm256_set1_ps(0.05550411f));
+    Series = _mm256_fmadd_ps(F, Series, _mm256_set1_ps(0.24022651f));
+    Series = _mm256_fmadd_ps(F, Series, _mm256_set1_ps(0.69314718f));
+    Series = _mm256_fmadd_ps(F, Series, _mm256_set1_ps(1.0f));
+    __m256i Scale = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(Whole), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(_mm256_castsi256_ps(Scale), Series);
+}
+
+KERNEL_TARGET_AVX2
+static void CompressLanesAvx2(float32 *const *Data, int32 ChannelCount, int32 Count, const float32 *Params,
+                              float32 *Envelope)
+{
+    __m256 Threshold = _mm256_loadu_ps(Params);
+    __m256 Makeup = _mm256_loadu_ps(Params + KERNEL_LANES);
+    __m256 Slope = _mm256_loadu_ps(Params + 2*KERNEL_LANES);
+    __m256 Attack = _mm256_loadu_ps(Params + 3*KERNEL_LANES);
+    __m256 Release = _mm256_loadu_ps(Params + 4*KERNEL_LANES);
+    __m256 SignMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 Level = _mm256_loadu_ps(Envelope);
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        __m256 Peak = _mm256_setzero_ps();
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            Peak = _mm256_max_ps(Peak, _mm256_and_ps(_mm256_loadu_ps(Data[Channel] + Index*KERNEL_LANES), SignMask));
+        }
+        __m256 Rate = _mm256_blendv_ps(Release, Attack, _mm256_cmp_ps(Peak, Level, _CMP_GT_OQ));
+        Level = _mm256_fmadd_ps(_mm256_sub_ps(Peak, Level), Rate, Level);
+        __m256 Over = _mm256_sub_ps(Log2Avx2(_mm256_add_ps(Level, _mm256_set1_ps(1e-30f))), Threshold);
+        __m256 Gain = Exp2Avx2(_mm256_fnmadd_ps(Slope, _mm256_max_ps(Over, _mm256_setzero_ps()), Makeup));
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            float32 *Frame = Data[Channel] + Index*KERNEL_LANES;
+            _mm256_storeu_ps(Frame, _mm256_mul_ps(_mm256_loadu_ps(Frame), Gain));
+        }
+    }
+    _mm256_storeu_ps(Envelope, Level);
+}
+
+// Eight bins at a time through every term, so the sums stay in registers
+// and each product only costs its loads. The real part keeps its two
+// products in separate sums to halve the dependency chains.
+KERNEL_TARGET_AVX2
+static void SpectrumSumAvx2(float32 *Out, const float32 *const *X, const float32 *const *H, int32 TermCount, int32 Stride)
+{
+    for (int32 Bin = 0; Bin < Stride; Bin += 8)
+    {
+        __m256 Real = _mm256_setzero_ps(), RealCross = _mm256_setzero_ps();
+        __m256 Imag = _mm256_setzero_ps(), ImagCross = _mm256_setzero_ps();
+        for (int32 Term = 0; Term < TermCount; Term++)
+        {
+            __m256 XRe = _mm256_loadu_ps(X[Term] + Bin), XIm = _mm256_loadu_ps(X[Term] + Stride + Bin);
+            __m256 HRe = _mm256_loadu_ps(H[Term] + Bin), HIm = _mm256_loadu_ps(H[Term] + Stride + Bin);
+            Real = _mm256_fmadd_ps(XRe, HRe, Real);
+            RealCross = _mm256_fmadd_ps(XIm, HIm, RealCross);
+            Imag = _mm256_fmadd_ps(XRe, HIm, Imag);
+            ImagCross = _mm256_fmadd_ps(XIm, HRe, ImagCross);
+        }
+        _mm256_storeu_ps(Out + Bin, _mm256_sub_ps(Real, RealCross));
+        _mm256_storeu_ps(Out + Stride + Bin, _mm256_add_ps(Imag, ImagCross));
+    }
+}
+
+static const KernelTable KernelsAvx2 = {"avx2", MixAvx2, TrackGainsAvx2, MixEnvelopeAvx2, RampAvx2, RampExpAvx2, CurveAvx2,
+                                        PolyphaseAvx2, PackS16Avx2, PackS24Avx2, PackS32Avx2, PeakAvx2, ScaleAvx2,
+                                        StateEnergyAvx2, InterleaveLanesAvx2, DeinterleaveLanesAvx2, BiquadLanesAvx2,
+                                        CompressLanesAvx2, SpectrumSumAvx2, RangeAvx2};
+#endif
+
+const KernelTable *KernelSelect(void)
+{
+#ifdef KERNEL_HAVE_AVX2
+    int32 Flags = av_get_cpu_flags();
+    if ((Flags & AV_CPU_FLAG_AVX2) && (Flags & AV_CPU_FLAG_FMA3)) return &KernelsAvx2;
+#endif
+    return &KernelsC;
+}
@@ -0,0 +1,131 @@
+#ifndef MIXER_KERNEL_H
+#define MIXER_KERNEL_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+// Inner loops of the mixer. Every kernel has a portable C version and, where
+// the compiler can target x86, an AVX2 version. The set is picked at run time
+// from av_get_cpu_flags(), so one binary runs on any CPU and uses AVX2 where
+// it is available.
+
+// Dst[i] += (Gain + i*GainStep)*Src[i] for i in [0, Count).
+typedef void (*KernelMixFunc)(float32 *Dst, const float32 *Src, int32 Count, float32 Gain, float32 GainStep);
+
+// Target[c][t] = per channel gain of track t from its Gain, Pan and Audible
+// (0 or 1). Pan balances stereo output between -1 (left) and 1 (right) and
+// is ignored for other channel counts. Arrays are read in groups of eight
+// tracks, Count may be any value.
+typedef void (*KernelTrackGainsFunc)(float32 **Target, const float32 *Gain, const float32 *Pan, const float32 *Audible,
+                                     int32 Count, int32 ChannelCount);
+
+// Dst[i] += (Gain + i*GainStep)*Envelope[i]*Src[i], one multiply and one
+// fused multiply-add per sample.
+typedef void (*KernelMixEnvelopeFunc)(float32 *Dst, const float32 *Src, const float32 *Envelope, int32 Count,
+                                      float32 Gain, float32 GainStep);
+
+// Out[i] = Start + i*Step.
+typedef void (*KernelRampFunc)(float32 *Out, int32 Count, float32 Start, float32 Step);
+
+// Out[i] = Start*Ratio^i, a constant change in dB per sample.
+typedef void (*KernelRampExpFunc)(float32 *Out, int32 Count, float32 Start, float32 Ratio);
+
+// Out[i] *= Table at Position + i*Step, with positions clamped to [0, 1] and
+// Table holding Size + 1 points over that range, linearly interpolated.
+typedef void (*KernelCurveFunc)(float32 *Out, int32 Count, const float32 *Table, int32 Size, float32 Position, float32 Step);
+
+// Polyphase filter: Out[n] = sum of Filter[p*TapCount + t]*In[i + t] over
+// the TapCount taps, for n in [0, Count). Output 0 uses phase p = Phase and
+// i = 0, every output adds Step to the phase and carries each PhaseCount
+// into i. TapCount is a multiple of 8.
+typedef void (*KernelPolyphaseFunc)(float32 *Out, int32 Count, const float32 *In, const float32 *Filter,
+                                    int32 TapCount, int32 PhaseCount, int32 Step, int32 Phase);
+
+// Convert Count float samples in [-1, 1] to signed integers, clipping what
+// lies outside. Dither adds triangular noise of that many LSBs peak, drawn
+// from eight xorshift generators in Seed, sample i using Seed[i % 8].
+// PackS24 writes three little-endian bytes per sample.
+typedef void (*KernelPackFunc)(void *Out, const float32 *In, int32 Count, float32 Dither, uint32_t *Seed);
+
+// Peak[i] = max(Peak[i], |In[i]|).
+typedef void (*KernelPeakFunc)(float32 *Peak, const float32 *In, int32 Count);
+
+// Range[0] = min(Range[0], In[i]) and Range[1] = max(Range[1], In[i]) over
+// the Count samples, returns the sum of In[i]*In[i].
+typedef float64 (*KernelRangeFunc)(float32 *Range, const float32 *In, int32 Count);
+
+// Out[i] = In[i]*Gain[i].
+typedef void (*KernelScaleFunc)(float32 *Out, const float32 *In, const float32 *Gain, int32 Count);
+
+// Fourth order filter in state space form, y = C.s + D*x then s = A*s + B*x,
+// over Count samples of In. Returns the sum of y*y and leaves the state of
+// the last sample in State[4]. Matrix holds KERNEL_STATE_MATRIX values made
+// by KernelStateMatrix(), which steps four samples at a time.
+#define KERNEL_STATE_MATRIX     92
+typedef float64 (*KernelStateEnergyFunc)(const float32 *In, int32 Count, float64 *State, const float64 *Matrix);
+
+// Lane data carries eight tracks at once, Data[i*KERNEL_LANES + l] is frame
+// i of track l, and every per track value is an array of KERNEL_LANES.
+#define KERNEL_LANES            8
+
+// Data[i*KERNEL_LANES + l] = Planar[l][i] for i in [0, Count), lane data
+// from one block of each of eight tracks.
+typedef void (*KernelInterleaveLanesFunc)(float32 *Data, float32 *const *Planar, int32 Count);
+
+// Planar[l][i] = Data[i*KERNEL_LANES + l], the reverse.
+typedef void (*KernelDeinterleaveLanesFunc)(float32 *const *Planar, const float32 *Data, int32 Count);
+
+// StageCount biquads in series per lane, in transposed direct form II, in
+// place over Count frames of lane data. Each stage has b0, b1, b2, a1 and a2
+// (a0 = 1) in Coefficients and its two state variables in State.
+typedef void (*KernelBiquadLanesFunc)(float32 *Data, int32 Count, const float32 *Coefficients, float32 *State,
+                                      int32 StageCount);
+
+// Feed forward compressor per lane on ChannelCount channels of lane data,
+// with the detector linked across channels. Params holds the threshold and
+// the makeup gain as log2 of a linear level, the slope 1 - 1/ratio and the
+// attack and release coefficients of the peak follower, in that order, and
+// Envelope the follower of each lane.
+#define KERNEL_COMPRESSOR_PARAMS 5
+typedef void (*KernelCompressLanesFunc)(float32 *const *Data, int32 ChannelCount, int32 Count, const float32 *Params,
+                                        float32 *Envelope);
+
+// Sum of the products of TermCount pairs of spectra, Out = sum X[t]*H[t].
+// Every spectrum stores the real parts of its bins at [0, Stride) and the
+// imaginary parts at [Stride, 2*Stride), Out the same way. Stride is a
+// multiple of 8.
+typedef void (*KernelSpectrumSumFunc)(float32 *Out, const float32 *const *X, const float32 *const *H, int32 TermCount,
+                                      int32 Stride);
+
+typedef struct KernelTable
+{
+    const char *Name;
+    KernelMixFunc Mix;
+    KernelTrackGainsFunc TrackGains;
+    KernelMixEnvelopeFunc MixEnvelope;
+    KernelRampFunc Ramp;
+    KernelRampExpFunc RampExp;
+    KernelCurveFunc Curve;
+    KernelPolyphaseFunc Polyphase;
+    KernelPackFunc PackS16;
+    KernelPackFunc PackS24;
+    KernelPackFunc PackS32;
+    KernelPeakFunc Peak;
+    KernelScaleFunc Scale;
+    KernelStateEnergyFunc StateEnergy;
+    KernelInterleaveLanesFunc InterleaveLanes;
+    KernelDeinterleaveLanesFunc DeinterleaveLanes;
+    KernelBiquadLanesFunc BiquadLanes;
+    KernelCompressLanesFunc CompressLanes;
+    KernelSpectrumSumFunc SpectrumSum;
+    KernelRangeFunc Range;
+} KernelTable;
+
+// The fastest kernels the CPU supports, honouring av_force_cpu_flags().
+const KernelTable *KernelSelect(void);
+
+// Fill Matrix for KernelStateEnergyFunc from A (row major), B, C and D.
+void KernelStateMatrix(float64 *Matrix, const float64 *A, const float64 *B, const float64 *C, float64 D);
+
+#endif
@@ -0,0 +1,216 @@
+#include <math.h>
+#include <string.h>
+
+#include <libavutil/mem.h>
+
+#include "limiter.h"
+
+int32 LimiterOpen(Limiter **Result, int32 SampleRate, int32 ChannelCount, float32 CeilingDb, float32 LookaheadMs,
+                  float32 ReleaseMs, int32 Flags)
+{
+    *Result = NULL;
+    if (SampleRate <= 0 || ChannelCount <= 0 || ChannelCount > MIXER_MAX_CHANNELS) return MIXER_ERR_ARG;
+    if (LookaheadMs < 0 || ReleaseMs <= 0 || CeilingDb > 0) return MIXER_ERR_ARG;
+
+    Limiter *Lim = av_mallocz(sizeof(Limiter));
+    if (Lim == NULL) return MIXER_ERR_NOMEM;
+    *Result = Lim;
+
+    Lim->Kernels = KernelSelect();
+    Lim->ChannelCount = ChannelCount;
+    Lim->Ceiling = powf(10.0f, CeilingDb/20);
+    Lim->Release = 1.0f - expf(-1.0f/(ReleaseMs*1e-3f*SampleRate));
+    Lim->Window = (int32)(LookaheadMs*1e-3f*SampleRate + 0.5f) + 1;
+    Lim->Gain = 1.0f;
+
+    // The oversampler only has output for an input sample once half its
+    // filter has been written after it, which delays detection.
+    int32 DetectDelay = 0;
+    if (Flags & LIMITER_TRUE_PEAK)
+    {
+        const ResampleFilter *Filter = ResampleFilterGet(&Lim->Filters, SampleRate, 4*SampleRate, MIXER_RESAMPLE_FAST);
+        Lim->Oversampler = av_mallocz(sizeof(ResampleState));
+        if (Filter == NULL || Lim->Oversampler == NULL) return MIXER_ERR_NOMEM;
+        int32 Ret = ResampleInit(Lim->Oversampler, Filter, ChannelCount);
+        if (Ret < 0) return Ret;
+        // The filter's history never exceeds its length once read, so room for
+        // it and a chunk means LimiterProcess() never has to allocate.
+        float32 *In[MIXER_MAX_CHANNELS];
+        Ret = ResampleReserve(Lim->Oversampler, Filter->TapCount + LIMITER_CHUNK, In);
+        if (Ret < 0) return Ret;
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            Lim->Oversampled[Channel] = av_malloc(4*LIMITER_CHUNK*sizeof(float32));
+            if (Lim->Oversampled[Channel] == NULL) return MIXER_ERR_NOMEM;
+        }
+        DetectDelay = Filter->TapCount/2;
+    }
+    Lim->Latency = Lim->Window - 1 + DetectDelay;
+
+    Lim->DequeGain = av_malloc(Lim->Window*sizeof(float32));
+    Lim->DequeIndex = av_malloc(Lim->Window*sizeof(int64));
+    Lim->Average = av_malloc(Lim->Window*sizeof(float32));
+    Lim->Gains = av_malloc((LIMITER_CHUNK + DetectDelay)*sizeof(float32));
+    Lim->Peak = av_malloc(4*LIMITER_CHUNK*sizeof(float32));
+    if (Lim->DequeGain == NULL || Lim->DequeIndex == NULL || Lim->Average == NULL || Lim->Gains == NULL ||
+        Lim->Peak == NULL) return MIXER_ERR_NOMEM;
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        Lim->Delay[Channel] = av_mallocz((Lim->Latency + LIMITER_CHUNK)*sizeof(float32));
+        if (Lim->Delay[Channel] == NULL) return MIXER_ERR_NOMEM;
+    }
+
+    // Everything before the first sample is silence that needs no reduction,
+    // including the samples the detector has not caught up with yet.
+    for (int32 Index = 0; Index < Lim->Window; Index++)
+    {
+        Lim->Average[Index] = 1.0f;
+    }
+    Lim->AverageSum = Lim->Window;
+    for (int32 Index = 0; Index < DetectDelay; Index++)
+    {
+        Lim->Gains[Index] = 1.0f;
+    }
+    Lim->GainCount = DetectDelay;
+
+    return MIXER_OK;
+}
+
+void LimiterClose(Limiter **Result)
+{
+    Limiter *Lim = *Result;
+    if (Lim == NULL) return;
+
+    if (Lim->Oversampler != NULL) ResampleFree(Lim->Oversampler);
+    av_free(Lim->Oversampler);
+    ResampleCacheFree(&Lim->Filters);
+    for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+    {
+        av_free(Lim->Oversampled[Channel]);
+        av_free(Lim->Delay[Channel]);
+    }
+    av_free(Lim->DequeGain);
+    av_free(Lim->DequeIndex);
+    av_free(Lim->Average);
+    av_free(Lim->Gains);
+    av_free(Lim->Peak);
+    av_freep(Result);
+}
+
+int32 LimiterLatency(const Limiter *Lim)
+{
+    return Lim->Latency;
+}
+
+// Peak of every channel for each detector sample of Count input samples
+// into Lim->Peak, returns how many detector samples there are.
+static int32 LimiterDetect(Limiter *Lim, float32 **Channels, int32 Offset, int32 Count)
+{
+    if (Lim->Oversampler == NULL)
+    {
+        memset(Lim->Peak, 0, Count*sizeof(float32));
+        for (int32 Channel = 0; Channel < Lim->ChannelCount; Channel++)
+        {
+            Lim->Kernels->Peak(Lim->Peak, Channels[Channel] + Offset, Count);
+        }
+        return Count;
+    }
+
+    // Reserved in LimiterOpen(), this cannot fail.
+    float32 *In[MIXER_MAX_CHANNELS];
+    ResampleReserve(Lim->Oversampler, Count, In);
+    for (int32 Channel = 0; Channel < Lim->ChannelCount; Channel++)
+    {
+        memcpy(In[Channel], Channels[Channel] + Offset, Count*sizeof(float32));
+    }
+    ResampleCommit(Lim->Oversampler, Count);
+    // Every input sample past the filter's delay gives four outputs.
+    int32 Oversampled = ResampleRead(Lim->Oversampler, Lim->Oversampled, 4*LIMITER_CHUNK);
+    memset(Lim->Peak, 0, Oversampled*sizeof(float32));
+    for (int32 Channel = 0; Channel < Lim->ChannelCount; Channel++)
+    {
+        Lim->Kernels->Peak(Lim->Peak, Lim->Oversampled[Channel], Oversampled);
+    }
+    int32 DetectCount = Oversampled/4;
+    for (int32 Index = 0; Index < DetectCount; Index++)
+    {
+        const float32 *Group = Lim->Peak + 4*Index;
+        float32 Value = Group[0] > Group[1] ? Group[0] : Group[1];
+        Value = Group[2] > Value ? Group[2] : Value;
+        Lim->Peak[Index] = Group[3] > Value ? Group[3] : Value;
+    }
+    return DetectCount;
+}
+
+// Turn detector samples into gains, one per sample, appended to Lim->Gains.
+static void LimiterGains(Limiter *Lim, int32 DetectCount)
+{
+    int32 Window = Lim->Window;
+    float64 Scale = 1.0/Window;
+    float32 Ceiling = Lim->Ceiling;
+    float32 Gain = Lim->Gain;
+    float32 *Gains = Lim->Gains + Lim->GainCount;
+    for (int32 Index = 0; Index < DetectCount; Index++)
+    {
+        float32 Peak = Lim->Peak[Index];
+        float32 Wanted = Peak > Ceiling ? Ceiling/Peak : 1.0f;
+        int64 DetectIndex = Lim->DetectCount++;
+
+        if (Lim->DequeCount > 0 && Lim->DequeIndex[Lim->DequeHead] <= DetectIndex - Window)
+        {
+            Lim->DequeHead = Lim->DequeHead + 1 == Window ? 0 : Lim->DequeHead + 1;
+            Lim->DequeCount--;
+        }
+        // Entries at least as large as the new one can never be the minimum again.
+        while (Lim->DequeCount > 0)
+        {
+            int32 Back = Lim->DequeHead + Lim->DequeCount - 1;
+            if (Back >= Window) Back -= Window;
+            if (Lim->DequeGain[Back] < Wanted) break;
+            Lim->DequeCount--;
+        }
+        int32 Back = Lim->DequeHead + Lim->DequeCount;
+        if (Back >= Window) Back -= Window;
+        Lim->DequeGain[Back] = Wanted;
+        Lim->DequeIndex[Back] = DetectIndex;
+        Lim->DequeCount++;
+        float32 Held = Lim->DequeGain[Lim->DequeHead];
+
+        Lim->AverageSum += Held - Lim->Average[Lim->AveragePosition];
+        Lim->Average[Lim->AveragePosition] = Held;
+        Lim->AveragePosition = Lim->AveragePosition + 1 == Window ? 0 : Lim->AveragePosition + 1;
+        float32 Target = (float32)(Lim->AverageSum*Scale);
+
+        if (Target < Gain) Gain = Target;
+        else Gain += (Target - Gain)*Lim->Release;
+        Gains[Index] = Gain;
+    }
+    Lim->Gain = Gain;
+    Lim->GainCount += DetectCount;
+}
+
+void LimiterProcess(void *State, float32 **Channels, int32 ChannelCount, int32 SampleCount)
+{
+    Limiter *Lim = (Limiter *)State;
+    int32 Latency = Lim->Latency;
+    if (ChannelCount != Lim->ChannelCount) return;
+
+    for (int32 Offset = 0; Offset < SampleCount; Offset += LIMITER_CHUNK)
+    {
+        int32 Count = SampleCount - Offset < LIMITER_CHUNK ? SampleCount - Offset : LIMITER_CHUNK;
+
+        // Gains for this pass may depend on peaks within it.
+        LimiterGains(Lim, LimiterDetect(Lim, Channels, Offset, Count));
+        if (Lim->GainCount < Count) return;
+
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            float32 *Delay = Lim->Delay[Channel];
+            memcpy(Delay + Latency, Channels[Channel] + Offset, Count*sizeof(float32));
+            Lim->Kernels->Scale(Channels[Channel] + Offset, Delay, Lim->Gains, Count);
+            memmove(Delay, Delay + Count, Latency*sizeof(float32));
+        }
+        Lim->GainCount -= Count;
+        memmove(Lim->Gains, Lim->Gains + Count, Lim->GainCount*sizeof(float32));
+    }
+}
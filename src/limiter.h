@@ -0,0 +1,76 @@
+#ifndef MIXER_LIMITER_H
+#define MIXER_LIMITER_H
+
+#include "kernel.h"
+#include "mixer.h"
+#include "resample.h"
+
+// Brickwall lookahead limiter, meant as the last effect on the master bus.
+// The gain needed to keep each sample under the ceiling is held at its
+// minimum over the lookahead window and smoothed by a moving average of the
+// same length, so the gain ramps down over the lookahead and reaches its
+// target exactly at the peak; it recovers with an exponential release.
+//
+// The output is delayed by LimiterLatency() samples, which the mixer
+// compensates when the limiter is added with MixerAddTimedEffect().
+
+// Detect peaks between samples on a 4x oversampled copy, as the true peak
+// meters of BS.1770 do, instead of on the samples themselves.
+#define LIMITER_TRUE_PEAK       1
+
+// Samples processed per pass, longer blocks are split.
+#define LIMITER_CHUNK           1024
+
+typedef struct Limiter
+{
+    const KernelTable *Kernels;
+    int32 ChannelCount;
+    float32 Ceiling;            // Linear.
+    float32 Release;            // Fraction of the distance to the target gain recovered per sample.
+    int32 Window;               // Lookahead plus one, the length of the minimum and of the average.
+    int32 Latency;
+
+    // Minimum of the required gain over the last Window detector samples,
+    // increasing from the front.
+    float32 *DequeGain;
+    int64 *DequeIndex;
+    int32 DequeHead;
+    int32 DequeCount;
+    int64 DetectCount;
+
+    // Moving average of the held minimum.
+    float32 *Average;
+    int32 AveragePosition;
+    float64 AverageSum;
+    float32 Gain;               // Last gain after the release.
+
+    // Gains computed but not applied yet, Gains[0] belongs to the oldest
+    // sample of the delay line.
+    float32 *Gains;
+    int32 GainCount;
+
+    // Latency samples of history followed by the samples of this pass.
+    float32 *Delay[MIXER_MAX_CHANNELS];
+    float32 *Peak;
+
+    // 4x oversampling for true peak detection, NULL for sample peaks.
+    ResampleFilter *Filters;
+    ResampleState *Oversampler;
+    float32 *Oversampled[MIXER_MAX_CHANNELS];
+} Limiter;
+
+// Keep SampleRate audio of ChannelCount channels under CeilingDb (dBFS, or
+// dBTP with LIMITER_TRUE_PEAK) with LookaheadMs of lookahead and a release
+// time constant of ReleaseMs.
+int32 LimiterOpen(Limiter **Result, int32 SampleRate, int32 ChannelCount, float32 CeilingDb, float32 LookaheadMs,
+                  float32 ReleaseMs, int32 Flags);
+
+void LimiterClose(Limiter **Result);
+
+// Delay of the output in samples.
+int32 LimiterLatency(const Limiter *Lim);
+
+// A MixerEffectFunc, State is the Limiter.
+void LimiterProcess(void *State, float32 **Channels, int32 ChannelCount, int32 SampleCount);
+
+#endif
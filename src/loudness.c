@@ -0,0 +1,297 @@
+#include <math.h>
+#include <string.h>
+
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+
+#include "loudness.h"
+#include "source.h"
+
+int32 LoudnessInit(LoudnessMeter *Meter, int32 SampleRate, int32 ChannelCount)
+{
+    if (SampleRate <= 0 || ChannelCount <= 0 || ChannelCount > MIXER_MAX_CHANNELS) return MIXER_ERR_ARG;
+
+    memset(Meter, 0, sizeof(LoudnessMeter));
+    Meter->ChannelCount = ChannelCount;
+    int64 Layout = av_get_default_channel_layout(ChannelCount);
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        uint64_t Id = av_channel_layout_extract_channel(Layout, Channel);
+        if (Id == AV_CH_LOW_FREQUENCY) Meter->Weight[Channel] = 0.0;
+        else if (Id & (AV_CH_SIDE_LEFT | AV_CH_SIDE_RIGHT | AV_CH_BACK_LEFT | AV_CH_BACK_RIGHT)) Meter->Weight[Channel] = 1.41;
+        else Meter->Weight[Channel] = 1.0;
+    }
+
+    // The BS.1770 filters, specified at 48 kHz, through the bilinear
+    // transform at SampleRate. First a high shelf b0 b1 b2 / 1 a1 a2 ...
+    float64 K = tan(M_PI*1681.974450955533/SampleRate);
+    float64 Q = 0.7071752369554196;
+    float64 Vh = pow(10.0, 3.999843853973347/20);
+    float64 Vb = pow(Vh, 0.4996667741545416);
+    float64 A0 = 1.0 + K/Q + K*K;
+    float64 B0 = (Vh + Vb*K/Q + K*K)/A0;
+    float64 B1 = 2.0*(K*K - Vh)/A0;
+    float64 B2 = (Vh - Vb*K/Q + K*K)/A0;
+    float64 A1 = 2.0*(K*K - 1.0)/A0;
+    float64 A2 = (1.0 - K/Q + K*K)/A0;
+    // ... then a high pass 1 -2 1 / 1 h1 h2.
+    K = tan(M_PI*38.13547087602444/SampleRate);
+    Q = 0.5003270373238773;
+    A0 = 1.0 + K/Q + K*K;
+    float64 H1 = 2.0*(K*K - 1.0)/A0;
+    float64 H2 = (1.0 - K/Q + K*K)/A0;
+
+    // With y = b0 x + s0 out of the shelf and z = y + s2 out of the high
+    // pass, the four transposed direct form II states advance as
+    //   s0 = b1 x - a1 y + s1,  s1 = b2 x - a2 y,
+    //   s2 = -2 y - h1 z + s3,  s3 = y - h2 z.
+    float64 A[16] = {-A1, 1.0, 0.0, 0.0,
+                     -A2, 0.0, 0.0, 0.0,
+                     -(2.0 + H1), 0.0, -H1, 1.0,
+                     1.0 - H2, 0.0, -H2, 0.0};
+    float64 B[4] = {B1 - A1*B0, B2 - A2*B0, -(2.0 + H1)*B0, (1.0 - H2)*B0};
+    float64 C[4] = {1.0, 0.0, 1.0, 0.0};
+    KernelStateMatrix(Meter->Filter, A, B, C, B0);
+    Meter->Kernels = KernelSelect();
+
+    Meter->QuarterLength = (SampleRate + 5)/10;
+    return MIXER_OK;
+}
+
+void LoudnessFree(LoudnessMeter *Meter)
+{
+    av_freep(&Meter->Blocks);
+    Meter->BlockCount = 0;
+    Meter->BlockCapacity = 0;
+}
+
+static void LoudnessQuarterEnd(LoudnessMeter *Meter)
+{
+    if (Meter->QuarterCount == 4) memmove(Meter->Quarters, Meter->Quarters + 1, 3*sizeof(float64));
+    else Meter->QuarterCount++;
+    Meter->Quarters[Meter->QuarterCount - 1] = Meter->QuarterEnergy;
+    Meter->QuarterEnergy = 0.0;
+    Meter->QuarterFill = 0;
+    if (Meter->QuarterCount < 4) return;
+
+    if (Meter->BlockCount == Meter->BlockCapacity)
+    {
+        int32 Capacity = Meter->BlockCapacity ? Meter->BlockCapacity*2 : 1024;
+        float64 *Blocks = av_realloc_array(Meter->Blocks, Capacity, sizeof(float64));
+        // Without memory the block is left out of the measurement.
+        if (Blocks == NULL) return;
+        Meter->Blocks = Blocks;
+        Meter->BlockCapacity = Capacity;
+    }
+    float64 Energy = Meter->Quarters[0] + Meter->Quarters[1] + Meter->Quarters[2] + Meter->Quarters[3];
+    Meter->Blocks[Meter->BlockCount++] = Energy/(4.0*Meter->QuarterLength);
+}
+
+void LoudnessProcess(void *State, float32 **Channels, int32 ChannelCount, int32 SampleCount)
+{
+    LoudnessMeter *Meter = (LoudnessMeter *)State;
+    if (ChannelCount != Meter->ChannelCount) return;
+
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        for (int32 Index = 0; Index < SampleCount; Index += LOUDNESS_PEAK_LANES)
+        {
+            int32 Count = SampleCount - Index < LOUDNESS_PEAK_LANES ? SampleCount - Index : LOUDNESS_PEAK_LANES;
+            Meter->Kernels->Peak(Meter->Peaks, Channels[Channel] + Index, Count);
+        }
+    }
+
+    int32 Offset = 0;
+    while (Offset < SampleCount)
+    {
+        int32 Count = Meter->QuarterLength - Meter->QuarterFill;
+        if (Count > SampleCount - Offset) Count = SampleCount - Offset;
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            float64 Sum = Meter->Kernels->StateEnergy(Channels[Channel] + Offset, Count, Meter->State[Channel], Meter->Filter);
+            Meter->QuarterEnergy += Meter->Weight[Channel]*Sum;
+        }
+        Meter->QuarterFill += Count;
+        Offset += Count;
+        if (Meter->QuarterFill == Meter->QuarterLength) LoudnessQuarterEnd(Meter);
+    }
+}
+
+float64 LoudnessIntegrated(const LoudnessMeter *Meter)
+{
+    // -70 LUFS as a mean square.
+    float64 Threshold = pow(10.0, (-70.0 + 0.691)/10);
+    for (int32 Pass = 0; Pass < 2; Pass++)
+    {
+        float64 Sum = 0.0;
+        int32 Count = 0;
+        for (int32 Index = 0; Index < Meter->BlockCount; Index++)
+        {
+            if (Meter->Blocks[Index] <= Threshold) continue;
+            Sum += Meter->Blocks[Index];
+            Count++;
+        }
+        if (Count == 0) return -HUGE_VAL;
+        if (Pass == 1) return -0.691 + 10.0*log10(Sum/Count);
+        // 10 LU below the blocks above the absolute gate.
+        Threshold = Sum/Count*0.1;
+    }
+    return -HUGE_VAL;
+}
+
+float32 LoudnessPeak(const LoudnessMeter *Meter)
+{
+    float32 Peak = 0.0f;
+    for (int32 Lane = 0; Lane < LOUDNESS_PEAK_LANES; Lane++)
+    {
+        if (Meter->Peaks[Lane] > Peak) Peak = Meter->Peaks[Lane];
+    }
+    return Peak;
+}
+
+// FNV-1a.
+static uint64_t LoudnessHash(const char *Key)
+{
+    uint64_t Hash = 14695981039346656037ull;
+    for (; *Key != '\0'; Key++)
+    {
+        Hash = (Hash ^ (unsigned char)*Key)*1099511628211ull;
+    }
+    return Hash;
+}
+
+static LoudnessEntry *LoudnessCacheFind(const LoudnessCache *Cache, const char *Key, int32 ChannelCount)
+{
+    uint64_t Hash = LoudnessHash(Key);
+    for (int32 Index = 0; Index < Cache->Count; Index++)
+    {
+        LoudnessEntry *Entry = &Cache->Entries[Index];
+        if (Entry->Hash == Hash && Entry->ChannelCount == ChannelCount && strcmp(Entry->Key, Key) == 0) return Entry;
+    }
+    return NULL;
+}
+
+// Add an entry for Key, whose ownership passes to the cache.
+static int32 LoudnessCacheAdd(LoudnessCache *Cache, char *Key, int32 ChannelCount, float64 Lufs)
+{
+    if (Cache->Count == Cache->Capacity)
+    {
+        int32 Capacity = Cache->Capacity ? Cache->Capacity*2 : 64;
+        LoudnessEntry *Entries = av_realloc_array(Cache->Entries, Capacity, sizeof(LoudnessEntry));
+        if (Entries == NULL)
+        {
+            av_free(Key);
+            return MIXER_ERR_NOMEM;
+        }
+        Cache->Entries = Entries;
+        Cache->Capacity = Capacity;
+    }
+    LoudnessEntry *Entry = &Cache->Entries[Cache->Count++];
+    Entry->Hash = LoudnessHash(Key);
+    Entry->Key = Key;
+    Entry->ChannelCount = ChannelCount;
+    Entry->Lufs = Lufs;
+    return MIXER_OK;
+}
+
+int32 LoudnessCacheLoad(LoudnessCache *Cache, const char *FileName)
+{
+    FILE *File = fopen(FileName, "r");
+    if (File == NULL) return MIXER_OK;
+
+    // One entry per line: loudness, channel count, then the key up to the end of the line.
+    char Line[8192];
+    int32 Ret = MIXER_OK;
+    while (Ret >= 0 && fgets(Line, sizeof(Line), File) != NULL)
+    {
+        float64 Lufs;
+        int32 ChannelCount;
+        int32 KeyStart = 0;
+        Line[strcspn(Line, "\r\n")] = '\0';
+        if (sscanf(Line, "%lf %d %n", &Lufs, &ChannelCount, &KeyStart) != 2 || Line[KeyStart] == '\0') continue;
+        if (LoudnessCacheFind(Cache, Line + KeyStart, ChannelCount) != NULL) continue;
+        char *Key = av_strdup(Line + KeyStart);
+        Ret = Key == NULL ? MIXER_ERR_NOMEM : LoudnessCacheAdd(Cache, Key, ChannelCount, Lufs);
+    }
+
+    fclose(File);
+    return Ret;
+}
+
+int32 LoudnessCacheSave(const LoudnessCache *Cache, const char *FileName)
+{
+    FILE *File = fopen(FileName, "w");
+    if (File == NULL)
+    {
+        DEBUG(stderr, "ERROR when open loudness cache %s\n", FileName);
+        return MIXER_ERR_OPEN;
+    }
+    for (int32 Index = 0; Index < Cache->Count; Index++)
+    {
+        const LoudnessEntry *Entry = &Cache->Entries[Index];
+        fprintf(File, "%.17g %d %s\n", Entry->Lufs, Entry->ChannelCount, Entry->Key);
+    }
+    fclose(File);
+    return MIXER_OK;
+}
+
+void LoudnessCacheFree(LoudnessCache *Cache)
+{
+    for (int32 Index = 0; Index < Cache->Count; Index++)
+    {
+        av_free(Cache->Entries[Index].Key);
+    }
+    av_freep(&Cache->Entries);
+    Cache->Count = 0;
+    Cache->Capacity = 0;
+}
+
+int32 LoudnessAnalyze(const MixerConfig *Config, const char *FileName, LoudnessCache *Cache, float64 *Lufs)
+{
+    char *Key = SourceIdentify(FileName);
+    if (Key == NULL) return MIXER_ERR_NOMEM;
+    const LoudnessEntry *Entry = Cache != NULL ? LoudnessCacheFind(Cache, Key, Config->ChannelCount) : NULL;
+    if (Entry != NULL)
+    {
+        av_free(Key);
+        *Lufs = Entry->Lufs;
+        return MIXER_OK;
+    }
+
+    MixerContext *Mixer = NULL;
+    LoudnessMeter Meter;
+    float32 *Block = av_malloc(Config->BlockSize*Config->ChannelCount*sizeof(float32));
+    int32 Ret = Block == NULL ? MIXER_ERR_NOMEM : LoudnessInit(&Meter, Config->SampleRate, Config->ChannelCount);
+    if (Ret < 0)
+    {
+        av_free(Block);
+        av_free(Key);
+        return Ret;
+    }
+    Ret = MixerOpen(&Mixer, Config);
+    if (Ret >= 0) Ret = MixerAddInput(Mixer, FileName, 0, 1.0f);
+    if (Ret >= 0) Ret = MixerAddEffect(Mixer, MIXER_MASTER_BUS, LoudnessProcess, &Meter);
+    int32 SampleCount = 0;
+    while (Ret == MIXER_OK)
+    {
+        Ret = MixerRenderBlock(Mixer, Block, &SampleCount);
+    }
+    MixerClose(&Mixer);
+    av_free(Block);
+
+    if (Ret >= 0)
+    {
+        *Lufs = LoudnessIntegrated(&Meter);
+        Ret = MIXER_OK;
+        if (Cache != NULL)
+        {
+            Ret = LoudnessCacheAdd(Cache, Key, Config->ChannelCount, *Lufs);
+            Cache->Dirty = 1;
+            Key = NULL;
+        }
+    }
+    av_free(Key);
+    LoudnessFree(&Meter);
+    return Ret;
+}
@@ -0,0 +1,82 @@
+#ifndef MIXER_LOUDNESS_H
+#define MIXER_LOUDNESS_H
+
+#include <stdint.h>
+
+#include "kernel.h"
+#include "mixer.h"
+
+// Integrated loudness after EBU R128 / ITU-R BS.1770: K-weighting, mean
+// square per 400 ms block every 100 ms, blocks gated at -70 LUFS and then
+// at 10 LU below the loudness of the blocks left.
+
+// The sample peak is kept per lane so the peak kernel can track it.
+#define LOUDNESS_PEAK_LANES     64
+
+typedef struct LoudnessMeter
+{
+    int32 ChannelCount;
+    float64 Weight[MIXER_MAX_CHANNELS];     // 0 for LFE, 1.41 for surround channels.
+    const KernelTable *Kernels;
+    float64 Filter[KERNEL_STATE_MATRIX];    // Both K-weighting stages as one state space system.
+    float64 State[MIXER_MAX_CHANNELS][4];   // Transposed direct form II state of the shelf, then of the high pass.
+
+    int32 QuarterLength;                    // Samples per 100 ms.
+    int32 QuarterFill;
+    float64 QuarterEnergy;                  // Weighted sum of squares so far.
+    float64 Quarters[4];                    // The last four complete quarters, oldest first.
+    int32 QuarterCount;
+
+    float64 *Blocks;                        // Mean square of every 400 ms block.
+    int32 BlockCount;
+    int32 BlockCapacity;
+    float32 Peaks[LOUDNESS_PEAK_LANES];     // Highest sample magnitude per position modulo the lanes.
+} LoudnessMeter;
+
+int32 LoudnessInit(LoudnessMeter *Meter, int32 SampleRate, int32 ChannelCount);
+
+void LoudnessFree(LoudnessMeter *Meter);
+
+// A MixerEffectFunc that measures without changing the samples, State is the
+// LoudnessMeter. Added last to the master bus it meters the mix as rendered.
+void LoudnessProcess(void *State, float32 **Channels, int32 ChannelCount, int32 SampleCount);
+
+// Integrated loudness in LUFS of everything processed, -HUGE_VAL if all of it
+// was gated away.
+float64 LoudnessIntegrated(const LoudnessMeter *Meter);
+
+// Highest sample magnitude processed.
+float32 LoudnessPeak(const LoudnessMeter *Meter);
+
+// Loudness of inputs measured alone, by the identity SourceIdentify() gives
+// their file and the channel count they were mixed to, kept in a text file
+// between runs so an input is analysed once.
+typedef struct LoudnessEntry
+{
+    uint64_t Hash;          // Of Key, compared first.
+    char *Key;
+    int32 ChannelCount;
+    float64 Lufs;
+} LoudnessEntry;
+
+typedef struct LoudnessCache
+{
+    LoudnessEntry *Entries;
+    int32 Count;
+    int32 Capacity;
+    int32 Dirty;            // Entries were added since the load.
+} LoudnessCache;
+
+// Add the entries of FileName to Cache, a missing file is an empty cache.
+int32 LoudnessCacheLoad(LoudnessCache *Cache, const char *FileName);
+
+int32 LoudnessCacheSave(const LoudnessCache *Cache, const char *FileName);
+
+void LoudnessCacheFree(LoudnessCache *Cache);
+
+// Integrated loudness of FileName decoded alone at the rate and channel
+// count of Config, from Cache when it is there and added to it otherwise.
+// Cache may be NULL.
+int32 LoudnessAnalyze(const MixerConfig *Config, const char *FileName, LoudnessCache *Cache, float64 *Lufs);
+
+#endif
@@ -1,168 +1,547 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include <libavformat/avformat.h>
-
-#define DEBUG fprintf
-#define int32 int
-#define int64 long long
-#define float32 float
-#define float64 double
-
-// TODO 100M size buffer too big?
-#define AUDIO_BUFFER_SIZE 1024*1024*100
-
-// Global Variabes
-AVFormatContext *FormatContext = NULL;
-AVCodec *Codec = NULL;
-AVCodecContext *CodecContext;
-int AudioStreamIndex;
-const char *FileName = "a.mp3";
+#include "batch.h"
+#include "bench.h"
+#include "decoder.h"
+#include "limiter.h"
+#include "loudness.h"
+#include "mixer.h"
+#include "pack.h"
+#include "reverb.h"
+#include "scan.h"
+#include "segment.h"
+#include "wav.h"
+#include "writer.h"
 
 void ErrExit()
 {
-    system("pause");
     exit(1);
 }
 
-void DumpAudioInfo()
+void Usage()
 {
-    av_dump_format(FormatContext, 0, FileName, 0);
-
-    const char *CodecName = Codec->name;
-    const char *CodecFullName = Codec->long_name;
-    int64 BitRate = CodecContext->bit_rate;
-    int32 SampleRate = CodecContext->sample_rate;
-    int32 ChannelCount = CodecContext->channels;
-    const char *SampleFormatName = av_get_sample_fmt_name(CodecContext->sample_fmt);
-    char ChannelLayoutName[256];
-    av_get_channel_layout_string(ChannelLayoutName, sizeof(ChannelLayoutName), ChannelCount, CodecContext->channel_layout);
-
-    DEBUG(stdout, "> File Name=%s\n", FileName);
-    DEBUG(stdout, "> audio codec=%s(%s)\n", CodecName, CodecFullName);
-    DEBUG(stdout, "> BitRate=%lld bps\n", BitRate);
-    DEBUG(stdout, "> SampleRate=%d Hz\n", SampleRate);
-    DEBUG(stdout, "> SampleFormatName=%s\n", SampleFormatName);
-    DEBUG(stdout, "> ChannelCount=%d\n", ChannelCount);
-    DEBUG(stdout, "> ChannelLayoutName=%s\n", ChannelLayoutName);
+    DEBUG(stderr, "Usage: mixer [-o output.wav | -o - [-splice]] [-range start[,length]] [-rate Hz] [-resample normal|fast|high|swr] [-input native|ffmpeg] [-iodepth N] [-format f32|s16|s24|s32] [-dither none|tpdf|shaped] [-limit dBFS | -truepeak dBTP] [-duck clips[,dB]] [-reverb ir.wav [-wet gain]] [-normalize LUFS] [-prenormalize LUFS [-loudcache file]] [-channels N] [-block N] [-direct] [-peaks] [-v] file[@start[,gain[,trim[,length]]]]...\n");
+    DEBUG(stderr, "       mixer -segment seconds [-threads N] [-o output.wav | -o -] [-format f32|s16|s24|s32] [-dither none|tpdf|shaped] [-limit dBFS | -truepeak dBTP] [-duck clips[,dB]] [-reverb ir.wav [-wet gain]] [-prenormalize LUFS [-loudcache file]] [-range start[,length]] file[@start[,gain[,trim[,length]]]]...\n");
+    DEBUG(stderr, "       mixer -scan json|csv [-index file] [-threads N] [-input native|ffmpeg] [-o output] file|directory...\n");
+    DEBUG(stderr, "       mixer -batch manifest.txt [-threads N] [-iodepth N] [-decoders N] [-rate Hz] [-channels N] [-block N]\n");
+    DEBUG(stderr, "       mixer -bench range|rerender|graph|tracks|automation|strip|resample|limiter|loudness|reverb|read|io|peaks|open|pack [-threads N] [-window seconds] file[@start[,gain[,trim[,length]]]]...\n");
+    DEBUG(stderr, "       -decoders N keeps up to N closed decoders opened for later inputs (default 16, 0 closes them)\n");
+    DEBUG(stderr, "       -o - streams raw interleaved samples to stdout, an input named pcm:encoding:rate:channels:- reads them from stdin\n");
+    ErrExit();
 }
 
-void OpenCodec(const char *FileName)
+// The buses and master effects of the command line, built the same on the
+// single mixer and on every segment's.
+typedef struct MasterChainInfo
+{
+    const MixerConfig *Config;
+    int32 ClipCount;
+    int32 DuckCount;                // The first DuckCount clips duck the others, 0 for no ducker.
+    float32 DuckDb;
+    const ReverbImpulse *Impulse;   // NULL for no reverb.
+    float32 ReverbWet;
+    float32 LimitDb;                // > 0 for no limiter.
+    int32 LimitFlags;
+} MasterChainInfo;
+
+typedef struct MasterChain
+{
+    Reverb *Rev;
+    Limiter *Lim;
+} MasterChain;
+
+// Add the chain to Mixer once its clips are. Closed with MasterChainClose()
+// after the mixer, also when this fails.
+static int32 MasterChainOpen(MixerContext *Mixer, const MasterChainInfo *Info, MasterChain *Chain)
 {
-    // Open File.
-	if (avformat_open_input(&FormatContext, FileName, NULL, NULL) < 0)
+    const MixerConfig *Config = Info->Config;
+    memset(Chain, 0, sizeof(MasterChain));
+
+    // The first DuckCount clips are the dialog, everything else plays under it.
+    if (Info->DuckCount > 0)
     {
-        DEBUG(stderr, "ERROR when avformat_open_input()\n");
-        ErrExit(1);
+        MixerDuckInfo Duck = {-40.0f, Info->DuckDb, 10.0f, 300.0f, 200.0f, 10.0f};
+        int32 Music = MixerAddBus(Mixer, MIXER_MASTER_BUS, 1.0f);
+        int32 Dialog = Music < 0 ? Music : MixerAddBus(Mixer, MIXER_MASTER_BUS, 1.0f);
+        int32 Ret = Dialog;
+        for (int32 Index = 0; Ret >= 0 && Index < Info->ClipCount; Index++)
+        {
+            Ret = MixerSetClipBus(Mixer, Index, Index < Info->DuckCount ? Dialog : Music);
+        }
+        if (Ret >= 0) Ret = MixerAddDucker(Mixer, Music, Dialog, &Duck);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when adding the ducker: %s\n", MixerErrorString(Ret));
+            return Ret;
+        }
     }
-    if (avformat_find_stream_info(FormatContext, NULL) < 0)
+
+    if (Info->Impulse != NULL)
     {
-        DEBUG(stderr, "ERROR when avformat_find_stream_info()\n");
-        ErrExit(1);
+        int32 Ret = ReverbOpen(&Chain->Rev, Info->Impulse, Config->BlockSize, 1.0f, Info->ReverbWet);
+        if (Ret >= 0) Ret = MixerAddTimedEffect(Mixer, MIXER_MASTER_BUS, ReverbProcess, Chain->Rev, ReverbLatency(Chain->Rev), ReverbTail(Chain->Rev));
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when adding the reverb: %s\n", MixerErrorString(Ret));
+            return Ret;
+        }
     }
 
+    // The limiter goes last on the master so it sees the final mix.
+    if (Info->LimitDb <= 0)
+    {
+        int32 Ret = LimiterOpen(&Chain->Lim, Config->SampleRate, Config->ChannelCount, Info->LimitDb, 5.0f, 50.0f, Info->LimitFlags);
+        if (Ret >= 0) Ret = MixerAddTimedEffect(Mixer, MIXER_MASTER_BUS, LimiterProcess, Chain->Lim, LimiterLatency(Chain->Lim), 0);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when adding the limiter: %s\n", MixerErrorString(Ret));
+            return Ret;
+        }
+    }
+
+    return MIXER_OK;
+}
+
+static void MasterChainClose(MasterChain *Chain)
+{
+    LimiterClose(&Chain->Lim);
+    ReverbClose(&Chain->Rev);
+}
+
+static int32 SegmentChainSetup(MixerContext *Mixer, void *Arg, void **State)
+{
+    MasterChain *Chain = malloc(sizeof(MasterChain));
+    if (Chain == NULL) return MIXER_ERR_NOMEM;
+    *State = Chain;
+    return MasterChainOpen(Mixer, (const MasterChainInfo *)Arg, Chain);
+}
+
+static void SegmentChainCleanup(void *State)
+{
+    MasterChainClose((MasterChain *)State);
+    free(State);
+}
+
+int main(int argc, char **argv)
+{
+    MixerConfig Config;
+    MixerDefaultConfig(&Config);
+    const char *OutFileName = NULL;
+    const char *ManifestFileName = NULL;
+    int32 ThreadCount = 0;
+    int32 DecoderCount = 16;
+    const char *BenchName = NULL;
+    float64 RangeStart = 0;
+    float64 RangeLength = 0;
+    float64 SegmentSeconds = 0;
+    int32 Format = PACK_F32;
+    int32 Dither = -1;
+    float32 LimitDb = 1;
+    int32 LimitFlags = 0;
+    float64 NormalizeLufs = 1;
+    float64 PrenormalizeLufs = 1;
+    const char *LoudCacheFileName = NULL;
+    int32 DuckCount = 0;
+    float32 DuckDb = -12.0f;
+    const char *ReverbFileName = NULL;
+    float32 ReverbWet = 0.3f;
+    int32 WriterFlags = 0;
+    int32 ScanOutput = -1;
+    const char *IndexFileName = NULL;
 
-	// Find the audio stream in the file.
-    AudioStreamIndex = av_find_best_stream(FormatContext, AVMEDIA_TYPE_AUDIO, -1, -1, &Codec, 0);
-    if (AudioStreamIndex< 0)
+    int32 ArgIndex = 1;
+    for (; ArgIndex < argc && argv[ArgIndex][0] == '-'; ArgIndex++)
     {
-        DEBUG(stderr, "ERROR when av_find_best_stream()\n");
-        ErrExit(1);
+        const char *Option = argv[ArgIndex];
+        if (strcmp(Option, "-v") == 0) Config.Verbose = 1;
+        else if (strcmp(Option, "-direct") == 0) WriterFlags |= WRITER_DIRECT;
+        else if (strcmp(Option, "-splice") == 0) WriterFlags |= WRITER_SPLICE;
+        else if (strcmp(Option, "-peaks") == 0) Config.Peaks = 1;
+        else if (ArgIndex + 1 >= argc) Usage();
+        else if (strcmp(Option, "-o") == 0) OutFileName = argv[++ArgIndex];
+        else if (strcmp(Option, "-rate") == 0) Config.SampleRate = atoi(argv[++ArgIndex]);
+        else if (strcmp(Option, "-channels") == 0) Config.ChannelCount = atoi(argv[++ArgIndex]);
+        else if (strcmp(Option, "-block") == 0) Config.BlockSize = atoi(argv[++ArgIndex]);
+        else if (strcmp(Option, "-batch") == 0) ManifestFileName = argv[++ArgIndex];
+        else if (strcmp(Option, "-iodepth") == 0) Config.IoDepth = atoi(argv[++ArgIndex]);
+        else if (strcmp(Option, "-decoders") == 0) DecoderCount = atoi(argv[++ArgIndex]);
+        else if (strcmp(Option, "-threads") == 0) ThreadCount = atoi(argv[++ArgIndex]);
+        else if (strcmp(Option, "-segment") == 0) SegmentSeconds = atof(argv[++ArgIndex]);
+        else if (strcmp(Option, "-resample") == 0)
+        {
+            const char *Quality = argv[++ArgIndex];
+            if (strcmp(Quality, "normal") == 0) Config.ResampleQuality = MIXER_RESAMPLE_NORMAL;
+            else if (strcmp(Quality, "fast") == 0) Config.ResampleQuality = MIXER_RESAMPLE_FAST;
+            else if (strcmp(Quality, "high") == 0) Config.ResampleQuality = MIXER_RESAMPLE_HIGH;
+            else if (strcmp(Quality, "swr") == 0) Config.ResampleQuality = MIXER_RESAMPLE_SWR;
+            else Usage();
+        }
+        else if (strcmp(Option, "-input") == 0)
+        {
+            const char *Reader = argv[++ArgIndex];
+            if (strcmp(Reader, "native") == 0) Config.NativeInput = 1;
+            else if (strcmp(Reader, "ffmpeg") == 0) Config.NativeInput = 0;
+            else Usage();
+        }
+        else if (strcmp(Option, "-format") == 0)
+        {
+            const char *Name = argv[++ArgIndex];
+            if (strcmp(Name, "f32") == 0) Format = PACK_F32;
+            else if (strcmp(Name, "s16") == 0) Format = PACK_S16;
+            else if (strcmp(Name, "s24") == 0) Format = PACK_S24;
+            else if (strcmp(Name, "s32") == 0) Format = PACK_S32;
+            else Usage();
+        }
+        else if (strcmp(Option, "-scan") == 0)
+        {
+            const char *Name = argv[++ArgIndex];
+            if (strcmp(Name, "json") == 0) ScanOutput = SCAN_JSON;
+            else if (strcmp(Name, "csv") == 0) ScanOutput = SCAN_CSV;
+            else Usage();
+        }
+        else if (strcmp(Option, "-index") == 0) IndexFileName = argv[++ArgIndex];
+        else if (strcmp(Option, "-dither") == 0)
+        {
+            const char *Name = argv[++ArgIndex];
+            if (strcmp(Name, "none") == 0) Dither = PACK_DITHER_NONE;
+            else if (strcmp(Name, "tpdf") == 0) Dither = PACK_DITHER_TPDF;
+            else if (strcmp(Name, "shaped") == 0) Dither = PACK_DITHER_SHAPED;
+            else Usage();
+        }
+        else if (strcmp(Option, "-limit") == 0) LimitDb = (float32)atof(argv[++ArgIndex]);
+        else if (strcmp(Option, "-truepeak") == 0)
+        {
+            LimitDb = (float32)atof(argv[++ArgIndex]);
+            LimitFlags = LIMITER_TRUE_PEAK;
+        }
+        else if (strcmp(Option, "-duck") == 0)
+        {
+            // clips[,dB] and nothing after it.
+            const char *Spec = argv[++ArgIndex];
+            int End = 0;
+            if (sscanf(Spec, "%d%n,%f%n", &DuckCount, &End, &DuckDb, &End) < 1 || Spec[End] != '\0' || DuckCount <= 0) Usage();
+        }
+        else if (strcmp(Option, "-reverb") == 0) ReverbFileName = argv[++ArgIndex];
+        else if (strcmp(Option, "-wet") == 0) ReverbWet = (float32)atof(argv[++ArgIndex]);
+        else if (strcmp(Option, "-normalize") == 0) NormalizeLufs = atof(argv[++ArgIndex]);
+        else if (strcmp(Option, "-prenormalize") == 0) PrenormalizeLufs = atof(argv[++ArgIndex]);
+        else if (strcmp(Option, "-loudcache") == 0) LoudCacheFileName = argv[++ArgIndex];
+        else if (strcmp(Option, "-range") == 0)
+        {
+            // start[,length] in seconds and nothing after it.
+            const char *Spec = argv[++ArgIndex];
+            int End = 0;
+            if (sscanf(Spec, "%lf%n,%lf%n", &RangeStart, &End, &RangeLength, &End) < 1 || Spec[End] != '\0' ||
+                RangeStart < 0 || RangeLength < 0)
+            {
+                Usage();
+            }
+        }
+        else if (strcmp(Option, "-bench") == 0)
+        {
+            // Everything after the bench name belongs to the bench.
+            BenchName = argv[++ArgIndex];
+            ArgIndex++;
+            break;
+        }
+        else Usage();
     }
+    // Scans print their records, renders write a WAV unless told otherwise.
+    if (OutFileName == NULL) OutFileName = ScanOutput >= 0 ? WRITER_STDOUT : "mix.wav";
+    // A stream to stdout takes it before anything is printed.
+    int32 Stream = strcmp(OutFileName, WRITER_STDOUT) == 0;
+    if (Stream && BenchName == NULL && ManifestFileName == NULL) WriterReserveStdout();
+    DEBUG(stdout, ">>> Start...\n");
+    DecoderPoolInit(DecoderCount);
 
-    // Allocate codec context for the decoder.
-    if ((CodecContext = avcodec_alloc_context3(Codec)) == NULL)
+    if (BenchName != NULL)
     {
-        DEBUG(stderr, "ERROR when avcodec_alloc_context3()\n");
-        ErrExit(1);
+        Config.ThreadCount = ThreadCount;
+        int32 Ret = BenchRun(BenchName, &Config, argc - ArgIndex, argv + ArgIndex);
+        if (Ret == MIXER_ERR_ARG) Usage();
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when BenchRun(%s): %s\n", BenchName, MixerErrorString(Ret));
+            ErrExit();
+        }
+        exit(0);
     }
-    // Init codec context using input stream.
-    if (avcodec_parameters_to_context(CodecContext, FormatContext->streams[AudioStreamIndex]->codecpar) < 0)
+
+    if (ManifestFileName != NULL)
     {
-        DEBUG(stderr, "ERROR when avcodec_parameters_to_context()\n");
-        ErrExit(1);
+        BatchStats Stats;
+        int32 Ret = BatchRun(ManifestFileName, &Config, ThreadCount, &Stats);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when BatchRun(%s): %s\n", ManifestFileName, MixerErrorString(Ret));
+            ErrExit();
+        }
+        DEBUG(stdout, ">>> Batch: %d jobs (%d failed) in %.3f s, %.1f jobs/s\n",
+              Stats.JobCount, Stats.FailedCount, Stats.Seconds, Stats.JobsPerSecond);
+        DEBUG(stdout, ">>> Job latency: p50=%.1f ms p90=%.1f ms p99=%.1f ms max=%.1f ms\n",
+              Stats.LatencyP50*1e3, Stats.LatencyP90*1e3, Stats.LatencyP99*1e3, Stats.LatencyMax*1e3);
+        DecoderStats Decoders;
+        DecoderPoolGetStats(&Decoders);
+        DEBUG(stdout, ">>> Decoders: %d opened at %.3f ms, %d reused at %.3f ms\n", Decoders.OpenCount,
+              Decoders.OpenCount ? Decoders.OpenSeconds*1e3/Decoders.OpenCount : 0.0, Decoders.ReuseCount,
+              Decoders.ReuseCount ? Decoders.ReuseSeconds*1e3/Decoders.ReuseCount : 0.0);
+        exit(Stats.FailedCount ? 1 : 0);
     }
-    // Open codec.
-    if (avcodec_open2(CodecContext, Codec, NULL) < 0)
+    if (ArgIndex >= argc) Usage();
+
+    if (ScanOutput >= 0)
     {
-        DEBUG(stderr, "ERROR when open decoder\n");
-        ErrExit(1);
+        ScanStats Stats;
+        int32 Ret = ScanRun(argv + ArgIndex, argc - ArgIndex, &Config, ThreadCount, ScanOutput, IndexFileName, OutFileName, &Stats);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when ScanRun(): %s\n", MixerErrorString(Ret));
+            ErrExit();
+        }
+        DEBUG(stdout, ">>> Scan: %d files (%d probed, %d not audio) in %.3f s, %.0f files/min\n",
+              Stats.FileCount, Stats.ProbedCount, Stats.FailedCount, Stats.Seconds, Stats.FilesPerMinute);
+        exit(0);
     }
 
-    DumpAudioInfo();
-}
+    int32 ClipCount = argc - ArgIndex;
+    MixerClipInfo *Clips = malloc(ClipCount*sizeof(MixerClipInfo));
+    if (Clips == NULL)
+    {
+        DEBUG(stderr, "ERROR when allocating the clips: %s\n", MixerErrorString(MIXER_ERR_NOMEM));
+        ErrExit();
+    }
+    for (int32 Index = 0; Index < ClipCount; Index++)
+    {
+        BatchParseClip(argv[ArgIndex + Index], Config.SampleRate, &Clips[Index]);
+    }
 
-void GetAllAudioFrame()
-{
-    // Demux packets from file.
-    int packetCount = 0;
-    int frameCount = 0;
-    AVPacket packet = {0};
-    AVFrame *frame = av_frame_alloc();
-    while (av_read_frame(FormatContext, &packet) == 0)
-    {
-        // Skip non-audio packet.
-		if (packet.stream_index != AudioStreamIndex) continue;
-
-        DEBUG(stdout, "Demux a packet[%d]\n", packetCount++);
-
-        // Decode frames from packet.
-        int ret = avcodec_send_packet(CodecContext, &packet);
-        if (ret < 0)
-        {
-            DEBUG(stdout, "ret=%d, AVERROR_EOF=%d", ret, AVERROR_EOF);
-            char buf[1024];
-            av_make_error_string(buf, sizeof(buf), ret);
-            DEBUG(stdout, buf);
-
-            av_frame_free(&frame);
-            av_packet_unref(&packet);
-            if (ret == AVERROR_EOF)
+    // Bring each input to the target on its own, analysing only those the cache doesn't know.
+    if (PrenormalizeLufs <= 0)
+    {
+        LoudnessCache Cache = {0};
+        int32 Ret = LoudCacheFileName != NULL ? LoudnessCacheLoad(&Cache, LoudCacheFileName) : MIXER_OK;
+        for (int32 Index = 0; Ret >= 0 && Index < ClipCount; Index++)
+        {
+            float64 Lufs;
+            Ret = LoudnessAnalyze(&Config, Clips[Index].FileName, &Cache, &Lufs);
+            if (Ret < 0)
             {
-                DEBUG(stdout, "Finish demuxing\n");
+                DEBUG(stderr, "ERROR when LoudnessAnalyze(%s): %s\n", Clips[Index].FileName, MixerErrorString(Ret));
                 break;
             }
-            else
-            {
-                DEBUG(stderr, "ERROR when avcodec_send_packet()\n");
-                ErrExit(0);
-            }
+            if (Config.Verbose) DEBUG(stdout, ">>> %s: %.1f LUFS\n", Clips[Index].FileName, Lufs);
+            if (isfinite(Lufs)) Clips[Index].Gain *= (float32)pow(10.0, (PrenormalizeLufs - Lufs)/20);
         }
+        if (Ret >= 0 && LoudCacheFileName != NULL && Cache.Dirty) Ret = LoudnessCacheSave(&Cache, LoudCacheFileName);
+        LoudnessCacheFree(&Cache);
+        if (Ret < 0) ErrExit();
+    }
+    int64 RangeStartSample = (int64)(RangeStart*Config.SampleRate);
+    int64 RangeLengthSample = (int64)(RangeLength*Config.SampleRate);
 
-        // Get a decoded frame.
-        while ((ret = avcodec_receive_frame(CodecContext, frame)) == 0)
+    // The impulse is loaded once and shared by the reverbs of every segment.
+    ReverbImpulse *Impulses = NULL;
+    MasterChainInfo ChainInfo = {&Config, ClipCount, DuckCount, DuckDb, NULL, ReverbWet, LimitDb, LimitFlags};
+    if (ReverbFileName != NULL)
+    {
+        int32 Ret = ReverbImpulseGet(&Impulses, &Config, ReverbFileName, &ChainInfo.Impulse);
+        if (Ret < 0)
         {
-            DEBUG(stdout, "Decode a frame[%d]\n", frameCount++);
-            // Do with frame.
-            av_frame_unref(frame);
+            DEBUG(stderr, "ERROR when loading the reverb %s: %s\n", ReverbFileName, MixerErrorString(Ret));
+            ErrExit();
         }
-        if (ret < 0)
+    }
+    // Integer output is dithered unless asked otherwise, 32 bits are finer than the float mix.
+    if (Dither < 0) Dither = Format == PACK_S16 || Format == PACK_S24 ? PACK_DITHER_TPDF : PACK_DITHER_NONE;
+
+    if (SegmentSeconds > 0)
+    {
+        // The segments are written as they finish, nothing can scale them afterwards.
+        if (NormalizeLufs <= 0)
         {
-            if (!(ret == AVERROR(EAGAIN) || ret == AVERROR(EINVAL)))
-            {
-                DEBUG(stderr, "Error when avcodec_receive_frame(), errcode=%d\n", ret);
-                av_packet_unref(&packet);
-                av_frame_unref(frame);
-                ErrExit(0);
-            }
+            DEBUG(stderr, "ERROR: -normalize needs the whole mix before writing and cannot be combined with -segment\n");
+            ErrExit();
         }
+        SegmentChain Chain = {SegmentChainSetup, SegmentChainCleanup, &ChainInfo};
+        SegmentStats Stats;
+        int32 Ret = SegmentRender(&Config, Clips, ClipCount, &Chain, RangeStartSample, RangeLengthSample,
+                                  SegmentSeconds, ThreadCount, Format, Dither, OutFileName, &Stats);
+        free(Clips);
+        ReverbCacheFree(&Impulses);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when SegmentRender(): %s\n", MixerErrorString(Ret));
+            ErrExit();
+        }
+        DEBUG(stdout, ">>> Segmented render: %d segments on %d threads in %.3f s, %.1fx realtime\n",
+              Stats.SegmentCount, Stats.ThreadCount, Stats.Seconds, Stats.Realtime);
+        DEBUG(stdout, ">>> Output: %.1f MB at %.1f MB/s, blocked %.1f ms, writing %.1f ms\n",
+              Stats.Output.Bytes/1e6, Stats.Output.BytesPerSecond/1e6, Stats.Output.BlockedSeconds*1e3, Stats.Output.WriteSeconds*1e3);
+        DEBUG(stdout, ">>> Finish! %lld samples written to %s\n", Stats.SampleCount, OutFileName);
+        exit(0);
+    }
 
-        av_packet_unref(&packet);
+    MixerContext *Mixer = NULL;
+    int32 Ret = MixerOpen(&Mixer, &Config);
+    if (Ret < 0)
+    {
+        DEBUG(stderr, "ERROR when MixerOpen(): %s\n", MixerErrorString(Ret));
+        ErrExit();
     }
 
-    avformat_free_context(FormatContext);
+    for (int32 Index = 0; Index < ClipCount; Index++)
+    {
+        Ret = MixerAddClip(Mixer, &Clips[Index]);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when MixerAddClip(%s): %s\n", Clips[Index].FileName, MixerErrorString(Ret));
+            MixerClose(&Mixer);
+            ErrExit();
+        }
+    }
+    free(Clips);
 
-}
+    MasterChain Chain;
+    Ret = MasterChainOpen(Mixer, &ChainInfo, &Chain);
+    if (Ret < 0)
+    {
+        MixerClose(&Mixer);
+        MasterChainClose(&Chain);
+        ErrExit();
+    }
 
-int main()
-{
-    DEBUG(stdout, ">>> Start...\n");
+    // Metered after the limiter, the measurement is of the mix as written.
+    LoudnessMeter Meter;
+    int32 Normalize = NormalizeLufs <= 0;
+    if (Normalize)
+    {
+        Ret = LoudnessInit(&Meter, Config.SampleRate, Config.ChannelCount);
+        if (Ret >= 0) Ret = MixerAddEffect(Mixer, MIXER_MASTER_BUS, LoudnessProcess, &Meter);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when adding the loudness meter: %s\n", MixerErrorString(Ret));
+            MixerClose(&Mixer);
+            MasterChainClose(&Chain);
+            ErrExit();
+        }
+    }
+
+    if (RangeStart > 0 || RangeLength > 0)
+    {
+        Ret = MixerSetRange(Mixer, RangeStartSample, RangeLengthSample);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when MixerSetRange(): %s\n", MixerErrorString(Ret));
+            MixerClose(&Mixer);
+            MasterChainClose(&Chain);
+            ErrExit();
+        }
+    }
+
+    PackState Packer;
+    PackInit(&Packer, Format, Config.ChannelCount, Dither);
+    int32 FrameSize = PackSampleSize(Format)*Config.ChannelCount;
+    uint8_t Header[WAV_HEADER_MAX];
+    // A stream has no header, nothing can go back to fill in its size.
+    int32 HeaderSize = 0;
+    if (!Stream && Format == PACK_F32) HeaderSize = WavHeader(Header, Config.SampleRate, Config.ChannelCount, 0);
+    else if (!Stream) HeaderSize = WavHeaderPcm(Header, Config.SampleRate, Config.ChannelCount, 8*PackSampleSize(Format), 0);
+
+    // The length of the mix is known up front, so the output is allocated in one go.
+    int64 OutLength = RangeLengthSample > 0 ? RangeLengthSample : MixerGetLength(Mixer) - RangeStartSample;
+    Writer *Out = NULL;
+    Ret = WriterOpen(&Out, OutFileName, WriterFlags, OutLength > 0 ? HeaderSize + OutLength*FrameSize : 0);
+    if (Ret < 0)
+    {
+        MixerClose(&Mixer);
+        MasterChainClose(&Chain);
+        ErrExit();
+    }
+    // Room for the header, written with the final sizes when the output is closed.
+    WriterWrite(Out, Header, HeaderSize);
+
+    float32 *Block = malloc(Config.BlockSize*Config.ChannelCount*sizeof(float32));
+    void *Packed = malloc(Config.BlockSize*FrameSize);
+    if (Block == NULL || Packed == NULL)
+    {
+        DEBUG(stderr, "ERROR when allocating the render buffers\n");
+        Ret = MIXER_ERR_NOMEM;
+    }
+    int64 DataSize = 0;
+    int32 SampleCount = 0;
+    // Normalizing needs the loudness of the whole mix before the first
+    // sample is written, so the float mix goes to a scratch file first and
+    // is scaled on the way to the output, the inputs are decoded once.
+    int32 MixFrameSize = Config.ChannelCount*sizeof(float32);
+    FILE *MixFile = Normalize && Ret >= 0 ? tmpfile() : NULL;
+    if (Normalize && Ret >= 0 && MixFile == NULL)
+    {
+        DEBUG(stderr, "ERROR when creating the scratch file\n");
+        Ret = MIXER_ERR_OPEN;
+    }
+    while (Ret >= 0 && (Ret = MixerRenderBlock(Mixer, Block, &SampleCount)) == MIXER_OK)
+    {
+        if (Normalize)
+        {
+            if ((int32)fwrite(Block, MixFrameSize, SampleCount, MixFile) != SampleCount) Ret = MIXER_ERR_WRITE;
+            continue;
+        }
+        PackInterleaved(&Packer, Packed, Block, SampleCount);
+        Ret = WriterWrite(Out, Packed, (int64)SampleCount*FrameSize);
+        DataSize += (int64)SampleCount*FrameSize;
+    }
+    MixerClose(&Mixer);
+    MasterChainClose(&Chain);
+    ReverbCacheFree(&Impulses);
 
-    OpenCodec(FileName);
+    // A full scratch disk may only show when the last buffer is flushed.
+    if (Normalize && Ret >= 0 && fflush(MixFile) != 0) Ret = MIXER_ERR_WRITE;
+    if (Normalize && Ret >= 0)
+    {
+        // Never push the peak past the limiter's ceiling, or full scale without one.
+        float64 Lufs = LoudnessIntegrated(&Meter);
+        float64 Ceiling = LimitDb <= 0 ? pow(10.0, LimitDb/20) : 1.0;
+        float64 Gain = isfinite(Lufs) ? pow(10.0, (NormalizeLufs - Lufs)/20) : 1.0;
+        float64 Peak = LoudnessPeak(&Meter);
+        if (Peak*Gain > Ceiling) Gain = Ceiling/Peak;
+        DEBUG(stdout, ">>> Loudness: %.1f LUFS, peak %.1f dBFS, gain %+.2f dB\n", Lufs, 20*log10(Peak), 20*log10(Gain));
 
-    /* GetAllAudioFrame(); */
+        rewind(MixFile);
+        while ((SampleCount = (int32)fread(Block, MixFrameSize, Config.BlockSize, MixFile)) > 0)
+        {
+            for (int32 Index = 0; Index < SampleCount*Config.ChannelCount; Index++)
+            {
+                Block[Index] *= (float32)Gain;
+            }
+            PackInterleaved(&Packer, Packed, Block, SampleCount);
+            Ret = WriterWrite(Out, Packed, (int64)SampleCount*FrameSize);
+            if (Ret < 0) break;
+            DataSize += (int64)SampleCount*FrameSize;
+        }
+        if (Ret >= 0 && ferror(MixFile)) Ret = MIXER_ERR_WRITE;
+    }
+    if (MixFile != NULL) fclose(MixFile);
+    if (Normalize) LoudnessFree(&Meter);
+    free(Packed);
+    free(Block);
+
+    if (Format == PACK_F32) WavHeader(Header, Config.SampleRate, Config.ChannelCount, DataSize);
+    else WavHeaderPcm(Header, Config.SampleRate, Config.ChannelCount, 8*PackSampleSize(Format), DataSize);
+    WriterStats Written;
+    int32 CloseRet = WriterClose(&Out, Header, HeaderSize, &Written);
+    if (Ret >= 0) Ret = CloseRet;
+
+    if (Ret < 0)
+    {
+        DEBUG(stderr, "ERROR when MixerRenderBlock(): %s\n", MixerErrorString(Ret));
+        ErrExit();
+    }
+    DEBUG(stdout, ">>> Output: %.1f MB at %.1f MB/s, blocked %.1f ms, writing %.1f ms\n",
+          Written.Bytes/1e6, Written.BytesPerSecond/1e6, Written.BlockedSeconds*1e3, Written.WriteSeconds*1e3);
 
-    DEBUG(stdout, ">>> Finish!\n");
-    system("pause");
+    DEBUG(stdout, ">>> Finish! %lld samples written to %s\n", DataSize/FrameSize, OutFileName);
     exit(0);
 }
@@ -0,0 +1,1863 @@
+#include <math.h>
+#include <string.h>
+
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+
+#include "duck.h"
+#include "kernel.h"
+#include "mixer.h"
+#include "pool.h"
+#include "source.h"
+#include "strip.h"
+#include "thread.h"
+
+// A clip seeks instead of decoding forward when the samples it needs next lie
+// further ahead of its source's buffer than this.
+#define MIXER_SEEK_AHEAD_SECONDS 2
+
+// Points of the fade curve tables, which hold one more as a guard.
+#define MIXER_CURVE_TABLE_SIZE 256
+
+// Lowest gain an exponential segment reaches, -100 dB.
+#define MIXER_ENVELOPE_FLOOR 1e-5
+
+// Gain automation of one clip, see MixerSetClipEnvelope().
+typedef struct MixerAutomation
+{
+    MixerEnvelopePoint *Points;
+    int32 PointCount;
+    int64 FadeIn;
+    int64 FadeOut;
+    int32 FadeCurve;
+    float32 *Envelope;      // BlockSize gains, the curve of the block being mixed.
+} MixerAutomation;
+
+// One placement of a source on the output timeline.
+typedef struct MixerClip
+{
+    MixerSource *Source;
+    int64 StartSample;      // Output position of the first sample played.
+    int64 TrimSample;       // Source position played at StartSample.
+    int64 LengthSample;     // Samples to play, -1 plays until the source ends.
+    int64 EndSample;        // Output position where the clip stops, -1 until known.
+    int64 SourcePosition;   // Next source sample this clip needs.
+    int32 Edited;           // Gain, pan or mute changed while blocks were cached, see MixerCacheBlock.
+    int32 Bus;
+    MixerAutomation *Automation;    // NULL plays the clip at its track gains.
+    StripState *Strip;              // NULL plays the clip unprocessed.
+} MixerClip;
+
+// Mix parameters of the clips, as one array per parameter indexed by clip
+// rather than fields of MixerClip, so that they are evaluated for eight clips
+// per instruction. Arrays are cache line aligned and padded to whole lines.
+typedef struct MixerTrackTable
+{
+    float32 *Gain;
+    float32 *Pan;                           // Stereo balance, -1 left to 1 right.
+    float32 *Audible;                       // 0 while muted, 1 otherwise.
+    float32 *Target[MIXER_MAX_CHANNELS];    // Per channel gain from the three above.
+    float32 *Current[MIXER_MAX_CHANNELS];   // Per channel gain reached by the last block, ramps to Target.
+    float32 *Cached[MIXER_MAX_CHANNELS];    // Per channel gain the block cache holds the clip with.
+    int32 Capacity;
+    int32 Dirty;                            // Target is out of date.
+} MixerTrackTable;
+
+#define MIXER_TRACK_ALIGN 16
+
+typedef struct MixerEffect
+{
+    MixerEffectFunc Process;
+    void *State;
+    int32 Latency;
+    int64 Tail;
+} MixerEffect;
+
+// A node of the mix graph. Children always have a higher index than the bus
+// they feed, since a bus can only route into one that already exists.
+typedef struct MixerBus
+{
+    struct MixerContext *Mixer;
+    int32 Output;           // Bus this one sums into, -1 for the master.
+    float32 Gain;
+    float32 *Buffer[MIXER_MAX_CHANNELS];
+    int32 *Children;
+    int32 ChildCount;
+    MixerEffect *Effects;
+    int32 EffectCount;
+    StripGroup *Strips;     // Scratch for the clips with a strip, NULL while no clip has one.
+    Ducker *Duck;           // Ducking of this bus by its key, NULL without one.
+    int32 *Ducked;          // Buses keyed by this one, waiting on it every block.
+    int32 DuckedCount;
+    DelayLine *Delay;       // Lookahead of the duckers the bus takes part in, NULL without one.
+
+    // Latency of the output behind the clips and how long it rings on after
+    // them, see TimelineDelay(). The bus's own clips are held back by
+    // InputLatency to line up with the slowest bus feeding it, its output by
+    // whatever it is ahead of the slowest bus feeding its parent.
+    int32 InputLatency;
+    int32 Latency;
+    int64 Tail;
+    DelayLine *ClipAlign;   // NULL while no clip of the bus needs holding back.
+    DelayLine *Align;       // NULL if the bus is the slowest feeding its parent.
+
+    // Per block state.
+    int32 ClipStart;        // Active clips of this bus, a slice of BusClips.
+    int32 ClipCount;
+    volatile int32 Pending; // Children and key not processed yet.
+    int32 Result;
+} MixerBus;
+
+// Unscaled samples of one edited clip in one block, planar.
+typedef struct MixerCacheStem
+{
+    int32 Clip;
+    float32 *Samples;
+} MixerCacheStem;
+
+// Cached mix of one block: Base is the sum of every clip that has not been
+// edited since it was cached, each edited clip playing in the block keeps its
+// own stem. Re-rendering the block only decodes an edited clip the first time
+// its stem is needed, then only scales and adds.
+typedef struct MixerCacheBlock
+{
+    float32 *Base;
+    MixerCacheStem *Stems;
+    int32 StemCount;
+} MixerCacheBlock;
+
+typedef struct MixerClipOrder
+{
+    int64 StartSample;
+    int32 Index;
+} MixerClipOrder;
+
+struct MixerContext
+{
+    MixerConfig Config;
+    const KernelTable *Kernels;
+    MixerClip *Clips;
+    int32 ClipCount;
+    int32 ClipCapacity;
+    MixerTrackTable Tracks;
+    MixerSource **Sources;
+    int32 SourceCount;
+    int32 SourceCapacity;
+    float32 *MixBuffer[MIXER_MAX_CHANNELS];
+    int64 Position;         // Output position of the next block.
+
+    // Sorted event list: clips ordered by start, a cursor to the next clip to
+    // start, and the clips playing in the current block. A block only visits
+    // the active clips, blocks without any are silence.
+    MixerClipOrder *Order;
+    int32 NextClip;
+    int32 *Active;
+    int32 ActiveCount;
+    MixerSource **Touched;  // Scratch list of the sources read in a block.
+    int32 Started;          // Timeline is built, clips can no longer be added.
+    int64 MixEnd;           // Latest end of the clips that have stopped.
+    int64 RangeEnd;         // Rendering stops here, -1 renders to the end of the mix.
+    int64 BlockIndex;
+
+    // The bus graph delays the master by Latency samples and rings on for
+    // Tail more after the last clip. Positions above are of the clips, the output runs
+    // Latency behind them: its first Skip samples after a seek are dropped
+    // and the mix ends Latency + Tail after the clips do. Carry holds the
+    // rest of a block split by the skip, so blocks stay whole.
+    int32 Latency;
+    int64 Tail;
+    int64 Skip;
+    float32 *Carry;
+    int32 CarryStart;
+    int32 CarryCount;
+
+    // Bus 0 is the master, mixed straight into MixBuffer.
+    MixerBus *Buses;
+    int32 BusCount;
+    int32 EffectCount;
+    int32 *BusClips;
+    ThreadPool *Pool;
+
+    // Block cache indexed by BlockStart / BlockSize, see MixerSetCache().
+    int32 CacheEnabled;
+    MixerCacheBlock **Cache;
+    int64 CacheCapacity;
+
+    // Rate conversion filters shared by the sources.
+    ResampleFilter *Filters;
+
+    // Fade shapes over [0, 1], linear and equal power.
+    float32 CurveTables[2][MIXER_CURVE_TABLE_SIZE + 1];
+};
+
+const char *MixerErrorString(int32 Error)
+{
+    switch (Error)
+    {
+        case MIXER_OK:              return "ok";
+        case MIXER_EOF:             return "end of mix";
+        case MIXER_ERR_ARG:         return "invalid argument";
+        case MIXER_ERR_NOMEM:       return "out of memory";
+        case MIXER_ERR_OPEN:        return "cannot open input";
+        case MIXER_ERR_STREAM:      return "no audio stream";
+        case MIXER_ERR_CODEC:       return "cannot open decoder";
+        case MIXER_ERR_DECODE:      return "decode error";
+        case MIXER_ERR_RESAMPLE:    return "sample conversion error";
+        case MIXER_ERR_WRITE:       return "cannot write output";
+        default:                    return "unknown error";
+    }
+}
+
+void MixerDefaultConfig(MixerConfig *Config)
+{
+    Config->SampleRate = 44100;
+    Config->ChannelCount = 2;
+    Config->BlockSize = 1024;
+    Config->Verbose = 0;
+    Config->ThreadCount = 0;
+    Config->ResampleQuality = MIXER_RESAMPLE_NORMAL;
+    Config->NativeInput = 1;
+    Config->IoDepth = 0;
+    Config->Peaks = 0;
+}
+
+int MixerOpen(MixerContext **Mixer, const MixerConfig *Config)
+{
+    if (Mixer == NULL || Config == NULL) return MIXER_ERR_ARG;
+    *Mixer = NULL;
+    if (Config->SampleRate <= 0 || Config->BlockSize <= 0 ||
+        Config->ChannelCount <= 0 || Config->ChannelCount > MIXER_MAX_CHANNELS ||
+        Config->ResampleQuality < MIXER_RESAMPLE_NORMAL || Config->ResampleQuality > MIXER_RESAMPLE_SWR)
+    {
+        return MIXER_ERR_ARG;
+    }
+
+    MixerContext *Context = av_mallocz(sizeof(MixerContext));
+    if (Context == NULL) return MIXER_ERR_NOMEM;
+    Context->Config = *Config;
+    Context->Kernels = KernelSelect();
+    Context->RangeEnd = -1;
+    for (int32 Point = 0; Point <= MIXER_CURVE_TABLE_SIZE; Point++)
+    {
+        float64 X = (float64)Point/MIXER_CURVE_TABLE_SIZE;
+        Context->CurveTables[0][Point] = (float32)X;
+        Context->CurveTables[1][Point] = (float32)sin(X*M_PI/2);
+    }
+
+    for (int32 Channel = 0; Channel < Config->ChannelCount; Channel++)
+    {
+        Context->MixBuffer[Channel] = av_malloc(Config->BlockSize*sizeof(float32));
+        if (Context->MixBuffer[Channel] == NULL)
+        {
+            MixerClose(&Context);
+            return MIXER_ERR_NOMEM;
+        }
+    }
+
+    Context->Buses = av_mallocz(sizeof(MixerBus));
+    if (Context->Buses == NULL)
+    {
+        MixerClose(&Context);
+        return MIXER_ERR_NOMEM;
+    }
+    Context->BusCount = 1;
+    Context->Buses[0].Mixer = Context;
+    Context->Buses[0].Output = -1;
+    Context->Buses[0].Gain = 1.0f;
+    for (int32 Channel = 0; Channel < Config->ChannelCount; Channel++)
+    {
+        Context->Buses[0].Buffer[Channel] = Context->MixBuffer[Channel];
+    }
+
+    *Mixer = Context;
+    return MIXER_OK;
+}
+
+static float32 *TrackGrow(float32 *Array, int32 Count, int32 Capacity)
+{
+    float32 *Grown = av_mallocz(Capacity*sizeof(float32));
+    if (Grown == NULL) return NULL;
+    if (Array != NULL) memcpy(Grown, Array, Count*sizeof(float32));
+    av_free(Array);
+    return Grown;
+}
+
+// Grow every track array to hold Count clips, padded to whole cache lines.
+static int32 TrackReserve(MixerContext *Mixer, int32 Count)
+{
+    MixerTrackTable *Tracks = &Mixer->Tracks;
+    int32 Capacity = Tracks->Capacity ? Tracks->Capacity : MIXER_TRACK_ALIGN;
+    while (Capacity < Count) Capacity *= 2;
+
+    float32 **Arrays[3 + 3*MIXER_MAX_CHANNELS];
+    int32 ArrayCount = 0;
+    Arrays[ArrayCount++] = &Tracks->Gain;
+    Arrays[ArrayCount++] = &Tracks->Pan;
+    Arrays[ArrayCount++] = &Tracks->Audible;
+    for (int32 Channel = 0; Channel < Mixer->Config.ChannelCount; Channel++)
+    {
+        Arrays[ArrayCount++] = &Tracks->Target[Channel];
+        Arrays[ArrayCount++] = &Tracks->Current[Channel];
+        Arrays[ArrayCount++] = &Tracks->Cached[Channel];
+    }
+    for (int32 Index = 0; Index < ArrayCount; Index++)
+    {
+        float32 *Grown = TrackGrow(*Arrays[Index], Mixer->ClipCount, Capacity);
+        if (Grown == NULL) return MIXER_ERR_NOMEM;
+        *Arrays[Index] = Grown;
+    }
+    Tracks->Capacity = Capacity;
+
+    return MIXER_OK;
+}
+
+static void TrackFree(MixerTrackTable *Tracks)
+{
+    av_freep(&Tracks->Gain);
+    av_freep(&Tracks->Pan);
+    av_freep(&Tracks->Audible);
+    for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+    {
+        av_freep(&Tracks->Target[Channel]);
+        av_freep(&Tracks->Current[Channel]);
+        av_freep(&Tracks->Cached[Channel]);
+    }
+}
+
+// Recompute the per channel gains of every clip after a parameter change.
+static void TrackUpdate(MixerContext *Mixer)
+{
+    MixerTrackTable *Tracks = &Mixer->Tracks;
+    if (!Tracks->Dirty) return;
+    Mixer->Kernels->TrackGains(Tracks->Target, Tracks->Gain, Tracks->Pan, Tracks->Audible, Mixer->ClipCount, Mixer->Config.ChannelCount);
+    Tracks->Dirty = 0;
+}
+
+// A clip starting to play takes its gains as they are, without a ramp, and
+// its strip starts from silence.
+static void TrackStart(MixerContext *Mixer, int32 Index)
+{
+    if (Mixer->Clips[Index].Strip != NULL) StripReset(Mixer->Clips[Index].Strip);
+    for (int32 Channel = 0; Channel < Mixer->Config.ChannelCount; Channel++)
+    {
+        Mixer->Tracks.Current[Channel][Index] = Mixer->Tracks.Target[Channel][Index];
+    }
+}
+
+// Gains clip Index plays this block with: a ramp from where the last block
+// ended to the current target, which then becomes the new start.
+static void TrackRamp(MixerContext *Mixer, int32 Index, float32 *From, float32 *To)
+{
+    for (int32 Channel = 0; Channel < Mixer->Config.ChannelCount; Channel++)
+    {
+        From[Channel] = Mixer->Tracks.Current[Channel][Index];
+        To[Channel] = Mixer->Tracks.Target[Channel][Index];
+        Mixer->Tracks.Current[Channel][Index] = To[Channel];
+    }
+}
+
+int MixerAddClip(MixerContext *Mixer, const MixerClipInfo *Info)
+{
+    if (Mixer == NULL || Info == NULL || Info->FileName == NULL) return MIXER_ERR_ARG;
+    if (Info->StartSample < 0 || Info->TrimSample < 0 || Info->LengthSample < 0) return MIXER_ERR_ARG;
+    if (Mixer->Started) return MIXER_ERR_ARG;
+
+    if (Mixer->ClipCount == Mixer->ClipCapacity)
+    {
+        int32 Capacity = Mixer->ClipCapacity ? Mixer->ClipCapacity*2 : 8;
+        MixerClip *Clips = av_realloc_array(Mixer->Clips, Capacity, sizeof(MixerClip));
+        if (Clips == NULL) return MIXER_ERR_NOMEM;
+        Mixer->Clips = Clips;
+        Mixer->ClipCapacity = Capacity;
+    }
+    if (Mixer->ClipCount == Mixer->Tracks.Capacity)
+    {
+        int32 Ret = TrackReserve(Mixer, Mixer->ClipCount + 1);
+        if (Ret < 0) return Ret;
+    }
+    if (Mixer->SourceCount == Mixer->SourceCapacity)
+    {
+        int32 Capacity = Mixer->SourceCapacity ? Mixer->SourceCapacity*2 : 8;
+        MixerSource **Sources = av_realloc_array(Mixer->Sources, Capacity, sizeof(MixerSource *));
+        if (Sources == NULL) return MIXER_ERR_NOMEM;
+        Mixer->Sources = Sources;
+        Mixer->SourceCapacity = Capacity;
+    }
+
+    char *Key = SourceIdentify(Info->FileName);
+    if (Key == NULL) return MIXER_ERR_NOMEM;
+
+    // Reuse the decode of an identical input, or open a new source.
+    MixerSource *Source = NULL;
+    for (int32 SourceIndex = 0; SourceIndex < Mixer->SourceCount; SourceIndex++)
+    {
+        MixerSource *Candidate = Mixer->Sources[SourceIndex];
+        if (Candidate->Shareable && strcmp(Candidate->Key, Key) == 0)
+        {
+            Source = Candidate;
+            Source->RefCount++;
+            av_free(Key);
+            if (Mixer->Config.Verbose) DEBUG(stdout, "> %s shares an already opened source (%d uses)\n", Info->FileName, Source->RefCount);
+            break;
+        }
+    }
+    if (Source == NULL)
+    {
+        int32 Ret = SourceOpen(&Source, Info->FileName, Key, &Mixer->Config, &Mixer->Filters);
+        if (Ret < 0)
+        {
+            if (Source != NULL) SourceClose(Source);
+            return Ret;
+        }
+        Mixer->Sources[Mixer->SourceCount++] = Source;
+    }
+
+    MixerClip *Clip = &Mixer->Clips[Mixer->ClipCount];
+    Clip->Source = Source;
+    Clip->StartSample = Info->StartSample;
+    Clip->TrimSample = Info->TrimSample;
+    Clip->LengthSample = Info->LengthSample > 0 ? Info->LengthSample : -1;
+    Clip->EndSample = Clip->LengthSample >= 0 ? Clip->StartSample + Clip->LengthSample : -1;
+    Clip->SourcePosition = Clip->TrimSample;
+    Clip->Edited = 0;
+    Clip->Bus = MIXER_MASTER_BUS;
+    Clip->Automation = NULL;
+    Clip->Strip = NULL;
+    Mixer->Tracks.Gain[Mixer->ClipCount] = Info->Gain;
+    Mixer->Tracks.Pan[Mixer->ClipCount] = 0.0f;
+    Mixer->Tracks.Audible[Mixer->ClipCount] = 1.0f;
+    Mixer->Tracks.Dirty = 1;
+
+    return Mixer->ClipCount++;
+}
+
+int MixerAddInput(MixerContext *Mixer, const char *FileName, int64 StartSample, float32 Gain)
+{
+    MixerClipInfo Info = {0};
+    Info.FileName = FileName;
+    Info.StartSample = StartSample;
+    Info.Gain = Gain;
+
+    int32 Ret = MixerAddClip(Mixer, &Info);
+    return Ret < 0 ? Ret : MIXER_OK;
+}
+
+int MixerAddBus(MixerContext *Mixer, int32 Output, float32 Gain)
+{
+    if (Mixer == NULL || Output < 0 || Output >= Mixer->BusCount || Mixer->Started) return MIXER_ERR_ARG;
+
+    MixerBus *Buses = av_realloc_array(Mixer->Buses, Mixer->BusCount + 1, sizeof(MixerBus));
+    if (Buses == NULL) return MIXER_ERR_NOMEM;
+    Mixer->Buses = Buses;
+    int32 *Children = av_realloc_array(Buses[Output].Children, Buses[Output].ChildCount + 1, sizeof(int32));
+    if (Children == NULL) return MIXER_ERR_NOMEM;
+    Buses[Output].Children = Children;
+
+    MixerBus *Bus = &Buses[Mixer->BusCount];
+    memset(Bus, 0, sizeof(MixerBus));
+    Bus->Mixer = Mixer;
+    Bus->Output = Output;
+    Bus->Gain = Gain;
+    for (int32 Channel = 0; Channel < Mixer->Config.ChannelCount; Channel++)
+    {
+        Bus->Buffer[Channel] = av_malloc(Mixer->Config.BlockSize*sizeof(float32));
+        if (Bus->Buffer[Channel] == NULL)
+        {
+            while (--Channel >= 0) av_freep(&Bus->Buffer[Channel]);
+            return MIXER_ERR_NOMEM;
+        }
+    }
+    Children[Buses[Output].ChildCount++] = Mixer->BusCount;
+
+    return Mixer->BusCount++;
+}
+
+int MixerSetClipBus(MixerContext *Mixer, int32 Clip, int32 Bus)
+{
+    if (Mixer == NULL || Clip < 0 || Clip >= Mixer->ClipCount || Bus < 0 || Bus >= Mixer->BusCount) return MIXER_ERR_ARG;
+
+    Mixer->Clips[Clip].Bus = Bus;
+    return MIXER_OK;
+}
+
+int MixerAddEffect(MixerContext *Mixer, int32 Bus, MixerEffectFunc Process, void *State)
+{
+    return MixerAddTimedEffect(Mixer, Bus, Process, State, 0, 0);
+}
+
+int MixerAddTimedEffect(MixerContext *Mixer, int32 Bus, MixerEffectFunc Process, void *State, int32 Latency, int64 Tail)
+{
+    if (Mixer == NULL || Bus < 0 || Bus >= Mixer->BusCount || Process == NULL) return MIXER_ERR_ARG;
+    // The compensation is set up with the timeline.
+    if (Latency < 0 || Tail < 0 || ((Latency > 0 || Tail > 0) && Mixer->Started)) return MIXER_ERR_ARG;
+
+    MixerBus *Target = &Mixer->Buses[Bus];
+    MixerEffect *Effects = av_realloc_array(Target->Effects, Target->EffectCount + 1, sizeof(MixerEffect));
+    if (Effects == NULL) return MIXER_ERR_NOMEM;
+    Effects[Target->EffectCount].Process = Process;
+    Effects[Target->EffectCount].State = State;
+    Effects[Target->EffectCount].Latency = Latency;
+    Effects[Target->EffectCount].Tail = Tail;
+    Target->Effects = Effects;
+    Target->EffectCount++;
+    Mixer->EffectCount++;
+
+    return MIXER_OK;
+}
+
+static int32 DelayReserve(MixerContext *Mixer, DelayLine **Result, int32 Length)
+{
+    if (*Result != NULL) return MIXER_OK;
+
+    DelayLine *Delay = av_malloc(sizeof(DelayLine));
+    if (Delay == NULL) return MIXER_ERR_NOMEM;
+    int32 Ret = DelayInit(Delay, Length, Mixer->Config.ChannelCount, Mixer->Config.BlockSize);
+    if (Ret < 0)
+    {
+        av_free(Delay);
+        return Ret;
+    }
+    *Result = Delay;
+    return MIXER_OK;
+}
+
+int MixerAddDucker(MixerContext *Mixer, int32 Bus, int32 Key, const MixerDuckInfo *Info)
+{
+    if (Mixer == NULL || Info == NULL || Bus < 0 || Key <= Bus || Key >= Mixer->BusCount || Mixer->Started) return MIXER_ERR_ARG;
+    MixerBus *Target = &Mixer->Buses[Bus];
+    MixerBus *Source = &Mixer->Buses[Key];
+    if (Target->Duck != NULL) return MIXER_ERR_ARG;
+    // Outputs have lower indices, the key feeds Bus if its path to the master passes it.
+    for (int32 Output = Source->Output; Output >= Bus; Output = Mixer->Buses[Output].Output)
+    {
+        if (Output == Bus) return MIXER_ERR_ARG;
+    }
+
+    Ducker *Duck = av_malloc(sizeof(Ducker));
+    if (Duck == NULL) return MIXER_ERR_NOMEM;
+    int32 Ret = DuckerInit(Duck, Info, Key, Mixer->Config.SampleRate, Mixer->Config.BlockSize);
+    if (Ret >= 0 && ((Target->Delay != NULL && Target->Delay->Length != Duck->Lookahead) ||
+                     (Source->Delay != NULL && Source->Delay->Length != Duck->Lookahead)))
+    {
+        Ret = MIXER_ERR_ARG;
+    }
+    if (Ret >= 0)
+    {
+        int32 *Ducked = av_realloc_array(Source->Ducked, Source->DuckedCount + 1, sizeof(int32));
+        if (Ducked == NULL) Ret = MIXER_ERR_NOMEM;
+        else Source->Ducked = Ducked;
+    }
+    if (Ret >= 0) Ret = DelayReserve(Mixer, &Target->Delay, Duck->Lookahead);
+    if (Ret >= 0) Ret = DelayReserve(Mixer, &Source->Delay, Duck->Lookahead);
+    if (Ret < 0)
+    {
+        DuckerFree(Duck);
+        av_free(Duck);
+        return Ret;
+    }
+    Source->Ducked[Source->DuckedCount++] = Bus;
+    Target->Duck = Duck;
+    // Like an effect, the delays ring out through blocks between clips.
+    Mixer->EffectCount++;
+
+    return MIXER_OK;
+}
+
+// Give every bus the scratch its clips with a strip are processed in.
+static int32 StripReserve(MixerContext *Mixer)
+{
+    for (int32 BusIndex = 0; BusIndex < Mixer->BusCount; BusIndex++)
+    {
+        MixerBus *Bus = &Mixer->Buses[BusIndex];
+        if (Bus->Strips != NULL) continue;
+        StripGroup *Group = av_malloc(sizeof(StripGroup));
+        if (Group == NULL) return MIXER_ERR_NOMEM;
+        int32 Ret = StripGroupInit(Group, Mixer->Config.ChannelCount, Mixer->Config.BlockSize);
+        if (Ret < 0)
+        {
+            av_free(Group);
+            return Ret;
+        }
+        Bus->Strips = Group;
+    }
+    return MIXER_OK;
+}
+
+static int CompareClipOrder(const void *A, const void *B)
+{
+    const MixerClipOrder *X = (const MixerClipOrder *)A;
+    const MixerClipOrder *Y = (const MixerClipOrder *)B;
+    if (X->StartSample != Y->StartSample) return X->StartSample < Y->StartSample ? -1 : 1;
+    return X->Index - Y->Index;
+}
+
+// Latency and tail of every bus, from the leaves up. A bus waits for the
+// slowest bus feeding it, then its effects and ducker delay add their own.
+// The master's are those of the whole mix.
+static void TimelineDelay(MixerContext *Mixer)
+{
+    for (int32 BusIndex = Mixer->BusCount - 1; BusIndex >= 0; BusIndex--)
+    {
+        MixerBus *Bus = &Mixer->Buses[BusIndex];
+        Bus->InputLatency = 0;
+        Bus->Tail = 0;
+        for (int32 Index = 0; Index < Bus->ChildCount; Index++)
+        {
+            const MixerBus *Child = &Mixer->Buses[Bus->Children[Index]];
+            if (Child->Latency > Bus->InputLatency) Bus->InputLatency = Child->Latency;
+            if (Child->Tail > Bus->Tail) Bus->Tail = Child->Tail;
+        }
+        Bus->Latency = Bus->InputLatency + (Bus->Delay != NULL ? Bus->Delay->Length : 0);
+        for (int32 Index = 0; Index < Bus->EffectCount; Index++)
+        {
+            Bus->Latency += Bus->Effects[Index].Latency;
+            Bus->Tail += Bus->Effects[Index].Tail;
+        }
+    }
+    Mixer->Latency = Mixer->Buses[MIXER_MASTER_BUS].Latency;
+    Mixer->Tail = Mixer->Buses[MIXER_MASTER_BUS].Tail;
+}
+
+// Delay lines lining every bus and clip up with the slowest path to the master.
+static int32 TimelineAlign(MixerContext *Mixer)
+{
+    for (int32 BusIndex = 1; BusIndex < Mixer->BusCount; BusIndex++)
+    {
+        MixerBus *Bus = &Mixer->Buses[BusIndex];
+        int32 Length = Mixer->Buses[Bus->Output].InputLatency - Bus->Latency;
+        if (Length == 0) continue;
+        int32 Ret = DelayReserve(Mixer, &Bus->Align, Length);
+        if (Ret < 0) return Ret;
+    }
+    for (int32 Index = 0; Index < Mixer->ClipCount; Index++)
+    {
+        MixerBus *Bus = &Mixer->Buses[Mixer->Clips[Index].Bus];
+        if (Bus->InputLatency == 0) continue;
+        int32 Ret = DelayReserve(Mixer, &Bus->ClipAlign, Bus->InputLatency);
+        if (Ret < 0) return Ret;
+    }
+    return MIXER_OK;
+}
+
+// Sort clips by start and set up the per-source discard bookkeeping.
+static int32 TimelineBuild(MixerContext *Mixer)
+{
+    Mixer->Order = av_malloc_array(Mixer->ClipCount + 1, sizeof(MixerClipOrder));
+    Mixer->Active = av_malloc_array(Mixer->ClipCount + 1, sizeof(int32));
+    Mixer->Touched = av_malloc_array(Mixer->SourceCount + 1, sizeof(MixerSource *));
+    Mixer->BusClips = av_malloc_array(Mixer->ClipCount + 1, sizeof(int32));
+    if (Mixer->Order == NULL || Mixer->Active == NULL || Mixer->Touched == NULL || Mixer->BusClips == NULL) return MIXER_ERR_NOMEM;
+    TimelineDelay(Mixer);
+    int32 Ret = TimelineAlign(Mixer);
+    if (Ret < 0) return Ret;
+    Mixer->Skip = Mixer->Latency;
+    if (Mixer->Latency > 0)
+    {
+        Mixer->Carry = av_malloc_array(Mixer->Config.BlockSize, Mixer->Config.ChannelCount*sizeof(float32));
+        if (Mixer->Carry == NULL) return MIXER_ERR_NOMEM;
+    }
+    if (Mixer->BusCount > 1 && Mixer->Config.ThreadCount > 1)
+    {
+        if (PoolCreate(&Mixer->Pool, Mixer->Config.ThreadCount) != 0) return MIXER_ERR_NOMEM;
+    }
+    for (int32 Index = 0; Index < Mixer->ClipCount; Index++)
+    {
+        if (Mixer->Clips[Index].Strip == NULL) continue;
+        Ret = StripReserve(Mixer);
+        if (Ret < 0) return Ret;
+        break;
+    }
+
+    for (int32 Index = 0; Index < Mixer->ClipCount; Index++)
+    {
+        Mixer->Order[Index].StartSample = Mixer->Clips[Index].StartSample;
+        Mixer->Order[Index].Index = Index;
+    }
+    qsort(Mixer->Order, Mixer->ClipCount, sizeof(MixerClipOrder), CompareClipOrder);
+
+    for (int32 SourceIndex = 0; SourceIndex < Mixer->SourceCount; SourceIndex++)
+    {
+        MixerSource *Source = Mixer->Sources[SourceIndex];
+        Source->Unstarted = 0;
+        Source->MinTrim = INT64_MAX;
+        Source->Stamp = -1;
+    }
+    for (int32 Index = 0; Index < Mixer->ClipCount; Index++)
+    {
+        MixerClip *Clip = &Mixer->Clips[Index];
+        MixerSource *Source = Clip->Source;
+        Source->Unstarted++;
+        if (Clip->TrimSample < Source->MinTrim) Source->MinTrim = Clip->TrimSample;
+        Source->ReadPosition = Source->MinTrim;
+    }
+
+    Mixer->Started = 1;
+    return MIXER_OK;
+}
+
+// Source position where Clip stops playing, INT64_MAX while unknown.
+static int64 ClipSourceEnd(const MixerClip *Clip)
+{
+    int64 End = Clip->LengthSample >= 0 ? Clip->TrimSample + Clip->LengthSample : INT64_MAX;
+    if (Clip->Source->Ended && Clip->Source->Length < End) End = Clip->Source->Length;
+    return End;
+}
+
+// Decode until the clip's source is buffered from SourceStart up to SourceEnd,
+// or has ended. Samples that were already dropped, or that lie far ahead of
+// what is buffered, are reached by seeking rather than decoding. The caller
+// holds the source's lock.
+static int32 ClipFill(MixerClip *Clip, int32 ChannelCount, int64 SourceStart, int64 SourceEnd)
+{
+    MixerSource *Source = Clip->Source;
+    int32 Ret = MIXER_OK;
+
+    int64 BufferEnd = Source->BufferStart + Source->BufferCount;
+    if (!(Source->Ended && SourceStart >= Source->Length))
+    {
+        if (SourceStart < Source->BufferStart)
+        {
+            // Also bring back what other clips on this source still need.
+            int64 Target = Source->ReadPosition < SourceStart ? Source->ReadPosition : SourceStart;
+            Ret = SourceSeek(Source, Target);
+        }
+        else if (!Source->SeekFailed)
+        {
+            // Skip what no clip needs anymore. Inputs that cannot seek are decoded through.
+            int64 Target = Source->ReadPosition < SourceStart ? Source->ReadPosition : SourceStart;
+            if (Target - BufferEnd > (int64)MIXER_SEEK_AHEAD_SECONDS*Source->SampleRate)
+            {
+                Ret = SourceSeek(Source, Target);
+                if (Ret == MIXER_ERR_DECODE) Ret = MIXER_OK;
+            }
+        }
+    }
+    if (Ret >= 0) Ret = SourceFill(Source, ChannelCount, SourceEnd);
+    if (Source->Ended)
+    {
+        int64 End = ClipSourceEnd(Clip);
+        Clip->EndSample = Clip->StartSample + (End > Clip->TrimSample ? End - Clip->TrimSample : 0);
+    }
+
+    return Ret < 0 ? Ret : MIXER_OK;
+}
+
+int32 MixerGetInputCount(MixerContext *Mixer)
+{
+    return Mixer ? Mixer->ClipCount : 0;
+}
+
+int MixerPrefetchInput(MixerContext *Mixer, int32 Index, int32 SampleCount)
+{
+    if (Mixer == NULL || Index < 0 || Index >= Mixer->ClipCount || SampleCount < 0) return MIXER_ERR_ARG;
+    if (!Mixer->Started) return MIXER_OK;
+
+    MixerClip *Clip = &Mixer->Clips[Index];
+    int64 OutputEnd = Mixer->Position + SampleCount;
+    if (OutputEnd <= Clip->StartSample) return MIXER_OK;
+    if (Clip->EndSample >= 0 && Clip->EndSample <= Mixer->Position) return MIXER_OK;
+
+    int64 OutputStart = Mixer->Position > Clip->StartSample ? Mixer->Position : Clip->StartSample;
+    int64 SourceStart = Clip->TrimSample + (OutputStart - Clip->StartSample);
+    int64 SourceEnd = Clip->TrimSample + (OutputEnd - Clip->StartSample);
+
+    MutexLock(&Clip->Source->Lock);
+    int64 ClipEnd = ClipSourceEnd(Clip);
+    if (SourceEnd > ClipEnd) SourceEnd = ClipEnd;
+    int32 Ret = ClipFill(Clip, Mixer->Config.ChannelCount, SourceStart, SourceEnd);
+    MutexUnlock(&Clip->Source->Lock);
+
+    return Ret;
+}
+
+// Output position where Clip stops playing, estimated from the container
+// duration until known. -1 if unknown.
+static int64 ClipOutputEnd(const MixerClip *Clip)
+{
+    if (Clip->EndSample >= 0) return Clip->EndSample;
+    int64 Duration = Clip->Source->Duration;
+    if (Duration < 0) return -1;
+    return Clip->StartSample + (Duration > Clip->TrimSample ? Duration - Clip->TrimSample : 0);
+}
+
+// Evaluate the automation of Clip for Count samples from output position
+// Position into Envelope. Every segment becomes one linear or exponential
+// ramp and fades are looked up in the curve tables, so mixing the clip then
+// costs one more multiply per sample.
+static void ClipEnvelope(MixerContext *Mixer, const MixerClip *Clip, int64 Position, int32 Count, float32 *Envelope)
+{
+    const KernelTable *Kernels = Mixer->Kernels;
+    const MixerAutomation *Automation = Clip->Automation;
+    const MixerEnvelopePoint *Points = Automation->Points;
+    int32 PointCount = Automation->PointCount;
+    int64 Time = Position - Clip->StartSample;
+
+    if (PointCount == 0) Kernels->Ramp(Envelope, Count, 1.0f, 0.0f);
+    for (int32 Done = 0; PointCount > 0 && Done < Count;)
+    {
+        // Find the last point at or before Now, -1 if there is none.
+        int64 Now = Time + Done;
+        int32 Low = 0;
+        int32 High = PointCount;
+        while (Low < High)
+        {
+            int32 Middle = (Low + High)/2;
+            if (Points[Middle].Sample <= Now) Low = Middle + 1;
+            else High = Middle;
+        }
+        int32 Point = Low - 1;
+
+        int64 Remaining = Count - Done;
+        if (Point < 0 || Point == PointCount - 1)
+        {
+            // Hold before the first and after the last point.
+            if (Point < 0 && Points[0].Sample - Now < Remaining) Remaining = Points[0].Sample - Now;
+            Kernels->Ramp(Envelope + Done, (int32)Remaining, Points[Point < 0 ? 0 : Point].Gain, 0.0f);
+            Done += (int32)Remaining;
+            continue;
+        }
+
+        const MixerEnvelopePoint *From = &Points[Point];
+        const MixerEnvelopePoint *To = &Points[Point + 1];
+        if (To->Sample - Now < Remaining) Remaining = To->Sample - Now;
+        float64 Span = (float64)(To->Sample - From->Sample);
+        float64 Elapsed = (float64)(Now - From->Sample);
+        if (From->Curve == MIXER_CURVE_EXPONENTIAL)
+        {
+            float64 Start = From->Gain > MIXER_ENVELOPE_FLOOR ? From->Gain : MIXER_ENVELOPE_FLOOR;
+            float64 End = To->Gain > MIXER_ENVELOPE_FLOOR ? To->Gain : MIXER_ENVELOPE_FLOOR;
+            float64 Ratio = pow(End/Start, 1.0/Span);
+            Kernels->RampExp(Envelope + Done, (int32)Remaining, (float32)(Start*pow(Ratio, Elapsed)), (float32)Ratio);
+        }
+        else
+        {
+            float64 Step = (To->Gain - From->Gain)/Span;
+            Kernels->Ramp(Envelope + Done, (int32)Remaining, (float32)(From->Gain + Elapsed*Step), (float32)Step);
+        }
+        Done += (int32)Remaining;
+    }
+
+    const float32 *Table = Mixer->CurveTables[Automation->FadeCurve == MIXER_CURVE_EQUAL_POWER];
+    int64 FadeIn = Automation->FadeIn;
+    if (FadeIn > 0 && Time < FadeIn)
+    {
+        int32 Length = FadeIn - Time < Count ? (int32)(FadeIn - Time) : Count;
+        Kernels->Curve(Envelope, Length, Table, MIXER_CURVE_TABLE_SIZE, (float32)Time/FadeIn, 1.0f/FadeIn);
+    }
+    int64 FadeOut = Automation->FadeOut;
+    int64 End = ClipOutputEnd(Clip);
+    if (FadeOut > 0 && End >= 0)
+    {
+        // The curve runs backwards from the end of the clip.
+        End -= Clip->StartSample;
+        int64 Skip = End - FadeOut - Time;
+        if (Skip < 0) Skip = 0;
+        if (Skip < Count)
+        {
+            float32 Left = (float32)(End - Time - Skip)/FadeOut;
+            Kernels->Curve(Envelope + Skip, Count - (int32)Skip, Table, MIXER_CURVE_TABLE_SIZE, Left, -1.0f/FadeOut);
+        }
+    }
+}
+
+// Add Count samples of Clip starting at output position Position to Mix at
+// Offset, with the gain of each channel ramping from From to To over the
+// Count samples, times the clip's automation if Automate. Clips on
+// different buses may share a source and be mixed concurrently, the source
+// stays locked until its samples have been read.
+static int32 MixClip(MixerContext *Mixer, MixerClip *Clip, int64 Position, int32 Offset, int32 Count,
+                     float32 *const *Mix, const float32 *From, const float32 *To, int32 Automate)
+{
+    int32 ChannelCount = Mixer->Config.ChannelCount;
+    MixerSource *Source = Clip->Source;
+    int64 SourcePosition = Clip->TrimSample + (Position - Clip->StartSample);
+    int64 SourceEnd = SourcePosition + Count;
+
+    MutexLock(&Source->Lock);
+    int64 ClipEnd = ClipSourceEnd(Clip);
+    if (SourceEnd > ClipEnd) SourceEnd = ClipEnd;
+    int32 Ret = ClipFill(Clip, ChannelCount, SourcePosition, SourceEnd);
+    if (Ret < 0)
+    {
+        MutexUnlock(&Source->Lock);
+        return Ret;
+    }
+
+    // A seek that landed late leaves the samples before it silent.
+    int32 RampLength = Count;
+    int64 Skip = Source->BufferStart - SourcePosition;
+    if (Skip < 0) Skip = 0;
+    if (Skip > Count) Skip = Count;
+    SourcePosition += Skip;
+    Offset += (int32)Skip;
+    Count -= (int32)Skip;
+
+    int64 BufferEnd = Source->BufferStart + Source->BufferCount;
+    int64 Available = (BufferEnd < SourceEnd ? BufferEnd : SourceEnd) - SourcePosition;
+    int32 MixCount = Available < Count ? (int32)Available : Count;
+    if (MixCount < 0) MixCount = 0;
+    int32 BufferOffset = (int32)(SourcePosition - Source->BufferStart);
+    float32 *Envelope = NULL;
+    if (Automate && Clip->Automation != NULL && MixCount > 0)
+    {
+        // Each clip is mixed once per block, its scratch is never shared.
+        Envelope = Clip->Automation->Envelope;
+        ClipEnvelope(Mixer, Clip, Position + Skip, MixCount, Envelope);
+    }
+    // Only the mixer's own DSP runs with denormals flushed, decoding and rate
+    // conversion above stay in the default mode so that a block comes out the
+    // same whether or not it was prefetched.
+    uint32_t Mode = ThreadFlushDenormals();
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        float32 Step = (To[Channel] - From[Channel])/RampLength;
+        float32 *Dst = Mix[Channel] + Offset;
+        const float32 *Src = Source->Buffer[Channel] + BufferOffset;
+        if (Envelope != NULL) Mixer->Kernels->MixEnvelope(Dst, Src, Envelope, MixCount, From[Channel] + Skip*Step, Step);
+        else Mixer->Kernels->Mix(Dst, Src, MixCount, From[Channel] + Skip*Step, Step);
+    }
+    ThreadRestoreDenormals(Mode);
+    MutexUnlock(&Source->Lock);
+    Clip->SourcePosition = SourcePosition + MixCount;
+
+    return MIXER_OK;
+}
+
+// Release samples of the sources touched this block that no clip will read
+// again, and drop the clips that stopped from the active list.
+static void RetireClips(MixerContext *Mixer, int64 BlockEnd)
+{
+    int32 ChannelCount = Mixer->Config.ChannelCount;
+    int64 Stamp = Mixer->BlockIndex++;
+
+    int32 TouchedCount = 0;
+    for (int32 Index = 0; Index < Mixer->ActiveCount; Index++)
+    {
+        MixerSource *Source = Mixer->Clips[Mixer->Active[Index]].Source;
+        if (Source->Stamp == Stamp) continue;
+        Source->Stamp = Stamp;
+        Source->ReadPosition = Source->Unstarted ? Source->MinTrim : INT64_MAX;
+        Mixer->Touched[TouchedCount++] = Source;
+    }
+
+    int32 Kept = 0;
+    for (int32 Index = 0; Index < Mixer->ActiveCount; Index++)
+    {
+        int32 ClipIndex = Mixer->Active[Index];
+        MixerClip *Clip = &Mixer->Clips[ClipIndex];
+        if (Clip->EndSample >= 0 && Clip->EndSample <= BlockEnd)
+        {
+            if (Clip->EndSample > Mixer->MixEnd) Mixer->MixEnd = Clip->EndSample;
+            continue;
+        }
+        if (Clip->SourcePosition < Clip->Source->ReadPosition) Clip->Source->ReadPosition = Clip->SourcePosition;
+        Mixer->Active[Kept++] = ClipIndex;
+    }
+    Mixer->ActiveCount = Kept;
+
+    for (int32 Index = 0; Index < TouchedCount; Index++)
+    {
+        MixerSource *Source = Mixer->Touched[Index];
+        SourceDiscard(Source, ChannelCount, Source->ReadPosition);
+    }
+}
+
+// Samples of the block at BlockStart up to where Clip stops. The filter
+// tails after that are cut so that the clip ends as it would unprocessed.
+static int32 StripLength(const MixerClip *Clip, int64 BlockStart, int32 BlockSize)
+{
+    if (Clip->EndSample < 0 || Clip->EndSample >= BlockStart + BlockSize) return BlockSize;
+    return Clip->EndSample > BlockStart ? (int32)(Clip->EndSample - BlockStart) : 0;
+}
+
+// Mix the clips loaded into the strip group of Bus, Clips[l] playing in lane
+// l, into the bus after their strips, with their gains and automation.
+static void StripFlush(MixerContext *Mixer, MixerBus *Bus, const int32 *Clips, int64 BlockStart)
+{
+    StripGroup *Group = Bus->Strips;
+    int32 BlockSize = Mixer->Config.BlockSize;
+
+    uint32_t Mode = ThreadFlushDenormals();
+    StripGroupRun(Group, Mixer->Kernels, BlockSize);
+    for (int32 Lane = 0; Lane < Group->Count; Lane++)
+    {
+        int32 ClipIndex = Clips[Lane];
+        MixerClip *Clip = &Mixer->Clips[ClipIndex];
+        int64 Start = Clip->StartSample > BlockStart ? Clip->StartSample : BlockStart;
+        int32 Offset = (int32)(Start - BlockStart);
+        int32 RampLength = BlockSize - Offset;
+        int32 Count = StripLength(Clip, BlockStart, BlockSize) - Offset;
+        if (Count <= 0) continue;
+
+        float32 From[MIXER_MAX_CHANNELS], To[MIXER_MAX_CHANNELS];
+        TrackRamp(Mixer, ClipIndex, From, To);
+        float32 *Envelope = NULL;
+        if (Clip->Automation != NULL)
+        {
+            Envelope = Clip->Automation->Envelope;
+            ClipEnvelope(Mixer, Clip, Start, Count, Envelope);
+        }
+        for (int32 Channel = 0; Channel < Mixer->Config.ChannelCount; Channel++)
+        {
+            float32 Step = (To[Channel] - From[Channel])/RampLength;
+            float32 *Dst = Bus->Buffer[Channel] + Offset;
+            const float32 *Src = Group->Planar[Lane][Channel] + Offset;
+            if (Envelope != NULL) Mixer->Kernels->MixEnvelope(Dst, Src, Envelope, Count, From[Channel], Step);
+            else Mixer->Kernels->Mix(Dst, Src, Count, From[Channel], Step);
+        }
+    }
+    ThreadRestoreDenormals(Mode);
+    Group->Count = 0;
+}
+
+// Mix Count clips of the list Clips into Bus. Clips with a strip are
+// decoded at unity gain into a lane of the bus's strip group, and the group
+// is mixed whenever its lanes are full and after the last clip.
+static int32 MixClips(MixerContext *Mixer, MixerBus *Bus, const int32 *Clips, int32 Count, int64 BlockStart)
+{
+    int32 ChannelCount = Mixer->Config.ChannelCount;
+    int32 BlockSize = Mixer->Config.BlockSize;
+    int64 BlockEnd = BlockStart + BlockSize;
+    int32 Lanes[KERNEL_LANES];
+
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        int32 ClipIndex = Clips[Index];
+        MixerClip *Clip = &Mixer->Clips[ClipIndex];
+        int64 Start = Clip->StartSample > BlockStart ? Clip->StartSample : BlockStart;
+        float32 From[MIXER_MAX_CHANNELS], To[MIXER_MAX_CHANNELS];
+        if (Clip->Strip == NULL)
+        {
+            TrackRamp(Mixer, ClipIndex, From, To);
+            int32 Ret = MixClip(Mixer, Clip, Start, (int32)(Start - BlockStart), (int32)(BlockEnd - Start), Bus->Buffer, From, To, 1);
+            if (Ret < 0) return Ret;
+            continue;
+        }
+
+        StripGroup *Group = Bus->Strips;
+        float32 **Planar = Group->Planar[Group->Count];
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            memset(Planar[Channel], 0, BlockSize*sizeof(float32));
+            From[Channel] = 1.0f;
+        }
+        int32 Ret = MixClip(Mixer, Clip, Start, (int32)(Start - BlockStart), (int32)(BlockEnd - Start), Planar, From, From, 0);
+        if (Ret < 0)
+        {
+            Group->Count = 0;
+            return Ret;
+        }
+        Lanes[Group->Count] = ClipIndex;
+        StripGroupLoad(Group, Clip->Strip);
+        if (Group->Count == KERNEL_LANES) StripFlush(Mixer, Bus, Lanes, BlockStart);
+    }
+    if (Bus->Strips != NULL && Bus->Strips->Count > 0) StripFlush(Mixer, Bus, Lanes, BlockStart);
+
+    return MIXER_OK;
+}
+
+// Filter and effect tails decay into denormals, which cost far more than
+// they are worth, so effects run with them flushed.
+static void BusEffects(MixerContext *Mixer, MixerBus *Bus)
+{
+    uint32_t Mode = ThreadFlushDenormals();
+    for (int32 Index = 0; Index < Bus->EffectCount; Index++)
+    {
+        MixerEffect *Effect = &Bus->Effects[Index];
+        Effect->Process(Effect->State, Bus->Buffer, Mixer->Config.ChannelCount, Mixer->Config.BlockSize);
+    }
+    ThreadRestoreDenormals(Mode);
+}
+
+// Sum the bus's clips and the buses feeding it, then run its effects.
+static int32 BusProcess(MixerContext *Mixer, MixerBus *Bus, int64 BlockStart)
+{
+    int32 ChannelCount = Mixer->Config.ChannelCount;
+    int32 BlockSize = Mixer->Config.BlockSize;
+
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        memset(Bus->Buffer[Channel], 0, BlockSize*sizeof(float32));
+    }
+    int32 Ret = MixClips(Mixer, Bus, Mixer->BusClips + Bus->ClipStart, Bus->ClipCount, BlockStart);
+    if (Ret < 0) return Ret;
+    if (Bus->ClipAlign != NULL) DelayProcess(Bus->ClipAlign, Bus->Buffer, ChannelCount, BlockSize);
+
+    // The clips are in, the rest is the bus's own DSP.
+    uint32_t Mode = ThreadFlushDenormals();
+    for (int32 Index = 0; Index < Bus->ChildCount; Index++)
+    {
+        MixerBus *Child = &Mixer->Buses[Bus->Children[Index]];
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            Mixer->Kernels->Mix(Bus->Buffer[Channel], Child->Buffer[Channel], BlockSize, Child->Gain, 0.0f);
+        }
+    }
+    BusEffects(Mixer, Bus);
+
+    // Keys see their output ahead of the delay, ducked buses get the gains
+    // their key left for this block.
+    for (int32 Index = 0; Index < Bus->DuckedCount; Index++)
+    {
+        DuckerKey(Mixer->Buses[Bus->Ducked[Index]].Duck, Bus->Buffer, ChannelCount, BlockSize);
+    }
+    if (Bus->Delay != NULL && Bus->Delay->Length > 0) DelayProcess(Bus->Delay, Bus->Buffer, ChannelCount, BlockSize);
+    if (Bus->Duck != NULL) DuckerApply(Bus->Duck, Bus->Buffer, ChannelCount, BlockSize);
+    if (Bus->Align != NULL) DelayProcess(Bus->Align, Bus->Buffer, ChannelCount, BlockSize);
+    ThreadRestoreDenormals(Mode);
+
+    return MIXER_OK;
+}
+
+// Process a bus on the pool and hand its parent on once the last bus feeding it is done.
+static void BusTask(void *Arg)
+{
+    MixerBus *Bus = (MixerBus *)Arg;
+    MixerContext *Mixer = Bus->Mixer;
+
+    Bus->Result = BusProcess(Mixer, Bus, Mixer->Position);
+    if (Bus->Output >= 0)
+    {
+        MixerBus *Parent = &Mixer->Buses[Bus->Output];
+        if (AtomicAdd(&Parent->Pending, -1) == 0) PoolSubmit(Mixer->Pool, BusTask, Parent);
+    }
+    for (int32 Index = 0; Index < Bus->DuckedCount; Index++)
+    {
+        MixerBus *Ducked = &Mixer->Buses[Bus->Ducked[Index]];
+        if (AtomicAdd(&Ducked->Pending, -1) == 0) PoolSubmit(Mixer->Pool, BusTask, Ducked);
+    }
+}
+
+// Render the active clips through the bus graph into the master.
+static int32 MixGraph(MixerContext *Mixer, int64 BlockStart)
+{
+    // Bucket the active clips by bus.
+    for (int32 Index = 0; Index < Mixer->BusCount; Index++)
+    {
+        Mixer->Buses[Index].ClipCount = 0;
+    }
+    for (int32 Index = 0; Index < Mixer->ActiveCount; Index++)
+    {
+        Mixer->Buses[Mixer->Clips[Mixer->Active[Index]].Bus].ClipCount++;
+    }
+    int32 ClipStart = 0;
+    for (int32 Index = 0; Index < Mixer->BusCount; Index++)
+    {
+        MixerBus *Bus = &Mixer->Buses[Index];
+        Bus->ClipStart = ClipStart;
+        ClipStart += Bus->ClipCount;
+        Bus->ClipCount = 0;
+    }
+    for (int32 Index = 0; Index < Mixer->ActiveCount; Index++)
+    {
+        MixerBus *Bus = &Mixer->Buses[Mixer->Clips[Mixer->Active[Index]].Bus];
+        Mixer->BusClips[Bus->ClipStart + Bus->ClipCount++] = Mixer->Active[Index];
+    }
+
+    if (Mixer->Pool != NULL)
+    {
+        // Start from the leaves, every bus submits its parent when it is the
+        // last child done, and the buses it ducks when it is their last wait.
+        for (int32 Index = 0; Index < Mixer->BusCount; Index++)
+        {
+            MixerBus *Bus = &Mixer->Buses[Index];
+            Bus->Result = MIXER_OK;
+            AtomicStore(&Bus->Pending, Bus->ChildCount + (Bus->Duck != NULL));
+        }
+        for (int32 Index = 0; Index < Mixer->BusCount; Index++)
+        {
+            MixerBus *Bus = &Mixer->Buses[Index];
+            if (Bus->ChildCount == 0 && Bus->Duck == NULL) PoolSubmit(Mixer->Pool, BusTask, Bus);
+        }
+        PoolWait(Mixer->Pool);
+        for (int32 Index = 0; Index < Mixer->BusCount; Index++)
+        {
+            if (Mixer->Buses[Index].Result < 0) return Mixer->Buses[Index].Result;
+        }
+    }
+    else
+    {
+        // Children and keys come after the buses waiting on them, so reverse
+        // order respects every dependency.
+        for (int32 Index = Mixer->BusCount - 1; Index >= 0; Index--)
+        {
+            int32 Ret = BusProcess(Mixer, &Mixer->Buses[Index], BlockStart);
+            if (Ret < 0) return Ret;
+        }
+    }
+
+    return MIXER_OK;
+}
+
+static void CacheDrop(MixerContext *Mixer, int64 BlockIndex)
+{
+    MixerCacheBlock *Block = Mixer->Cache[BlockIndex];
+    if (Block == NULL) return;
+    for (int32 Stem = 0; Stem < Block->StemCount; Stem++)
+    {
+        av_free(Block->Stems[Stem].Samples);
+    }
+    av_free(Block->Stems);
+    av_free(Block->Base);
+    av_free(Block);
+    Mixer->Cache[BlockIndex] = NULL;
+}
+
+static void CacheFree(MixerContext *Mixer)
+{
+    for (int64 Index = 0; Index < Mixer->CacheCapacity; Index++)
+    {
+        CacheDrop(Mixer, Index);
+    }
+    av_freep(&Mixer->Cache);
+    Mixer->CacheCapacity = 0;
+}
+
+// Look up block BlockIndex, creating an empty one (Fresh) on a miss.
+static int32 CacheGet(MixerContext *Mixer, int64 BlockIndex, MixerCacheBlock **Result, int32 *Fresh)
+{
+    if (BlockIndex >= Mixer->CacheCapacity)
+    {
+        int64 Capacity = Mixer->CacheCapacity ? Mixer->CacheCapacity : 256;
+        while (Capacity <= BlockIndex) Capacity *= 2;
+        MixerCacheBlock **Cache = av_realloc_array(Mixer->Cache, Capacity, sizeof(MixerCacheBlock *));
+        if (Cache == NULL) return MIXER_ERR_NOMEM;
+        memset(Cache + Mixer->CacheCapacity, 0, (Capacity - Mixer->CacheCapacity)*sizeof(MixerCacheBlock *));
+        Mixer->Cache = Cache;
+        Mixer->CacheCapacity = Capacity;
+    }
+
+    *Fresh = 0;
+    if (Mixer->Cache[BlockIndex] == NULL)
+    {
+        MixerCacheBlock *Block = av_mallocz(sizeof(MixerCacheBlock));
+        if (Block == NULL) return MIXER_ERR_NOMEM;
+        Block->Base = av_mallocz(Mixer->Config.ChannelCount*Mixer->Config.BlockSize*sizeof(float32));
+        if (Block->Base == NULL)
+        {
+            av_free(Block);
+            return MIXER_ERR_NOMEM;
+        }
+        Mixer->Cache[BlockIndex] = Block;
+        *Fresh = 1;
+    }
+    *Result = Mixer->Cache[BlockIndex];
+
+    return MIXER_OK;
+}
+
+static void CacheChannels(const MixerContext *Mixer, float32 *Samples, float32 **Channels)
+{
+    for (int32 Channel = 0; Channel < Mixer->Config.ChannelCount; Channel++)
+    {
+        Channels[Channel] = Samples + Channel*Mixer->Config.BlockSize;
+    }
+}
+
+// Run the stem of Clip through its strip, on its own in the master's group.
+static void StripStem(MixerContext *Mixer, MixerClip *Clip, int64 BlockStart, float32 *const *Samples)
+{
+    StripGroup *Group = Mixer->Buses[MIXER_MASTER_BUS].Strips;
+    size_t Size = Mixer->Config.BlockSize*sizeof(float32);
+    for (int32 Channel = 0; Channel < Mixer->Config.ChannelCount; Channel++)
+    {
+        memcpy(Group->Planar[0][Channel], Samples[Channel], Size);
+    }
+    StripGroupLoad(Group, Clip->Strip);
+    uint32_t Mode = ThreadFlushDenormals();
+    StripGroupRun(Group, Mixer->Kernels, Mixer->Config.BlockSize);
+    ThreadRestoreDenormals(Mode);
+    Group->Count = 0;
+    int32 Length = StripLength(Clip, BlockStart, Mixer->Config.BlockSize);
+    for (int32 Channel = 0; Channel < Mixer->Config.ChannelCount; Channel++)
+    {
+        memcpy(Samples[Channel], Group->Planar[0][Channel], Length*sizeof(float32));
+    }
+}
+
+// Render the active clips through a cached block into the mix buffer. Clips
+// already summed into the base are not decoded, an edited clip is decoded
+// into its stem the first time the block is rendered after the edit and
+// moved out of the base.
+static int32 MixCached(MixerContext *Mixer, MixerCacheBlock *Block, int32 Fresh, int64 BlockStart)
+{
+    int32 ChannelCount = Mixer->Config.ChannelCount;
+    int32 BlockSize = Mixer->Config.BlockSize;
+    int64 BlockEnd = BlockStart + BlockSize;
+    float32 *Base[MIXER_MAX_CHANNELS];
+    CacheChannels(Mixer, Block->Base, Base);
+
+    for (int32 Index = 0; Index < Mixer->ActiveCount; Index++)
+    {
+        int32 ClipIndex = Mixer->Active[Index];
+        MixerClip *Clip = &Mixer->Clips[ClipIndex];
+        int64 Start = Clip->StartSample > BlockStart ? Clip->StartSample : BlockStart;
+        int32 Offset = (int32)(Start - BlockStart);
+
+        MixerCacheStem *Stem = NULL;
+        for (int32 StemIndex = 0; StemIndex < Block->StemCount; StemIndex++)
+        {
+            if (Block->Stems[StemIndex].Clip == ClipIndex) Stem = &Block->Stems[StemIndex];
+        }
+        if (Stem != NULL || (!Clip->Edited && !Fresh))
+        {
+            // Cached, only keep the source bookkeeping moving.
+            Clip->SourcePosition = Clip->TrimSample + (BlockEnd - Clip->StartSample);
+            continue;
+        }
+        // The base holds each clip at one gain, edits ramp in as the stems are mixed out.
+        float32 Gains[MIXER_MAX_CHANNELS];
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            Gains[Channel] = Clip->Edited ? 1.0f : Mixer->Tracks.Target[Channel][ClipIndex];
+        }
+        if (!Clip->Edited)
+        {
+            int32 Ret = MixClip(Mixer, Clip, Start, Offset, (int32)(BlockEnd - Start), Base, Gains, Gains, 1);
+            if (Ret < 0) return Ret;
+            continue;
+        }
+
+        float32 *Stored = av_mallocz(ChannelCount*BlockSize*sizeof(float32));
+        MixerCacheStem *Stems = av_realloc_array(Block->Stems, Block->StemCount + 1, sizeof(MixerCacheStem));
+        if (Stems != NULL) Block->Stems = Stems;
+        if (Stored == NULL || Stems == NULL)
+        {
+            av_free(Stored);
+            return MIXER_ERR_NOMEM;
+        }
+
+        float32 *Samples[MIXER_MAX_CHANNELS];
+        CacheChannels(Mixer, Stored, Samples);
+        int32 Ret = MixClip(Mixer, Clip, Start, Offset, (int32)(BlockEnd - Start), Samples, Gains, Gains, 0);
+        if (Ret < 0)
+        {
+            av_free(Stored);
+            return Ret;
+        }
+        if (Clip->Strip != NULL) StripStem(Mixer, Clip, BlockStart, Samples);
+        Block->Stems[Block->StemCount].Clip = ClipIndex;
+        Block->Stems[Block->StemCount].Samples = Stored;
+        Block->StemCount++;
+        if (!Fresh)
+        {
+            // The base was rendered with the clip's gains before the edit.
+            uint32_t Mode = ThreadFlushDenormals();
+            for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+            {
+                Mixer->Kernels->Mix(Base[Channel], Samples[Channel], BlockSize, -Mixer->Tracks.Cached[Channel][ClipIndex], 0.0f);
+            }
+            ThreadRestoreDenormals(Mode);
+        }
+    }
+
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        memcpy(Mixer->MixBuffer[Channel], Base[Channel], BlockSize*sizeof(float32));
+    }
+    uint32_t Mode = ThreadFlushDenormals();
+    for (int32 StemIndex = 0; StemIndex < Block->StemCount; StemIndex++)
+    {
+        MixerCacheStem *Stem = &Block->Stems[StemIndex];
+        MixerClip *Clip = &Mixer->Clips[Stem->Clip];
+        // Stems are unscaled, automation applies on the way out like the gains.
+        float32 *Envelope = NULL;
+        if (Clip->Automation != NULL)
+        {
+            Envelope = Clip->Automation->Envelope;
+            ClipEnvelope(Mixer, Clip, BlockStart, BlockSize, Envelope);
+        }
+        // Edits ramp in over the block as in MixClips(), the base keeps the
+        // clips that never changed at their one gain.
+        float32 From[MIXER_MAX_CHANNELS], To[MIXER_MAX_CHANNELS];
+        TrackRamp(Mixer, Stem->Clip, From, To);
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            float32 Step = (To[Channel] - From[Channel])/BlockSize;
+            float32 *Samples = Stem->Samples + Channel*BlockSize;
+            if (Envelope != NULL) Mixer->Kernels->MixEnvelope(Mixer->MixBuffer[Channel], Samples, Envelope, BlockSize, From[Channel], Step);
+            else Mixer->Kernels->Mix(Mixer->MixBuffer[Channel], Samples, BlockSize, From[Channel], Step);
+        }
+    }
+    ThreadRestoreDenormals(Mode);
+
+    return MIXER_OK;
+}
+
+int MixerSetCache(MixerContext *Mixer, int32 Enable)
+{
+    if (Mixer == NULL) return MIXER_ERR_ARG;
+
+    if (!Enable) CacheFree(Mixer);
+    for (int32 ClipIndex = 0; ClipIndex < Mixer->ClipCount; ClipIndex++)
+    {
+        // The base holds clips at a constant gain, automated ones and ones
+        // with a strip stay stems.
+        MixerClip *Clip = &Mixer->Clips[ClipIndex];
+        Clip->Edited = Enable && (Clip->Automation != NULL || Clip->Strip != NULL);
+    }
+    Mixer->CacheEnabled = Enable != 0;
+
+    return MIXER_OK;
+}
+
+// About to change a parameter of clip Index. The first change after blocks
+// were cached moves the clip out of the cached base, which holds it at the
+// gains it has right now.
+static void TrackEdit(MixerContext *Mixer, int32 Index)
+{
+    MixerClip *Clip = &Mixer->Clips[Index];
+    if (Mixer->CacheCapacity > 0 && !Clip->Edited)
+    {
+        TrackUpdate(Mixer);
+        for (int32 Channel = 0; Channel < Mixer->Config.ChannelCount; Channel++)
+        {
+            Mixer->Tracks.Cached[Channel][Index] = Mixer->Tracks.Target[Channel][Index];
+        }
+        Clip->Edited = 1;
+    }
+    Mixer->Tracks.Dirty = 1;
+}
+
+int MixerSetClipGain(MixerContext *Mixer, int32 Index, float32 Gain)
+{
+    if (Mixer == NULL || Index < 0 || Index >= Mixer->ClipCount) return MIXER_ERR_ARG;
+
+    TrackEdit(Mixer, Index);
+    Mixer->Tracks.Gain[Index] = Gain;
+    return MIXER_OK;
+}
+
+int MixerSetClipPan(MixerContext *Mixer, int32 Index, float32 Pan)
+{
+    if (Mixer == NULL || Index < 0 || Index >= Mixer->ClipCount || Pan < -1.0f || Pan > 1.0f) return MIXER_ERR_ARG;
+
+    TrackEdit(Mixer, Index);
+    Mixer->Tracks.Pan[Index] = Pan;
+    return MIXER_OK;
+}
+
+int MixerSetClipMute(MixerContext *Mixer, int32 Index, int32 Mute)
+{
+    if (Mixer == NULL || Index < 0 || Index >= Mixer->ClipCount) return MIXER_ERR_ARG;
+
+    TrackEdit(Mixer, Index);
+    Mixer->Tracks.Audible[Index] = Mute ? 0.0f : 1.0f;
+    return MIXER_OK;
+}
+
+// Automation of clip Index, created on first use. The clip leaves the
+// cached base for good, see MixerSetCache().
+static MixerAutomation *ClipAutomation(MixerContext *Mixer, int32 Index)
+{
+    MixerClip *Clip = &Mixer->Clips[Index];
+    if (Clip->Automation == NULL)
+    {
+        MixerAutomation *Automation = av_mallocz(sizeof(MixerAutomation));
+        if (Automation == NULL) return NULL;
+        Automation->Envelope = av_malloc(Mixer->Config.BlockSize*sizeof(float32));
+        if (Automation->Envelope == NULL)
+        {
+            av_free(Automation);
+            return NULL;
+        }
+        TrackEdit(Mixer, Index);
+        if (Mixer->CacheEnabled) Clip->Edited = 1;
+        Clip->Automation = Automation;
+    }
+    return Clip->Automation;
+}
+
+static void ClipAutomationFree(MixerClip *Clip)
+{
+    if (Clip->Automation == NULL) return;
+    av_free(Clip->Automation->Points);
+    av_free(Clip->Automation->Envelope);
+    av_freep(&Clip->Automation);
+}
+
+int MixerSetClipEnvelope(MixerContext *Mixer, int32 Index, const MixerEnvelopePoint *Points, int32 Count)
+{
+    if (Mixer == NULL || Index < 0 || Index >= Mixer->ClipCount || Count < 0 || (Count > 0 && Points == NULL)) return MIXER_ERR_ARG;
+    for (int32 Point = 0; Point < Count; Point++)
+    {
+        if (Points[Point].Curve != MIXER_CURVE_LINEAR && Points[Point].Curve != MIXER_CURVE_EXPONENTIAL) return MIXER_ERR_ARG;
+        if (Point > 0 && Points[Point].Sample < Points[Point - 1].Sample) return MIXER_ERR_ARG;
+    }
+    if (Count == 0 && Mixer->Clips[Index].Automation == NULL) return MIXER_OK;
+
+    MixerAutomation *Automation = ClipAutomation(Mixer, Index);
+    if (Automation == NULL) return MIXER_ERR_NOMEM;
+    MixerEnvelopePoint *Copy = NULL;
+    if (Count > 0)
+    {
+        Copy = av_malloc_array(Count, sizeof(MixerEnvelopePoint));
+        if (Copy == NULL) return MIXER_ERR_NOMEM;
+        memcpy(Copy, Points, Count*sizeof(MixerEnvelopePoint));
+    }
+    av_free(Automation->Points);
+    Automation->Points = Copy;
+    Automation->PointCount = Count;
+
+    return MIXER_OK;
+}
+
+int MixerSetClipFades(MixerContext *Mixer, int32 Index, int64 FadeIn, int64 FadeOut, int32 Curve)
+{
+    if (Mixer == NULL || Index < 0 || Index >= Mixer->ClipCount || FadeIn < 0 || FadeOut < 0) return MIXER_ERR_ARG;
+    if (Curve != MIXER_CURVE_LINEAR && Curve != MIXER_CURVE_EQUAL_POWER) return MIXER_ERR_ARG;
+
+    MixerAutomation *Automation = ClipAutomation(Mixer, Index);
+    if (Automation == NULL) return MIXER_ERR_NOMEM;
+    Automation->FadeIn = FadeIn;
+    Automation->FadeOut = FadeOut;
+    Automation->FadeCurve = Curve;
+
+    return MIXER_OK;
+}
+
+int MixerSetClipStrip(MixerContext *Mixer, int32 Index, const MixerStripInfo *Strip)
+{
+    if (Mixer == NULL || Index < 0 || Index >= Mixer->ClipCount) return MIXER_ERR_ARG;
+
+    MixerClip *Clip = &Mixer->Clips[Index];
+    if (Strip == NULL) av_freep(&Clip->Strip);
+    else
+    {
+        StripState *State = Clip->Strip != NULL ? Clip->Strip : av_mallocz(sizeof(StripState));
+        if (State == NULL) return MIXER_ERR_NOMEM;
+        int32 Ret = StripDesign(State, Strip, Mixer->Config.SampleRate);
+        if (Ret < 0)
+        {
+            if (State != Clip->Strip) av_free(State);
+            return Ret;
+        }
+        Clip->Strip = State;
+        if (Mixer->Started)
+        {
+            Ret = StripReserve(Mixer);
+            if (Ret < 0) return Ret;
+        }
+    }
+
+    // Cached stems hold the clip as its old strip processed it.
+    if (Mixer->CacheEnabled)
+    {
+        CacheFree(Mixer);
+        Clip->Edited = Clip->Automation != NULL || Clip->Strip != NULL;
+    }
+    return MIXER_OK;
+}
+
+static int32 MixBlock(MixerContext *Mixer, float32 *Output, int32 *SampleCount)
+{
+    if (Mixer == NULL || Output == NULL || SampleCount == NULL) return MIXER_ERR_ARG;
+    *SampleCount = 0;
+
+    if (!Mixer->Started)
+    {
+        int32 Ret = TimelineBuild(Mixer);
+        if (Ret < 0) return Ret;
+    }
+
+    int32 ChannelCount = Mixer->Config.ChannelCount;
+    int32 BlockSize = Mixer->Config.BlockSize;
+    int64 BlockStart = Mixer->Position;
+    int64 BlockEnd = BlockStart + BlockSize;
+    int64 RangeEnd = Mixer->RangeEnd >= 0 ? Mixer->RangeEnd + Mixer->Latency : -1;
+    if (RangeEnd >= 0 && BlockStart >= RangeEnd) return MIXER_EOF;
+
+    // Start the clips that begin inside this block.
+    TrackUpdate(Mixer);
+    while (Mixer->NextClip < Mixer->ClipCount && Mixer->Order[Mixer->NextClip].StartSample < BlockEnd)
+    {
+        int32 ClipIndex = Mixer->Order[Mixer->NextClip++].Index;
+        Mixer->Clips[ClipIndex].Source->Unstarted--;
+        Mixer->Active[Mixer->ActiveCount++] = ClipIndex;
+        TrackStart(Mixer, ClipIndex);
+    }
+
+    // Everything has played once the clips and the effects delaying or
+    // ringing on after them are through.
+    int32 Count = BlockSize;
+    int32 Played = Mixer->NextClip == Mixer->ClipCount;
+    int64 MixEnd = Mixer->MixEnd + Mixer->Latency + Mixer->Tail;
+    if (Mixer->ActiveCount == 0 && (Mixer->EffectCount == 0 || (Played && BlockStart >= MixEnd)))
+    {
+        if (Played)
+        {
+            Count = MixEnd < BlockEnd ? (int32)(MixEnd - BlockStart) : BlockSize;
+            if (Count <= 0) return MIXER_EOF;
+        }
+        if (RangeEnd >= 0 && RangeEnd - BlockStart < Count) Count = (int32)(RangeEnd - BlockStart);
+
+        // Silence between clips, no decoder is touched.
+        memset(Output, 0, Count*ChannelCount*sizeof(float32));
+        Mixer->Position += Count;
+        *SampleCount = Count;
+        return MIXER_OK;
+    }
+
+    MixerCacheBlock *Cached = NULL;
+    int32 Fresh = 0;
+    if (Mixer->BusCount > 1)
+    {
+        int32 Ret = MixGraph(Mixer, BlockStart);
+        if (Ret < 0) return Ret;
+    }
+    else if (Mixer->CacheEnabled && BlockStart % BlockSize == 0)
+    {
+        int32 Ret = CacheGet(Mixer, BlockStart/BlockSize, &Cached, &Fresh);
+        if (Ret < 0) return Ret;
+    }
+
+    if (Cached != NULL)
+    {
+        int32 Ret = MixCached(Mixer, Cached, Fresh, BlockStart);
+        if (Ret < 0)
+        {
+            // A half rendered base would be wrong forever.
+            if (Fresh) CacheDrop(Mixer, BlockStart/BlockSize);
+            return Ret;
+        }
+        BusEffects(Mixer, &Mixer->Buses[MIXER_MASTER_BUS]);
+    }
+    else if (Mixer->BusCount == 1)
+    {
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            memset(Mixer->MixBuffer[Channel], 0, BlockSize*sizeof(float32));
+        }
+        int32 Ret = MixClips(Mixer, &Mixer->Buses[MIXER_MASTER_BUS], Mixer->Active, Mixer->ActiveCount, BlockStart);
+        if (Ret < 0) return Ret;
+        BusEffects(Mixer, &Mixer->Buses[MIXER_MASTER_BUS]);
+    }
+
+    RetireClips(Mixer, BlockEnd);
+
+    if (Mixer->ActiveCount == 0 && Mixer->NextClip == Mixer->ClipCount)
+    {
+        MixEnd = Mixer->MixEnd + Mixer->Latency + Mixer->Tail;
+        Count = MixEnd < BlockEnd ? (int32)(MixEnd - BlockStart) : BlockSize;
+        if (Count <= 0) return MIXER_EOF;
+    }
+    if (RangeEnd >= 0 && RangeEnd - BlockStart < Count) Count = (int32)(RangeEnd - BlockStart);
+
+    // Interleave the planar mix buffer.
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        const float32 *Src = Mixer->MixBuffer[Channel];
+        for (int32 Index = 0; Index < Count; Index++)
+        {
+            Output[Index*ChannelCount + Channel] = Src[Index];
+        }
+    }
+
+    Mixer->Position += Count;
+    *SampleCount = Count;
+
+    return MIXER_OK;
+}
+
+// Fill Output from the mix with the first Skip samples after a seek, the
+// effects' latency, dropped. Blocks are mixed into Carry and copied out, the
+// part that doesn't fit waits there for the next call.
+static int32 MixDelayed(MixerContext *Mixer, float32 *Output, int32 *SampleCount)
+{
+    if (Mixer == NULL || Output == NULL || SampleCount == NULL) return MIXER_ERR_ARG;
+    if (!Mixer->Started)
+    {
+        int32 Ret = TimelineBuild(Mixer);
+        if (Ret < 0) return Ret;
+    }
+    if (Mixer->Latency == 0) return MixBlock(Mixer, Output, SampleCount);
+
+    int32 ChannelCount = Mixer->Config.ChannelCount;
+    int32 Filled = 0;
+    *SampleCount = 0;
+    while (Filled < Mixer->Config.BlockSize)
+    {
+        if (Mixer->CarryCount == 0)
+        {
+            int32 Count = 0;
+            int32 Ret = MixBlock(Mixer, Mixer->Carry, &Count);
+            if (Ret == MIXER_EOF) break;
+            if (Ret < 0) return Ret;
+            int32 Drop = Mixer->Skip < Count ? (int32)Mixer->Skip : Count;
+            Mixer->Skip -= Drop;
+            Mixer->CarryStart = Drop;
+            Mixer->CarryCount = Count - Drop;
+            continue;
+        }
+        int32 Count = Mixer->Config.BlockSize - Filled < Mixer->CarryCount ? Mixer->Config.BlockSize - Filled : Mixer->CarryCount;
+        memcpy(Output + Filled*ChannelCount, Mixer->Carry + Mixer->CarryStart*ChannelCount, Count*ChannelCount*sizeof(float32));
+        Filled += Count;
+        Mixer->CarryStart += Count;
+        Mixer->CarryCount -= Count;
+    }
+    *SampleCount = Filled;
+    return Filled > 0 ? MIXER_OK : MIXER_EOF;
+}
+
+int MixerRenderBlock(MixerContext *Mixer, float32 *Output, int32 *SampleCount)
+{
+    return MixDelayed(Mixer, Output, SampleCount);
+}
+
+int MixerSeek(MixerContext *Mixer, int64 Position)
+{
+    if (Mixer == NULL || Position < 0) return MIXER_ERR_ARG;
+    if (!Mixer->Started)
+    {
+        int32 Ret = TimelineBuild(Mixer);
+        if (Ret < 0) return Ret;
+    }
+
+    for (int32 SourceIndex = 0; SourceIndex < Mixer->SourceCount; SourceIndex++)
+    {
+        MixerSource *Source = Mixer->Sources[SourceIndex];
+        Source->Unstarted = 0;
+        Source->MinTrim = INT64_MAX;
+        Source->ReadPosition = INT64_MAX;
+    }
+
+    // Clips that started before Position are playing unless they are known
+    // to have stopped, the others wait for their start as usual. Sources are
+    // not touched here, the first block seeks each one it reads.
+    TrackUpdate(Mixer);
+    Mixer->ActiveCount = 0;
+    Mixer->MixEnd = 0;
+    int32 Next = 0;
+    for (; Next < Mixer->ClipCount && Mixer->Order[Next].StartSample < Position; Next++)
+    {
+        int32 ClipIndex = Mixer->Order[Next].Index;
+        MixerClip *Clip = &Mixer->Clips[ClipIndex];
+        if (Clip->EndSample >= 0 && Clip->EndSample <= Position)
+        {
+            if (Clip->EndSample > Mixer->MixEnd) Mixer->MixEnd = Clip->EndSample;
+            continue;
+        }
+        Clip->SourcePosition = Clip->TrimSample + (Position - Clip->StartSample);
+        if (Clip->SourcePosition < Clip->Source->ReadPosition) Clip->Source->ReadPosition = Clip->SourcePosition;
+        Mixer->Active[Mixer->ActiveCount++] = ClipIndex;
+        TrackStart(Mixer, ClipIndex);
+    }
+    Mixer->NextClip = Next;
+    for (; Next < Mixer->ClipCount; Next++)
+    {
+        MixerClip *Clip = &Mixer->Clips[Mixer->Order[Next].Index];
+        MixerSource *Source = Clip->Source;
+        Clip->SourcePosition = Clip->TrimSample;
+        Source->Unstarted++;
+        if (Clip->TrimSample < Source->MinTrim) Source->MinTrim = Clip->TrimSample;
+        if (Source->MinTrim < Source->ReadPosition) Source->ReadPosition = Source->MinTrim;
+    }
+
+    // Delays and duckers pick up from silence like the clips.
+    for (int32 BusIndex = 0; BusIndex < Mixer->BusCount; BusIndex++)
+    {
+        MixerBus *Bus = &Mixer->Buses[BusIndex];
+        if (Bus->Delay != NULL) DelayReset(Bus->Delay, Mixer->Config.ChannelCount);
+        if (Bus->ClipAlign != NULL) DelayReset(Bus->ClipAlign, Mixer->Config.ChannelCount);
+        if (Bus->Align != NULL) DelayReset(Bus->Align, Mixer->Config.ChannelCount);
+        if (Bus->Duck != NULL) DuckerReset(Bus->Duck);
+    }
+
+    Mixer->Position = Position;
+    Mixer->Skip = Mixer->Latency;
+    Mixer->CarryCount = 0;
+    return MIXER_OK;
+}
+
+int MixerSetRange(MixerContext *Mixer, int64 StartSample, int64 LengthSample)
+{
+    if (Mixer == NULL || LengthSample < 0) return MIXER_ERR_ARG;
+
+    int32 Ret = MixerSeek(Mixer, StartSample);
+    if (Ret < 0) return Ret;
+    Mixer->RangeEnd = LengthSample > 0 ? StartSample + LengthSample : -1;
+
+    return MIXER_OK;
+}
+
+int64 MixerGetLength(MixerContext *Mixer)
+{
+    if (Mixer == NULL) return -1;
+
+    // The effects' tail is part of the mix, their latency is not.
+    if (!Mixer->Started) TimelineDelay(Mixer);
+    int64 Length = 0;
+    for (int32 ClipIndex = 0; ClipIndex < Mixer->ClipCount; ClipIndex++)
+    {
+        MixerClip *Clip = &Mixer->Clips[ClipIndex];
+        int64 End = Clip->EndSample;
+        if (End < 0)
+        {
+            int64 SourceLength = Clip->Source->Ended ? Clip->Source->Length : Clip->Source->Duration;
+            if (SourceLength < 0) return -1;
+            End = Clip->StartSample + (SourceLength > Clip->TrimSample ? SourceLength - Clip->TrimSample : 0);
+        }
+        if (End > Length) Length = End;
+    }
+    return Length + Mixer->Tail;
+}
+
+int64 MixerGetTail(MixerContext *Mixer)
+{
+    if (Mixer == NULL) return -1;
+    if (!Mixer->Started) TimelineDelay(Mixer);
+    return Mixer->Tail;
+}
+
+void MixerClose(MixerContext **Mixer)
+{
+    if (Mixer == NULL || *Mixer == NULL) return;
+
+    MixerContext *Context = *Mixer;
+    for (int32 ClipIndex = 0; ClipIndex < Context->ClipCount; ClipIndex++)
+    {
+        MixerSource *Source = Context->Clips[ClipIndex].Source;
+        if (--Source->RefCount == 0) SourceClose(Source);
+        ClipAutomationFree(&Context->Clips[ClipIndex]);
+        av_freep(&Context->Clips[ClipIndex].Strip);
+    }
+    av_freep(&Context->Clips);
+    TrackFree(&Context->Tracks);
+    av_freep(&Context->Sources);
+    ResampleCacheFree(&Context->Filters);
+    av_freep(&Context->Order);
+    av_freep(&Context->Active);
+    av_freep(&Context->Touched);
+    av_freep(&Context->BusClips);
+    av_freep(&Context->Carry);
+    CacheFree(Context);
+    PoolDestroy(&Context->Pool);
+    for (int32 BusIndex = 0; BusIndex < Context->BusCount; BusIndex++)
+    {
+        MixerBus *Bus = &Context->Buses[BusIndex];
+        // The master's buffers are the mix buffers.
+        for (int32 Channel = 0; BusIndex > 0 && Channel < MIXER_MAX_CHANNELS; Channel++)
+        {
+            av_freep(&Bus->Buffer[Channel]);
+        }
+        av_freep(&Bus->Children);
+        av_freep(&Bus->Effects);
+        if (Bus->Strips != NULL) StripGroupFree(Bus->Strips);
+        av_freep(&Bus->Strips);
+        if (Bus->Duck != NULL) DuckerFree(Bus->Duck);
+        av_freep(&Bus->Duck);
+        av_freep(&Bus->Ducked);
+        if (Bus->Delay != NULL) DelayFree(Bus->Delay);
+        av_freep(&Bus->Delay);
+        if (Bus->ClipAlign != NULL) DelayFree(Bus->ClipAlign);
+        av_freep(&Bus->ClipAlign);
+        if (Bus->Align != NULL) DelayFree(Bus->Align);
+        av_freep(&Bus->Align);
+    }
+    av_freep(&Context->Buses);
+    for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+    {
+        av_freep(&Context->MixBuffer[Channel]);
+    }
+    av_freep(Mixer);
+}
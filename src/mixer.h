@@ -0,0 +1,241 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include "common.h"
+
+// Every Mixer* function returns one of these, negative values are errors.
+#define MIXER_OK                0
+#define MIXER_EOF               1       // No more samples to render.
+#define MIXER_ERR_ARG           -1      // Invalid argument.
+#define MIXER_ERR_NOMEM         -2      // Allocation failed.
+#define MIXER_ERR_OPEN          -3      // avformat_open_input() / avformat_find_stream_info() failed.
+#define MIXER_ERR_STREAM        -4      // No audio stream in the input.
+#define MIXER_ERR_CODEC         -5      // Decoder could not be allocated or opened.
+#define MIXER_ERR_DECODE        -6      // Demuxing or decoding failed.
+#define MIXER_ERR_RESAMPLE      -7      // Sample conversion failed.
+#define MIXER_ERR_WRITE         -8      // Creating or writing the output failed.
+
+#define MIXER_MAX_CHANNELS      8
+
+typedef struct MixerConfig
+{
+    int32 SampleRate;       // Output sample rate in Hz.
+    int32 ChannelCount;     // Output channel count, at most MIXER_MAX_CHANNELS.
+    int32 BlockSize;        // Samples per channel produced by one MixerRenderBlock().
+    int32 Verbose;          // Dump input info and decode progress to stdout.
+    int32 ThreadCount;      // Workers processing the independent buses of a block, 0 or 1 renders on the calling thread.
+    int32 ResampleQuality;  // MIXER_RESAMPLE_*, for inputs at another rate than SampleRate.
+    int32 NativeInput;      // Read uncompressed WAV and AIFF files without libavformat, see pcmfile.h.
+    int32 IoDepth;          // Reads in flight per input through io_uring, see ioreader.h, 0 for blocking reads.
+    int32 Peaks;            // Write a waveform peak sidecar of every input decoded from start to end, see peaks.h.
+} MixerConfig;
+
+// Inputs at another rate share one polyphase filter per rate and quality,
+// 32 taps for normal quality, 16 for fast and 64 for high. MIXER_RESAMPLE_SWR
+// resamples every input with its own swresample context instead.
+#define MIXER_RESAMPLE_NORMAL   0
+#define MIXER_RESAMPLE_FAST     1
+#define MIXER_RESAMPLE_HIGH     2
+#define MIXER_RESAMPLE_SWR      3
+
+// Opaque mixer state. One context owns its inputs, and the decoders while
+// they are open. Once DecoderPoolInit() has run, closed decoders go to a
+// process-wide pool that every context takes from, behind the pool's one
+// mutex (see decoder.h), so contexts opening and closing inputs at the same
+// time wait on each other there. Nothing else is shared, so independent mixes
+// can run on different threads at the same time.
+typedef struct MixerContext MixerContext;
+
+void MixerDefaultConfig(MixerConfig *Config);
+
+int MixerOpen(MixerContext **Mixer, const MixerConfig *Config);
+
+// A clip places a section of a file on the output timeline. All positions
+// and lengths are in output samples.
+typedef struct MixerClipInfo
+{
+    const char *FileName;   // Anything libavformat opens, or raw PCM named as in pcmfile.h.
+    int64 StartSample;      // Output position of the clip's first sample.
+    int64 TrimSample;       // Source position the clip starts playing from.
+    int64 LengthSample;     // Samples to play, 0 plays until the source ends.
+    float32 Gain;
+} MixerClipInfo;
+
+// Add a clip to the timeline and return its index (>= 0). Clips are
+// added before the first MixerRenderBlock(), in any order. Blocks without a
+// playing clip are rendered as silence without touching any decoder.
+int MixerAddClip(MixerContext *Mixer, const MixerClipInfo *Clip);
+
+// Add a whole file to the mix, starting at StartSample (in output samples)
+// and scaled by Gain.
+int MixerAddInput(MixerContext *Mixer, const char *FileName, int64 StartSample, float32 Gain);
+
+// Render the next block as interleaved float samples. Output must hold
+// BlockSize * ChannelCount floats. SampleCount receives the samples per
+// channel written, which is less than BlockSize only for the last block.
+// Returns MIXER_EOF once every input has been consumed.
+int MixerRenderBlock(MixerContext *Mixer, float32 *Output, int32 *SampleCount);
+
+// Clips play into buses and every bus but the master sums into another bus,
+// so the buses form a tree rooted at the master whose output
+// MixerRenderBlock() returns. Each block, a bus is processed once all buses
+// feeding it are, buses that don't depend on each other run concurrently on
+// ThreadCount workers. Clips play into the master unless routed elsewhere.
+#define MIXER_MASTER_BUS        0
+
+// Process one block of a bus in place, Channels[c] holds SampleCount planar
+// samples. Effects of different buses may run concurrently, a single effect
+// is never entered twice at the same time. Blocks between clips are still
+// processed so that effect tails ring out, after the last clip only as long
+// as the effects' tails reported to MixerAddTimedEffect().
+typedef void (*MixerEffectFunc)(void *State, float32 **Channels, int32 ChannelCount, int32 SampleCount);
+
+// Add a bus that sums into bus Output scaled by Gain and return its index.
+// Buses are added before the first MixerRenderBlock().
+int MixerAddBus(MixerContext *Mixer, int32 Output, float32 Gain);
+
+int MixerSetClipBus(MixerContext *Mixer, int32 Clip, int32 Bus);
+
+// Append an effect to the chain a bus runs after summing its inputs. The
+// caller owns State and keeps it alive until MixerClose().
+int MixerAddEffect(MixerContext *Mixer, int32 Bus, MixerEffectFunc Process, void *State);
+
+// Append an effect whose output runs Latency samples behind its input and
+// keeps sounding for Tail samples after its input falls silent. The mixer
+// compensates the latency: the clips and buses summed with a later bus are
+// held back to line up with it, the master's latency is dropped from the
+// first samples rendered after a seek, so the output lines up with the
+// clips, and the mix ends once the longest tail has rung out after the last
+// clip. Only before the first MixerRenderBlock() when Latency or Tail is not
+// 0.
+int MixerAddTimedEffect(MixerContext *Mixer, int32 Bus, MixerEffectFunc Process, void *State, int32 Latency, int64 Tail);
+
+typedef struct MixerDuckInfo
+{
+    float32 ThresholdDb;    // Key peak (dBFS) that starts the ducking.
+    float32 DepthDb;        // Gain of the ducked bus while the key plays, <= 0.
+    float32 AttackMs;       // Time constants of the gain going down and back up.
+    float32 ReleaseMs;
+    float32 HoldMs;         // Time the gain stays down after the key falls silent.
+    float32 LookaheadMs;    // How early the ducking starts, at most one block.
+} MixerDuckInfo;
+
+// Duck bus Bus whenever bus Key plays, e.g. music under dialog. The key's
+// gains are computed in the same block pass, right after the key bus is
+// processed and before Bus is, so no bus is buffered beyond the lookahead.
+// Both buses are delayed by the lookahead, which the mixer compensates like
+// effect latency, see MixerAddTimedEffect(). The lookahead is measured before
+// the delay, effect latency on one of the buses and not the other shifts it
+// by the difference. Key must be added after Bus and must not
+// feed it, a bus is ducked by one key at most and every ducker a bus takes
+// part in uses the same lookahead. Added before the first
+// MixerRenderBlock().
+int MixerAddDucker(MixerContext *Mixer, int32 Bus, int32 Key, const MixerDuckInfo *Info);
+
+// Inputs and clips are the same thing, indexed in the order they were added.
+int32 MixerGetInputCount(MixerContext *Mixer);
+
+// Decode input Index ahead so that the next SampleCount output samples are
+// buffered and the following MixerRenderBlock() calls only mix. Different
+// inputs of one context may be prefetched concurrently, but never while
+// MixerRenderBlock() runs on the same context.
+int MixerPrefetchInput(MixerContext *Mixer, int32 Index, int32 SampleCount);
+
+// Continue rendering at output position Position. Every input playing there
+// is seeked to just before its first needed sample on the next block rather
+// than decoded from the start, so the cost of a render does not depend on
+// where in the mix it begins.
+int MixerSeek(MixerContext *Mixer, int64 Position);
+
+// Seek to StartSample and stop rendering LengthSample samples later, or at
+// the end of the mix when LengthSample is 0.
+int MixerSetRange(MixerContext *Mixer, int64 StartSample, int64 LengthSample);
+
+// Keep the mix of every rendered block so that rendering it again, after
+// MixerSeek() back, only redoes the clips edited in the meantime. Costs
+// BlockSize * ChannelCount floats per block, plus as much again for every
+// edited clip in the block. Only blocks starting at a multiple of BlockSize
+// are cached, and only mixes without buses other than the master. Clips
+// with an envelope or fades are always kept as stems. Disabling frees the
+// cache.
+int MixerSetCache(MixerContext *Mixer, int32 Enable);
+
+// Change the gain of clip Index. The change ramps in over the next block
+// rendered so that it doesn't click. With the cache enabled the clip is
+// decoded once more into a stem of its own, and later gain, pan or mute
+// changes of the same clip cost no decoding at all.
+int MixerSetClipGain(MixerContext *Mixer, int32 Index, float32 Gain);
+
+// Stereo balance of clip Index, from -1 (left only) to 1 (right only). The
+// centre leaves both channels at full level. Ignored unless the output has two
+// channels.
+int MixerSetClipPan(MixerContext *Mixer, int32 Index, float32 Pan);
+
+// Silence clip Index without changing its gain or pan.
+int MixerSetClipMute(MixerContext *Mixer, int32 Index, int32 Mute);
+
+// Shapes of automation segments and fades.
+#define MIXER_CURVE_LINEAR      0
+#define MIXER_CURVE_EXPONENTIAL 1       // Constant change in dB per sample, envelopes only.
+#define MIXER_CURVE_EQUAL_POWER 2       // Quarter sine, fades only.
+
+typedef struct MixerEnvelopePoint
+{
+    int64 Sample;           // Output samples from the start of the clip.
+    float32 Gain;
+    int32 Curve;            // Shape of the segment to the next point.
+} MixerEnvelopePoint;
+
+// Automate the gain of clip Index with Count breakpoints sorted by Sample.
+// The gain holds the first point's value before it and the last one's after
+// it, and multiplies the clip's gain, pan and mute. Exponential segments
+// treat gains below -100 dB as -100 dB. Count 0 removes the envelope.
+int MixerSetClipEnvelope(MixerContext *Mixer, int32 Index, const MixerEnvelopePoint *Points, int32 Count);
+
+// Fade clip Index in over its first FadeIn samples and out over its last
+// FadeOut samples, on top of its envelope. Two clips overlapping by N samples
+// with equal power fades of N samples crossfade without a dip in loudness.
+// The fade out of a clip played until its source ends follows the
+// estimated length until the source has been decoded to the end.
+int MixerSetClipFades(MixerContext *Mixer, int32 Index, int64 FadeIn, int64 FadeOut, int32 Curve);
+
+// Channel strip of a clip: a high pass, a low and a high shelf and a
+// compressor, in that order, run on the clip's samples before its gain, pan,
+// automation and fades. A frequency of 0 leaves its filter out, a ratio of 1
+// leaves the compressor out.
+typedef struct MixerStripInfo
+{
+    float32 HighPassHz;     // Second order Butterworth.
+    float32 LowShelfHz;
+    float32 LowShelfDb;
+    float32 HighShelfHz;
+    float32 HighShelfDb;
+    float32 ThresholdDb;    // dBFS of the peak envelope, linked across channels.
+    float32 Ratio;
+    float32 AttackMs;
+    float32 ReleaseMs;
+    float32 MakeupDb;
+} MixerStripInfo;
+
+// Run clip Index through Strip, or through none when Strip is NULL. Strips
+// restart from silence whenever their clip starts playing. The clips with a
+// strip on one bus are processed eight at a time, each in one SIMD lane, so
+// a bus of many stripped clips costs little more per clip than its plain
+// mix. With the cache enabled they are always kept as stems, and changing a
+// strip drops the cache.
+int MixerSetClipStrip(MixerContext *Mixer, int32 Index, const MixerStripInfo *Strip);
+
+// Output length of the whole mix in samples, estimated from the container
+// durations until every input has been decoded, including the tails of the
+// effects added so far. -1 if unknown.
+int64 MixerGetLength(MixerContext *Mixer);
+
+// Samples the mix rings on after the last clip, the longest path of effect
+// tails through the buses added so far.
+int64 MixerGetTail(MixerContext *Mixer);
+
+void MixerClose(MixerContext **Mixer);
+
+const char *MixerErrorString(int32 Error);
+
+#endif
@@ -0,0 +1,119 @@
+#include <math.h>
+#include <string.h>
+
+#include "pack.h"
+
+int32 PackSampleSize(int32 Format)
+{
+    switch (Format)
+    {
+        case PACK_F32:  return 4;
+        case PACK_S16:  return 2;
+        case PACK_S24:  return 3;
+        case PACK_S32:  return 4;
+        default:        return 0;
+    }
+}
+
+int32 PackInit(PackState *State, int32 Format, int32 ChannelCount, int32 Dither)
+{
+    if (PackSampleSize(Format) == 0 || ChannelCount <= 0 || ChannelCount > MIXER_MAX_CHANNELS) return MIXER_ERR_ARG;
+    if (Dither < PACK_DITHER_NONE || Dither > PACK_DITHER_SHAPED) return MIXER_ERR_ARG;
+
+    memset(State, 0, sizeof(PackState));
+    State->Kernels = KernelSelect();
+    State->Format = Format;
+    State->ChannelCount = ChannelCount;
+    State->Dither = Dither;
+    // Any nonzero seeds, different per lane.
+    for (int32 Lane = 0; Lane < 8; Lane++)
+    {
+        State->Seed[Lane] = 0x9E3779B9u*(Lane + 1);
+    }
+    return MIXER_OK;
+}
+
+// Same generator and triangular noise as the pack kernels.
+static float32 PackNoise(uint32_t *Seed)
+{
+    uint32_t X = *Seed;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    *Seed = X;
+    return ((X & 0xFFFF) + (X >> 16))*(1.0f/65536) - 1.0f;
+}
+
+// Noise shaping feeds each rounding error back into the next sample of the
+// same channel, so it runs one sample at a time.
+static void PackShaped(PackState *State, uint8_t *Out, const float32 *In, int32 Count, int32 Stride, int32 Channel)
+{
+    int32 Size = PackSampleSize(State->Format);
+    float32 Scale = State->Format == PACK_S16 ? 32768.0f : State->Format == PACK_S24 ? 8388608.0f : 2147483648.0f;
+    float32 High = State->Format == PACK_S16 ? 32767.0f : State->Format == PACK_S24 ? 8388607.0f : 2147483520.0f;
+    float32 Error = State->Error[Channel];
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        float32 Wanted = In[Index*Stride]*Scale - Error;
+        float32 Value = Wanted + PackNoise(&State->Seed[Channel & 7]);
+        Value = Value < -Scale ? -Scale : Value > High ? High : Value;
+        int32 Rounded = (int32)lrintf(Value);
+        Error = (float32)Rounded - Wanted;
+        // Clipped samples would feed back without bound.
+        if (Error > 2.0f || Error < -2.0f) Error = 0.0f;
+
+        uint8_t *Dst = Out + (int64)Index*Stride*Size;
+        if (Size == 2)
+        {
+            int16_t Sample = (int16_t)Rounded;
+            memcpy(Dst, &Sample, 2);
+        }
+        else if (Size == 3)
+        {
+            Dst[0] = (uint8_t)Rounded;
+            Dst[1] = (uint8_t)(Rounded >> 8);
+            Dst[2] = (uint8_t)(Rounded >> 16);
+        }
+        else
+        {
+            memcpy(Dst, &Rounded, 4);
+        }
+    }
+    State->Error[Channel] = Error;
+}
+
+// Count samples that need no per channel state.
+static void PackRun(PackState *State, void *Out, const float32 *In, int32 Count)
+{
+    float32 Dither = State->Dither == PACK_DITHER_TPDF ? 1.0f : 0.0f;
+    switch (State->Format)
+    {
+        case PACK_F32:  memcpy(Out, In, Count*sizeof(float32)); break;
+        case PACK_S16:  State->Kernels->PackS16(Out, In, Count, Dither, State->Seed); break;
+        case PACK_S24:  State->Kernels->PackS24(Out, In, Count, Dither, State->Seed); break;
+        case PACK_S32:  State->Kernels->PackS32(Out, In, Count, Dither, State->Seed); break;
+    }
+}
+
+void PackInterleaved(PackState *State, void *Out, const float32 *In, int32 FrameCount)
+{
+    if (State->Dither != PACK_DITHER_SHAPED || State->Format == PACK_F32)
+    {
+        PackRun(State, Out, In, FrameCount*State->ChannelCount);
+        return;
+    }
+    int32 Size = PackSampleSize(State->Format);
+    for (int32 Channel = 0; Channel < State->ChannelCount; Channel++)
+    {
+        PackShaped(State, (uint8_t *)Out + Channel*Size, In + Channel, FrameCount, State->ChannelCount, Channel);
+    }
+}
+
+void PackPlanar(PackState *State, void *const *Out, const float32 *const *In, int32 FrameCount)
+{
+    for (int32 Channel = 0; Channel < State->ChannelCount; Channel++)
+    {
+        if (State->Dither != PACK_DITHER_SHAPED || State->Format == PACK_F32) PackRun(State, Out[Channel], In[Channel], FrameCount);
+        else PackShaped(State, Out[Channel], In[Channel], FrameCount, 1, Channel);
+    }
+}
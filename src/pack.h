@@ -0,0 +1,40 @@
+#ifndef MIXER_PACK_H
+#define MIXER_PACK_H
+
+#include "kernel.h"
+#include "mixer.h"
+
+// Conversion of the float mix to the integer sample formats of WAV files
+// and audio devices: clip, optional dither, round.
+
+#define PACK_F32                0       // Copied as is.
+#define PACK_S16                1
+#define PACK_S24                2       // Three bytes per sample.
+#define PACK_S32                3
+
+#define PACK_DITHER_NONE        0
+#define PACK_DITHER_TPDF        1       // Triangular noise of 1 LSB peak, decorrelates the rounding error.
+#define PACK_DITHER_SHAPED      2       // TPDF with first order error feedback, pushes the noise up in frequency.
+
+typedef struct PackState
+{
+    const KernelTable *Kernels;
+    int32 Format;
+    int32 ChannelCount;
+    int32 Dither;
+    uint32_t Seed[8];
+    float32 Error[MIXER_MAX_CHANNELS];  // Rounding error of the last sample per channel, for noise shaping.
+} PackState;
+
+int32 PackInit(PackState *State, int32 Format, int32 ChannelCount, int32 Dither);
+
+// Bytes per sample of Format, or 0 if unknown.
+int32 PackSampleSize(int32 Format);
+
+// FrameCount interleaved frames from In to Out.
+void PackInterleaved(PackState *State, void *Out, const float32 *In, int32 FrameCount);
+
+// FrameCount samples of every channel, In[c] to Out[c].
+void PackPlanar(PackState *State, void *const *Out, const float32 *const *In, int32 FrameCount);
+
+#endif
@@ -0,0 +1,413 @@
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#define read _read
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <libavutil/channel_layout.h>
+#include <libavutil/mem.h>
+
+#include "pcmfile.h"
+
+static const char *EncodingNames[] = {"u8", "s8", "s16", "s24", "s32", "f32", "f64"};
+static const int32 EncodingSizes[] = {1, 1, 2, 3, 4, 4, 8};
+
+static int32 ReadU16(const uint8_t *Bytes)    { return Bytes[0] | Bytes[1] << 8; }
+static uint32_t ReadU32(const uint8_t *Bytes) { return Bytes[0] | Bytes[1] << 8 | Bytes[2] << 16 | (uint32_t)Bytes[3] << 24; }
+static int64 ReadU64(const uint8_t *Bytes)    { return ReadU32(Bytes) | (int64)ReadU32(Bytes + 4) << 32; }
+static int32 ReadU16Be(const uint8_t *Bytes)  { return Bytes[0] << 8 | Bytes[1]; }
+static uint32_t ReadU32Be(const uint8_t *Bytes) { return (uint32_t)Bytes[0] << 24 | Bytes[1] << 16 | Bytes[2] << 8 | Bytes[3]; }
+
+static int32 PcmMap(PcmFile *File, const char *FileName)
+{
+#ifdef _WIN32
+    HANDLE FileHandle = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                    FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (FileHandle == INVALID_HANDLE_VALUE) return MIXER_ERR_OPEN;
+    File->FileHandle = FileHandle;
+    LARGE_INTEGER Size;
+    if (!GetFileSizeEx(FileHandle, &Size)) return MIXER_ERR_OPEN;
+    if (Size.QuadPart == 0) return MIXER_ERR_STREAM;
+    if ((File->MappingHandle = CreateFileMappingA(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL) return MIXER_ERR_OPEN;
+    if ((File->Mapping = MapViewOfFile(File->MappingHandle, FILE_MAP_READ, 0, 0, 0)) == NULL) return MIXER_ERR_OPEN;
+    File->MappingSize = Size.QuadPart;
+#else
+    int FileDescriptor = open(FileName, O_RDONLY);
+    if (FileDescriptor < 0) return MIXER_ERR_OPEN;
+    struct stat Info;
+    if (fstat(FileDescriptor, &Info) != 0 || !S_ISREG(Info.st_mode) || Info.st_size == 0)
+    {
+        close(FileDescriptor);
+        return MIXER_ERR_STREAM;
+    }
+    void *Mapping = mmap(NULL, Info.st_size, PROT_READ, MAP_SHARED, FileDescriptor, 0);
+    close(FileDescriptor);
+    if (Mapping == MAP_FAILED) return MIXER_ERR_OPEN;
+    // Inputs are read front to back, let the kernel read ahead aggressively.
+    madvise(Mapping, Info.st_size, MADV_SEQUENTIAL);
+    File->Mapping = Mapping;
+    File->MappingSize = Info.st_size;
+#endif
+    return MIXER_OK;
+}
+
+// Encoding of integer samples stored in Bytes bytes, AIFF's 8-bit samples are signed.
+static int32 PcmIntegerEncoding(int32 Bytes, int32 Signed8)
+{
+    switch (Bytes)
+    {
+        case 1: return Signed8 ? PCM_S8 : PCM_U8;
+        case 2: return PCM_S16;
+        case 3: return PCM_S24;
+        case 4: return PCM_S32;
+        default: return -1;
+    }
+}
+
+static int32 PcmParseWav(PcmFile *File)
+{
+    const uint8_t *Bytes = File->Mapping;
+    int64 Size = File->MappingSize;
+    int32 Rf64 = memcmp(Bytes, "RF64", 4) == 0;
+    int64 Rf64DataSize = -1;
+    int32 HasFormat = 0;
+    int32 BitsPerSample = 0;
+    int32 BlockAlign = 0;
+
+    File->Container = Rf64 ? "rf64" : "wav";
+    for (int64 Offset = 12; Offset + 8 <= Size;)
+    {
+        const uint8_t *Chunk = Bytes + Offset;
+        int64 ChunkSize = ReadU32(Chunk + 4);
+        int64 Left = Size - Offset - 8;
+        if (memcmp(Chunk, "ds64", 4) == 0 && ChunkSize >= 16 && ChunkSize <= Left)
+        {
+            Rf64DataSize = ReadU64(Chunk + 16);
+        }
+        else if (memcmp(Chunk, "fmt ", 4) == 0 && ChunkSize >= 16 && ChunkSize <= Left)
+        {
+            int32 Tag = ReadU16(Chunk + 8);
+            File->ChannelCount = ReadU16(Chunk + 10);
+            File->SampleRate = (int32)ReadU32(Chunk + 12);
+            BlockAlign = ReadU16(Chunk + 20);
+            BitsPerSample = ReadU16(Chunk + 22);
+            if (Tag == 0xFFFE && ChunkSize >= 40)
+            {
+                // WAVE_FORMAT_EXTENSIBLE, the real tag starts the sub format GUID.
+                File->ChannelLayout = ReadU32(Chunk + 28);
+                Tag = ReadU16(Chunk + 32);
+            }
+            if (Tag == 1) File->Encoding = PcmIntegerEncoding((BitsPerSample + 7)/8, 0);
+            else if (Tag == 3 && BitsPerSample == 32) File->Encoding = PCM_F32;
+            else if (Tag == 3 && BitsPerSample == 64) File->Encoding = PCM_F64;
+            else return MIXER_ERR_STREAM;
+            if (File->ChannelCount <= 0 || BlockAlign <= 0) return MIXER_ERR_STREAM;
+            HasFormat = 1;
+        }
+        else if (memcmp(Chunk, "data", 4) == 0)
+        {
+            if (!HasFormat || File->Encoding < 0) return MIXER_ERR_STREAM;
+            // Writers that never went back to fill in the size leave 0 or
+            // 0xFFFFFFFF, RF64 keeps the real size in ds64.
+            if (Rf64 && ChunkSize == 0xFFFFFFFF && Rf64DataSize >= 0) ChunkSize = Rf64DataSize;
+            else if (ChunkSize == 0 || ChunkSize == 0xFFFFFFFF) ChunkSize = Left;
+            // Plain RIFF files past 4 GB only keep the low 32 bits of the size.
+            else if (!Rf64) while (ChunkSize + 0x100000000LL <= Left) ChunkSize += 0x100000000LL;
+            if (ChunkSize > Left) ChunkSize = Left;
+            File->Data = Chunk + 8;
+            File->FrameSize = BlockAlign;
+            if (BlockAlign != File->ChannelCount*EncodingSizes[File->Encoding]) return MIXER_ERR_STREAM;
+            File->FrameCount = ChunkSize/BlockAlign;
+            return MIXER_OK;
+        }
+        Offset += 8 + ChunkSize + (ChunkSize & 1);
+    }
+    return MIXER_ERR_STREAM;
+}
+
+// 80-bit IEEE extended, the sample rate of an AIFF file.
+static float64 ReadExtended(const uint8_t *Bytes)
+{
+    int32 Exponent = ReadU16Be(Bytes) & 0x7FFF;
+    uint64_t Mantissa = (uint64_t)ReadU32Be(Bytes + 2) << 32 | ReadU32Be(Bytes + 6);
+    float64 Value = ldexp((float64)Mantissa, Exponent - 16383 - 63);
+    return Bytes[0] & 0x80 ? -Value : Value;
+}
+
+static int32 PcmParseAiff(PcmFile *File)
+{
+    const uint8_t *Bytes = File->Mapping;
+    int64 Size = File->MappingSize;
+    int32 Compressed = memcmp(Bytes + 8, "AIFC", 4) == 0;
+    int32 HasFormat = 0;
+    int64 FrameCount = 0;
+
+    File->Container = "aiff";
+    File->BigEndian = 1;
+    for (int64 Offset = 12; Offset + 8 <= Size;)
+    {
+        const uint8_t *Chunk = Bytes + Offset;
+        int64 ChunkSize = ReadU32Be(Chunk + 4);
+        int64 Left = Size - Offset - 8;
+        if (memcmp(Chunk, "COMM", 4) == 0 && ChunkSize >= (Compressed ? 22 : 18) && ChunkSize <= Left)
+        {
+            File->ChannelCount = ReadU16Be(Chunk + 8);
+            FrameCount = ReadU32Be(Chunk + 10);
+            int32 BitsPerSample = ReadU16Be(Chunk + 14);
+            File->SampleRate = (int32)lrint(ReadExtended(Chunk + 16));
+            File->Encoding = PcmIntegerEncoding((BitsPerSample + 7)/8, 1);
+            if (Compressed)
+            {
+                const uint8_t *Type = Chunk + 26;
+                if (memcmp(Type, "sowt", 4) == 0) File->BigEndian = 0;
+                else if (memcmp(Type, "raw ", 4) == 0 && BitsPerSample == 8) File->Encoding = PCM_U8;
+                else if (memcmp(Type, "fl32", 4) == 0 || memcmp(Type, "FL32", 4) == 0) File->Encoding = PCM_F32;
+                else if (memcmp(Type, "fl64", 4) == 0 || memcmp(Type, "FL64", 4) == 0) File->Encoding = PCM_F64;
+                else if (memcmp(Type, "NONE", 4) != 0 && memcmp(Type, "twos", 4) != 0) return MIXER_ERR_STREAM;
+            }
+            if (File->Encoding < 0 || File->ChannelCount <= 0) return MIXER_ERR_STREAM;
+            HasFormat = 1;
+        }
+        else if (memcmp(Chunk, "SSND", 4) == 0 && ChunkSize >= 8)
+        {
+            if (!HasFormat) return MIXER_ERR_STREAM;
+            if (ChunkSize > Left) ChunkSize = Left;
+            int64 DataOffset = ReadU32Be(Chunk + 8);
+            if (DataOffset > ChunkSize - 8) return MIXER_ERR_STREAM;
+            File->Data = Chunk + 16 + DataOffset;
+            File->FrameSize = File->ChannelCount*EncodingSizes[File->Encoding];
+            File->FrameCount = (ChunkSize - 8 - DataOffset)/File->FrameSize;
+            if (FrameCount < File->FrameCount) File->FrameCount = FrameCount;
+            return MIXER_OK;
+        }
+        Offset += 8 + ChunkSize + (ChunkSize & 1);
+    }
+    return MIXER_ERR_STREAM;
+}
+
+// Split "encoding:rate:channels:path" and return the path, NULL if malformed.
+static const char *PcmParseRaw(PcmFile *File, const char *Spec)
+{
+    static const char *Names[] = {"u8", "s8", "s16le", "s16be", "s24le", "s24be", "s32le", "s32be", "f32le", "f32be",
+                                  "f64le", "f64be"};
+    const char *Colon = strchr(Spec, ':');
+    if (Colon == NULL) return NULL;
+    File->Encoding = -1;
+    for (int32 Index = 0; Index < (int32)(sizeof(Names)/sizeof(Names[0])); Index++)
+    {
+        if (strlen(Names[Index]) == (size_t)(Colon - Spec) && strncmp(Spec, Names[Index], Colon - Spec) == 0)
+        {
+            File->Encoding = Index < 2 ? Index : 2 + (Index - 2)/2;
+            File->BigEndian = Index >= 2 && (Index & 1);
+        }
+    }
+    char *End;
+    File->SampleRate = (int32)strtol(Colon + 1, &End, 10);
+    if (*End != ':') return NULL;
+    File->ChannelCount = (int32)strtol(End + 1, &End, 10);
+    if (*End != ':' || File->Encoding < 0) return NULL;
+
+    File->Container = "raw";
+    return End + 1;
+}
+
+int32 PcmFileOpen(PcmFile **Result, const char *FileName)
+{
+    PcmFile *File = av_mallocz(sizeof(PcmFile));
+    if (File == NULL) return MIXER_ERR_NOMEM;
+    *Result = File;
+    File->Encoding = -1;
+
+    int32 Raw = strncmp(FileName, PCM_RAW_PREFIX, strlen(PCM_RAW_PREFIX)) == 0;
+    if (Raw && (FileName = PcmParseRaw(File, FileName + strlen(PCM_RAW_PREFIX))) == NULL)
+    {
+        DEBUG(stderr, "ERROR: raw input must be named %sencoding:rate:channels:path\n", PCM_RAW_PREFIX);
+        PcmFileClose(Result);
+        return MIXER_ERR_ARG;
+    }
+
+    // Standard input is read as it arrives, front to back, its length is only known at its end.
+    if (Raw && strcmp(FileName, PCM_STDIN) == 0)
+    {
+#ifdef _WIN32
+        _setmode(0, _O_BINARY);
+#endif
+        File->Stream = 1;
+        File->FrameSize = File->ChannelCount*EncodingSizes[File->Encoding];
+        File->FrameCount = -1;
+        if (File->ChannelCount > 0 && File->ChannelCount <= 64 && File->SampleRate > 0) return MIXER_OK;
+        DEBUG(stderr, "ERROR: %s is not a valid raw input\n", FileName);
+        PcmFileClose(Result);
+        return MIXER_ERR_ARG;
+    }
+
+    int32 Ret = PcmMap(File, FileName);
+    if (Ret < 0)
+    {
+        PcmFileClose(Result);
+        return Ret;
+    }
+
+    const uint8_t *Bytes = File->Mapping;
+    if (Raw)
+    {
+        File->Data = Bytes;
+        File->FrameSize = File->ChannelCount*EncodingSizes[File->Encoding];
+        File->FrameCount = File->FrameSize > 0 ? File->MappingSize/File->FrameSize : 0;
+    }
+    else if (File->MappingSize >= 12 && (memcmp(Bytes, "RIFF", 4) == 0 || memcmp(Bytes, "RF64", 4) == 0) &&
+             memcmp(Bytes + 8, "WAVE", 4) == 0)
+    {
+        Ret = PcmParseWav(File);
+    }
+    else if (File->MappingSize >= 12 && memcmp(Bytes, "FORM", 4) == 0 &&
+             (memcmp(Bytes + 8, "AIFF", 4) == 0 || memcmp(Bytes + 8, "AIFC", 4) == 0))
+    {
+        Ret = PcmParseAiff(File);
+    }
+    else Ret = MIXER_ERR_STREAM;
+
+    if (Ret >= 0 && (File->ChannelCount <= 0 || File->ChannelCount > 64 || File->SampleRate <= 0)) Ret = MIXER_ERR_STREAM;
+    if (Ret < 0)
+    {
+        if (Raw) DEBUG(stderr, "ERROR: %s is not a valid raw input\n", FileName);
+        PcmFileClose(Result);
+        return Raw ? MIXER_ERR_ARG : Ret;
+    }
+    // A layout that names a different number of channels is no layout.
+    if (av_get_channel_layout_nb_channels(File->ChannelLayout) != File->ChannelCount) File->ChannelLayout = 0;
+
+    return MIXER_OK;
+}
+
+void PcmFileClose(PcmFile **Result)
+{
+    PcmFile *File = *Result;
+    if (File == NULL) return;
+#ifdef _WIN32
+    if (File->Mapping) UnmapViewOfFile(File->Mapping);
+    if (File->MappingHandle) CloseHandle(File->MappingHandle);
+    if (File->FileHandle && File->FileHandle != INVALID_HANDLE_VALUE) CloseHandle(File->FileHandle);
+#else
+    if (File->Mapping) munmap(File->Mapping, File->MappingSize);
+#endif
+    av_free(File->StreamBuffer);
+    av_freep(Result);
+}
+
+static float32 FloatFromBits(uint32_t Bits)
+{
+    float32 Value;
+    memcpy(&Value, &Bits, sizeof(Value));
+    return Value;
+}
+
+static float64 DoubleFromBits(uint64_t Bits)
+{
+    float64 Value;
+    memcpy(&Value, &Bits, sizeof(Value));
+    return Value;
+}
+
+// One channel, Stride bytes between its samples. The loads are spelled out
+// byte by byte so they need no alignment, compilers turn them into plain or
+// byte swapping loads.
+#define PCM_CONVERT(Expression)                                     \
+    for (int32 Index = 0; Index < Count; Index++, In += Stride)     \
+    {                                                               \
+        Out[Index] = (Expression);                                  \
+    }
+
+static void PcmConvertChannel(float32 *Out, const uint8_t *In, int32 Stride, int32 Count, int32 Encoding, int32 BigEndian)
+{
+    if (!BigEndian)
+    {
+        switch (Encoding)
+        {
+            case PCM_U8:  PCM_CONVERT((In[0] - 128)*(1.0f/128)); break;
+            case PCM_S8:  PCM_CONVERT((int8_t)In[0]*(1.0f/128)); break;
+            case PCM_S16: PCM_CONVERT((int16_t)(In[0] | In[1] << 8)*(1.0f/32768)); break;
+            case PCM_S24: PCM_CONVERT((int32_t)((uint32_t)In[0] << 8 | (uint32_t)In[1] << 16 | (uint32_t)In[2] << 24)*(1.0f/2147483648.0f)); break;
+            case PCM_S32: PCM_CONVERT((int32_t)ReadU32(In)*(1.0f/2147483648.0f)); break;
+            case PCM_F32: PCM_CONVERT(FloatFromBits(ReadU32(In))); break;
+            case PCM_F64: PCM_CONVERT((float32)DoubleFromBits((uint64_t)ReadU64(In))); break;
+        }
+    }
+    else
+    {
+        switch (Encoding)
+        {
+            case PCM_U8:  PCM_CONVERT((In[0] - 128)*(1.0f/128)); break;
+            case PCM_S8:  PCM_CONVERT((int8_t)In[0]*(1.0f/128)); break;
+            case PCM_S16: PCM_CONVERT((int16_t)(In[0] << 8 | In[1])*(1.0f/32768)); break;
+            case PCM_S24: PCM_CONVERT((int32_t)((uint32_t)In[0] << 24 | (uint32_t)In[1] << 16 | (uint32_t)In[2] << 8)*(1.0f/2147483648.0f)); break;
+            case PCM_S32: PCM_CONVERT((int32_t)ReadU32Be(In)*(1.0f/2147483648.0f)); break;
+            case PCM_F32: PCM_CONVERT(FloatFromBits(ReadU32Be(In))); break;
+            case PCM_F64: PCM_CONVERT((float32)DoubleFromBits((uint64_t)ReadU32Be(In) << 32 | ReadU32Be(In + 4))); break;
+        }
+    }
+}
+
+// Read the next Count frames of standard input into the stream buffer,
+// fewer at its end.
+static int32 PcmReadStream(PcmFile *File, int64 Position, int32 Count)
+{
+    if (Position != File->StreamPosition) return MIXER_ERR_DECODE;
+    int64 Size = (int64)Count*File->FrameSize;
+    if (File->StreamBufferSize < Size)
+    {
+        av_freep(&File->StreamBuffer);
+        if ((File->StreamBuffer = av_malloc(Size)) == NULL) return MIXER_ERR_NOMEM;
+        File->StreamBufferSize = Size;
+    }
+    int64 Filled = 0;
+    while (Filled < Size)
+    {
+        int32 Got = (int32)read(0, File->StreamBuffer + Filled, (unsigned)(Size - Filled));
+        if (Got < 0 && errno == EINTR) continue;
+        if (Got < 0)
+        {
+            DEBUG(stderr, "ERROR when read standard input: %s\n", strerror(errno));
+            return MIXER_ERR_DECODE;
+        }
+        if (Got == 0) break;
+        Filled += Got;
+    }
+    // A partial frame at the end is dropped.
+    Count = (int32)(Filled/File->FrameSize);
+    File->StreamPosition += Count;
+    if (Filled < Size) File->FrameCount = File->StreamPosition;
+    return Count;
+}
+
+int32 PcmFileRead(PcmFile *File, float32 *const *Out, int64 Position, int32 Count)
+{
+    int32 SampleSize = EncodingSizes[File->Encoding];
+    const uint8_t *Frames = File->Data + Position*File->FrameSize;
+    if (File->Stream)
+    {
+        if ((Count = PcmReadStream(File, Position, Count)) < 0) return Count;
+        Frames = File->StreamBuffer;
+    }
+    for (int32 Channel = 0; Channel < File->ChannelCount; Channel++)
+    {
+        PcmConvertChannel(Out[Channel], Frames + Channel*SampleSize, File->FrameSize, Count, File->Encoding, File->BigEndian);
+    }
+    return Count;
+}
+
+const char *PcmEncodingName(int32 Encoding)
+{
+    return Encoding >= 0 && Encoding <= PCM_F64 ? EncodingNames[Encoding] : "unknown";
+}
@@ -0,0 +1,78 @@
+#ifndef MIXER_PCMFILE_H
+#define MIXER_PCMFILE_H
+
+#include <stdint.h>
+
+#include "mixer.h"
+
+// Uncompressed input read straight from a memory mapping of the file, without
+// libavformat. The header is parsed here and samples are converted to planar
+// float directly from the mapped pages, so an input costs one pass over its
+// data instead of a read into a packet, a decode into a frame and a
+// conversion by swresample. The page cache is the only buffer.
+//
+// Recognized are RIFF and RF64 WAV with integer (8 to 32 bits) or float
+// samples, AIFF and AIFF-C with big or little endian integers or floats, and
+// headerless files named as
+//
+//     pcm:encoding:rate:channels:path
+//
+// with encoding one of u8, s8, s16le, s16be, s24le, s24be, s32le, s32be, f32le,
+// f32be, f64le, f64be. A path of PCM_STDIN reads standard input instead, as
+// it arrives and without seeking, so another tool can pipe into the mix.
+
+#define PCM_RAW_PREFIX          "pcm:"
+#define PCM_STDIN               "-"
+
+// Sample encodings.
+#define PCM_U8                  0
+#define PCM_S8                  1
+#define PCM_S16                 2
+#define PCM_S24                 3
+#define PCM_S32                 4
+#define PCM_F32                 5
+#define PCM_F64                 6
+
+typedef struct PcmFile
+{
+    const char *Container;  // "wav", "rf64", "aiff" or "raw".
+    int32 Encoding;         // PCM_*.
+    int32 BigEndian;
+    int32 SampleRate;
+    int32 ChannelCount;
+    int64 ChannelLayout;    // From WAVE_FORMAT_EXTENSIBLE, 0 when the file doesn't say.
+    int32 FrameSize;        // Bytes of one sample of every channel.
+    int64 FrameCount;       // -1 until a stream ends.
+    const uint8_t *Data;    // First frame, inside the mapping.
+
+    int32 Stream;           // Standard input, read into StreamBuffer.
+    uint8_t *StreamBuffer;
+    int64 StreamBufferSize;
+    int64 StreamPosition;   // Frames read from the stream.
+
+    void *Mapping;
+    int64 MappingSize;
+#ifdef _WIN32
+    void *FileHandle;
+    void *MappingHandle;
+#endif
+} PcmFile;
+
+// Map FileName and parse its header. Returns MIXER_ERR_OPEN when the file
+// cannot be mapped and MIXER_ERR_STREAM when it is not uncompressed audio
+// this reader knows, in both cases libavformat may still open it. Names with
+// PCM_RAW_PREFIX fail with MIXER_ERR_ARG when the format is malformed.
+int32 PcmFileOpen(PcmFile **Result, const char *FileName);
+
+void PcmFileClose(PcmFile **Result);
+
+// Convert Count frames from frame Position on to planar float, one channel
+// to each Out[c], and return how many were. The frames must lie within a
+// file. A stream must be read in order, it returns fewer frames at its end
+// and sets FrameCount, and MIXER_ERR_DECODE when Position is not where the
+// last read stopped.
+int32 PcmFileRead(PcmFile *File, float32 *const *Out, int64 Position, int32 Count);
+
+const char *PcmEncodingName(int32 Encoding);
+
+#endif
@@ -0,0 +1,294 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/mem.h>
+
+#include "peaks.h"
+
+#define PEAK_HEADER_SIZE        (20 + 8 + PEAK_LEVELS*12)
+
+static void PeakReset(PeakBuilder *Peaks, int32 Level)
+{
+    for (int32 Channel = 0; Channel < Peaks->ChannelCount; Channel++)
+    {
+        Peaks->Range[Level][Channel][0] = FLT_MAX;
+        Peaks->Range[Level][Channel][1] = -FLT_MAX;
+        Peaks->Energy[Level][Channel] = 0.0;
+    }
+    Peaks->Samples[Level] = 0;
+}
+
+int32 PeakOpen(PeakBuilder **Result, int32 SampleRate, int32 ChannelCount)
+{
+    if (ChannelCount <= 0 || ChannelCount > MIXER_MAX_CHANNELS) return MIXER_ERR_ARG;
+    PeakBuilder *Peaks = av_mallocz(sizeof(PeakBuilder));
+    if (Peaks == NULL) return MIXER_ERR_NOMEM;
+    Peaks->Kernels = KernelSelect();
+    Peaks->SampleRate = SampleRate;
+    Peaks->ChannelCount = ChannelCount;
+    for (int32 Level = 0; Level < PEAK_LEVELS; Level++)
+    {
+        PeakReset(Peaks, Level);
+    }
+    *Result = Peaks;
+
+    return MIXER_OK;
+}
+
+void PeakClose(PeakBuilder **Result)
+{
+    PeakBuilder *Peaks = *Result;
+    if (Peaks == NULL) return;
+    for (int32 Level = 0; Level < PEAK_LEVELS; Level++)
+    {
+        av_free(Peaks->Buckets[Level]);
+    }
+    av_freep(Result);
+}
+
+static int16_t PeakScale(float32 Value)
+{
+    Value *= 32767.0f;
+    if (Value >= 32767.0f) return 32767;
+    if (Value <= -32767.0f) return -32767;
+    return (int16_t)lrintf(Value);
+}
+
+// Store the bucket being filled on Level and merge it into the one above.
+static int32 PeakEmit(PeakBuilder *Peaks, int32 Level)
+{
+    if (Peaks->BucketCount[Level] == Peaks->BucketCapacity[Level])
+    {
+        int64 Capacity = Peaks->BucketCapacity[Level] ? 2*Peaks->BucketCapacity[Level] : 256;
+        PeakBucket *Buckets = av_realloc_array(Peaks->Buckets[Level], Capacity*Peaks->ChannelCount, sizeof(PeakBucket));
+        if (Buckets == NULL) return MIXER_ERR_NOMEM;
+        Peaks->Buckets[Level] = Buckets;
+        Peaks->BucketCapacity[Level] = Capacity;
+    }
+    PeakBucket *Bucket = Peaks->Buckets[Level] + Peaks->BucketCount[Level]++*Peaks->ChannelCount;
+    for (int32 Channel = 0; Channel < Peaks->ChannelCount; Channel++)
+    {
+        const float32 *Range = Peaks->Range[Level][Channel];
+        float64 Rms = sqrt(Peaks->Energy[Level][Channel]/Peaks->Samples[Level])*65535.0;
+        Bucket[Channel].Min = PeakScale(Range[0]);
+        Bucket[Channel].Max = PeakScale(Range[1]);
+        Bucket[Channel].Rms = (uint16_t)(Rms < 65535.0 ? Rms + 0.5 : 65535.0);
+        if (Level + 1 < PEAK_LEVELS)
+        {
+            float32 *Above = Peaks->Range[Level + 1][Channel];
+            Above[0] = Range[0] < Above[0] ? Range[0] : Above[0];
+            Above[1] = Range[1] > Above[1] ? Range[1] : Above[1];
+            Peaks->Energy[Level + 1][Channel] += Peaks->Energy[Level][Channel];
+        }
+    }
+    if (Level + 1 < PEAK_LEVELS) Peaks->Samples[Level + 1] += Peaks->Samples[Level];
+    PeakReset(Peaks, Level);
+
+    if (Level + 1 < PEAK_LEVELS && Peaks->Samples[Level + 1] == (int64)PEAK_BASE << (4*(Level + 1)))
+    {
+        return PeakEmit(Peaks, Level + 1);
+    }
+    return MIXER_OK;
+}
+
+int32 PeakAdd(PeakBuilder *Peaks, float32 *const *Channels, int32 Count)
+{
+    int32 Offset = 0;
+    while (Offset < Count)
+    {
+        int32 Part = PEAK_BASE - (int32)Peaks->Samples[0];
+        if (Part > Count - Offset) Part = Count - Offset;
+        for (int32 Channel = 0; Channel < Peaks->ChannelCount; Channel++)
+        {
+            Peaks->Energy[0][Channel] += Peaks->Kernels->Range(Peaks->Range[0][Channel], Channels[Channel] + Offset, Part);
+        }
+        Peaks->Samples[0] += Part;
+        Peaks->Position += Part;
+        Offset += Part;
+        if (Peaks->Samples[0] == PEAK_BASE)
+        {
+            int32 Ret = PeakEmit(Peaks, 0);
+            if (Ret < 0) return Ret;
+        }
+    }
+    return MIXER_OK;
+}
+
+static uint8_t *PeakPutU32(uint8_t *Out, uint32_t Value)
+{
+    Out[0] = Value & 0xFF;
+    Out[1] = (Value >> 8) & 0xFF;
+    Out[2] = (Value >> 16) & 0xFF;
+    Out[3] = Value >> 24;
+    return Out + 4;
+}
+
+static uint8_t *PeakPutU64(uint8_t *Out, uint64_t Value)
+{
+    return PeakPutU32(PeakPutU32(Out, (uint32_t)Value), (uint32_t)(Value >> 32));
+}
+
+static uint32_t PeakGetU32(const uint8_t *In)
+{
+    return In[0] | In[1] << 8 | In[2] << 16 | (uint32_t)In[3] << 24;
+}
+
+static uint64_t PeakGetU64(const uint8_t *In)
+{
+    return PeakGetU32(In) | (uint64_t)PeakGetU32(In + 4) << 32;
+}
+
+int32 PeakWrite(PeakBuilder *Peaks, const char *FileName)
+{
+    // The short buckets at the end, bottom up so each lands in the one above.
+    for (int32 Level = 0; Level < PEAK_LEVELS; Level++)
+    {
+        if (Peaks->Samples[Level] == 0) continue;
+        int32 Ret = PeakEmit(Peaks, Level);
+        if (Ret < 0) return Ret;
+    }
+
+    uint8_t Header[PEAK_HEADER_SIZE];
+    uint8_t *Out = Header;
+    memcpy(Out, "PEAK", 4);
+    Out = PeakPutU32(Out + 4, PEAK_VERSION);
+    Out = PeakPutU32(Out, Peaks->SampleRate);
+    Out = PeakPutU32(Out, Peaks->ChannelCount);
+    Out = PeakPutU32(Out, PEAK_LEVELS);
+    Out = PeakPutU64(Out, Peaks->Position);
+    for (int32 Level = 0; Level < PEAK_LEVELS; Level++)
+    {
+        Out = PeakPutU32(Out, PEAK_BASE << (4*Level));
+        Out = PeakPutU64(Out, Peaks->BucketCount[Level]);
+    }
+
+    char *TempName = av_asprintf("%s.%p", FileName, (void *)Peaks);
+    if (TempName == NULL) return MIXER_ERR_NOMEM;
+    FILE *File = fopen(TempName, "wb");
+    if (File == NULL)
+    {
+        DEBUG(stderr, "ERROR when open %s\n", TempName);
+        av_free(TempName);
+        return MIXER_ERR_WRITE;
+    }
+    // Buckets are three int16 each, stored as they are in memory on little endian hosts.
+    fwrite(Header, 1, sizeof(Header), File);
+    for (int32 Level = 0; Level < PEAK_LEVELS; Level++)
+    {
+        fwrite(Peaks->Buckets[Level], sizeof(PeakBucket)*Peaks->ChannelCount, Peaks->BucketCount[Level], File);
+    }
+    int32 Ret = ferror(File) ? MIXER_ERR_WRITE : MIXER_OK;
+    if (fclose(File) != 0) Ret = MIXER_ERR_WRITE;
+#ifdef _WIN32
+    if (Ret == MIXER_OK) remove(FileName);
+#endif
+    if (Ret == MIXER_OK && rename(TempName, FileName) != 0) Ret = MIXER_ERR_WRITE;
+    if (Ret < 0)
+    {
+        DEBUG(stderr, "ERROR when write %s\n", FileName);
+        remove(TempName);
+    }
+    av_free(TempName);
+
+    return Ret;
+}
+
+int32 PeakFileLoad(PeakFile **Result, const char *FileName)
+{
+    FILE *File = fopen(FileName, "rb");
+    if (File == NULL) return MIXER_ERR_OPEN;
+    PeakFile *Peaks = av_mallocz(sizeof(PeakFile));
+    uint8_t Header[PEAK_HEADER_SIZE];
+    int32 Ret = Peaks == NULL ? MIXER_ERR_NOMEM : MIXER_OK;
+    if (Ret == MIXER_OK && (fread(Header, 1, sizeof(Header), File) != sizeof(Header) || memcmp(Header, "PEAK", 4) != 0 ||
+                            PeakGetU32(Header + 4) != PEAK_VERSION || PeakGetU32(Header + 16) != PEAK_LEVELS))
+    {
+        Ret = MIXER_ERR_STREAM;
+    }
+
+    int64 Size = 0;
+    if (Ret == MIXER_OK)
+    {
+        Peaks->SampleRate = (int32)PeakGetU32(Header + 8);
+        Peaks->ChannelCount = (int32)PeakGetU32(Header + 12);
+        Peaks->SampleCount = (int64)PeakGetU64(Header + 20);
+        if (Peaks->ChannelCount <= 0 || Peaks->ChannelCount > MIXER_MAX_CHANNELS) Ret = MIXER_ERR_STREAM;
+        for (int32 Level = 0; Ret == MIXER_OK && Level < PEAK_LEVELS; Level++)
+        {
+            Peaks->BucketSize[Level] = (int32)PeakGetU32(Header + 28 + 12*Level);
+            Peaks->BucketCount[Level] = (int64)PeakGetU64(Header + 32 + 12*Level);
+            if (Peaks->BucketSize[Level] <= 0 || Peaks->BucketCount[Level] < 0 || Peaks->BucketCount[Level] > ((int64)1 << 40))
+            {
+                Ret = MIXER_ERR_STREAM;
+            }
+            Size += Peaks->BucketCount[Level]*Peaks->ChannelCount*(int64)sizeof(PeakBucket);
+        }
+    }
+    if (Ret == MIXER_OK && (Peaks->Data = av_malloc(Size + 1)) == NULL) Ret = MIXER_ERR_NOMEM;
+    if (Ret == MIXER_OK && (int64)fread(Peaks->Data, 1, Size, File) != Size) Ret = MIXER_ERR_STREAM;
+    fclose(File);
+    if (Ret < 0)
+    {
+        if (Ret == MIXER_ERR_STREAM) DEBUG(stderr, "ERROR: %s is not a peak file\n", FileName);
+        PeakFileFree(&Peaks);
+        return Ret;
+    }
+
+    PeakBucket *Buckets = (PeakBucket *)Peaks->Data;
+    for (int32 Level = 0; Level < PEAK_LEVELS; Level++)
+    {
+        Peaks->Buckets[Level] = Buckets;
+        Buckets += Peaks->BucketCount[Level]*Peaks->ChannelCount;
+    }
+    *Result = Peaks;
+
+    return MIXER_OK;
+}
+
+void PeakFileFree(PeakFile **Result)
+{
+    if (*Result == NULL) return;
+    av_free((*Result)->Data);
+    av_freep(Result);
+}
+
+void PeakQuery(const PeakFile *File, int32 Channel, int64 Start, int64 End, int32 PixelCount, PeakBucket *Out)
+{
+    float64 PerPixel = PixelCount > 0 ? (float64)(End - Start)/PixelCount : 0;
+    int32 Level = 0;
+    while (Level + 1 < PEAK_LEVELS && File->BucketSize[Level + 1] <= PerPixel) Level++;
+    const PeakBucket *Buckets = File->Buckets[Level];
+    int64 Size = File->BucketSize[Level];
+    int64 Count = File->BucketCount[Level];
+
+    for (int32 Pixel = 0; Pixel < PixelCount; Pixel++)
+    {
+        int64 From = Start + (int64)(Pixel*PerPixel);
+        int64 To = Start + (int64)((Pixel + 1)*PerPixel);
+        int64 First = From/Size;
+        int64 Last = (To + Size - 1)/Size;
+        if (Last <= First) Last = First + 1;
+        if (Last > Count) Last = Count;
+
+        // RMS merges through the sum of squares of every bucket, weighted by
+        // its samples since the last bucket of the input may be short.
+        PeakBucket Merged = {0, 0, 0};
+        float64 Energy = 0.0;
+        int64 Samples = 0;
+        for (int64 Index = First; Index < Last; Index++)
+        {
+            const PeakBucket *Bucket = &Buckets[Index*File->ChannelCount + Channel];
+            int64 Length = File->SampleCount - Index*Size;
+            if (Length > Size || Length <= 0) Length = Size;
+            if (Index == First || Bucket->Min < Merged.Min) Merged.Min = Bucket->Min;
+            if (Index == First || Bucket->Max > Merged.Max) Merged.Max = Bucket->Max;
+            Energy += (float64)Bucket->Rms*Bucket->Rms*Length;
+            Samples += Length;
+        }
+        if (Samples > 0) Merged.Rms = (uint16_t)(sqrt(Energy/Samples) + 0.5);
+        Out[Pixel] = Merged;
+    }
+}
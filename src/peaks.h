@@ -0,0 +1,88 @@
+#ifndef MIXER_PEAKS_H
+#define MIXER_PEAKS_H
+
+#include <stdint.h>
+
+#include "kernel.h"
+#include "mixer.h"
+
+// Waveform overview of an input, kept as a pyramid of min/max/RMS buckets
+// and built while the input is decoded anyway, see MixerConfig.Peaks. Level
+// 0 has a bucket per PEAK_BASE samples and every level above merges
+// PEAK_FACTOR buckets of the one below, so drawing any zoom reads at most
+// PEAK_FACTOR buckets per pixel from the level that fits it.
+//
+// The sidecar is the input's name with PEAK_SUFFIX, all little endian:
+//
+//     "PEAK", version, sample rate, channels, levels (uint32 each)
+//     samples (uint64)
+//     per level: bucket size (uint32), bucket count (uint64)
+//     per level: bucket count times channels PeakBuckets
+//
+// Positions are in samples at the rate the input was decoded to, which the
+// header holds.
+
+#define PEAK_LEVELS             3
+#define PEAK_BASE               256
+#define PEAK_FACTOR             16
+#define PEAK_SUFFIX             ".peaks"
+#define PEAK_VERSION            1
+
+// Min and max scaled to int16, RMS to uint16 of full scale.
+typedef struct PeakBucket
+{
+    int16_t Min;
+    int16_t Max;
+    uint16_t Rms;
+} PeakBucket;
+
+typedef struct PeakBuilder
+{
+    const KernelTable *Kernels;
+    int32 SampleRate;
+    int32 ChannelCount;
+    int64 Position;             // Samples added.
+
+    // The bucket being filled on every level, per channel.
+    float32 Range[PEAK_LEVELS][MIXER_MAX_CHANNELS][2];
+    float64 Energy[PEAK_LEVELS][MIXER_MAX_CHANNELS];
+    int64 Samples[PEAK_LEVELS]; // In those buckets.
+
+    PeakBucket *Buckets[PEAK_LEVELS];   // Channels interleaved.
+    int64 BucketCount[PEAK_LEVELS];
+    int64 BucketCapacity[PEAK_LEVELS];
+} PeakBuilder;
+
+typedef struct PeakFile
+{
+    int32 SampleRate;
+    int32 ChannelCount;
+    int64 SampleCount;
+    int32 BucketSize[PEAK_LEVELS];
+    int64 BucketCount[PEAK_LEVELS];
+    PeakBucket *Buckets[PEAK_LEVELS];   // Into Data.
+    uint8_t *Data;
+} PeakFile;
+
+int32 PeakOpen(PeakBuilder **Result, int32 SampleRate, int32 ChannelCount);
+
+void PeakClose(PeakBuilder **Result);
+
+// Add Count samples of every channel, planar.
+int32 PeakAdd(PeakBuilder *Peaks, float32 *const *Channels, int32 Count);
+
+// Close the partial buckets and write the sidecar FileName. The file is
+// written under a temporary name and renamed, so readers and other builders
+// of the same input never see half of it.
+int32 PeakWrite(PeakBuilder *Peaks, const char *FileName);
+
+int32 PeakFileLoad(PeakFile **Result, const char *FileName);
+
+void PeakFileFree(PeakFile **Result);
+
+// Out[p] = the bucket covering pixel p of PixelCount spread evenly over
+// samples [Start, End) of Channel, merged from the coarsest level whose
+// buckets are no longer than a pixel.
+void PeakQuery(const PeakFile *File, int32 Channel, int64 Start, int64 End, int32 PixelCount, PeakBucket *Out);
+
+#endif
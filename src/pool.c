@@ -0,0 +1,276 @@
+#include <string.h>
+
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+
+#include "pool.h"
+#include "thread.h"
+
+typedef struct PoolTask
+{
+    PoolTaskFunc Func;
+    void *Arg;
+} PoolTask;
+
+// Ring buffer deque, Top is where thieves take, Bottom is the owner's end.
+typedef struct PoolDeque
+{
+    Mutex Lock;
+    PoolTask *Tasks;
+    int32 Capacity;
+    int32 Top;
+    int32 Count;
+} PoolDeque;
+
+typedef struct PoolWorker
+{
+    ThreadPool *Pool;
+    int32 Index;
+    uint32_t Seed;      // xorshift state for picking steal victims
+    Thread Handle;
+} PoolWorker;
+
+struct ThreadPool
+{
+    int32 ThreadCount;
+    PoolWorker *Workers;
+    PoolDeque *Deques;
+    volatile int32 Queued;      // Tasks sitting in deques.
+    volatile int32 Pending;     // Tasks submitted and not finished.
+    volatile int32 NextDeque;   // Round robin target for external submits.
+    volatile int32 Stop;
+    int32 Sleeping;
+    Mutex Lock;
+    Cond WorkCond;
+    Cond IdleCond;
+};
+
+static THREAD_LOCAL PoolWorker *CurrentWorker;
+
+static int32 DequePushBottom(PoolDeque *Deque, PoolTask Task)
+{
+    MutexLock(&Deque->Lock);
+    if (Deque->Count == Deque->Capacity)
+    {
+        int32 Capacity = Deque->Capacity ? Deque->Capacity*2 : 64;
+        PoolTask *Tasks = av_malloc_array(Capacity, sizeof(PoolTask));
+        if (Tasks == NULL)
+        {
+            MutexUnlock(&Deque->Lock);
+            return -1;
+        }
+        for (int32 Index = 0; Index < Deque->Count; Index++)
+        {
+            Tasks[Index] = Deque->Tasks[(Deque->Top + Index) % Deque->Capacity];
+        }
+        av_free(Deque->Tasks);
+        Deque->Tasks = Tasks;
+        Deque->Capacity = Capacity;
+        Deque->Top = 0;
+    }
+    Deque->Tasks[(Deque->Top + Deque->Count) % Deque->Capacity] = Task;
+    Deque->Count++;
+    MutexUnlock(&Deque->Lock);
+    return 0;
+}
+
+static int32 DequePopBottom(PoolDeque *Deque, PoolTask *Task)
+{
+    int32 Found = 0;
+    MutexLock(&Deque->Lock);
+    if (Deque->Count > 0)
+    {
+        Deque->Count--;
+        *Task = Deque->Tasks[(Deque->Top + Deque->Count) % Deque->Capacity];
+        Found = 1;
+    }
+    MutexUnlock(&Deque->Lock);
+    return Found;
+}
+
+static int32 DequeStealTop(PoolDeque *Deque, PoolTask *Task)
+{
+    int32 Found = 0;
+    MutexLock(&Deque->Lock);
+    if (Deque->Count > 0)
+    {
+        *Task = Deque->Tasks[Deque->Top];
+        Deque->Top = (Deque->Top + 1) % Deque->Capacity;
+        Deque->Count--;
+        Found = 1;
+    }
+    MutexUnlock(&Deque->Lock);
+    return Found;
+}
+
+static int32 FindTask(PoolWorker *Worker, PoolTask *Task)
+{
+    ThreadPool *Pool = Worker->Pool;
+    if (DequePopBottom(&Pool->Deques[Worker->Index], Task)) return 1;
+
+    // Steal, starting from a random victim so thieves spread out.
+    Worker->Seed ^= Worker->Seed << 13;
+    Worker->Seed ^= Worker->Seed >> 17;
+    Worker->Seed ^= Worker->Seed << 5;
+    int32 Start = (int32)(Worker->Seed % (uint32_t)Pool->ThreadCount);
+    for (int32 Offset = 0; Offset < Pool->ThreadCount; Offset++)
+    {
+        int32 Victim = (Start + Offset) % Pool->ThreadCount;
+        if (Victim == Worker->Index) continue;
+        if (DequeStealTop(&Pool->Deques[Victim], Task)) return 1;
+    }
+    return 0;
+}
+
+static void WorkerMain(void *Arg)
+{
+    PoolWorker *Worker = (PoolWorker *)Arg;
+    ThreadPool *Pool = Worker->Pool;
+    CurrentWorker = Worker;
+
+    for (;;)
+    {
+        PoolTask Task;
+        if (FindTask(Worker, &Task))
+        {
+            AtomicAdd(&Pool->Queued, -1);
+            Task.Func(Task.Arg);
+            if (AtomicAdd(&Pool->Pending, -1) == 0)
+            {
+                MutexLock(&Pool->Lock);
+                CondBroadcast(&Pool->IdleCond);
+                MutexUnlock(&Pool->Lock);
+            }
+            continue;
+        }
+
+        // Nothing to run or steal, sleep until a submit.
+        MutexLock(&Pool->Lock);
+        while (AtomicLoad(&Pool->Queued) == 0 && !AtomicLoad(&Pool->Stop))
+        {
+            Pool->Sleeping++;
+            CondWait(&Pool->WorkCond, &Pool->Lock);
+            Pool->Sleeping--;
+        }
+        MutexUnlock(&Pool->Lock);
+        if (AtomicLoad(&Pool->Stop)) break;
+    }
+}
+
+int32 PoolCreate(ThreadPool **Pool, int32 ThreadCount)
+{
+    if (ThreadCount <= 0) ThreadCount = av_cpu_count();
+    if (ThreadCount <= 0) ThreadCount = 1;
+
+    ThreadPool *Context = av_mallocz(sizeof(ThreadPool));
+    if (Context == NULL) return -1;
+    Context->ThreadCount = ThreadCount;
+    Context->Workers = av_mallocz_array(ThreadCount, sizeof(PoolWorker));
+    Context->Deques = av_mallocz_array(ThreadCount, sizeof(PoolDeque));
+    if (Context->Workers == NULL || Context->Deques == NULL)
+    {
+        av_free(Context->Workers);
+        av_free(Context->Deques);
+        av_free(Context);
+        return -1;
+    }
+    MutexInit(&Context->Lock);
+    CondInit(&Context->WorkCond);
+    CondInit(&Context->IdleCond);
+
+    for (int32 Index = 0; Index < ThreadCount; Index++)
+    {
+        MutexInit(&Context->Deques[Index].Lock);
+    }
+    for (int32 Index = 0; Index < ThreadCount; Index++)
+    {
+        PoolWorker *Worker = &Context->Workers[Index];
+        Worker->Pool = Context;
+        Worker->Index = Index;
+        Worker->Seed = 2463534242u + 977u*Index;
+        if (ThreadCreate(&Worker->Handle, WorkerMain, Worker) != 0)
+        {
+            // Run with the workers we got.
+            DEBUG(stderr, "ERROR when create pool worker %d\n", Index);
+            Context->ThreadCount = Index;
+            break;
+        }
+    }
+    if (Context->ThreadCount == 0)
+    {
+        PoolDestroy(&Context);
+        return -1;
+    }
+
+    *Pool = Context;
+    return 0;
+}
+
+int32 PoolSubmit(ThreadPool *Pool, PoolTaskFunc Func, void *Arg)
+{
+    PoolTask Task = { Func, Arg };
+    PoolWorker *Worker = CurrentWorker;
+    int32 Target;
+    if (Worker != NULL && Worker->Pool == Pool) Target = Worker->Index;
+    else Target = (int32)((uint32_t)AtomicAdd(&Pool->NextDeque, 1) % (uint32_t)Pool->ThreadCount);
+
+    AtomicAdd(&Pool->Pending, 1);
+    if (DequePushBottom(&Pool->Deques[Target], Task) != 0)
+    {
+        AtomicAdd(&Pool->Pending, -1);
+        return -1;
+    }
+    AtomicAdd(&Pool->Queued, 1);
+
+    MutexLock(&Pool->Lock);
+    if (Pool->Sleeping > 0) CondSignal(&Pool->WorkCond);
+    MutexUnlock(&Pool->Lock);
+
+    return 0;
+}
+
+void PoolWait(ThreadPool *Pool)
+{
+    MutexLock(&Pool->Lock);
+    while (AtomicLoad(&Pool->Pending) > 0) CondWait(&Pool->IdleCond, &Pool->Lock);
+    MutexUnlock(&Pool->Lock);
+}
+
+int32 PoolThreadCount(ThreadPool *Pool)
+{
+    return Pool->ThreadCount;
+}
+
+int32 PoolWorkerIndex(ThreadPool *Pool)
+{
+    PoolWorker *Worker = CurrentWorker;
+    return (Worker != NULL && Worker->Pool == Pool) ? Worker->Index : -1;
+}
+
+void PoolDestroy(ThreadPool **Pool)
+{
+    if (Pool == NULL || *Pool == NULL) return;
+    ThreadPool *Context = *Pool;
+
+    PoolWait(Context);
+    MutexLock(&Context->Lock);
+    AtomicStore(&Context->Stop, 1);
+    CondBroadcast(&Context->WorkCond);
+    MutexUnlock(&Context->Lock);
+    for (int32 Index = 0; Index < Context->ThreadCount; Index++)
+    {
+        ThreadJoin(Context->Workers[Index].Handle);
+    }
+
+    for (int32 Index = 0; Index < Context->ThreadCount; Index++)
+    {
+        MutexDestroy(&Context->Deques[Index].Lock);
+        av_free(Context->Deques[Index].Tasks);
+    }
+    CondDestroy(&Context->IdleCond);
+    CondDestroy(&Context->WorkCond);
+    MutexDestroy(&Context->Lock);
+    av_free(Context->Workers);
+    av_free(Context->Deques);
+    av_freep(Pool);
+}
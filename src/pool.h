@@ -0,0 +1,31 @@
+#ifndef MIXER_POOL_H
+#define MIXER_POOL_H
+
+#include "common.h"
+
+// Work-stealing thread pool. Every worker owns a deque: tasks submitted from
+// a worker go to the bottom of its own deque and are popped LIFO (hot caches,
+// continuation style), idle workers steal FIFO from the top of other deques.
+// Tasks submitted from outside the pool are spread over the deques.
+
+typedef void (*PoolTaskFunc)(void *Arg);
+
+typedef struct ThreadPool ThreadPool;
+
+// ThreadCount <= 0 uses one worker per CPU.
+int32 PoolCreate(ThreadPool **Pool, int32 ThreadCount);
+
+// Queue Func(Arg). Safe to call from any thread, including from inside a task.
+int32 PoolSubmit(ThreadPool *Pool, PoolTaskFunc Func, void *Arg);
+
+// Block until every submitted task, and every task they submitted, has run.
+void PoolWait(ThreadPool *Pool);
+
+int32 PoolThreadCount(ThreadPool *Pool);
+
+// Index of the calling worker in [0, PoolThreadCount), -1 outside the pool.
+int32 PoolWorkerIndex(ThreadPool *Pool);
+
+void PoolDestroy(ThreadPool **Pool);
+
+#endif
@@ -0,0 +1,180 @@
+#include <string.h>
+
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+
+#include "remix.h"
+
+// Generate a kernel for IN input and OUT output channels. With both counts
+// constant the channel loops unroll and the weights stay in registers, only
+// the loop over samples is left.
+#define REMIX_KERNEL(IN, OUT)                                                                               \
+static void RemixIn##IN##Out##OUT(const RemixMatrix *Matrix, float32 *const *Out, const float32 *const *In, \
+                                  int32 Count)                                                              \
+{                                                                                                           \
+    float32 Weight[OUT][IN];                                                                                \
+    for (int32 O = 0; O < OUT; O++)                                                                         \
+    {                                                                                                       \
+        for (int32 I = 0; I < IN; I++) Weight[O][I] = Matrix->Weight[O*IN + I];                             \
+    }                                                                                                       \
+    for (int32 Index = 0; Index < Count; Index++)                                                           \
+    {                                                                                                       \
+        float32 Sample[IN];                                                                                 \
+        for (int32 I = 0; I < IN; I++) Sample[I] = In[I][Index];                                            \
+        for (int32 O = 0; O < OUT; O++)                                                                     \
+        {                                                                                                   \
+            float32 Sum = 0.0f;                                                                             \
+            for (int32 I = 0; I < IN; I++) Sum += Weight[O][I]*Sample[I];                                   \
+            Out[O][Index] = Sum;                                                                            \
+        }                                                                                                   \
+    }                                                                                                       \
+}
+
+REMIX_KERNEL(1, 2)
+REMIX_KERNEL(2, 1)
+REMIX_KERNEL(2, 2)
+REMIX_KERNEL(3, 2)
+REMIX_KERNEL(4, 2)
+REMIX_KERNEL(6, 2)
+REMIX_KERNEL(8, 2)
+REMIX_KERNEL(6, 1)
+REMIX_KERNEL(1, 6)
+REMIX_KERNEL(2, 6)
+REMIX_KERNEL(8, 6)
+
+typedef struct RemixKernel
+{
+    int32 InCount;
+    int32 OutCount;
+    RemixFunc Process;
+} RemixKernel;
+
+static const RemixKernel RemixKernels[] =
+{
+    {1, 2, RemixIn1Out2},
+    {2, 1, RemixIn2Out1},
+    {2, 2, RemixIn2Out2},
+    {3, 2, RemixIn3Out2},
+    {4, 2, RemixIn4Out2},
+    {6, 2, RemixIn6Out2},
+    {8, 2, RemixIn8Out2},
+    {6, 1, RemixIn6Out1},
+    {1, 6, RemixIn1Out6},
+    {2, 6, RemixIn2Out6},
+    {8, 6, RemixIn8Out6},
+};
+
+static void RemixGeneric(const RemixMatrix *Matrix, float32 *const *Out, const float32 *const *In, int32 Count)
+{
+    for (int32 O = 0; O < Matrix->OutCount; O++)
+    {
+        const float32 *Weight = Matrix->Weight + O*Matrix->InCount;
+        memset(Out[O], 0, Count*sizeof(float32));
+        for (int32 I = 0; I < Matrix->InCount; I++)
+        {
+            if (Weight[I] == 0.0f) continue;
+            for (int32 Index = 0; Index < Count; Index++)
+            {
+                Out[O][Index] += Weight[I]*In[I][Index];
+            }
+        }
+    }
+}
+
+// Add input In into output channel Channel at Gain, if the output has it.
+static int32 RemixAdd(RemixMatrix *Matrix, int64 OutLayout, int32 In, uint64_t Channel, float32 Gain)
+{
+    if (!(OutLayout & Channel)) return 0;
+    int32 Out = av_get_channel_layout_channel_index(OutLayout, Channel);
+    Matrix->Weight[Out*Matrix->InCount + In] += Gain;
+    return 1;
+}
+
+static int32 RemixAddPair(RemixMatrix *Matrix, int64 OutLayout, int32 In, uint64_t Left, uint64_t Right, float32 Gain)
+{
+    if ((OutLayout & (Left | Right)) != (Left | Right)) return 0;
+    RemixAdd(Matrix, OutLayout, In, Left, Gain);
+    RemixAdd(Matrix, OutLayout, In, Right, Gain);
+    return 1;
+}
+
+// Route input In, channel Channel of the input layout, to the closest output
+// channels.
+static void RemixRoute(RemixMatrix *Matrix, int64 OutLayout, int32 In, uint64_t Channel)
+{
+    const uint64_t Left = AV_CH_FRONT_LEFT | AV_CH_FRONT_LEFT_OF_CENTER | AV_CH_SIDE_LEFT | AV_CH_BACK_LEFT |
+                          AV_CH_WIDE_LEFT | AV_CH_SURROUND_DIRECT_LEFT | AV_CH_TOP_FRONT_LEFT |
+                          AV_CH_TOP_BACK_LEFT | AV_CH_STEREO_LEFT;
+    const uint64_t Right = AV_CH_FRONT_RIGHT | AV_CH_FRONT_RIGHT_OF_CENTER | AV_CH_SIDE_RIGHT | AV_CH_BACK_RIGHT |
+                           AV_CH_WIDE_RIGHT | AV_CH_SURROUND_DIRECT_RIGHT | AV_CH_TOP_FRONT_RIGHT |
+                           AV_CH_TOP_BACK_RIGHT | AV_CH_STEREO_RIGHT;
+    const uint64_t Surround = AV_CH_SIDE_LEFT | AV_CH_SIDE_RIGHT | AV_CH_BACK_LEFT | AV_CH_BACK_RIGHT |
+                              AV_CH_SURROUND_DIRECT_LEFT | AV_CH_SURROUND_DIRECT_RIGHT |
+                              AV_CH_TOP_BACK_LEFT | AV_CH_TOP_BACK_RIGHT;
+    const float32 Half = (float32)M_SQRT1_2;
+
+    if (RemixAdd(Matrix, OutLayout, In, Channel, 1.0f)) return;
+    if (Channel & (AV_CH_LOW_FREQUENCY | AV_CH_LOW_FREQUENCY_2)) return;
+
+    if (Channel & (Left | Right))
+    {
+        int32 IsLeft = (Channel & Left) != 0;
+        uint64_t Front = IsLeft ? AV_CH_FRONT_LEFT : AV_CH_FRONT_RIGHT;
+        if (Channel & Surround)
+        {
+            // Side and back stand in for each other before folding forward.
+            uint64_t Side = IsLeft ? AV_CH_SIDE_LEFT : AV_CH_SIDE_RIGHT;
+            uint64_t Back = IsLeft ? AV_CH_BACK_LEFT : AV_CH_BACK_RIGHT;
+            if (RemixAdd(Matrix, OutLayout, In, Side, 1.0f)) return;
+            if (RemixAdd(Matrix, OutLayout, In, Back, 1.0f)) return;
+            if (RemixAdd(Matrix, OutLayout, In, Front, Half)) return;
+            RemixAdd(Matrix, OutLayout, In, AV_CH_FRONT_CENTER, 0.5f);
+            return;
+        }
+        if (RemixAdd(Matrix, OutLayout, In, Front, 1.0f)) return;
+        RemixAdd(Matrix, OutLayout, In, AV_CH_FRONT_CENTER, Half);
+        return;
+    }
+
+    if (Channel & (AV_CH_BACK_CENTER | AV_CH_TOP_BACK_CENTER))
+    {
+        if (RemixAddPair(Matrix, OutLayout, In, AV_CH_BACK_LEFT, AV_CH_BACK_RIGHT, Half)) return;
+        if (RemixAddPair(Matrix, OutLayout, In, AV_CH_SIDE_LEFT, AV_CH_SIDE_RIGHT, Half)) return;
+        if (RemixAddPair(Matrix, OutLayout, In, AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, 0.5f)) return;
+        RemixAdd(Matrix, OutLayout, In, AV_CH_FRONT_CENTER, Half);
+        return;
+    }
+    if (RemixAdd(Matrix, OutLayout, In, AV_CH_FRONT_CENTER, 1.0f)) return;
+    RemixAddPair(Matrix, OutLayout, In, AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, Half);
+}
+
+int32 RemixInit(RemixMatrix *Matrix, int64 InLayout, int64 OutLayout)
+{
+    memset(Matrix, 0, sizeof(RemixMatrix));
+    Matrix->InCount = av_get_channel_layout_nb_channels(InLayout);
+    Matrix->OutCount = av_get_channel_layout_nb_channels(OutLayout);
+    if (Matrix->InCount <= 0 || Matrix->InCount > REMIX_MAX_INPUTS) return MIXER_ERR_ARG;
+    if (Matrix->OutCount <= 0 || Matrix->OutCount > MIXER_MAX_CHANNELS) return MIXER_ERR_ARG;
+
+    for (int32 In = 0; In < Matrix->InCount; In++)
+    {
+        RemixRoute(Matrix, OutLayout, In, av_channel_layout_extract_channel(InLayout, In));
+    }
+
+    Matrix->Process = RemixGeneric;
+    for (int32 Index = 0; Index < (int32)(sizeof(RemixKernels)/sizeof(RemixKernels[0])); Index++)
+    {
+        if (RemixKernels[Index].InCount == Matrix->InCount && RemixKernels[Index].OutCount == Matrix->OutCount)
+        {
+            Matrix->Process = RemixKernels[Index].Process;
+            Matrix->Specialized = 1;
+        }
+    }
+
+    return MIXER_OK;
+}
+
+void RemixRun(const RemixMatrix *Matrix, float32 *const *Out, const float32 *const *In, int32 Count)
+{
+    Matrix->Process(Matrix, Out, In, Count);
+}
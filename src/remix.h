@@ -0,0 +1,37 @@
+#ifndef MIXER_REMIX_H
+#define MIXER_REMIX_H
+
+#include "mixer.h"
+
+// Channel layout conversion of planar float samples. Every output channel is
+// a weighted sum of the input channels, with the weights swresample uses by
+// default: a missing centre or surround folds into its neighbours at -3 dB
+// and LFE is dropped unless the output has one. The common pairs of input
+// and output channel counts run kernels generated for that pair, so the
+// loops over channels are unrolled at compile time, any other pair a
+// generic matrix loop.
+
+#define REMIX_MAX_INPUTS        32
+
+struct RemixMatrix;
+
+typedef void (*RemixFunc)(const struct RemixMatrix *Matrix, float32 *const *Out, const float32 *const *In, int32 Count);
+
+typedef struct RemixMatrix
+{
+    int32 InCount;
+    int32 OutCount;
+    float32 Weight[MIXER_MAX_CHANNELS*REMIX_MAX_INPUTS];    // Weight[o*InCount + i], input i into output o.
+    RemixFunc Process;
+    int32 Specialized;      // Process was generated for this pair of channel counts.
+} RemixMatrix;
+
+// Build the conversion between two av_channel_layout masks. Returns
+// MIXER_ERR_ARG when either has more channels than supported.
+int32 RemixInit(RemixMatrix *Matrix, int64 InLayout, int64 OutLayout);
+
+// Out[o][n] = sum of Weight[o*InCount + i]*In[i][n] for n in [0, Count).
+// Out must not overlap In.
+void RemixRun(const RemixMatrix *Matrix, float32 *const *Out, const float32 *const *In, int32 Count);
+
+#endif
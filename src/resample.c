@@ -0,0 +1,249 @@
+#include <math.h>
+#include <string.h>
+
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+
+#include "resample.h"
+
+// Kaiser window shape and passband edge relative to the lower Nyquist
+// frequency, the swresample defaults.
+#define RESAMPLE_KAISER_BETA    9.0
+#define RESAMPLE_CUTOFF         0.97
+
+#define RESAMPLE_MAX_TAPS       256
+
+static int32 ResampleTapCount(int32 Quality)
+{
+    switch (Quality)
+    {
+        case MIXER_RESAMPLE_FAST:   return 16;
+        case MIXER_RESAMPLE_HIGH:   return 64;
+        default:                    return 32;
+    }
+}
+
+// Zeroth order modified Bessel function of the first kind.
+static float64 ResampleBessel(float64 X)
+{
+    float64 Sum = 1.0;
+    float64 Term = 1.0;
+    for (int32 K = 1; K < 50 && Term > Sum*1e-12; K++)
+    {
+        Term *= (X/(2*K))*(X/(2*K));
+        Sum += Term;
+    }
+    return Sum;
+}
+
+static int32 ResampleDesign(ResampleFilter *Filter)
+{
+    // Downsampling lowers the cutoff and widens the filter by the same factor.
+    float64 Scale = Filter->PhaseCount < Filter->Step ? (float64)Filter->PhaseCount/Filter->Step : 1.0;
+    int32 TapCount = (int32)ceil(ResampleTapCount(Filter->Quality)/Scale);
+    TapCount = (TapCount + 7) & ~7;
+    if (TapCount > RESAMPLE_MAX_TAPS) TapCount = RESAMPLE_MAX_TAPS;
+    Filter->TapCount = TapCount;
+
+    Filter->Coefficients = av_malloc(Filter->PhaseCount*TapCount*sizeof(float32));
+    if (Filter->Coefficients == NULL) return MIXER_ERR_NOMEM;
+
+    float64 Cutoff = Scale*RESAMPLE_CUTOFF;
+    int32 Half = TapCount/2;
+    float64 Norm = ResampleBessel(RESAMPLE_KAISER_BETA);
+    for (int32 Phase = 0; Phase < Filter->PhaseCount; Phase++)
+    {
+        // Tap t reads the input (Half - 1 - t + Fraction) samples before the output.
+        float64 Fraction = (float64)Phase/Filter->PhaseCount;
+        float32 *Taps = Filter->Coefficients + Phase*TapCount;
+        float64 Sum = 0.0;
+        for (int32 Tap = 0; Tap < TapCount; Tap++)
+        {
+            float64 X = Tap - (Half - 1) - Fraction;
+            float64 W = X/Half;
+            float64 Window = W*W < 1.0 ? ResampleBessel(RESAMPLE_KAISER_BETA*sqrt(1.0 - W*W))/Norm : 0.0;
+            float64 Sinc = X == 0.0 ? 1.0 : sin(M_PI*Cutoff*X)/(M_PI*Cutoff*X);
+            float64 Value = Cutoff*Sinc*Window;
+            Taps[Tap] = (float32)Value;
+            Sum += Value;
+        }
+        // Unity gain at DC for every phase.
+        for (int32 Tap = 0; Tap < TapCount; Tap++)
+        {
+            Taps[Tap] = (float32)(Taps[Tap]/Sum);
+        }
+    }
+
+    return MIXER_OK;
+}
+
+const ResampleFilter *ResampleFilterGet(ResampleFilter **Cache, int32 InRate, int32 OutRate, int32 Quality)
+{
+    for (ResampleFilter *Filter = *Cache; Filter != NULL; Filter = Filter->Next)
+    {
+        if (Filter->InRate == InRate && Filter->OutRate == OutRate && Filter->Quality == Quality) return Filter;
+    }
+
+    int64 Divisor = av_gcd(InRate, OutRate);
+    if (Divisor <= 0 || OutRate/Divisor > RESAMPLE_MAX_PHASES) return NULL;
+    // Beyond this much downsampling the widest filter no longer covers the step between outputs.
+    if (InRate > OutRate*(RESAMPLE_MAX_TAPS/16)) return NULL;
+
+    ResampleFilter *Filter = av_mallocz(sizeof(ResampleFilter));
+    if (Filter == NULL) return NULL;
+    Filter->InRate = InRate;
+    Filter->OutRate = OutRate;
+    Filter->Quality = Quality;
+    Filter->PhaseCount = (int32)(OutRate/Divisor);
+    Filter->Step = (int32)(InRate/Divisor);
+    if (ResampleDesign(Filter) < 0)
+    {
+        av_free(Filter);
+        return NULL;
+    }
+    Filter->Next = *Cache;
+    *Cache = Filter;
+
+    return Filter;
+}
+
+void ResampleCacheFree(ResampleFilter **Cache)
+{
+    while (*Cache != NULL)
+    {
+        ResampleFilter *Filter = *Cache;
+        *Cache = Filter->Next;
+        av_free(Filter->Coefficients);
+        av_free(Filter);
+    }
+}
+
+int32 ResampleInit(ResampleState *State, const ResampleFilter *Filter, int32 ChannelCount)
+{
+    memset(State, 0, sizeof(ResampleState));
+    State->Filter = Filter;
+    State->Kernels = KernelSelect();
+    State->ChannelCount = ChannelCount;
+    float32 *In[MIXER_MAX_CHANNELS];
+    int32 Ret = ResampleReserve(State, 4096, In);
+    if (Ret < 0) return Ret;
+    ResampleReset(State);
+
+    return MIXER_OK;
+}
+
+void ResampleFree(ResampleState *State)
+{
+    for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+    {
+        av_freep(&State->History[Channel]);
+    }
+}
+
+void ResampleReset(ResampleState *State)
+{
+    // Leading silence centres the filter on input sample 0 for output 0.
+    int32 Lead = State->Filter->TapCount/2 - 1;
+    for (int32 Channel = 0; Channel < State->ChannelCount; Channel++)
+    {
+        memset(State->History[Channel], 0, Lead*sizeof(float32));
+    }
+    State->HistoryCount = Lead;
+    State->Index = 0;
+    State->Phase = 0;
+    State->InTotal = 0;
+    State->OutTotal = 0;
+    State->Flushed = 0;
+}
+
+int32 ResampleReserve(ResampleState *State, int32 Count, float32 **In)
+{
+    if (State->HistoryCount + Count > State->HistoryCapacity)
+    {
+        int32 Capacity = State->HistoryCapacity ? State->HistoryCapacity : 4096;
+        while (Capacity < State->HistoryCount + Count) Capacity *= 2;
+        for (int32 Channel = 0; Channel < State->ChannelCount; Channel++)
+        {
+            float32 *History = av_realloc(State->History[Channel], Capacity*sizeof(float32));
+            if (History == NULL) return MIXER_ERR_NOMEM;
+            State->History[Channel] = History;
+        }
+        State->HistoryCapacity = Capacity;
+    }
+    for (int32 Channel = 0; Channel < State->ChannelCount; Channel++)
+    {
+        In[Channel] = State->History[Channel] + State->HistoryCount;
+    }
+
+    return MIXER_OK;
+}
+
+void ResampleCommit(ResampleState *State, int32 Count)
+{
+    State->HistoryCount += Count;
+    State->InTotal += Count;
+}
+
+int32 ResampleFlush(ResampleState *State)
+{
+    if (State->Flushed) return MIXER_OK;
+
+    int32 Tail = State->Filter->TapCount/2;
+    float32 *In[MIXER_MAX_CHANNELS];
+    int32 Ret = ResampleReserve(State, Tail, In);
+    if (Ret < 0) return Ret;
+    for (int32 Channel = 0; Channel < State->ChannelCount; Channel++)
+    {
+        memset(In[Channel], 0, Tail*sizeof(float32));
+    }
+    State->HistoryCount += Tail;
+    State->Flushed = 1;
+
+    return MIXER_OK;
+}
+
+int32 ResamplePending(const ResampleState *State)
+{
+    const ResampleFilter *Filter = State->Filter;
+    // Outputs whose window starts at or before the last full one.
+    int64 Windows = State->HistoryCount - Filter->TapCount + 1 - State->Index;
+    if (Windows <= 0) return 0;
+    int64 Span = Windows*Filter->PhaseCount - State->Phase;
+    int64 Count = (Span + Filter->Step - 1)/Filter->Step;
+    if (State->Flushed)
+    {
+        // The padding only completes outputs that fall inside the input.
+        int64 Total = (State->InTotal*Filter->PhaseCount + Filter->Step - 1)/Filter->Step;
+        if (Count > Total - State->OutTotal) Count = Total - State->OutTotal;
+    }
+    return Count > 0 ? (int32)(Count < INT32_MAX ? Count : INT32_MAX) : 0;
+}
+
+int32 ResampleRead(ResampleState *State, float32 *const *Out, int32 Count)
+{
+    const ResampleFilter *Filter = State->Filter;
+    int32 Pending = ResamplePending(State);
+    if (Count > Pending) Count = Pending;
+    if (Count <= 0) return 0;
+
+    for (int32 Channel = 0; Channel < State->ChannelCount; Channel++)
+    {
+        State->Kernels->Polyphase(Out[Channel], Count, State->History[Channel] + State->Index, Filter->Coefficients,
+                                  Filter->TapCount, Filter->PhaseCount, Filter->Step, State->Phase);
+    }
+    int64 Phase = State->Phase + (int64)Count*Filter->Step;
+    State->Index += (int32)(Phase/Filter->PhaseCount);
+    State->Phase = (int32)(Phase % Filter->PhaseCount);
+    State->OutTotal += Count;
+
+    // Keep only what later windows still read.
+    int32 Keep = State->HistoryCount - State->Index;
+    for (int32 Channel = 0; Channel < State->ChannelCount; Channel++)
+    {
+        memmove(State->History[Channel], State->History[Channel] + State->Index, Keep*sizeof(float32));
+    }
+    State->HistoryCount = Keep;
+    State->Index = 0;
+
+    return Count;
+}
@@ -0,0 +1,72 @@
+#ifndef MIXER_RESAMPLE_H
+#define MIXER_RESAMPLE_H
+
+#include "kernel.h"
+#include "mixer.h"
+
+// Sample rate conversion of planar float with a polyphase windowed sinc
+// filter. The coefficients for one rate ratio and quality are computed once
+// per mixer context and shared by every input that needs them, so each input
+// only keeps a short history of samples and its position in the filter.
+
+// Ratios with more phases than this, after reducing both rates by their
+// greatest common divisor, are left to swresample.
+#define RESAMPLE_MAX_PHASES     1024
+
+typedef struct ResampleFilter
+{
+    int32 InRate;
+    int32 OutRate;
+    int32 Quality;          // MIXER_RESAMPLE_*.
+    int32 PhaseCount;       // OutRate reduced, output samples per Step input samples.
+    int32 Step;             // InRate reduced.
+    int32 TapCount;         // Multiple of 8.
+    float32 *Coefficients;  // TapCount per phase, phase after phase.
+    struct ResampleFilter *Next;
+} ResampleFilter;
+
+// Filter for InRate to OutRate at Quality from the list at *Cache, built and
+// added on first use. Returns NULL when the ratio has too many phases or the
+// allocation fails.
+const ResampleFilter *ResampleFilterGet(ResampleFilter **Cache, int32 InRate, int32 OutRate, int32 Quality);
+
+void ResampleCacheFree(ResampleFilter **Cache);
+
+typedef struct ResampleState
+{
+    const ResampleFilter *Filter;
+    const KernelTable *Kernels;
+    int32 ChannelCount;
+    float32 *History[MIXER_MAX_CHANNELS];   // Input not fully consumed yet, History[c][Index] starts the next window.
+    int32 HistoryCount;
+    int32 HistoryCapacity;
+    int32 Index;
+    int32 Phase;
+    int64 InTotal;          // Input samples since the last reset.
+    int64 OutTotal;         // Output samples since the last reset.
+    int32 Flushed;
+} ResampleState;
+
+int32 ResampleInit(ResampleState *State, const ResampleFilter *Filter, int32 ChannelCount);
+
+void ResampleFree(ResampleState *State);
+
+// Forget all input, the next sample written is aligned to output 0.
+void ResampleReset(ResampleState *State);
+
+// Make room for Count input samples per channel. In receives where to write
+// them, ResampleCommit() then adds them.
+int32 ResampleReserve(ResampleState *State, int32 Count, float32 **In);
+
+void ResampleCommit(ResampleState *State, int32 Count);
+
+// Pad the end of the input so that the last samples come out.
+int32 ResampleFlush(ResampleState *State);
+
+// Output samples ResampleRead() can produce from the input so far.
+int32 ResamplePending(const ResampleState *State);
+
+// Produce up to Count output samples into Out, returns how many.
+int32 ResampleRead(ResampleState *State, float32 *const *Out, int32 Count);
+
+#endif
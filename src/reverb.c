@@ -0,0 +1,420 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <libavutil/mem.h>
+
+#include "reverb.h"
+#include "source.h"
+
+static int32 ReverbLog2(int32 Size)
+{
+    int32 Bits = 0;
+    while ((1 << Bits) < Size) Bits++;
+    return Bits;
+}
+
+// Spectra from av_rdft_calc() keep the real Nyquist bin where the imaginary
+// part of the DC bin would be. The imaginary parts of both stay 0 here.
+static void ReverbUnpack(float32 *Spectrum, const float32 *Fft, int32 Partition, int32 Stride, float32 Scale)
+{
+    float32 *Re = Spectrum, *Im = Spectrum + Stride;
+    Re[0] = Fft[0]*Scale;
+    Re[Partition] = Fft[1]*Scale;
+    for (int32 Bin = 1; Bin < Partition; Bin++)
+    {
+        Re[Bin] = Fft[2*Bin]*Scale;
+        Im[Bin] = Fft[2*Bin + 1]*Scale;
+    }
+}
+
+static void ReverbPack(float32 *Fft, const float32 *Spectrum, int32 Partition, int32 Stride)
+{
+    const float32 *Re = Spectrum, *Im = Spectrum + Stride;
+    Fft[0] = Re[0];
+    Fft[1] = Re[Partition];
+    for (int32 Bin = 1; Bin < Partition; Bin++)
+    {
+        Fft[2*Bin] = Re[Bin];
+        Fft[2*Bin + 1] = Im[Bin];
+    }
+}
+
+// Transform every partition of Stage, zero padded to twice its length for
+// overlap-save and scaled so the inverse transform comes out at unity.
+static int32 ReverbStageDesign(ReverbStage *Stage, float32 *const *Samples, int32 ChannelCount, int64 Length)
+{
+    int32 Partition = Stage->Partition;
+    RDFTContext *Forward = av_rdft_init(ReverbLog2(2*Partition), DFT_R2C);
+    float32 *Fft = av_malloc(2*Partition*sizeof(float32));
+    int32 Ret = Forward == NULL || Fft == NULL ? MIXER_ERR_NOMEM : MIXER_OK;
+    for (int32 Channel = 0; Ret >= 0 && Channel < ChannelCount; Channel++)
+    {
+        Stage->Spectra[Channel] = av_mallocz_array(Stage->Count, 2*Stage->Stride*sizeof(float32));
+        if (Stage->Spectra[Channel] == NULL)
+        {
+            Ret = MIXER_ERR_NOMEM;
+            break;
+        }
+        for (int32 Index = 0; Index < Stage->Count; Index++)
+        {
+            int64 Start = Stage->Start + (int64)Index*Partition;
+            int32 Count = Length - Start < Partition ? (int32)(Length - Start) : Partition;
+            memset(Fft, 0, 2*Partition*sizeof(float32));
+            memcpy(Fft, Samples[Channel] + Start, Count*sizeof(float32));
+            av_rdft_calc(Forward, Fft);
+            ReverbUnpack(Stage->Spectra[Channel] + Index*2*Stage->Stride, Fft, Partition, Stage->Stride, 1.0f/Partition);
+        }
+    }
+    if (Forward != NULL) av_rdft_end(Forward);
+    av_free(Fft);
+    return Ret;
+}
+
+int32 ReverbImpulseCreate(ReverbImpulse **Result, float32 *const *Samples, int32 ChannelCount, int64 Length,
+                          int32 SampleRate, int32 MaxPartition)
+{
+    *Result = NULL;
+    if (ChannelCount <= 0 || ChannelCount > MIXER_MAX_CHANNELS || Length <= 0 || Length > INT32_MAX) return MIXER_ERR_ARG;
+    int32 Longest = REVERB_PARTITION;
+    while (Longest < MaxPartition && Longest < REVERB_MAX_PARTITION) Longest *= 8;
+    if (Longest != MaxPartition || MaxPartition > REVERB_MAX_PARTITION) return MIXER_ERR_ARG;
+
+    ReverbImpulse *Impulse = av_mallocz(sizeof(ReverbImpulse));
+    if (Impulse == NULL) return MIXER_ERR_NOMEM;
+    Impulse->SampleRate = SampleRate;
+    Impulse->ChannelCount = ChannelCount;
+    Impulse->Length = Length;
+
+    // Each stage ends where the next, eight times longer, partition is due
+    // in time: a partition that starts its own length into the response.
+    // The next stage only pays for its longer transforms when it holds a few
+    // partitions, otherwise this one runs to the end.
+    int64 Start = 0;
+    for (int32 Partition = REVERB_PARTITION; Start < Length; Partition *= 8)
+    {
+        int64 End = Partition < MaxPartition ? 8*Partition : Length;
+        if (Length - End < REVERB_MIN_COUNT*8*(int64)Partition) End = Length;
+        ReverbStage *Stage = &Impulse->Stages[Impulse->StageCount++];
+        Stage->Partition = Partition;
+        Stage->Start = (int32)Start;
+        Stage->Count = (int32)((End - Start + Partition - 1)/Partition);
+        Stage->Stride = (Partition + 1 + 7) & ~7;
+        int32 Ret = ReverbStageDesign(Stage, Samples, ChannelCount, Length);
+        if (Ret < 0)
+        {
+            ReverbImpulseFree(Impulse);
+            return Ret;
+        }
+        Start += (int64)Stage->Count*Partition;
+    }
+
+    *Result = Impulse;
+    return MIXER_OK;
+}
+
+void ReverbImpulseFree(ReverbImpulse *Impulse)
+{
+    if (Impulse == NULL) return;
+    for (int32 Index = 0; Index < Impulse->StageCount; Index++)
+    {
+        for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+        {
+            av_free(Impulse->Stages[Index].Spectra[Channel]);
+        }
+    }
+    av_free(Impulse->Key);
+    av_free(Impulse);
+}
+
+// Decode FileName alone through a mixer into planar Samples.
+static int32 ReverbDecode(const MixerConfig *Config, const char *FileName, float32 **Samples, int64 *Length)
+{
+    int32 ChannelCount = Config->ChannelCount;
+    int32 BlockSize = Config->BlockSize;
+    MixerContext *Mixer = NULL;
+    float32 *Block = av_malloc(BlockSize*ChannelCount*sizeof(float32));
+    int32 Ret = Block == NULL ? MIXER_ERR_NOMEM : MixerOpen(&Mixer, Config);
+    if (Ret >= 0) Ret = MixerAddInput(Mixer, FileName, 0, 1.0f);
+
+    int64 Capacity = 0;
+    *Length = 0;
+    int32 SampleCount = 0;
+    while (Ret >= 0 && (Ret = MixerRenderBlock(Mixer, Block, &SampleCount)) == MIXER_OK)
+    {
+        if (*Length + SampleCount > Capacity)
+        {
+            Capacity = 2*Capacity + BlockSize;
+            for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+            {
+                float32 *Grown = av_realloc(Samples[Channel], Capacity*sizeof(float32));
+                if (Grown == NULL) Ret = MIXER_ERR_NOMEM;
+                else Samples[Channel] = Grown;
+            }
+            if (Ret < 0) break;
+        }
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            for (int32 Index = 0; Index < SampleCount; Index++)
+            {
+                Samples[Channel][*Length + Index] = Block[Index*ChannelCount + Channel];
+            }
+        }
+        *Length += SampleCount;
+    }
+    MixerClose(&Mixer);
+    av_free(Block);
+    if (Ret >= 0 && *Length == 0) Ret = MIXER_ERR_DECODE;
+    return Ret < 0 ? Ret : MIXER_OK;
+}
+
+int32 ReverbImpulseGet(ReverbImpulse **Cache, const MixerConfig *Config, const char *FileName,
+                       const ReverbImpulse **Result)
+{
+    *Result = NULL;
+    char *Key = SourceIdentify(FileName);
+    if (Key == NULL) return MIXER_ERR_NOMEM;
+    for (ReverbImpulse *Impulse = *Cache; Impulse != NULL; Impulse = Impulse->Next)
+    {
+        if (Impulse->Key != NULL && strcmp(Impulse->Key, Key) == 0 && Impulse->SampleRate == Config->SampleRate &&
+            Impulse->ChannelCount == Config->ChannelCount)
+        {
+            av_free(Key);
+            *Result = Impulse;
+            return MIXER_OK;
+        }
+    }
+
+    float32 *Samples[MIXER_MAX_CHANNELS] = {NULL};
+    int64 Length = 0;
+    ReverbImpulse *Impulse = NULL;
+    int32 Ret = ReverbDecode(Config, FileName, Samples, &Length);
+    if (Ret >= 0) Ret = ReverbImpulseCreate(&Impulse, Samples, Config->ChannelCount, Length, Config->SampleRate,
+                                            REVERB_MAX_PARTITION);
+    for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+    {
+        av_free(Samples[Channel]);
+    }
+    if (Ret < 0)
+    {
+        av_free(Key);
+        return Ret;
+    }
+    Impulse->Key = Key;
+    Impulse->Next = *Cache;
+    *Cache = Impulse;
+
+    *Result = Impulse;
+    return MIXER_OK;
+}
+
+void ReverbCacheFree(ReverbImpulse **Cache)
+{
+    while (*Cache != NULL)
+    {
+        ReverbImpulse *Impulse = *Cache;
+        *Cache = Impulse->Next;
+        ReverbImpulseFree(Impulse);
+    }
+}
+
+int32 ReverbOpen(Reverb **Result, const ReverbImpulse *Impulse, int32 BlockSize, float32 Dry, float32 Wet)
+{
+    *Result = NULL;
+    if (Impulse == NULL || BlockSize <= 0) return MIXER_ERR_ARG;
+
+    Reverb *Rev = av_mallocz(sizeof(Reverb));
+    if (Rev == NULL) return MIXER_ERR_NOMEM;
+    *Result = Rev;
+    Rev->Impulse = Impulse;
+    Rev->Kernels = KernelSelect();
+    Rev->ChannelCount = Impulse->ChannelCount;
+    Rev->BlockSize = BlockSize;
+    Rev->Dry = Dry;
+    Rev->Wet = Wet;
+    Rev->Latency = BlockSize % REVERB_PARTITION == 0 ? 0 : REVERB_PARTITION;
+
+    int32 MaxCount = 0;
+    int32 MaxStride = 0;
+    for (int32 Index = 0; Index < Impulse->StageCount; Index++)
+    {
+        const ReverbStage *Stage = &Impulse->Stages[Index];
+        int32 Bits = ReverbLog2(2*Stage->Partition);
+        Rev->Forward[Index] = av_rdft_init(Bits, DFT_R2C);
+        Rev->Inverse[Index] = av_rdft_init(Bits, IDFT_C2R);
+        if (Rev->Forward[Index] == NULL || Rev->Inverse[Index] == NULL) return MIXER_ERR_NOMEM;
+        for (int32 Channel = 0; Channel < Rev->ChannelCount; Channel++)
+        {
+            Rev->Lines[Index][Channel] = av_mallocz_array(Stage->Count, 2*Stage->Stride*sizeof(float32));
+            if (Rev->Lines[Index][Channel] == NULL) return MIXER_ERR_NOMEM;
+        }
+        if (Stage->Count > MaxCount) MaxCount = Stage->Count;
+        if (Stage->Stride > MaxStride) MaxStride = Stage->Stride;
+    }
+
+    // The last stage has the longest partition and starts latest.
+    const ReverbStage *Last = &Impulse->Stages[Impulse->StageCount - 1];
+    int32 HistorySize = 2*Last->Partition;
+    int32 TailSize = 1 << ReverbLog2(Last->Start + REVERB_PARTITION);
+    Rev->HistoryMask = HistorySize - 1;
+    Rev->TailMask = TailSize - 1;
+    for (int32 Channel = 0; Channel < Rev->ChannelCount; Channel++)
+    {
+        Rev->History[Channel] = av_mallocz(HistorySize*sizeof(float32));
+        Rev->Tail[Channel] = av_mallocz(TailSize*sizeof(float32));
+        Rev->In[Channel] = av_malloc(REVERB_PARTITION*sizeof(float32));
+        Rev->Out[Channel] = av_mallocz((Rev->Latency + BlockSize)*sizeof(float32));
+        if (Rev->History[Channel] == NULL || Rev->Tail[Channel] == NULL || Rev->In[Channel] == NULL ||
+            Rev->Out[Channel] == NULL) return MIXER_ERR_NOMEM;
+    }
+    Rev->OutCount = Rev->Latency;
+    Rev->Fft = av_malloc(2*Last->Partition*sizeof(float32));
+    Rev->Sum = av_malloc(2*MaxStride*sizeof(float32));
+    Rev->Terms = av_malloc_array(2*MaxCount, sizeof(const float32 *));
+    if (Rev->Fft == NULL || Rev->Sum == NULL || Rev->Terms == NULL) return MIXER_ERR_NOMEM;
+
+    return MIXER_OK;
+}
+
+void ReverbClose(Reverb **Result)
+{
+    Reverb *Rev = *Result;
+    if (Rev == NULL) return;
+
+    for (int32 Index = 0; Index < REVERB_MAX_STAGES; Index++)
+    {
+        if (Rev->Forward[Index] != NULL) av_rdft_end(Rev->Forward[Index]);
+        if (Rev->Inverse[Index] != NULL) av_rdft_end(Rev->Inverse[Index]);
+        for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+        {
+            av_free(Rev->Lines[Index][Channel]);
+        }
+    }
+    for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+    {
+        av_free(Rev->History[Channel]);
+        av_free(Rev->Tail[Channel]);
+        av_free(Rev->In[Channel]);
+        av_free(Rev->Out[Channel]);
+    }
+    av_free(Rev->Fft);
+    av_free(Rev->Sum);
+    av_free(Rev->Terms);
+    av_freep(Result);
+}
+
+int32 ReverbLatency(const Reverb *Rev)
+{
+    return Rev->Latency;
+}
+
+int64 ReverbTail(const Reverb *Rev)
+{
+    return Rev->Impulse->Length > 0 ? Rev->Impulse->Length - 1 : 0;
+}
+
+// Convolve the last 2 * Partition input samples of a channel with the stage
+// and add the new output to the tail, Start samples after the input ends.
+static void ReverbStageRun(Reverb *Rev, int32 StageIndex, int32 Channel, int64 End)
+{
+    const ReverbStage *Stage = &Rev->Impulse->Stages[StageIndex];
+    int32 Partition = Stage->Partition;
+    int32 Stride = Stage->Stride;
+    int32 Cursor = Rev->Cursors[StageIndex];
+
+    // The window may wrap around the history ring.
+    int32 From = (int32)((End - 2*Partition) & Rev->HistoryMask);
+    int32 First = Rev->HistoryMask + 1 - From < 2*Partition ? Rev->HistoryMask + 1 - From : 2*Partition;
+    memcpy(Rev->Fft, Rev->History[Channel] + From, First*sizeof(float32));
+    memcpy(Rev->Fft + First, Rev->History[Channel], (2*Partition - First)*sizeof(float32));
+    av_rdft_calc(Rev->Forward[StageIndex], Rev->Fft);
+    float32 *Line = Rev->Lines[StageIndex][Channel];
+    ReverbUnpack(Line + Cursor*2*Stride, Rev->Fft, Partition, Stride, 1.0f);
+
+    // Partition j of the response meets the window from j partitions ago.
+    for (int32 Index = 0; Index < Stage->Count; Index++)
+    {
+        int32 Entry = Cursor - Index < 0 ? Cursor - Index + Stage->Count : Cursor - Index;
+        Rev->Terms[Index] = Line + Entry*2*Stride;
+        Rev->Terms[Stage->Count + Index] = Stage->Spectra[Channel] + Index*2*Stride;
+    }
+    Rev->Kernels->SpectrumSum(Rev->Sum, Rev->Terms, Rev->Terms + Stage->Count, Stage->Count, Stride);
+    ReverbPack(Rev->Fft, Rev->Sum, Partition, Stride);
+    av_rdft_calc(Rev->Inverse[StageIndex], Rev->Fft);
+
+    // Overlap-save keeps the second half of the window.
+    float32 *Tail = Rev->Tail[Channel];
+    int64 Position = End - Partition + Stage->Start;
+    for (int32 Index = 0; Index < Partition; Index++)
+    {
+        Tail[(Position + Index) & Rev->TailMask] += Rev->Fft[Partition + Index];
+    }
+}
+
+// Take the partition of input in In, run every stage whose partition it
+// completes and move the finished output of the partition to Out.
+static void ReverbPartition(Reverb *Rev)
+{
+    const ReverbImpulse *Impulse = Rev->Impulse;
+    int64 End = Rev->Time + REVERB_PARTITION;
+    int32 HistoryPosition = (int32)(Rev->Time & Rev->HistoryMask);
+    for (int32 Channel = 0; Channel < Rev->ChannelCount; Channel++)
+    {
+        memcpy(Rev->History[Channel] + HistoryPosition, Rev->In[Channel], REVERB_PARTITION*sizeof(float32));
+    }
+
+    for (int32 Index = 0; Index < Impulse->StageCount; Index++)
+    {
+        const ReverbStage *Stage = &Impulse->Stages[Index];
+        if (End % Stage->Partition != 0) continue;
+        for (int32 Channel = 0; Channel < Rev->ChannelCount; Channel++)
+        {
+            ReverbStageRun(Rev, Index, Channel, End);
+        }
+        Rev->Cursors[Index] = Rev->Cursors[Index] + 1 == Stage->Count ? 0 : Rev->Cursors[Index] + 1;
+    }
+
+    int32 TailPosition = (int32)(Rev->Time & Rev->TailMask);
+    for (int32 Channel = 0; Channel < Rev->ChannelCount; Channel++)
+    {
+        float32 *Tail = Rev->Tail[Channel] + TailPosition;
+        float32 *In = Rev->In[Channel];
+        float32 *Out = Rev->Out[Channel] + Rev->OutCount;
+        for (int32 Index = 0; Index < REVERB_PARTITION; Index++)
+        {
+            Out[Index] = Rev->Dry*In[Index] + Rev->Wet*Tail[Index];
+        }
+        memset(Tail, 0, REVERB_PARTITION*sizeof(float32));
+    }
+    Rev->OutCount += REVERB_PARTITION;
+    Rev->Time = End;
+}
+
+void ReverbProcess(void *State, float32 **Channels, int32 ChannelCount, int32 SampleCount)
+{
+    Reverb *Rev = (Reverb *)State;
+    if (ChannelCount != Rev->ChannelCount || SampleCount > Rev->BlockSize) return;
+
+    for (int32 Done = 0; Done < SampleCount;)
+    {
+        int32 Count = REVERB_PARTITION - Rev->InCount;
+        if (Count > SampleCount - Done) Count = SampleCount - Done;
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            memcpy(Rev->In[Channel] + Rev->InCount, Channels[Channel] + Done, Count*sizeof(float32));
+        }
+        Rev->InCount += Count;
+        Done += Count;
+        if (Rev->InCount == REVERB_PARTITION)
+        {
+            ReverbPartition(Rev);
+            Rev->InCount = 0;
+        }
+    }
+
+    Rev->OutCount -= SampleCount;
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        memcpy(Channels[Channel], Rev->Out[Channel], SampleCount*sizeof(float32));
+        memmove(Rev->Out[Channel], Rev->Out[Channel] + SampleCount, Rev->OutCount*sizeof(float32));
+    }
+}
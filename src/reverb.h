@@ -0,0 +1,122 @@
+#ifndef MIXER_REVERB_H
+#define MIXER_REVERB_H
+
+#include <libavcodec/avfft.h>
+
+#include "kernel.h"
+#include "mixer.h"
+
+// Convolution reverb with a non-uniformly partitioned impulse response. The
+// head of the response is cut into short partitions so the output needs no
+// more input than the current partition, later parts into partitions eight
+// times longer each time, which start late enough in the response that
+// their longer FFTs are done before their output is due. Every part runs as
+// uniformly partitioned overlap-save convolution with a frequency domain
+// delay line, so a multi-second response costs a few spectrum products per
+// sample instead of one per partition of the shortest length.
+//
+// The response spectra only depend on the file, the rate and the channel
+// count, they are computed once and shared by every reverb using them.
+
+// Shortest partition, the granularity the reverb processes input at.
+#define REVERB_PARTITION        256
+
+// Longest partition, also what a response is cut into uniformly past the
+// head. REVERB_PARTITION partitions everything uniformly.
+#define REVERB_MAX_PARTITION    16384
+
+#define REVERB_MAX_STAGES       4
+
+// Fewest partitions worth starting a stage of longer ones for.
+#define REVERB_MIN_COUNT        4
+
+// Part of the response cut into Count partitions of Partition samples,
+// starting Start samples into it.
+typedef struct ReverbStage
+{
+    int32 Partition;
+    int32 Start;
+    int32 Count;
+    int32 Stride;                           // Bins of a spectrum, Partition + 1 rounded up to 8.
+    float32 *Spectra[MIXER_MAX_CHANNELS];   // Count spectra of 2 * Stride floats, see KernelSpectrumSumFunc.
+} ReverbStage;
+
+typedef struct ReverbImpulse
+{
+    char *Key;              // Identity of the file, see SourceIdentify(). NULL when built from samples.
+    int32 SampleRate;
+    int32 ChannelCount;
+    int64 Length;
+    ReverbStage Stages[REVERB_MAX_STAGES];
+    int32 StageCount;
+    struct ReverbImpulse *Next;
+} ReverbImpulse;
+
+// Partition Length samples of ChannelCount channels, with partitions of at
+// most MaxPartition samples.
+int32 ReverbImpulseCreate(ReverbImpulse **Result, float32 *const *Samples, int32 ChannelCount, int64 Length,
+                          int32 SampleRate, int32 MaxPartition);
+
+void ReverbImpulseFree(ReverbImpulse *Impulse);
+
+// Response of FileName decoded at the rate and channel count of Config from
+// the list at *Cache, loaded and added on first use. Each channel of the
+// output is convolved with the same channel of the response.
+int32 ReverbImpulseGet(ReverbImpulse **Cache, const MixerConfig *Config, const char *FileName,
+                       const ReverbImpulse **Result);
+
+void ReverbCacheFree(ReverbImpulse **Cache);
+
+typedef struct Reverb
+{
+    const ReverbImpulse *Impulse;
+    const KernelTable *Kernels;
+    int32 ChannelCount;
+    int32 BlockSize;                        // Most samples one call processes.
+    float32 Dry;
+    float32 Wet;
+    int32 Latency;
+    int64 Time;                             // Input samples processed, a multiple of REVERB_PARTITION.
+
+    RDFTContext *Forward[REVERB_MAX_STAGES];
+    RDFTContext *Inverse[REVERB_MAX_STAGES];
+    float32 *Lines[REVERB_MAX_STAGES][MIXER_MAX_CHANNELS];  // Spectra of the last Count input windows of each stage.
+    int32 Cursors[REVERB_MAX_STAGES];       // Line entry the next window goes to.
+
+    // Input history and the output still to come, both rings.
+    float32 *History[MIXER_MAX_CHANNELS];
+    int32 HistoryMask;
+    float32 *Tail[MIXER_MAX_CHANNELS];
+    int32 TailMask;
+
+    // Input of the partition being filled and output ready to leave.
+    float32 *In[MIXER_MAX_CHANNELS];
+    int32 InCount;
+    float32 *Out[MIXER_MAX_CHANNELS];
+    int32 OutCount;
+
+    float32 *Fft;
+    float32 *Sum;
+    const float32 **Terms;                  // Spectrum pointers of one product sum, line then response.
+} Reverb;
+
+// Reverb through Impulse, which must outlive it, mixing Dry times the input
+// with Wet times the reverberated input. Blocks of a multiple of
+// REVERB_PARTITION samples come out without delay, other block sizes
+// REVERB_PARTITION samples late.
+int32 ReverbOpen(Reverb **Result, const ReverbImpulse *Impulse, int32 BlockSize, float32 Dry, float32 Wet);
+
+void ReverbClose(Reverb **Result);
+
+// Delay of the output in samples.
+int32 ReverbLatency(const Reverb *Rev);
+
+// Samples the output rings on after the input falls silent, not counting
+// the latency. Pass both to MixerAddTimedEffect() so the mix ends after the
+// response does.
+int64 ReverbTail(const Reverb *Rev);
+
+// A MixerEffectFunc, State is the Reverb.
+void ReverbProcess(void *State, float32 **Channels, int32 ChannelCount, int32 SampleCount);
+
+#endif
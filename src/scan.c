@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define fdopen _fdopen
+#else
+#include <dirent.h>
+#endif
+
+#include <libavutil/avstring.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+#include "pool.h"
+#include "scan.h"
+#include "writer.h"
+
+// Files one probe task takes, enough that the pool's overhead disappears
+// next to the opens.
+#define SCAN_TASK_FILES 16
+
+typedef struct ScanContext
+{
+    const MixerConfig *Config;
+    ScanIndex Index;
+    int32 *Order;               // Entries in the order they were found.
+    int32 OrderCount;
+    int32 OrderCapacity;
+    int32 *Pending;             // Entries to probe.
+    int32 PendingCount;
+} ScanContext;
+
+typedef struct ScanTask
+{
+    ScanContext *Scan;
+    int32 First;                // Into Pending.
+    int32 Count;
+} ScanTask;
+
+// FNV-1a.
+static uint64_t ScanHash(const char *Path)
+{
+    uint64_t Hash = 14695981039346656037ull;
+    for (; *Path != '\0'; Path++)
+    {
+        Hash = (Hash ^ (unsigned char)*Path)*1099511628211ull;
+    }
+    return Hash;
+}
+
+static int32 ScanIndexFind(const ScanIndex *Index, const char *Path, uint64_t Hash)
+{
+    if (Index->SlotCount == 0) return -1;
+    for (int32 Slot = (int32)(Hash & (Index->SlotCount - 1));; Slot = (Slot + 1) & (Index->SlotCount - 1))
+    {
+        int32 Found = Index->Slots[Slot];
+        if (Found < 0) return -1;
+        const ScanEntry *Entry = &Index->Entries[Found];
+        if (Entry->Hash == Hash && strcmp(Entry->Path, Path) == 0) return Found;
+    }
+}
+
+// Rebuild the table with SlotCount slots, a power of two.
+static int32 ScanIndexRehash(ScanIndex *Index, int32 SlotCount)
+{
+    int32 *Slots = av_malloc_array(SlotCount, sizeof(int32));
+    if (Slots == NULL) return MIXER_ERR_NOMEM;
+    memset(Slots, 0xFF, SlotCount*sizeof(int32));
+    for (int32 Found = 0; Found < Index->Count; Found++)
+    {
+        int32 Slot = (int32)(Index->Entries[Found].Hash & (SlotCount - 1));
+        while (Slots[Slot] >= 0) Slot = (Slot + 1) & (SlotCount - 1);
+        Slots[Slot] = Found;
+    }
+    av_free(Index->Slots);
+    Index->Slots = Slots;
+    Index->SlotCount = SlotCount;
+    return MIXER_OK;
+}
+
+// Add an entry for Path, whose ownership passes to the index. Returns the
+// entry's index.
+static int32 ScanIndexAdd(ScanIndex *Index, char *Path)
+{
+    if (Index->Count == Index->Capacity)
+    {
+        int32 Capacity = Index->Capacity ? Index->Capacity*2 : 1024;
+        ScanEntry *Entries = av_realloc_array(Index->Entries, Capacity, sizeof(ScanEntry));
+        if (Entries == NULL)
+        {
+            av_free(Path);
+            return MIXER_ERR_NOMEM;
+        }
+        Index->Entries = Entries;
+        Index->Capacity = Capacity;
+    }
+    // At most half full keeps the probe sequences short.
+    if (2*(Index->Count + 1) > Index->SlotCount)
+    {
+        int32 Ret = ScanIndexRehash(Index, Index->SlotCount ? 2*Index->SlotCount : 2048);
+        if (Ret < 0)
+        {
+            av_free(Path);
+            return Ret;
+        }
+    }
+    ScanEntry *Entry = &Index->Entries[Index->Count];
+    memset(Entry, 0, sizeof(ScanEntry));
+    Entry->Path = Path;
+    Entry->Hash = ScanHash(Path);
+    Entry->Info.Duration = -1;
+    int32 Slot = (int32)(Entry->Hash & (Index->SlotCount - 1));
+    while (Index->Slots[Slot] >= 0) Slot = (Slot + 1) & (Index->SlotCount - 1);
+    Index->Slots[Slot] = Index->Count;
+    return Index->Count++;
+}
+
+int32 ScanIndexLoad(ScanIndex *Index, const char *FileName)
+{
+    FILE *File = fopen(FileName, "r");
+    if (File == NULL) return MIXER_OK;
+
+    char Line[8192];
+    int32 Ret = MIXER_OK;
+    while (Ret >= 0 && fgets(Line, sizeof(Line), File) != NULL)
+    {
+        ScanEntry Entry;
+        int32 PathStart = 0;
+        memset(&Entry, 0, sizeof(Entry));
+        Line[strcspn(Line, "\r\n")] = '\0';
+        if (sscanf(Line, "%lld %lld %d %d %d %lld %lld %lf %31s %23s %7s %n", &Entry.Size, &Entry.ModifyTime,
+                   &Entry.Status, &Entry.Info.SampleRate, &Entry.Info.ChannelCount, &Entry.Info.ChannelLayout,
+                   &Entry.Info.BitRate, &Entry.Info.Duration, Entry.Info.Format, Entry.Info.Codec,
+                   Entry.Info.SampleFormat, &PathStart) != 11 || Line[PathStart] == '\0')
+        {
+            continue;
+        }
+        const char *Path = Line + PathStart;
+        if (ScanIndexFind(Index, Path, ScanHash(Path)) >= 0) continue;
+        char *Copy = av_strdup(Path);
+        Ret = Copy == NULL ? MIXER_ERR_NOMEM : ScanIndexAdd(Index, Copy);
+        if (Ret < 0) break;
+
+        // Names a failed probe never found are saved as "-".
+        if (strcmp(Entry.Info.Format, "-") == 0) Entry.Info.Format[0] = '\0';
+        if (strcmp(Entry.Info.Codec, "-") == 0) Entry.Info.Codec[0] = '\0';
+        if (strcmp(Entry.Info.SampleFormat, "-") == 0) Entry.Info.SampleFormat[0] = '\0';
+        Entry.Path = Index->Entries[Ret].Path;
+        Entry.Hash = Index->Entries[Ret].Hash;
+        Index->Entries[Ret] = Entry;
+    }
+
+    fclose(File);
+    return Ret < 0 ? Ret : MIXER_OK;
+}
+
+int32 ScanIndexSave(const ScanIndex *Index, const char *FileName)
+{
+    FILE *File = fopen(FileName, "w");
+    if (File == NULL)
+    {
+        DEBUG(stderr, "ERROR when open scan index %s\n", FileName);
+        return MIXER_ERR_OPEN;
+    }
+    for (int32 Found = 0; Found < Index->Count; Found++)
+    {
+        const ScanEntry *Entry = &Index->Entries[Found];
+        const SourceInfo *Info = &Entry->Info;
+        // A line per entry, a path with a line break in it can't be saved.
+        if (strpbrk(Entry->Path, "\r\n") != NULL) continue;
+        fprintf(File, "%lld %lld %d %d %d %lld %lld %.6f %s %s %s %s\n", Entry->Size, Entry->ModifyTime,
+                Entry->Status, Info->SampleRate, Info->ChannelCount, Info->ChannelLayout, Info->BitRate,
+                Info->Duration, Info->Format[0] ? Info->Format : "-", Info->Codec[0] ? Info->Codec : "-",
+                Info->SampleFormat[0] ? Info->SampleFormat : "-", Entry->Path);
+    }
+    int32 Failed = ferror(File);
+    if (fclose(File) != 0 || Failed)
+    {
+        DEBUG(stderr, "ERROR when write scan index %s\n", FileName);
+        return MIXER_ERR_WRITE;
+    }
+    return MIXER_OK;
+}
+
+void ScanIndexFree(ScanIndex *Index)
+{
+    for (int32 Found = 0; Found < Index->Count; Found++)
+    {
+        av_free(Index->Entries[Found].Path);
+    }
+    av_freep(&Index->Entries);
+    av_freep(&Index->Slots);
+    Index->Count = 0;
+    Index->Capacity = 0;
+    Index->SlotCount = 0;
+}
+
+// Note the file at Path, to be probed when the index doesn't know it as it is.
+static int32 ScanAddFile(ScanContext *Scan, const char *Path, int64 Size, int64 ModifyTime)
+{
+    int32 Found = ScanIndexFind(&Scan->Index, Path, ScanHash(Path));
+    if (Found < 0)
+    {
+        char *Copy = av_strdup(Path);
+        if (Copy == NULL) return MIXER_ERR_NOMEM;
+        if ((Found = ScanIndexAdd(&Scan->Index, Copy)) < 0) return Found;
+        Scan->Index.Entries[Found].Probe = 1;
+    }
+    ScanEntry *Entry = &Scan->Index.Entries[Found];
+    if (Entry->Size != Size || Entry->ModifyTime != ModifyTime) Entry->Probe = 1;
+    Entry->Size = Size;
+    Entry->ModifyTime = ModifyTime;
+
+    if (Scan->OrderCount == Scan->OrderCapacity)
+    {
+        int32 Capacity = Scan->OrderCapacity ? Scan->OrderCapacity*2 : 1024;
+        int32 *Order = av_realloc_array(Scan->Order, Capacity, sizeof(int32));
+        if (Order == NULL) return MIXER_ERR_NOMEM;
+        Scan->Order = Order;
+        Scan->OrderCapacity = Capacity;
+    }
+    Scan->Order[Scan->OrderCount++] = Found;
+    return MIXER_OK;
+}
+
+// Add Path, every file below it if it is a directory. Hidden files and
+// directories are skipped, whatever can't be read is left out with a warning.
+static int32 ScanAddPath(ScanContext *Scan, const char *Path)
+{
+    struct stat Info;
+    if (stat(Path, &Info) != 0)
+    {
+        DEBUG(stderr, "WARNING: cannot stat %s\n", Path);
+        return MIXER_OK;
+    }
+    if ((Info.st_mode & S_IFMT) == S_IFREG) return ScanAddFile(Scan, Path, (int64)Info.st_size, (int64)Info.st_mtime);
+    if ((Info.st_mode & S_IFMT) != S_IFDIR) return MIXER_OK;
+
+    int32 Ret = MIXER_OK;
+#ifdef _WIN32
+    char *Pattern = av_asprintf("%s\\*", Path);
+    if (Pattern == NULL) return MIXER_ERR_NOMEM;
+    WIN32_FIND_DATAA Item;
+    HANDLE Find = FindFirstFileA(Pattern, &Item);
+    av_free(Pattern);
+    if (Find == INVALID_HANDLE_VALUE) return MIXER_OK;
+    do
+    {
+        if (Item.cFileName[0] == '.') continue;
+        char *Child = av_asprintf("%s\\%s", Path, Item.cFileName);
+        Ret = Child == NULL ? MIXER_ERR_NOMEM : ScanAddPath(Scan, Child);
+        av_free(Child);
+    }
+    while (Ret >= 0 && FindNextFileA(Find, &Item));
+    FindClose(Find);
+#else
+    DIR *Dir = opendir(Path);
+    if (Dir == NULL)
+    {
+        DEBUG(stderr, "WARNING: cannot read directory %s\n", Path);
+        return MIXER_OK;
+    }
+    struct dirent *Item;
+    while (Ret >= 0 && (Item = readdir(Dir)) != NULL)
+    {
+        if (Item->d_name[0] == '.') continue;
+        char *Child = av_asprintf("%s/%s", Path, Item->d_name);
+        Ret = Child == NULL ? MIXER_ERR_NOMEM : ScanAddPath(Scan, Child);
+        av_free(Child);
+    }
+    closedir(Dir);
+#endif
+    return Ret;
+}
+
+static void ScanProbeTask(void *Arg)
+{
+    ScanTask *Task = (ScanTask *)Arg;
+    ScanContext *Scan = Task->Scan;
+    for (int32 Index = Task->First; Index < Task->First + Task->Count; Index++)
+    {
+        ScanEntry *Entry = &Scan->Index.Entries[Scan->Pending[Index]];
+        memset(&Entry->Info, 0, sizeof(SourceInfo));
+        Entry->Info.Duration = -1;
+        Entry->Status = SourceProbe(Entry->Path, Scan->Config->NativeInput, &Entry->Info);
+    }
+}
+
+static void ScanWriteJsonString(FILE *Out, const char *Text)
+{
+    fputc('"', Out);
+    for (; *Text != '\0'; Text++)
+    {
+        unsigned char Char = (unsigned char)*Text;
+        if (Char == '"' || Char == '\\') fprintf(Out, "\\%c", Char);
+        else if (Char < 0x20) fprintf(Out, "\\u%04x", Char);
+        else fputc(Char, Out);
+    }
+    fputc('"', Out);
+}
+
+static void ScanWriteCsvString(FILE *Out, const char *Text)
+{
+    if (strpbrk(Text, ",\"\r\n") == NULL)
+    {
+        fputs(Text, Out);
+        return;
+    }
+    fputc('"', Out);
+    for (; *Text != '\0'; Text++)
+    {
+        if (*Text == '"') fputc('"', Out);
+        fputc(*Text, Out);
+    }
+    fputc('"', Out);
+}
+
+static void ScanWriteEntry(FILE *Out, int32 Output, const ScanEntry *Entry)
+{
+    const SourceInfo *Info = &Entry->Info;
+    const char *Status = Entry->Status < 0 ? MixerErrorString(Entry->Status) : "ok";
+    char Layout[64];
+    av_get_channel_layout_string(Layout, sizeof(Layout), Info->ChannelCount, Info->ChannelLayout);
+
+    if (Output == SCAN_CSV)
+    {
+        ScanWriteCsvString(Out, Entry->Path);
+        fprintf(Out, ",%lld,%lld,%s", Entry->Size, Entry->ModifyTime, Status);
+        if (Entry->Status >= 0)
+        {
+            fprintf(Out, ",%s,%s,%s,%d,%d,", Info->Format, Info->Codec, Info->SampleFormat, Info->SampleRate, Info->ChannelCount);
+            ScanWriteCsvString(Out, Layout);
+            fprintf(Out, ",%lld,", Info->BitRate);
+            if (Info->Duration >= 0) fprintf(Out, "%.3f", Info->Duration);
+        }
+        else fputs(",,,,,,,,", Out);
+        fputc('\n', Out);
+        return;
+    }
+
+    fputs("{\"path\":", Out);
+    ScanWriteJsonString(Out, Entry->Path);
+    fprintf(Out, ",\"size\":%lld,\"mtime\":%lld,\"status\":\"%s\"", Entry->Size, Entry->ModifyTime, Status);
+    if (Entry->Status >= 0)
+    {
+        fprintf(Out, ",\"format\":\"%s\",\"codec\":\"%s\",\"sample_format\":\"%s\",\"sample_rate\":%d,\"channels\":%d,\"layout\":",
+                Info->Format, Info->Codec, Info->SampleFormat, Info->SampleRate, Info->ChannelCount);
+        ScanWriteJsonString(Out, Layout);
+        fprintf(Out, ",\"bit_rate\":%lld,\"duration\":", Info->BitRate);
+        if (Info->Duration >= 0) fprintf(Out, "%.3f", Info->Duration);
+        else fputs("null", Out);
+    }
+    fputs("}\n", Out);
+}
+
+int32 ScanRun(char **Paths, int32 PathCount, const MixerConfig *Config, int32 ThreadCount, int32 Output,
+              const char *IndexFileName, const char *OutFileName, ScanStats *Stats)
+{
+    memset(Stats, 0, sizeof(ScanStats));
+    int64 StartTime = av_gettime_relative();
+
+    ScanContext Scan;
+    memset(&Scan, 0, sizeof(Scan));
+    Scan.Config = Config;
+    int32 Ret = IndexFileName != NULL ? ScanIndexLoad(&Scan.Index, IndexFileName) : MIXER_OK;
+    for (int32 Index = 0; Ret >= 0 && Index < PathCount; Index++)
+    {
+        Ret = ScanAddPath(&Scan, Paths[Index]);
+    }
+
+    // Only what the index doesn't know goes to the pool.
+    if (Ret >= 0 && (Scan.Pending = av_malloc_array(Scan.OrderCount + 1, sizeof(int32))) == NULL) Ret = MIXER_ERR_NOMEM;
+    for (int32 Index = 0; Ret >= 0 && Index < Scan.OrderCount; Index++)
+    {
+        ScanEntry *Entry = &Scan.Index.Entries[Scan.Order[Index]];
+        if (Entry->Probe)
+        {
+            // A file named twice is probed once.
+            Entry->Probe = 0;
+            Scan.Pending[Scan.PendingCount++] = Scan.Order[Index];
+        }
+    }
+    if (Ret >= 0 && Scan.PendingCount > 0)
+    {
+        int32 TaskCount = (Scan.PendingCount + SCAN_TASK_FILES - 1)/SCAN_TASK_FILES;
+        ScanTask *Tasks = av_malloc_array(TaskCount, sizeof(ScanTask));
+        ThreadPool *Pool = NULL;
+        if (Tasks == NULL || PoolCreate(&Pool, ThreadCount) != 0) Ret = MIXER_ERR_NOMEM;
+        if (Ret >= 0)
+        {
+            // Files that aren't audio are expected here, keep libavformat quiet about them.
+            int32 LogLevel = av_log_get_level();
+            if (!Config->Verbose) av_log_set_level(AV_LOG_FATAL);
+            for (int32 Index = 0; Index < TaskCount; Index++)
+            {
+                Tasks[Index].Scan = &Scan;
+                Tasks[Index].First = Index*SCAN_TASK_FILES;
+                Tasks[Index].Count = FFMIN(SCAN_TASK_FILES, Scan.PendingCount - Tasks[Index].First);
+                PoolSubmit(Pool, ScanProbeTask, &Tasks[Index]);
+            }
+            PoolWait(Pool);
+            av_log_set_level(LogLevel);
+            Scan.Index.Dirty = 1;
+        }
+        PoolDestroy(&Pool);
+        av_free(Tasks);
+    }
+
+    FILE *Out = NULL;
+    if (Ret >= 0)
+    {
+        if (strcmp(OutFileName, WRITER_STDOUT) == 0) Out = fdopen(WriterReserveStdout(), "w");
+        else Out = fopen(OutFileName, "w");
+        if (Out == NULL)
+        {
+            DEBUG(stderr, "ERROR when open %s\n", OutFileName);
+            Ret = MIXER_ERR_WRITE;
+        }
+    }
+    if (Out != NULL)
+    {
+        if (Output == SCAN_CSV) fputs("path,size,mtime,status,format,codec,sample_format,sample_rate,channels,layout,bit_rate,duration\n", Out);
+        for (int32 Index = 0; Index < Scan.OrderCount; Index++)
+        {
+            const ScanEntry *Entry = &Scan.Index.Entries[Scan.Order[Index]];
+            ScanWriteEntry(Out, Output, Entry);
+            if (Entry->Status < 0) Stats->FailedCount++;
+        }
+        if (fclose(Out) != 0) Ret = MIXER_ERR_WRITE;
+    }
+    if (Ret >= 0 && IndexFileName != NULL && Scan.Index.Dirty) Ret = ScanIndexSave(&Scan.Index, IndexFileName);
+
+    Stats->FileCount = Scan.OrderCount;
+    Stats->ProbedCount = Scan.PendingCount;
+    Stats->Seconds = (av_gettime_relative() - StartTime)/1e6;
+    Stats->FilesPerMinute = Stats->Seconds > 0 ? 60*Stats->FileCount/Stats->Seconds : 0.0;
+
+    ScanIndexFree(&Scan.Index);
+    av_free(Scan.Order);
+    av_free(Scan.Pending);
+    return Ret;
+}
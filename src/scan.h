@@ -0,0 +1,68 @@
+#ifndef MIXER_SCAN_H
+#define MIXER_SCAN_H
+
+#include "mixer.h"
+#include "source.h"
+
+// Scan mode probes every file under a list of files and directories on a
+// thread pool and writes what SourceProbe() finds, one record per file, as
+// JSON lines or CSV. Results are kept in an index file keyed by path, size
+// and modification time, so scanning a library again only probes the files
+// that were added or changed since.
+//
+// The index is a text file, one file per line:
+//
+//     size mtime status rate channels layout bitrate duration format codec sampleformat path
+//
+// where status is 0 or the MIXER_ERR_* the probe failed with. Failed files
+// stay in the index too and are not probed again until they change.
+
+#define SCAN_JSON               0
+#define SCAN_CSV                1
+
+typedef struct ScanEntry
+{
+    char *Path;
+    uint64_t Hash;              // Of Path.
+    int64 Size;
+    int64 ModifyTime;
+    int32 Status;
+    int32 Probe;                // Not in the index or changed, probed by this scan.
+    SourceInfo Info;
+} ScanEntry;
+
+typedef struct ScanIndex
+{
+    ScanEntry *Entries;
+    int32 Count;
+    int32 Capacity;
+    int32 *Slots;               // Open addressing table of entry indices by hash, -1 if empty.
+    int32 SlotCount;
+    int32 Dirty;                // Entries were added or changed since the load.
+} ScanIndex;
+
+typedef struct ScanStats
+{
+    int32 FileCount;
+    int32 ProbedCount;          // Probed by this scan, the rest came from the index.
+    int32 FailedCount;          // Not audio or not readable, from the index or not.
+    float64 Seconds;
+    float64 FilesPerMinute;
+} ScanStats;
+
+// Add the entries of FileName to Index, a missing file is an empty index.
+int32 ScanIndexLoad(ScanIndex *Index, const char *FileName);
+
+int32 ScanIndexSave(const ScanIndex *Index, const char *FileName);
+
+void ScanIndexFree(ScanIndex *Index);
+
+// Scan the PathCount files and directories of Paths, directories
+// recursively, and write a record of every file to OutFileName, or to
+// standard output if it is WRITER_STDOUT. IndexFileName may be NULL to probe
+// everything. Config->NativeInput chooses the reader of uncompressed files,
+// ThreadCount <= 0 uses one worker per CPU.
+int32 ScanRun(char **Paths, int32 PathCount, const MixerConfig *Config, int32 ThreadCount, int32 Output,
+              const char *IndexFileName, const char *OutFileName, ScanStats *Stats);
+
+#endif
@@ -0,0 +1,289 @@
+#include <string.h>
+
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+#include "pack.h"
+#include "pool.h"
+#include "segment.h"
+#include "thread.h"
+#include "wav.h"
+#include "writer.h"
+
+#define SEGMENT_DEFAULT_SECONDS 30
+
+// Rendered before every segment but the first and thrown away.
+#define SEGMENT_PREROLL_MS 500
+
+struct SegmentContext;
+
+typedef struct Segment
+{
+    struct SegmentContext *Render;
+    int64 Start;
+    int64 Length;               // 0 renders to the end of the mix.
+    float32 *Samples;           // Interleaved, without the preroll.
+    int64 SampleCount;
+    int32 Done;
+} Segment;
+
+typedef struct SegmentContext
+{
+    MixerConfig Config;
+    const MixerClipInfo *Clips;
+    int32 ClipCount;
+    const SegmentChain *Chain;
+    ThreadPool *Pool;
+    Segment *Segments;
+    int32 SegmentCount;
+    volatile int32 NextSegment;
+
+    // Completed segments are handed to the writer by whichever worker finds
+    // the next one in order done, the disk is written by the writer's thread.
+    Mutex Lock;
+    int32 NextWrite;
+    Writer *Out;
+    PackState Packer;
+    uint8_t *Packed;            // One block in the output format.
+    int64 SampleCount;
+    int32 Failed;
+} SegmentContext;
+
+static void SegmentTask(void *Arg);
+
+static void SegmentClose(SegmentContext *Render, MixerContext **Mixer, void **State)
+{
+    MixerClose(Mixer);
+    if (*State != NULL && Render->Chain->Cleanup != NULL) Render->Chain->Cleanup(*State);
+    *State = NULL;
+}
+
+// Open a mixer with every clip and the chain, whose state goes in *State.
+static int32 SegmentOpen(SegmentContext *Render, MixerContext **Mixer, void **State)
+{
+    *State = NULL;
+    int32 Ret = MixerOpen(Mixer, &Render->Config);
+    if (Ret < 0) return Ret;
+
+    for (int32 Index = 0; Index < Render->ClipCount; Index++)
+    {
+        Ret = MixerAddClip(*Mixer, &Render->Clips[Index]);
+        if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when MixerAddClip(%s): %s\n", Render->Clips[Index].FileName, MixerErrorString(Ret));
+            MixerClose(Mixer);
+            return Ret;
+        }
+    }
+    if (Render->Chain != NULL && Render->Chain->Setup != NULL)
+    {
+        Ret = Render->Chain->Setup(*Mixer, Render->Chain->Arg, State);
+        if (Ret < 0)
+        {
+            SegmentClose(Render, Mixer, State);
+            return Ret;
+        }
+    }
+    return MIXER_OK;
+}
+
+// Render the segment and its preroll into Samples, dropping the preroll.
+static int32 SegmentMix(SegmentContext *Render, Segment *Item)
+{
+    MixerConfig *Config = &Render->Config;
+    MixerContext *Mixer = NULL;
+    void *State = NULL;
+    int32 Ret = SegmentOpen(Render, &Mixer, &State);
+    if (Ret < 0) return Ret;
+
+    // The tails of everything that played before the segment ring into it.
+    int64 Preroll = (int64)SEGMENT_PREROLL_MS*Config->SampleRate/1000 + MixerGetTail(Mixer);
+    if (Preroll > Item->Start) Preroll = Item->Start;
+    Ret = MixerSetRange(Mixer, Item->Start - Preroll, Item->Length ? Item->Length + Preroll : 0);
+
+    int64 Capacity = (Item->Length ? Item->Length + Preroll : (int64)SEGMENT_DEFAULT_SECONDS*Config->SampleRate) + Config->BlockSize;
+    int64 Rendered = 0;
+    float32 *Samples = NULL;
+    while (Ret == MIXER_OK)
+    {
+        if (Samples == NULL || Rendered + Config->BlockSize > Capacity)
+        {
+            while (Rendered + Config->BlockSize > Capacity) Capacity *= 2;
+            float32 *Grown = av_realloc(Samples, Capacity*Config->ChannelCount*sizeof(float32));
+            if (Grown == NULL)
+            {
+                Ret = MIXER_ERR_NOMEM;
+                break;
+            }
+            Samples = Grown;
+        }
+        int32 SampleCount = 0;
+        Ret = MixerRenderBlock(Mixer, Samples + Rendered*Config->ChannelCount, &SampleCount);
+        Rendered += SampleCount;
+    }
+    SegmentClose(Render, &Mixer, &State);
+
+    if (Ret < 0)
+    {
+        av_free(Samples);
+        return Ret;
+    }
+    if (Rendered < Preroll) Preroll = Rendered;
+    if (Preroll > 0) memmove(Samples, Samples + Preroll*Config->ChannelCount, (Rendered - Preroll)*Config->ChannelCount*sizeof(float32));
+    Item->Samples = Samples;
+    Item->SampleCount = Rendered - Preroll;
+
+    return MIXER_OK;
+}
+
+// Pack a completed segment a block at a time and hand it to the writer,
+// called in segment order under the lock.
+static int32 SegmentWrite(SegmentContext *Render, Segment *Item)
+{
+    int32 ChannelCount = Render->Config.ChannelCount;
+    int32 BlockSize = Render->Config.BlockSize;
+    int64 FrameSize = PackSampleSize(Render->Packer.Format)*ChannelCount;
+    for (int64 Done = 0; Done < Item->SampleCount; Done += BlockSize)
+    {
+        int32 Count = Item->SampleCount - Done < BlockSize ? (int32)(Item->SampleCount - Done) : BlockSize;
+        PackInterleaved(&Render->Packer, Render->Packed, Item->Samples + Done*ChannelCount, Count);
+        int32 Ret = WriterWrite(Render->Out, Render->Packed, Count*FrameSize);
+        if (Ret < 0) return Ret;
+    }
+    return MIXER_OK;
+}
+
+static void SegmentTask(void *Arg)
+{
+    Segment *Item = (Segment *)Arg;
+    SegmentContext *Render = Item->Render;
+
+    int32 Ret = SegmentMix(Render, Item);
+    if (Ret < 0) DEBUG(stderr, "ERROR when render segment at %lld: %s\n", Item->Start, MixerErrorString(Ret));
+
+    MutexLock(&Render->Lock);
+    if (Ret < 0) Render->Failed = 1;
+    Item->Done = 1;
+    while (Render->NextWrite < Render->SegmentCount && Render->Segments[Render->NextWrite].Done)
+    {
+        Segment *Next = &Render->Segments[Render->NextWrite++];
+        if (!Render->Failed && SegmentWrite(Render, Next) < 0) Render->Failed = 1;
+        Render->SampleCount += Next->SampleCount;
+        av_freep(&Next->Samples);
+    }
+    MutexUnlock(&Render->Lock);
+
+    // Keep the number of buffered segments bounded, start the next one as this one leaves.
+    int32 Next = AtomicAdd(&Render->NextSegment, 1) - 1;
+    if (Next < Render->SegmentCount) PoolSubmit(Render->Pool, SegmentTask, &Render->Segments[Next]);
+}
+
+int32 SegmentRender(const MixerConfig *Config, const MixerClipInfo *Clips, int32 ClipCount, const SegmentChain *Chain,
+                    int64 StartSample, int64 LengthSample, float64 SegmentSeconds, int32 ThreadCount,
+                    int32 Format, int32 Dither, const char *OutFileName, SegmentStats *Stats)
+{
+    memset(Stats, 0, sizeof(SegmentStats));
+    if (StartSample < 0 || LengthSample < 0 || PackSampleSize(Format) == 0) return MIXER_ERR_ARG;
+    if (SegmentSeconds <= 0) SegmentSeconds = SEGMENT_DEFAULT_SECONDS;
+
+    SegmentContext Render;
+    memset(&Render, 0, sizeof(Render));
+    Render.Config = *Config;
+    Render.Clips = Clips;
+    Render.ClipCount = ClipCount;
+    Render.Chain = Chain;
+
+    int64 StartTime = av_gettime_relative();
+
+    // The segments need the mix length up front, the demuxers' estimate will do
+    // since the last segment renders to the real end.
+    int64 End = StartSample + LengthSample;
+    if (LengthSample == 0)
+    {
+        MixerContext *Mixer = NULL;
+        void *State = NULL;
+        int32 Ret = SegmentOpen(&Render, &Mixer, &State);
+        if (Ret < 0) return Ret;
+        End = MixerGetLength(Mixer);
+        SegmentClose(&Render, &Mixer, &State);
+        if (End < 0)
+        {
+            DEBUG(stderr, "ERROR: mix length is unknown, cannot split it into segments\n");
+            return MIXER_ERR_ARG;
+        }
+        if (End < StartSample) End = StartSample;
+    }
+
+    int64 SegmentLength = (int64)(SegmentSeconds*Config->SampleRate);
+    if (SegmentLength < Config->BlockSize) SegmentLength = Config->BlockSize;
+    int64 SegmentCount = (End - StartSample + SegmentLength - 1)/SegmentLength;
+    if (SegmentCount < 1) SegmentCount = 1;
+    Render.SegmentCount = (int32)SegmentCount;
+    Render.Segments = av_mallocz_array(Render.SegmentCount, sizeof(Segment));
+    if (Render.Segments == NULL) return MIXER_ERR_NOMEM;
+    for (int32 Index = 0; Index < Render.SegmentCount; Index++)
+    {
+        Segment *Item = &Render.Segments[Index];
+        Item->Render = &Render;
+        Item->Start = StartSample + Index*SegmentLength;
+        Item->Length = SegmentLength;
+    }
+    // An open ended mix stops wherever its inputs really end.
+    Segment *Last = &Render.Segments[Render.SegmentCount - 1];
+    Last->Length = LengthSample == 0 ? 0 : End - Last->Start;
+
+    int32 SampleSize = PackSampleSize(Format);
+    int32 FrameSize = SampleSize*Config->ChannelCount;
+    uint8_t Header[WAV_HEADER_MAX];
+    int32 Stream = strcmp(OutFileName, WRITER_STDOUT) == 0;
+    int32 HeaderSize = 0;
+    if (!Stream && Format == PACK_F32) HeaderSize = WavHeader(Header, Config->SampleRate, Config->ChannelCount, 0);
+    else if (!Stream) HeaderSize = WavHeaderPcm(Header, Config->SampleRate, Config->ChannelCount, 8*SampleSize, 0);
+    PackInit(&Render.Packer, Format, Config->ChannelCount, Dither);
+    Render.Packed = av_malloc(Config->BlockSize*FrameSize);
+    int32 Ret = Render.Packed != NULL ? MIXER_OK : MIXER_ERR_NOMEM;
+    if (Ret == MIXER_OK) Ret = WriterOpen(&Render.Out, OutFileName, 0, HeaderSize + (End - StartSample)*FrameSize);
+    if (Ret == MIXER_OK && PoolCreate(&Render.Pool, ThreadCount) != 0) Ret = MIXER_ERR_NOMEM;
+
+    if (Ret == MIXER_OK)
+    {
+        WriterWrite(Render.Out, Header, HeaderSize);
+        MutexInit(&Render.Lock);
+
+        // Two segments per worker keep every core busy while the writer waits for a slow one.
+        int32 InFlight = 2*PoolThreadCount(Render.Pool);
+        if (InFlight > Render.SegmentCount) InFlight = Render.SegmentCount;
+        AtomicStore(&Render.NextSegment, InFlight);
+        for (int32 Index = 0; Index < InFlight; Index++)
+        {
+            PoolSubmit(Render.Pool, SegmentTask, &Render.Segments[Index]);
+        }
+        PoolWait(Render.Pool);
+        Stats->ThreadCount = PoolThreadCount(Render.Pool);
+        PoolDestroy(&Render.Pool);
+        MutexDestroy(&Render.Lock);
+
+        if (Format == PACK_F32) WavHeader(Header, Config->SampleRate, Config->ChannelCount, Render.SampleCount*FrameSize);
+        else WavHeaderPcm(Header, Config->SampleRate, Config->ChannelCount, 8*SampleSize, Render.SampleCount*FrameSize);
+        if (Render.Failed) Ret = MIXER_ERR_DECODE;
+    }
+    if (Render.Out != NULL)
+    {
+        int32 CloseRet = WriterClose(&Render.Out, Header, HeaderSize, &Stats->Output);
+        if (Ret == MIXER_OK) Ret = CloseRet;
+    }
+
+    for (int32 Index = 0; Index < Render.SegmentCount; Index++)
+    {
+        av_free(Render.Segments[Index].Samples);
+    }
+    av_free(Render.Segments);
+    av_free(Render.Packed);
+
+    Stats->SegmentCount = Render.SegmentCount;
+    Stats->SampleCount = Render.SampleCount;
+    Stats->Seconds = (av_gettime_relative() - StartTime)/1e6;
+    Stats->Realtime = Stats->Seconds > 0 ? (float64)Render.SampleCount/Config->SampleRate/Stats->Seconds : 0.0;
+
+    return Ret;
+}
@@ -0,0 +1,50 @@
+#ifndef MIXER_SEGMENT_H
+#define MIXER_SEGMENT_H
+
+#include "mixer.h"
+#include "writer.h"
+
+// Segmented render splits the output timeline of one mix into segments and
+// renders each on its own worker with its own mixer context, so one long mix
+// uses every core. Each context seeks its inputs to its segment and renders
+// a short preroll before it that is thrown away, which lets decoders and any
+// stateful stage settle, then the segments are written in order.
+
+// Adds the buses and effects of one segment's mixer once its clips are, from
+// the worker rendering the segment. Whatever it allocates goes in *State,
+// which is handed to the cleanup after the mixer is closed, also when the
+// setup fails.
+typedef int32 (*SegmentSetupFunc)(MixerContext *Mixer, void *Arg, void **State);
+typedef void (*SegmentCleanupFunc)(void *State);
+
+// Built the same on every segment, so the segments join into the mix a
+// single mixer with the same chain renders. Effect tails lengthen the
+// preroll, a segment starts with the tails of what played before it.
+typedef struct SegmentChain
+{
+    SegmentSetupFunc Setup;
+    SegmentCleanupFunc Cleanup;
+    void *Arg;
+} SegmentChain;
+
+typedef struct SegmentStats
+{
+    int32 SegmentCount;
+    int32 ThreadCount;
+    int64 SampleCount;          // Samples per channel written.
+    float64 Seconds;            // Wall time from first open to output closed.
+    float64 Realtime;           // Seconds of audio rendered per second.
+    WriterStats Output;
+} SegmentStats;
+
+// Render LengthSample samples from StartSample (0 renders to the end of the
+// mix) of Clips through Chain (NULL for none) into a WAV of PACK_* Format
+// with PACK_DITHER_* Dither, or as raw samples to stdout when OutFileName is
+// WRITER_STDOUT. The segments are packed in order, so the dither runs on
+// as in one pass. SegmentSeconds <= 0 uses the default segment length,
+// ThreadCount <= 0 one worker per CPU.
+int32 SegmentRender(const MixerConfig *Config, const MixerClipInfo *Clips, int32 ClipCount, const SegmentChain *Chain,
+                    int64 StartSample, int64 LengthSample, float64 SegmentSeconds, int32 ThreadCount,
+                    int32 Format, int32 Dither, const char *OutFileName, SegmentStats *Stats);
+
+#endif
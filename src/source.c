@@ -0,0 +1,737 @@
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+#include <libswresample/swresample.h>
+
+#include "decoder.h"
+#include "source.h"
+
+// Sources up to this long are decoded once and shared by every clip that
+// uses the same file, longer ones get a decoder per clip so that clips far
+// apart on the timeline don't pin the whole file in memory.
+#define MIXER_SHARE_MAX_SECONDS 600
+
+// Decoding after a seek restarts this much before the requested position,
+// on top of the preroll the container asks for.
+#define MIXER_SEEK_PREROLL_MS 100
+
+// Frames one SourceDecode() of an uncompressed input converts, about what a
+// decoder returns per frame.
+#define MIXER_PCM_CHUNK 4096
+
+// The layout of ChannelCount channels, Layout unless it doesn't match the count.
+static int64 SourceLayout(int64 Layout, int32 ChannelCount)
+{
+    if (Layout == 0 || av_get_channel_layout_nb_channels(Layout) != ChannelCount)
+    {
+        Layout = av_get_default_channel_layout(ChannelCount);
+    }
+    return Layout;
+}
+
+// The codec names libavcodec gives these encodings, and the sample format its decoders produce.
+static const char *PcmCodecNames[][2] = {{"pcm_u8", "pcm_u8"}, {"pcm_s8", "pcm_s8"}, {"pcm_s16le", "pcm_s16be"},
+                                         {"pcm_s24le", "pcm_s24be"}, {"pcm_s32le", "pcm_s32be"},
+                                         {"pcm_f32le", "pcm_f32be"}, {"pcm_f64le", "pcm_f64be"}};
+static const char *PcmSampleFormats[] = {"u8", "u8", "s16", "s32", "s32", "flt", "dbl"};
+
+static void SourceInfoPcm(const PcmFile *File, SourceInfo *Info)
+{
+    memset(Info, 0, sizeof(SourceInfo));
+    av_strlcpy(Info->Format, File->Container, sizeof(Info->Format));
+    av_strlcpy(Info->Codec, PcmCodecNames[File->Encoding][File->BigEndian], sizeof(Info->Codec));
+    av_strlcpy(Info->SampleFormat, PcmSampleFormats[File->Encoding], sizeof(Info->SampleFormat));
+    Info->SampleRate = File->SampleRate;
+    Info->ChannelCount = File->ChannelCount;
+    Info->ChannelLayout = SourceLayout(File->ChannelLayout, File->ChannelCount);
+    Info->BitRate = (int64)File->FrameSize*8*File->SampleRate;
+    Info->Duration = File->FrameCount >= 0 ? (float64)File->FrameCount/File->SampleRate : -1;
+}
+
+static void SourceInfoStream(const AVFormatContext *FormatContext, int32 StreamIndex, SourceInfo *Info)
+{
+    const AVCodecParameters *Parameters = FormatContext->streams[StreamIndex]->codecpar;
+    const char *SampleFormat = av_get_sample_fmt_name(Parameters->format);
+    memset(Info, 0, sizeof(SourceInfo));
+    av_strlcpy(Info->Format, FormatContext->iformat->name, sizeof(Info->Format));
+    av_strlcpy(Info->Codec, avcodec_get_name(Parameters->codec_id), sizeof(Info->Codec));
+    av_strlcpy(Info->SampleFormat, SampleFormat ? SampleFormat : "none", sizeof(Info->SampleFormat));
+    Info->SampleRate = Parameters->sample_rate;
+    Info->ChannelCount = Parameters->channels;
+    Info->ChannelLayout = SourceLayout(Parameters->channel_layout, Parameters->channels);
+    Info->BitRate = Parameters->bit_rate > 0 ? Parameters->bit_rate : FormatContext->bit_rate;
+    Info->Duration = FormatContext->duration != AV_NOPTS_VALUE ? (float64)FormatContext->duration/AV_TIME_BASE : -1;
+}
+
+static void DumpAudioInfo(const MixerSource *Source)
+{
+    SourceInfo Info;
+    if (Source->Pcm) SourceInfoPcm(Source->Pcm, &Info);
+    else
+    {
+        av_dump_format(Source->FormatContext, 0, Source->FileName, 0);
+        SourceInfoStream(Source->FormatContext, Source->AudioStreamIndex, &Info);
+    }
+    char ChannelLayoutName[256];
+    av_get_channel_layout_string(ChannelLayoutName, sizeof(ChannelLayoutName), Info.ChannelCount, Info.ChannelLayout);
+
+    DEBUG(stdout, "> File Name=%s\n", Source->FileName);
+    if (Source->Pcm) DEBUG(stdout, "> native %s reader, %s\n", Info.Format, Info.Codec);
+    else DEBUG(stdout, "> audio codec=%s(%s)\n", Source->Codec->name, Source->Codec->long_name);
+    DEBUG(stdout, "> BitRate=%lld bps\n", Info.BitRate);
+    DEBUG(stdout, "> SampleRate=%d Hz\n", Info.SampleRate);
+    DEBUG(stdout, "> SampleFormatName=%s\n", Info.SampleFormat);
+    DEBUG(stdout, "> ChannelCount=%d\n", Info.ChannelCount);
+    DEBUG(stdout, "> ChannelLayoutName=%s\n", ChannelLayoutName);
+    DEBUG(stdout, "> Duration=%.3f s\n", Info.Duration);
+
+    if (Source->RateConverter)
+    {
+        const ResampleFilter *Filter = Source->RateConverter->Filter;
+        DEBUG(stdout, "> Resample=%d -> %d Hz, %d phases of %d taps\n", Filter->InRate, Filter->OutRate,
+              Filter->PhaseCount, Filter->TapCount);
+    }
+    if (Source->Remix)
+    {
+        DEBUG(stdout, "> Remix=%d -> %d channels (%s)\n", Source->Remix->InCount, Source->Remix->OutCount,
+              Source->Remix->Specialized ? "specialized" : "generic");
+    }
+}
+
+void SourceClose(MixerSource *Source)
+{
+    MutexDestroy(&Source->Lock);
+    DecoderClose(&Source->CodecContext);
+    avformat_close_input(&Source->FormatContext);
+    if (Source->IoContext) av_freep(&Source->IoContext->buffer);
+    avio_context_free(&Source->IoContext);
+    IoReaderClose(&Source->Io);
+    swr_free(&Source->Resampler);
+    PcmFileClose(&Source->Pcm);
+    PeakClose(&Source->Peaks);
+    av_freep(&Source->Remix);
+    if (Source->RateConverter) ResampleFree(Source->RateConverter);
+    av_freep(&Source->RateConverter);
+    for (int32 Channel = 0; Channel < REMIX_MAX_INPUTS; Channel++)
+    {
+        av_freep(&Source->Converted[Channel]);
+    }
+    av_frame_free(&Source->Frame);
+    av_packet_unref(&Source->Packet);
+    for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+    {
+        av_freep(&Source->Buffer[Channel]);
+    }
+    av_freep(&Source->FileName);
+    av_freep(&Source->Key);
+    av_free(Source);
+}
+
+char *SourceIdentify(const char *FileName)
+{
+    char Path[4096];
+    struct stat Info;
+#ifdef _WIN32
+    if (_fullpath(Path, FileName, sizeof(Path)) == NULL) return av_strdup(FileName);
+#else
+    if (realpath(FileName, Path) == NULL) return av_strdup(FileName);
+#endif
+    if (stat(Path, &Info) != 0) return av_strdup(FileName);
+
+    return av_asprintf("%lld:%lld:%s", (int64)Info.st_size, (int64)Info.st_mtime, Path);
+}
+
+// Set up the remix from InChannelLayout and the polyphase conversion from
+// InSampleRate to the mix format where they apply. Either is left NULL when
+// the formats match or when it cannot handle them.
+static int32 SourceInitConversion(MixerSource *Source, const MixerConfig *Config, ResampleFilter **Filters,
+                                  int64 InChannelLayout, int32 InSampleRate)
+{
+    int32 InChannelCount = av_get_channel_layout_nb_channels(InChannelLayout);
+    int64 OutChannelLayout = av_get_default_channel_layout(Config->ChannelCount);
+    if (InChannelLayout != OutChannelLayout && InChannelCount <= REMIX_MAX_INPUTS)
+    {
+        if ((Source->Remix = av_malloc(sizeof(RemixMatrix))) == NULL) return MIXER_ERR_NOMEM;
+        if (RemixInit(Source->Remix, InChannelLayout, OutChannelLayout) < 0) av_freep(&Source->Remix);
+    }
+    // Rate conversion uses the filter shared by every input at this rate when possible.
+    if (InSampleRate != Config->SampleRate && Config->ResampleQuality != MIXER_RESAMPLE_SWR)
+    {
+        const ResampleFilter *Filter = ResampleFilterGet(Filters, InSampleRate, Config->SampleRate, Config->ResampleQuality);
+        if (Filter != NULL)
+        {
+            if ((Source->RateConverter = av_malloc(sizeof(ResampleState))) == NULL) return MIXER_ERR_NOMEM;
+            if (ResampleInit(Source->RateConverter, Filter, Config->ChannelCount) < 0) return MIXER_ERR_NOMEM;
+        }
+    }
+    return MIXER_OK;
+}
+
+// Open FileName with the native reader. Returns MIXER_ERR_STREAM or
+// MIXER_ERR_OPEN, with nothing left open, when libavformat should try.
+static int32 SourceOpenPcm(MixerSource *Source, const char *FileName, const MixerConfig *Config, ResampleFilter **Filters)
+{
+    int32 Ret = PcmFileOpen(&Source->Pcm, FileName);
+    if (Ret < 0) return Ret;
+
+    const PcmFile *File = Source->Pcm;
+    int64 InChannelLayout = SourceLayout(File->ChannelLayout, File->ChannelCount);
+    Ret = SourceInitConversion(Source, Config, Filters, InChannelLayout, File->SampleRate);
+    if (Ret < 0) return Ret;
+    // Without swresample the remix and the polyphase filter are all the
+    // conversion there is.
+    if ((Source->Remix == NULL && InChannelLayout != av_get_default_channel_layout(Config->ChannelCount)) ||
+        (Source->RateConverter == NULL && File->SampleRate != Config->SampleRate))
+    {
+        int32 Raw = strcmp(File->Container, "raw") == 0;
+        if (Raw) DEBUG(stderr, "ERROR: %s needs swresample, which raw input can't use\n", FileName);
+        PcmFileClose(&Source->Pcm);
+        av_freep(&Source->Remix);
+        if (Source->RateConverter) ResampleFree(Source->RateConverter);
+        av_freep(&Source->RateConverter);
+        return Raw ? MIXER_ERR_RESAMPLE : MIXER_ERR_STREAM;
+    }
+
+    // Standard input can only be read once, by one clip.
+    if (!File->Stream)
+    {
+        Source->Duration = av_rescale(File->FrameCount, Config->SampleRate, File->SampleRate);
+        Source->Shareable = Source->Duration <= (int64)MIXER_SHARE_MAX_SECONDS*Config->SampleRate;
+    }
+    else Source->SeekFailed = 1;
+
+    if (Config->Verbose) DumpAudioInfo(Source);
+
+    return MIXER_OK;
+}
+
+// Give the format context an AVIOContext reading FileName through an
+// IoReader. Leaves it to libavformat's own file protocol when the name is a
+// URL or io_uring is not available.
+static int32 SourceOpenIo(MixerSource *Source, const char *FileName, int32 Depth)
+{
+    if (strstr(FileName, "://") != NULL) return MIXER_OK;
+    int32 Ret = IoReaderOpen(&Source->Io, FileName, Depth);
+    if (Ret == MIXER_ERR_OPEN) return MIXER_OK;
+    if (Ret < 0) return Ret;
+
+    uint8_t *Buffer = av_malloc(IO_BUFFER_SIZE);
+    if (Buffer == NULL) return MIXER_ERR_NOMEM;
+    Source->IoContext = avio_alloc_context(Buffer, IO_BUFFER_SIZE, 0, Source->Io, IoReaderRead, NULL, IoReaderSeek);
+    if (Source->IoContext == NULL)
+    {
+        av_free(Buffer);
+        return MIXER_ERR_NOMEM;
+    }
+    if ((Source->FormatContext = avformat_alloc_context()) == NULL) return MIXER_ERR_NOMEM;
+    Source->FormatContext->pb = Source->IoContext;
+    Source->FormatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    return MIXER_OK;
+}
+
+// Peaks are built for files only, and only when the sidecar is missing or
+// older than the file.
+static int32 SourceOpenPeaks(MixerSource *Source, const MixerConfig *Config)
+{
+    const char *FileName = Source->FileName;
+    if (!Config->Peaks || strcmp(FileName, PCM_STDIN) == 0) return MIXER_OK;
+    if (strncmp(FileName, PCM_RAW_PREFIX, strlen(PCM_RAW_PREFIX)) == 0 || strstr(FileName, "://") != NULL) return MIXER_OK;
+
+    struct stat Info;
+    struct stat PeakInfo;
+    if (stat(FileName, &Info) != 0) return MIXER_OK;
+    char *PeakName = av_asprintf("%s%s", FileName, PEAK_SUFFIX);
+    if (PeakName == NULL) return MIXER_ERR_NOMEM;
+    int32 Fresh = stat(PeakName, &PeakInfo) == 0 && PeakInfo.st_mtime >= Info.st_mtime;
+    av_free(PeakName);
+    if (Fresh) return MIXER_OK;
+
+    return PeakOpen(&Source->Peaks, Config->SampleRate, Config->ChannelCount);
+}
+
+int32 SourceOpen(MixerSource **Result, const char *FileName, char *Key, const MixerConfig *Config, ResampleFilter **Filters)
+{
+    MixerSource *Source = av_mallocz(sizeof(MixerSource));
+    if (Source == NULL)
+    {
+        av_free(Key);
+        return MIXER_ERR_NOMEM;
+    }
+    *Result = Source;
+    MutexInit(&Source->Lock);
+    av_init_packet(&Source->Packet);
+    Source->Key = Key;
+    Source->RefCount = 1;
+    Source->Length = -1;
+    Source->Duration = -1;
+    Source->SampleRate = Config->SampleRate;
+    if ((Source->FileName = av_strdup(FileName)) == NULL) return MIXER_ERR_NOMEM;
+
+    // Uncompressed files are read directly, everything the native reader
+    // doesn't know or can't convert goes through libavformat.
+    if (Config->NativeInput || strncmp(FileName, PCM_RAW_PREFIX, strlen(PCM_RAW_PREFIX)) == 0)
+    {
+        int32 Ret = SourceOpenPcm(Source, FileName, Config, Filters);
+        if (Ret == MIXER_OK) return SourceOpenPeaks(Source, Config);
+        if (Ret != MIXER_ERR_STREAM && Ret != MIXER_ERR_OPEN) return Ret;
+    }
+
+    // Open File, reading it through io_uring when asked to.
+    if (Config->IoDepth > 0)
+    {
+        int32 Ret = SourceOpenIo(Source, FileName, Config->IoDepth);
+        if (Ret < 0) return Ret;
+    }
+    if (avformat_open_input(&Source->FormatContext, FileName, NULL, NULL) < 0)
+    {
+        DEBUG(stderr, "ERROR when avformat_open_input(%s)\n", FileName);
+        return MIXER_ERR_OPEN;
+    }
+    if (avformat_find_stream_info(Source->FormatContext, NULL) < 0)
+    {
+        DEBUG(stderr, "ERROR when avformat_find_stream_info(%s)\n", FileName);
+        return MIXER_ERR_OPEN;
+    }
+
+    // Find the audio stream in the file.
+    Source->AudioStreamIndex = av_find_best_stream(Source->FormatContext, AVMEDIA_TYPE_AUDIO, -1, -1, &Source->Codec, 0);
+    if (Source->AudioStreamIndex < 0)
+    {
+        DEBUG(stderr, "ERROR when av_find_best_stream(%s)\n", FileName);
+        return MIXER_ERR_STREAM;
+    }
+
+    // Open the decoder, or reuse one an earlier input of the same kind left.
+    int32 Ret = DecoderOpen(&Source->CodecContext, Source->Codec, Source->FormatContext->streams[Source->AudioStreamIndex]->codecpar);
+    if (Ret < 0) return Ret;
+
+    // Convert whatever the decoder produces to planar float in the mix format.
+    // The resampler only converts the sample format and rate, the layout is
+    // remixed afterwards unless it already matches or is too exotic.
+    AVCodecContext *CodecContext = Source->CodecContext;
+    int64 InChannelLayout = SourceLayout(CodecContext->channel_layout, CodecContext->channels);
+    int64 OutChannelLayout = av_get_default_channel_layout(Config->ChannelCount);
+    Ret = SourceInitConversion(Source, Config, Filters, InChannelLayout, CodecContext->sample_rate);
+    if (Ret < 0) return Ret;
+    Source->Resampler = swr_alloc_set_opts(NULL,
+                                           Source->Remix ? InChannelLayout : OutChannelLayout,
+                                           AV_SAMPLE_FMT_FLTP,
+                                           Source->RateConverter ? CodecContext->sample_rate : Config->SampleRate,
+                                           InChannelLayout,
+                                           CodecContext->sample_fmt,
+                                           CodecContext->sample_rate,
+                                           0,
+                                           NULL);
+    if (Source->Resampler == NULL || swr_init(Source->Resampler) < 0)
+    {
+        DEBUG(stderr, "ERROR when swr_init()\n");
+        return MIXER_ERR_RESAMPLE;
+    }
+
+    if ((Source->Frame = av_frame_alloc()) == NULL) return MIXER_ERR_NOMEM;
+
+    AVStream *Stream = Source->FormatContext->streams[Source->AudioStreamIndex];
+    Source->StreamStart = Stream->start_time != AV_NOPTS_VALUE ? Stream->start_time : 0;
+
+    int64 Duration = Source->FormatContext->duration;
+    Source->Shareable = Duration != AV_NOPTS_VALUE && Duration > 0 && Duration <= (int64)MIXER_SHARE_MAX_SECONDS*AV_TIME_BASE;
+    if (Duration != AV_NOPTS_VALUE && Duration > 0) Source->Duration = av_rescale(Duration, Config->SampleRate, AV_TIME_BASE);
+
+    if (Config->Verbose) DumpAudioInfo(Source);
+
+    return SourceOpenPeaks(Source, Config);
+}
+
+int32 SourceProbe(const char *FileName, int32 NativeInput, SourceInfo *Info)
+{
+    if (NativeInput || strncmp(FileName, PCM_RAW_PREFIX, strlen(PCM_RAW_PREFIX)) == 0)
+    {
+        PcmFile *File = NULL;
+        int32 Ret = PcmFileOpen(&File, FileName);
+        if (Ret >= 0) SourceInfoPcm(File, Info);
+        PcmFileClose(&File);
+        if (Ret != MIXER_ERR_STREAM && Ret != MIXER_ERR_OPEN) return Ret;
+    }
+
+    AVFormatContext *FormatContext = NULL;
+    if (avformat_open_input(&FormatContext, FileName, NULL, NULL) < 0) return MIXER_ERR_OPEN;
+    int32 Ret = MIXER_OK;
+    if (avformat_find_stream_info(FormatContext, NULL) < 0) Ret = MIXER_ERR_OPEN;
+    int32 StreamIndex = Ret < 0 ? -1 : av_find_best_stream(FormatContext, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (StreamIndex >= 0) SourceInfoStream(FormatContext, StreamIndex, Info);
+    else if (Ret == MIXER_OK) Ret = MIXER_ERR_STREAM;
+    avformat_close_input(&FormatContext);
+
+    return Ret;
+}
+
+static int32 SourceReserve(MixerSource *Source, int32 ChannelCount, int32 Count)
+{
+    if (Source->BufferCount + Count <= Source->BufferCapacity) return MIXER_OK;
+
+    int32 Capacity = Source->BufferCapacity ? Source->BufferCapacity : 4096;
+    while (Capacity < Source->BufferCount + Count) Capacity *= 2;
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        float32 *Buffer = av_realloc(Source->Buffer[Channel], Capacity*sizeof(float32));
+        if (Buffer == NULL) return MIXER_ERR_NOMEM;
+        Source->Buffer[Channel] = Buffer;
+    }
+    Source->BufferCapacity = Capacity;
+
+    return MIXER_OK;
+}
+
+static int32 SourceReserveConverted(MixerSource *Source, int32 Count)
+{
+    if (Count <= Source->ConvertedCapacity) return MIXER_OK;
+
+    for (int32 Channel = 0; Channel < Source->Remix->InCount; Channel++)
+    {
+        av_freep(&Source->Converted[Channel]);
+        if ((Source->Converted[Channel] = av_malloc(Count*sizeof(float32))) == NULL) return MIXER_ERR_NOMEM;
+    }
+    Source->ConvertedCapacity = Count;
+
+    return MIXER_OK;
+}
+
+// Make room for Count samples in the output layout and point Staged at
+// where they go, the rate converter if there is one, the buffer otherwise.
+static int32 SourceStage(MixerSource *Source, int32 ChannelCount, int32 Count, float32 **Staged)
+{
+    if (Source->RateConverter) return ResampleReserve(Source->RateConverter, Count, Staged);
+
+    int32 Ret = SourceReserve(Source, ChannelCount, Count);
+    if (Ret < 0) return Ret;
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        Staged[Channel] = Source->Buffer[Channel] + Source->BufferCount;
+    }
+    return MIXER_OK;
+}
+
+// Append everything the rate converter can produce, padding its input first
+// when Flush.
+static int32 SourceDrain(MixerSource *Source, int32 ChannelCount, int32 Flush)
+{
+    if (Flush)
+    {
+        int32 Ret = ResampleFlush(Source->RateConverter);
+        if (Ret < 0) return Ret;
+    }
+    int32 Pending = ResamplePending(Source->RateConverter);
+    int32 Ret = SourceReserve(Source, ChannelCount, Pending);
+    if (Ret < 0) return Ret;
+    float32 *Out[MIXER_MAX_CHANNELS];
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        Out[Channel] = Source->Buffer[Channel] + Source->BufferCount;
+    }
+    Source->BufferCount += ResampleRead(Source->RateConverter, Out, Pending);
+
+    return MIXER_OK;
+}
+
+// Run InFrame (NULL to flush) through the resampler and append the result.
+static int32 SourceConvert(MixerSource *Source, int32 ChannelCount, AVFrame *InFrame)
+{
+    if (Source->Resync && InFrame)
+    {
+        // First frame after a seek, place it on the source timeline.
+        int64 Pts = InFrame->best_effort_timestamp;
+        if (Pts == AV_NOPTS_VALUE) Pts = InFrame->pts;
+        if (Pts != AV_NOPTS_VALUE)
+        {
+            AVStream *Stream = Source->FormatContext->streams[Source->AudioStreamIndex];
+            Source->BufferStart = av_rescale_q(Pts - Source->StreamStart, Stream->time_base, (AVRational){1, Source->SampleRate});
+        }
+        Source->Resync = 0;
+    }
+
+    int32 InCount = InFrame ? InFrame->nb_samples : 0;
+    int32 OutCount = swr_get_out_samples(Source->Resampler, InCount);
+    if (OutCount > 0)
+    {
+        float32 *Staged[MIXER_MAX_CHANNELS];
+        int32 Ret = SourceStage(Source, ChannelCount, OutCount, Staged);
+        if (Ret < 0) return Ret;
+
+        uint8_t *Out[REMIX_MAX_INPUTS];
+        for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+        {
+            Out[Channel] = (uint8_t *)Staged[Channel];
+        }
+        if (Source->Remix)
+        {
+            Ret = SourceReserveConverted(Source, OutCount);
+            if (Ret < 0) return Ret;
+            for (int32 Channel = 0; Channel < Source->Remix->InCount; Channel++)
+            {
+                Out[Channel] = (uint8_t *)Source->Converted[Channel];
+            }
+        }
+        int32 Converted = swr_convert(Source->Resampler,
+                                      Out,
+                                      OutCount,
+                                      InFrame ? (const uint8_t **)InFrame->extended_data : NULL,
+                                      InCount);
+        if (Converted < 0)
+        {
+            DEBUG(stderr, "ERROR when swr_convert(), errcode=%d\n", Converted);
+            return MIXER_ERR_RESAMPLE;
+        }
+        if (Source->Remix) RemixRun(Source->Remix, Staged, (const float32 *const *)Source->Converted, Converted);
+        if (Source->RateConverter) ResampleCommit(Source->RateConverter, Converted);
+        else Source->BufferCount += Converted;
+    }
+
+    return Source->RateConverter ? SourceDrain(Source, ChannelCount, InFrame == NULL) : MIXER_OK;
+}
+
+// Convert the next MIXER_PCM_CHUNK frames of an uncompressed input straight
+// from the mapping to the buffer, through the remix and rate converter
+// where there are any.
+static int32 SourceDecodePcm(MixerSource *Source, int32 ChannelCount)
+{
+    PcmFile *File = Source->Pcm;
+    int64 Left = File->FrameCount < 0 ? MIXER_PCM_CHUNK : File->FrameCount - Source->PcmPosition;
+    if (Left <= 0)
+    {
+        int32 Ret = Source->RateConverter ? SourceDrain(Source, ChannelCount, 1) : MIXER_OK;
+        Source->Ended = 1;
+        Source->Length = Source->BufferStart + Source->BufferCount;
+        return Ret < 0 ? Ret : MIXER_EOF;
+    }
+
+    int32 Count = Left < MIXER_PCM_CHUNK ? (int32)Left : MIXER_PCM_CHUNK;
+    float32 *Staged[MIXER_MAX_CHANNELS];
+    int32 Ret = SourceStage(Source, ChannelCount, Count, Staged);
+    if (Ret < 0) return Ret;
+    if (Source->Remix)
+    {
+        Ret = SourceReserveConverted(Source, Count);
+        if (Ret < 0) return Ret;
+        Count = PcmFileRead(File, Source->Converted, Source->PcmPosition, Count);
+        if (Count > 0) RemixRun(Source->Remix, Staged, (const float32 *const *)Source->Converted, Count);
+    }
+    else Count = PcmFileRead(File, Staged, Source->PcmPosition, Count);
+    if (Count < 0) return Count;
+    // The end of a stream shows as a short read.
+    if (Count == 0) return SourceDecodePcm(Source, ChannelCount);
+    Source->PcmPosition += Count;
+
+    if (!Source->RateConverter)
+    {
+        Source->BufferCount += Count;
+        return MIXER_OK;
+    }
+    ResampleCommit(Source->RateConverter, Count);
+    return SourceDrain(Source, ChannelCount, 0);
+}
+
+static int32 SourceDecodeFrame(MixerSource *Source, int32 ChannelCount)
+{
+    if (Source->Pcm) return SourceDecodePcm(Source, ChannelCount);
+
+    for (;;)
+    {
+        // Drain every frame the decoder has ready.
+        int32 Ret = avcodec_receive_frame(Source->CodecContext, Source->Frame);
+        if (Ret == 0)
+        {
+            Ret = SourceConvert(Source, ChannelCount, Source->Frame);
+            av_frame_unref(Source->Frame);
+            return Ret;
+        }
+        if (Ret == AVERROR_EOF)
+        {
+            // Flush samples buffered in the resampler.
+            Ret = SourceConvert(Source, ChannelCount, NULL);
+            Source->Ended = 1;
+            Source->Length = Source->BufferStart + Source->BufferCount;
+            // Seeked past the last frame, the demuxer's estimate is all there is.
+            if (Source->Resync && Source->Duration >= 0 && Source->Duration < Source->Length) Source->Length = Source->Duration;
+            return Ret < 0 ? Ret : MIXER_EOF;
+        }
+        if (Ret != AVERROR(EAGAIN))
+        {
+            DEBUG(stderr, "ERROR when avcodec_receive_frame(), errcode=%d\n", Ret);
+            return MIXER_ERR_DECODE;
+        }
+
+        // Demux the next audio packet, or start draining the decoder.
+        if (Source->DemuxEnded) return MIXER_ERR_DECODE;
+        Ret = av_read_frame(Source->FormatContext, &Source->Packet);
+        if (Ret == AVERROR_EOF || (Ret < 0 && avio_feof(Source->FormatContext->pb)))
+        {
+            Source->DemuxEnded = 1;
+            Ret = avcodec_send_packet(Source->CodecContext, NULL);
+        }
+        else if (Ret < 0)
+        {
+            DEBUG(stderr, "ERROR when av_read_frame(), errcode=%d\n", Ret);
+            return MIXER_ERR_DECODE;
+        }
+        else if (Source->Packet.stream_index != Source->AudioStreamIndex)
+        {
+            // Skip non-audio packet.
+            av_packet_unref(&Source->Packet);
+            continue;
+        }
+        else
+        {
+            Ret = avcodec_send_packet(Source->CodecContext, &Source->Packet);
+            av_packet_unref(&Source->Packet);
+            // Corrupt packets are dropped, the decoder resyncs on the next one.
+            if (Ret == AVERROR_INVALIDDATA) continue;
+        }
+        if (Ret < 0 && Ret != AVERROR_EOF)
+        {
+            DEBUG(stderr, "ERROR when avcodec_send_packet(), errcode=%d\n", Ret);
+            return MIXER_ERR_DECODE;
+        }
+    }
+}
+
+int32 SourceDecode(MixerSource *Source, int32 ChannelCount)
+{
+    if (Source->Ended) return MIXER_EOF;
+    int32 Ret = SourceDecodeFrame(Source, ChannelCount);
+    PeakBuilder *Peaks = Source->Peaks;
+    if (Peaks == NULL) return Ret;
+
+    // Samples are only dropped between calls, up to what was fed here, so
+    // everything decoded since the last call is still buffered.
+    int64 End = Source->BufferStart + Source->BufferCount;
+    if (Ret < 0 || Peaks->Position < Source->BufferStart || Peaks->Position > End)
+    {
+        PeakClose(&Source->Peaks);
+        return Ret;
+    }
+    float32 *Channels[MIXER_MAX_CHANNELS];
+    for (int32 Channel = 0; Channel < Peaks->ChannelCount; Channel++)
+    {
+        Channels[Channel] = Source->Buffer[Channel] + (Peaks->Position - Source->BufferStart);
+    }
+    int32 PeakRet = PeakAdd(Peaks, Channels, (int32)(End - Peaks->Position));
+    if (PeakRet == MIXER_OK && Source->Ended)
+    {
+        char *PeakName = av_asprintf("%s%s", Source->FileName, PEAK_SUFFIX);
+        PeakRet = PeakName ? PeakWrite(Peaks, PeakName) : MIXER_ERR_NOMEM;
+        av_free(PeakName);
+    }
+    // Peaks are a by-product, failing them doesn't fail the decode.
+    if (PeakRet < 0 || Source->Ended) PeakClose(&Source->Peaks);
+
+    return Ret;
+}
+
+// Uncompressed input seeks to the exact sample. With rate conversion the
+// input restarts a filter length early, on an input sample that falls on an
+// output sample.
+static void SourceSeekPcm(MixerSource *Source, int64 Position)
+{
+    const PcmFile *File = Source->Pcm;
+    int64 Target = Position;
+    int64 InTarget = Position;
+    if (Source->RateConverter)
+    {
+        const ResampleFilter *Filter = Source->RateConverter->Filter;
+        int64 Preroll = av_rescale(Filter->TapCount, Filter->OutRate, Filter->InRate) + 1;
+        int64 Periods = (Position > Preroll ? Position - Preroll : 0)/Filter->PhaseCount;
+        Target = Periods*Filter->PhaseCount;
+        InTarget = Periods*Filter->Step;
+        ResampleReset(Source->RateConverter);
+    }
+    if (InTarget > File->FrameCount)
+    {
+        InTarget = File->FrameCount;
+        Target = av_rescale(InTarget, Source->SampleRate, File->SampleRate);
+    }
+
+    Source->PcmPosition = InTarget;
+    Source->Ended = 0;
+    Source->BufferCount = 0;
+    Source->BufferStart = Target;
+}
+
+int32 SourceSeek(MixerSource *Source, int64 Position)
+{
+    if (Source->Pcm && Source->Pcm->Stream)
+    {
+        DEBUG(stderr, "ERROR: cannot seek in %s, it is read as it arrives\n", Source->FileName);
+        return MIXER_ERR_DECODE;
+    }
+    if (Source->Pcm)
+    {
+        PeakClose(&Source->Peaks);
+        SourceSeekPcm(Source, Position);
+        return MIXER_OK;
+    }
+
+    AVStream *Stream = Source->FormatContext->streams[Source->AudioStreamIndex];
+    int64 Preroll = av_rescale(MIXER_SEEK_PREROLL_MS, Source->SampleRate, 1000);
+    if (Stream->codecpar->seek_preroll > 0 && Stream->codecpar->sample_rate > 0)
+    {
+        Preroll += av_rescale(Stream->codecpar->seek_preroll, Source->SampleRate, Stream->codecpar->sample_rate);
+    }
+    int64 Target = Position > Preroll ? Position - Preroll : 0;
+    int64 Timestamp = av_rescale_q(Target, (AVRational){1, Source->SampleRate}, Stream->time_base) + Source->StreamStart;
+
+    int32 Ret = av_seek_frame(Source->FormatContext, Source->AudioStreamIndex, Timestamp, AVSEEK_FLAG_BACKWARD);
+    if (Ret < 0)
+    {
+        DEBUG(stderr, "ERROR when av_seek_frame(%s), errcode=%d\n", Source->FileName, Ret);
+        Source->SeekFailed = 1;
+        return MIXER_ERR_DECODE;
+    }
+
+    // Drop everything decoded for the old position.
+    PeakClose(&Source->Peaks);
+    av_packet_unref(&Source->Packet);
+    avcodec_flush_buffers(Source->CodecContext);
+    if (swr_init(Source->Resampler) < 0)
+    {
+        DEBUG(stderr, "ERROR when swr_init()\n");
+        return MIXER_ERR_RESAMPLE;
+    }
+    if (Source->RateConverter) ResampleReset(Source->RateConverter);
+    Source->DemuxEnded = 0;
+    Source->Ended = 0;
+    Source->BufferCount = 0;
+    Source->BufferStart = Target;
+    Source->Resync = 1;
+
+    return MIXER_OK;
+}
+
+void SourceDiscard(MixerSource *Source, int32 ChannelCount, int64 Position)
+{
+    int64 Drop = Position - Source->BufferStart;
+    if (Drop <= 0) return;
+    if (Drop > Source->BufferCount) Drop = Source->BufferCount;
+
+    int32 Keep = Source->BufferCount - (int32)Drop;
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        memmove(Source->Buffer[Channel], Source->Buffer[Channel] + Drop, Keep*sizeof(float32));
+    }
+    Source->BufferCount = Keep;
+    Source->BufferStart += Drop;
+}
+
+int32 SourceFill(MixerSource *Source, int32 ChannelCount, int64 End)
+{
+    while (Source->BufferStart + Source->BufferCount < End)
+    {
+        int32 Ret = SourceDecode(Source, ChannelCount);
+        if (Ret != MIXER_OK) return Ret;
+        SourceDiscard(Source, ChannelCount, Source->ReadPosition);
+    }
+    return MIXER_OK;
+}
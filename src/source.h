@@ -0,0 +1,113 @@
+#ifndef MIXER_SOURCE_H
+#define MIXER_SOURCE_H
+
+#include <libavformat/avformat.h>
+
+#include "ioreader.h"
+#include "mixer.h"
+#include "pcmfile.h"
+#include "peaks.h"
+#include "remix.h"
+#include "resample.h"
+#include "thread.h"
+
+// Decoded samples of one file, converted to the mixer format (planar float
+// at the output rate and channel count). A source is reference counted and
+// may feed several clips; samples stay buffered until the clip furthest
+// behind has consumed them.
+typedef struct MixerSource
+{
+    char *FileName;
+    char *Key;              // Identity of the file and decode parameters, see SourceIdentify().
+    int32 RefCount;
+    int32 Shareable;
+    Mutex Lock;             // Serializes decoding when clips sharing the source are prefetched in parallel.
+    AVFormatContext *FormatContext;
+    IoReader *Io;           // Reads the file for FormatContext through io_uring, NULL when libavformat reads it.
+    AVIOContext *IoContext;
+    AVCodec *Codec;
+    AVCodecContext *CodecContext;
+    int32 AudioStreamIndex;
+    int64 StreamStart;      // Stream timestamp of source position 0.
+    struct SwrContext *Resampler;
+    RemixMatrix *Remix;     // Maps the input layout to the output, NULL when the resampler does.
+    float32 *Converted[REMIX_MAX_INPUTS];   // Resampler output in the input layout, the remix input.
+    int32 ConvertedCapacity;
+    ResampleState *RateConverter;   // Polyphase rate conversion after the remix, NULL when the resampler converts the rate.
+    PcmFile *Pcm;           // Uncompressed input read without libavformat, which leaves the demuxer, decoder and resampler NULL.
+    int64 PcmPosition;      // Next frame of Pcm to convert.
+    int32 SampleRate;       // Output rate, the unit of every position below.
+    AVPacket Packet;
+    AVFrame *Frame;
+    int32 DemuxEnded;       // av_read_frame() hit end of file, decoder is draining.
+    int32 Ended;            // Decoder and resampler are fully drained.
+    int64 Length;           // Total samples, known once Ended.
+    int64 Duration;         // Length estimated by the demuxer, -1 if unknown.
+    int32 Resync;           // Seeked, BufferStart is taken from the next frame's timestamp.
+    int32 SeekFailed;       // The input cannot seek, skip ahead by decoding.
+    int64 ReadPosition;     // Lowest position any clip still needs, older samples are dropped.
+    PeakBuilder *Peaks;     // Fed every decoded sample until the input ends, NULL when not wanted or after a seek.
+
+    // Timeline bookkeeping owned by the mixer.
+    int32 Unstarted;        // Clips using this source that have not started playing.
+    int64 MinTrim;          // Lowest trim among those clips.
+    int64 Stamp;
+
+    // Buffer[c][0] is the sample at position BufferStart of this source.
+    float32 *Buffer[MIXER_MAX_CHANNELS];
+    int32 BufferCount;
+    int32 BufferCapacity;
+    int64 BufferStart;
+} MixerSource;
+
+// What a file holds, as far as opening it tells without decoding.
+typedef struct SourceInfo
+{
+    char Format[32];        // Container, libavformat's name or the native reader's.
+    char Codec[24];         // libavcodec's name of the codec.
+    char SampleFormat[8];   // Of the decoded samples.
+    int32 SampleRate;
+    int32 ChannelCount;
+    int64 ChannelLayout;
+    int64 BitRate;          // bps, 0 if unknown.
+    float64 Duration;       // Seconds, -1 if unknown.
+} SourceInfo;
+
+// Two clips decode to identical samples when they name the same file (same
+// canonical path, size and modification time), since every source of a
+// context is converted to the same output format. Non-file URLs are keyed by
+// their name. The returned string is owned by the caller.
+char *SourceIdentify(const char *FileName);
+
+// Open FileName and take ownership of Key. Rate conversion filters come from
+// and are added to the list at Filters, which must outlive the source. On
+// failure *Result may still hold a partially opened source that must be
+// passed to SourceClose().
+int32 SourceOpen(MixerSource **Result, const char *FileName, char *Key, const MixerConfig *Config, ResampleFilter **Filters);
+
+void SourceClose(MixerSource *Source);
+
+// Fill Info for FileName from its header alone, without opening a decoder or
+// any conversion. Uncompressed files are parsed by the native reader when
+// NativeInput is set, like SourceOpen() does.
+int32 SourceProbe(const char *FileName, int32 NativeInput, SourceInfo *Info);
+
+// Decode until at least one frame has been appended to the buffer.
+// Returns MIXER_EOF once the decoder and the resampler are drained, which
+// also writes the peak sidecar when the input was decoded from its start.
+int32 SourceDecode(MixerSource *Source, int32 ChannelCount);
+
+// Seek so that decoding resumes at or before Position. The decoder restarts
+// a little earlier than asked so that codecs with inter-frame state settle
+// before Position, and SourceFill() discards the preroll sample-accurately
+// using the timestamp of the first frame decoded.
+int32 SourceSeek(MixerSource *Source, int64 Position);
+
+// Drop buffered samples that lie before Position.
+void SourceDiscard(MixerSource *Source, int32 ChannelCount, int64 Position);
+
+// Decode until samples up to End are buffered, dropping everything before
+// ReadPosition along the way. Returns MIXER_EOF if the source ends first.
+int32 SourceFill(MixerSource *Source, int32 ChannelCount, int64 End);
+
+#endif
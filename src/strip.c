@@ -0,0 +1,200 @@
+#include <math.h>
+#include <string.h>
+
+#include <libavutil/mem.h>
+
+#include "strip.h"
+
+// Threshold of a compressor that never acts, as log2 of the level.
+#define STRIP_NO_THRESHOLD      1000.0f
+
+// What unused lanes run: every filter passes through, the compressor never acts.
+static const StripState StripPassThrough = {0, {{1.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+                                                {1.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+                                                {1.0f, 0.0f, 0.0f, 0.0f, 0.0f}},
+                                            {{{0.0f}}}, {STRIP_NO_THRESHOLD, 0.0f, 0.0f, 1.0f, 1.0f}, 0.0f};
+
+static void StripCoefficients(float32 *Coefficients, float64 B0, float64 B1, float64 B2, float64 A0, float64 A1, float64 A2)
+{
+    Coefficients[0] = (float32)(B0/A0);
+    Coefficients[1] = (float32)(B1/A0);
+    Coefficients[2] = (float32)(B2/A0);
+    Coefficients[3] = (float32)(A1/A0);
+    Coefficients[4] = (float32)(A2/A0);
+}
+
+// Filters of the Audio EQ Cookbook, shelves with a slope of 1.
+int32 StripDesign(StripState *Strip, const MixerStripInfo *Info, int32 SampleRate)
+{
+    float32 Nyquist = SampleRate/2.0f;
+    if (Info->HighPassHz < 0 || Info->HighPassHz >= Nyquist || Info->LowShelfHz < 0 || Info->LowShelfHz >= Nyquist ||
+        Info->HighShelfHz < 0 || Info->HighShelfHz >= Nyquist || Info->Ratio < 1.0f)
+    {
+        return MIXER_ERR_ARG;
+    }
+    if (Info->Ratio > 1.0f && (Info->AttackMs <= 0 || Info->ReleaseMs <= 0)) return MIXER_ERR_ARG;
+
+    Strip->Flags = 0;
+    memcpy(Strip->Coefficients, StripPassThrough.Coefficients, sizeof(Strip->Coefficients));
+    memcpy(Strip->Params, StripPassThrough.Params, sizeof(Strip->Params));
+
+    if (Info->HighPassHz > 0)
+    {
+        float64 W = 2*M_PI*Info->HighPassHz/SampleRate;
+        float64 Cos = cos(W);
+        float64 Alpha = sin(W)/(2*M_SQRT1_2);
+        StripCoefficients(Strip->Coefficients[0], (1 + Cos)/2, -(1 + Cos), (1 + Cos)/2, 1 + Alpha, -2*Cos, 1 - Alpha);
+        Strip->Flags |= STRIP_HIGH_PASS;
+    }
+    if (Info->LowShelfHz > 0)
+    {
+        float64 A = pow(10.0, Info->LowShelfDb/40.0);
+        float64 W = 2*M_PI*Info->LowShelfHz/SampleRate;
+        float64 Cos = cos(W);
+        float64 Root = sqrt(2*A)*sin(W);   // 2 sqrt(A) alpha.
+        StripCoefficients(Strip->Coefficients[1], A*((A + 1) - (A - 1)*Cos + Root), 2*A*((A - 1) - (A + 1)*Cos),
+                          A*((A + 1) - (A - 1)*Cos - Root), (A + 1) + (A - 1)*Cos + Root, -2*((A - 1) + (A + 1)*Cos),
+                          (A + 1) + (A - 1)*Cos - Root);
+        Strip->Flags |= STRIP_LOW_SHELF;
+    }
+    if (Info->HighShelfHz > 0)
+    {
+        float64 A = pow(10.0, Info->HighShelfDb/40.0);
+        float64 W = 2*M_PI*Info->HighShelfHz/SampleRate;
+        float64 Cos = cos(W);
+        float64 Root = sqrt(2*A)*sin(W);   // 2 sqrt(A) alpha.
+        StripCoefficients(Strip->Coefficients[2], A*((A + 1) + (A - 1)*Cos + Root), -2*A*((A - 1) + (A + 1)*Cos),
+                          A*((A + 1) + (A - 1)*Cos - Root), (A + 1) - (A - 1)*Cos + Root, 2*((A - 1) - (A + 1)*Cos),
+                          (A + 1) - (A - 1)*Cos - Root);
+        Strip->Flags |= STRIP_HIGH_SHELF;
+    }
+    if (Info->Ratio > 1.0f)
+    {
+        Strip->Params[0] = (float32)(Info->ThresholdDb/20.0*M_LN10/M_LN2);
+        Strip->Params[1] = (float32)(Info->MakeupDb/20.0*M_LN10/M_LN2);
+        Strip->Params[2] = 1.0f - 1.0f/Info->Ratio;
+        Strip->Params[3] = (float32)(1.0 - exp(-1.0/(Info->AttackMs*1e-3*SampleRate)));
+        Strip->Params[4] = (float32)(1.0 - exp(-1.0/(Info->ReleaseMs*1e-3*SampleRate)));
+        Strip->Flags |= STRIP_COMPRESSOR;
+    }
+
+    return MIXER_OK;
+}
+
+void StripReset(StripState *Strip)
+{
+    memset(Strip->Filter, 0, sizeof(Strip->Filter));
+    Strip->Envelope = 0.0f;
+}
+
+int32 StripGroupInit(StripGroup *Group, int32 ChannelCount, int32 BlockSize)
+{
+    memset(Group, 0, sizeof(StripGroup));
+    Group->ChannelCount = ChannelCount;
+    Group->BlockSize = BlockSize;
+    for (int32 Channel = 0; Channel < ChannelCount; Channel++)
+    {
+        Group->Data[Channel] = av_mallocz(BlockSize*KERNEL_LANES*sizeof(float32));
+        if (Group->Data[Channel] == NULL)
+        {
+            StripGroupFree(Group);
+            return MIXER_ERR_NOMEM;
+        }
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++)
+        {
+            Group->Planar[Lane][Channel] = av_mallocz(BlockSize*sizeof(float32));
+            if (Group->Planar[Lane][Channel] == NULL)
+            {
+                StripGroupFree(Group);
+                return MIXER_ERR_NOMEM;
+            }
+        }
+    }
+    return MIXER_OK;
+}
+
+void StripGroupFree(StripGroup *Group)
+{
+    for (int32 Channel = 0; Channel < MIXER_MAX_CHANNELS; Channel++)
+    {
+        av_freep(&Group->Data[Channel]);
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++) av_freep(&Group->Planar[Lane][Channel]);
+    }
+}
+
+void StripGroupLoad(StripGroup *Group, StripState *Strip)
+{
+    Group->Strips[Group->Count++] = Strip;
+}
+
+void StripGroupRun(StripGroup *Group, const KernelTable *Kernels, int32 Count)
+{
+    int32 Flags = 0;
+    for (int32 Lane = 0; Lane < Group->Count; Lane++)
+    {
+        Flags |= Group->Strips[Lane]->Flags;
+    }
+    int32 Stages[STRIP_STAGES];
+    int32 StageCount = 0;
+    for (int32 Stage = 0; Stage < STRIP_STAGES; Stage++)
+    {
+        if (Flags & (1 << Stage)) Stages[StageCount++] = Stage;
+    }
+
+    // Transpose the strips and the samples into the lanes.
+    for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++)
+    {
+        const StripState *Strip = Lane < Group->Count ? Group->Strips[Lane] : &StripPassThrough;
+        for (int32 Stage = 0; Stage < StageCount; Stage++)
+        {
+            for (int32 Coefficient = 0; Coefficient < 5; Coefficient++)
+            {
+                Group->Coefficients[(Stage*5 + Coefficient)*KERNEL_LANES + Lane] = Strip->Coefficients[Stages[Stage]][Coefficient];
+            }
+            for (int32 Channel = 0; Channel < Group->ChannelCount; Channel++)
+            {
+                Group->Filter[Channel][(Stage*2 + 0)*KERNEL_LANES + Lane] = Strip->Filter[Stages[Stage]][Channel][0];
+                Group->Filter[Channel][(Stage*2 + 1)*KERNEL_LANES + Lane] = Strip->Filter[Stages[Stage]][Channel][1];
+            }
+        }
+        for (int32 Param = 0; Param < KERNEL_COMPRESSOR_PARAMS; Param++)
+        {
+            Group->Params[Param*KERNEL_LANES + Lane] = Strip->Params[Param];
+        }
+        Group->Envelope[Lane] = Strip->Envelope;
+    }
+
+    // Lanes left free hold whatever an earlier group left there, which is
+    // processed and ignored.
+    for (int32 Channel = 0; Channel < Group->ChannelCount; Channel++)
+    {
+        float32 *Planar[KERNEL_LANES];
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++) Planar[Lane] = Group->Planar[Lane][Channel];
+        Kernels->InterleaveLanes(Group->Data[Channel], Planar, Count);
+        if (StageCount > 0) Kernels->BiquadLanes(Group->Data[Channel], Count, Group->Coefficients, Group->Filter[Channel], StageCount);
+    }
+    if (Flags & STRIP_COMPRESSOR)
+    {
+        Kernels->CompressLanes(Group->Data, Group->ChannelCount, Count, Group->Params, Group->Envelope);
+    }
+    for (int32 Channel = 0; Channel < Group->ChannelCount; Channel++)
+    {
+        float32 *Planar[KERNEL_LANES];
+        for (int32 Lane = 0; Lane < KERNEL_LANES; Lane++) Planar[Lane] = Group->Planar[Lane][Channel];
+        Kernels->DeinterleaveLanes(Planar, Group->Data[Channel], Count);
+    }
+
+    for (int32 Lane = 0; Lane < Group->Count; Lane++)
+    {
+        StripState *Strip = Group->Strips[Lane];
+        for (int32 Stage = 0; Stage < StageCount; Stage++)
+        {
+            for (int32 Channel = 0; Channel < Group->ChannelCount; Channel++)
+            {
+                Strip->Filter[Stages[Stage]][Channel][0] = Group->Filter[Channel][(Stage*2 + 0)*KERNEL_LANES + Lane];
+                Strip->Filter[Stages[Stage]][Channel][1] = Group->Filter[Channel][(Stage*2 + 1)*KERNEL_LANES + Lane];
+            }
+        }
+        Strip->Envelope = Group->Envelope[Lane];
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef MIXER_STRIP_H
+#define MIXER_STRIP_H
+
+#include "kernel.h"
+#include "mixer.h"
+
+// Channel strips of clips, see MixerStripInfo. Up to KERNEL_LANES clips are
+// processed as a group, each in one lane of the strip kernels: every clip
+// renders its block into the planar buffers of its lane, then the group runs
+// once and leaves each lane's output in the same buffers. Filters a strip
+// doesn't use pass through, and stages no strip of the group uses are
+// skipped.
+
+#define STRIP_HIGH_PASS         1
+#define STRIP_LOW_SHELF         2
+#define STRIP_HIGH_SHELF        4
+#define STRIP_COMPRESSOR        8
+
+// Filters of a strip, one bit each from STRIP_HIGH_PASS up.
+#define STRIP_STAGES            3
+
+typedef struct StripState
+{
+    int32 Flags;                                            // STRIP_* parts in use.
+    float32 Coefficients[STRIP_STAGES][5];                  // b0, b1, b2, a1 and a2 of each filter.
+    float32 Filter[STRIP_STAGES][MIXER_MAX_CHANNELS][2];    // Transposed direct form II state.
+    float32 Params[KERNEL_COMPRESSOR_PARAMS];               // As KernelCompressLanesFunc takes them.
+    float32 Envelope;
+} StripState;
+
+typedef struct StripGroup
+{
+    int32 ChannelCount;
+    int32 BlockSize;
+    StripState *Strips[KERNEL_LANES];
+    int32 Count;                                        // Lanes loaded.
+    float32 *Data[MIXER_MAX_CHANNELS];                  // BlockSize frames of lane data.
+    float32 *Planar[KERNEL_LANES][MIXER_MAX_CHANNELS];  // The block of each lane.
+
+    // Strips of the lanes while the group runs.
+    float32 Coefficients[STRIP_STAGES*5*KERNEL_LANES];
+    float32 Filter[MIXER_MAX_CHANNELS][STRIP_STAGES*2*KERNEL_LANES];
+    float32 Params[KERNEL_COMPRESSOR_PARAMS*KERNEL_LANES];
+    float32 Envelope[KERNEL_LANES];
+} StripGroup;
+
+// Design Strip from Info for SampleRate, keeping its state.
+int32 StripDesign(StripState *Strip, const MixerStripInfo *Info, int32 SampleRate);
+
+// Back to silence.
+void StripReset(StripState *Strip);
+
+int32 StripGroupInit(StripGroup *Group, int32 ChannelCount, int32 BlockSize);
+
+void StripGroupFree(StripGroup *Group);
+
+// Take the next free lane, whose Group->Planar block is rendered, to be
+// run through Strip.
+void StripGroupLoad(StripGroup *Group, StripState *Strip);
+
+// Run the first Count frames of every loaded lane through its strip, in
+// place.
+void StripGroupRun(StripGroup *Group, const KernelTable *Kernels, int32 Count);
+
+#endif
@@ -0,0 +1,84 @@
+#include "thread.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define THREAD_HAVE_MXCSR 1
+#endif
+
+// Flush to zero and denormals are zero, bits 15 and 6 of MXCSR.
+#define THREAD_MXCSR_DENORMALS  0x8040
+// Flush to zero, bit 24 of the AArch64 FPCR.
+#define THREAD_FPCR_DENORMALS   (1u << 24)
+
+typedef struct ThreadStart
+{
+    ThreadFunc Func;
+    void *Arg;
+} ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI ThreadMain(LPVOID Data)
+#else
+static void *ThreadMain(void *Data)
+#endif
+{
+    ThreadStart Start = *(ThreadStart *)Data;
+    free(Data);
+    Start.Func(Start.Arg);
+    return 0;
+}
+
+int32 ThreadCreate(Thread *Handle, ThreadFunc Func, void *Arg)
+{
+    ThreadStart *Start = malloc(sizeof(ThreadStart));
+    if (Start == NULL) return -1;
+    Start->Func = Func;
+    Start->Arg = Arg;
+
+#ifdef _WIN32
+    *Handle = CreateThread(NULL, 0, ThreadMain, Start, 0, NULL);
+    if (*Handle != NULL) return 0;
+#else
+    if (pthread_create(Handle, NULL, ThreadMain, Start) == 0) return 0;
+#endif
+    free(Start);
+    return -1;
+}
+
+void ThreadJoin(Thread Handle)
+{
+#ifdef _WIN32
+    WaitForSingleObject(Handle, INFINITE);
+    CloseHandle(Handle);
+#else
+    pthread_join(Handle, NULL);
+#endif
+}
+
+uint32_t ThreadFlushDenormals(void)
+{
+#if defined(THREAD_HAVE_MXCSR)
+    uint32_t Mode = _mm_getcsr();
+    _mm_setcsr(Mode | THREAD_MXCSR_DENORMALS);
+    return Mode;
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t Mode;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(Mode));
+    __asm__ volatile("msr fpcr, %0" : : "r"(Mode | THREAD_FPCR_DENORMALS));
+    return (uint32_t)Mode;
+#else
+    return 0;
+#endif
+}
+
+void ThreadRestoreDenormals(uint32_t Mode)
+{
+#if defined(THREAD_HAVE_MXCSR)
+    _mm_setcsr(Mode);
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t Control = Mode;
+    __asm__ volatile("msr fpcr, %0" : : "r"(Control));
+#else
+    (void)Mode;
+#endif
+}
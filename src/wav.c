@@ -0,0 +1,96 @@
+#include <string.h>
+
+#include <libavutil/channel_layout.h>
+
+#include "wav.h"
+
+static uint8_t *WriteTag(uint8_t *Out, const char *Tag)
+{
+    memcpy(Out, Tag, 4);
+    return Out + 4;
+}
+
+static uint8_t *WriteU16(uint8_t *Out, int32 Value)
+{
+    Out[0] = Value & 0xFF;
+    Out[1] = (Value >> 8) & 0xFF;
+    return Out + 2;
+}
+
+static uint8_t *WriteU32(uint8_t *Out, int64 Value)
+{
+    Out = WriteU16(Out, (int32)(Value & 0xFFFF));
+    return WriteU16(Out, (int32)((Value >> 16) & 0xFFFF));
+}
+
+int32 WavHeader(uint8_t *Header, int32 SampleRate, int32 ChannelCount, int64 DataSize)
+{
+    uint8_t *Out = Header;
+    int32 BlockAlign = ChannelCount*sizeof(float32);
+    Out = WriteTag(Out, "RIFF");
+    Out = WriteU32(Out, 4 + 26 + 12 + 8 + DataSize);
+    Out = WriteTag(Out, "WAVE");
+    Out = WriteTag(Out, "fmt ");
+    Out = WriteU32(Out, 18);
+    Out = WriteU16(Out, 3);                // WAVE_FORMAT_IEEE_FLOAT
+    Out = WriteU16(Out, ChannelCount);
+    Out = WriteU32(Out, SampleRate);
+    Out = WriteU32(Out, (int64)SampleRate*BlockAlign);
+    Out = WriteU16(Out, BlockAlign);
+    Out = WriteU16(Out, 32);
+    Out = WriteU16(Out, 0);
+    Out = WriteTag(Out, "fact");
+    Out = WriteU32(Out, 4);
+    Out = WriteU32(Out, DataSize/BlockAlign);
+    Out = WriteTag(Out, "data");
+    Out = WriteU32(Out, DataSize);
+
+    return (int32)(Out - Header);
+}
+
+int32 WavHeaderPcm(uint8_t *Header, int32 SampleRate, int32 ChannelCount, int32 BitsPerSample, int64 DataSize)
+{
+    uint8_t *Out = Header;
+    // KSDATAFORMAT_SUBTYPE_PCM without its first two bytes, the format tag.
+    static const unsigned char SubFormat[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+                                                0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+    int32 Extensible = ChannelCount > 2 || BitsPerSample > 16;
+    int32 BlockAlign = ChannelCount*(BitsPerSample/8);
+    int32 FormatSize = Extensible ? 40 : 16;
+    Out = WriteTag(Out, "RIFF");
+    Out = WriteU32(Out, 4 + 8 + FormatSize + 8 + DataSize);
+    Out = WriteTag(Out, "WAVE");
+    Out = WriteTag(Out, "fmt ");
+    Out = WriteU32(Out, FormatSize);
+    Out = WriteU16(Out, Extensible ? 0xFFFE : 1);    // WAVE_FORMAT_EXTENSIBLE or WAVE_FORMAT_PCM
+    Out = WriteU16(Out, ChannelCount);
+    Out = WriteU32(Out, SampleRate);
+    Out = WriteU32(Out, (int64)SampleRate*BlockAlign);
+    Out = WriteU16(Out, BlockAlign);
+    Out = WriteU16(Out, BitsPerSample);
+    if (Extensible)
+    {
+        Out = WriteU16(Out, 22);
+        Out = WriteU16(Out, BitsPerSample);
+        Out = WriteU32(Out, av_get_default_channel_layout(ChannelCount) & 0xFFFFFFFF);
+        Out = WriteU16(Out, 1);
+        memcpy(Out, SubFormat, sizeof(SubFormat));
+        Out += sizeof(SubFormat);
+    }
+    Out = WriteTag(Out, "data");
+    Out = WriteU32(Out, DataSize);
+
+    return (int32)(Out - Header);
+}
+
+void WavWriteHeader(FILE *File, int32 SampleRate, int32 ChannelCount, int64 DataSize)
+{
+    uint8_t Header[WAV_HEADER_MAX];
+    fwrite(Header, 1, WavHeader(Header, SampleRate, ChannelCount, DataSize), File);
+}
+
+void WavWriteHeaderPcm(FILE *File, int32 SampleRate, int32 ChannelCount, int32 BitsPerSample, int64 DataSize)
+{
+    uint8_t Header[WAV_HEADER_MAX];
+    fwrite(Header, 1, WavHeaderPcm(Header, SampleRate, ChannelCount, BitsPerSample, DataSize), File);
+}
@@ -0,0 +1,26 @@
+#ifndef MIXER_WAV_H
+#define MIXER_WAV_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+// Longest header the functions below produce.
+#define WAV_HEADER_MAX          68
+
+// Write a 32-bit float WAV header. Write it once with DataSize 0 before the
+// samples, then seek back and write it again with the final size.
+void WavWriteHeader(FILE *File, int32 SampleRate, int32 ChannelCount, int64 DataSize);
+
+// Same for signed integer samples of 16, 24 or 32 bits. Files with more than
+// two channels or more than 16 bits use WAVE_FORMAT_EXTENSIBLE, with the
+// default speaker positions for the channel count.
+void WavWriteHeaderPcm(FILE *File, int32 SampleRate, int32 ChannelCount, int32 BitsPerSample, int64 DataSize);
+
+// Build the same headers in Header, which must hold WAV_HEADER_MAX bytes,
+// and return their size.
+int32 WavHeader(uint8_t *Header, int32 SampleRate, int32 ChannelCount, int64 DataSize);
+
+int32 WavHeaderPcm(uint8_t *Header, int32 SampleRate, int32 ChannelCount, int32 BitsPerSample, int64 DataSize);
+
+#endif
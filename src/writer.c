@@ -0,0 +1,322 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+#include "mixer.h"
+#include "writer.h"
+
+// O_DIRECT wants buffers, sizes and offsets aligned to the logical block
+// size, a page covers every device in use.
+#define WRITER_ALIGN            4096
+
+#ifdef _WIN32
+#define WriterCreate(Name, Flags)   _open(Name, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define WriterRawWrite              _write
+#define WriterRawClose              _close
+#define WriterSeekStart(File)       _lseeki64(File, 0, SEEK_SET)
+#define WriterDup                   _dup
+#define WriterDup2                  _dup2
+#else
+#define WriterCreate(Name, Flags)   open(Name, O_WRONLY | O_CREAT | O_TRUNC | (Flags), 0644)
+#define WriterRawWrite              write
+#define WriterRawClose              close
+#define WriterSeekStart(File)       lseek(File, 0, SEEK_SET)
+#define WriterDup                   dup
+#define WriterDup2                  dup2
+#endif
+
+// On failure *Error holds the errno of the failing call, later calls may
+// clobber errno before the caller reports it.
+static int32 WriterWriteAll(int File, const uint8_t *Data, int64 Size, int *Error)
+{
+    while (Size > 0)
+    {
+        int32 Chunk = Size < (1 << 30) ? (int32)Size : (1 << 30);
+        int32 Written = (int32)WriterRawWrite(File, Data, Chunk);
+        if (Written < 0 && errno == EINTR) continue;
+        if (Written <= 0)
+        {
+            *Error = Written < 0 ? errno : EIO;
+            return MIXER_ERR_WRITE;
+        }
+        Data += Written;
+        Size -= Written;
+    }
+    return MIXER_OK;
+}
+
+int WriterReserveStdout(void)
+{
+    static int StdoutFile = -1;
+    if (StdoutFile < 0)
+    {
+        fflush(stdout);
+        StdoutFile = WriterDup(1);
+        if (StdoutFile >= 0) WriterDup2(2, 1);
+    }
+    return StdoutFile;
+}
+
+#ifdef SPLICE_F_GIFT
+// Map Data into the pipe instead of copying it, the pages stay referenced
+// by the pipe until the reader takes them.
+static int32 WriterSpliceAll(int File, uint8_t *Data, int64 Size, int *Error)
+{
+    while (Size > 0)
+    {
+        struct iovec Vector = {Data, (size_t)Size};
+        ssize_t Written = vmsplice(File, &Vector, 1, 0);
+        if (Written < 0 && errno == EINTR) continue;
+        if (Written <= 0)
+        {
+            *Error = Written < 0 ? errno : EIO;
+            return MIXER_ERR_WRITE;
+        }
+        Data += Written;
+        Size -= Written;
+    }
+    return MIXER_OK;
+}
+
+// The pipe holds exactly one buffer, so the pages of a spliced buffer are
+// free once the buffer after it is in the pipe, or once the pipe is empty.
+static int32 WriterSpliceSetup(int File)
+{
+    struct stat Info;
+    if (fstat(File, &Info) != 0 || !S_ISFIFO(Info.st_mode)) return 0;
+    return fcntl(File, F_SETPIPE_SZ, WRITER_BUFFER_SIZE) == WRITER_BUFFER_SIZE;
+}
+
+static void WriterSpliceDrain(int File)
+{
+    int Pending;
+    while (ioctl(File, FIONREAD, &Pending) == 0 && Pending > 0) av_usleep(1000);
+}
+#endif
+
+static void WriterMain(void *Arg)
+{
+    Writer *Out = Arg;
+    MutexLock(&Out->Lock);
+    for (;;)
+    {
+        while (Out->Queued == Out->Held && !Out->Stop) CondWait(&Out->Ready, &Out->Lock);
+        if (Out->Queued == Out->Held) break;
+        int32 Index = (Out->Next + Out->Held) % WRITER_BUFFER_COUNT;
+        MutexUnlock(&Out->Lock);
+
+        // Only the last buffer is short, direct writes pad it to the
+        // alignment and WriterClose() cuts the file back.
+        int64 Size = Out->Fill[Index];
+        if (Out->Direct && Size % WRITER_ALIGN)
+        {
+            int64 Padded = (Size + WRITER_ALIGN - 1)/WRITER_ALIGN*WRITER_ALIGN;
+            memset(Out->Buffers[Index] + Size, 0, Padded - Size);
+            Size = Padded;
+        }
+        int64 StartTime = av_gettime_relative();
+        int32 Ret = Out->Error;
+        int Error = 0;
+#ifdef SPLICE_F_GIFT
+        if (Ret == 0 && Out->Splice) Ret = WriterSpliceAll(Out->File, Out->Buffers[Index], Size, &Error);
+        else
+#endif
+        if (Ret == 0) Ret = WriterWriteAll(Out->File, Out->Buffers[Index], Size, &Error);
+        int64 Elapsed = av_gettime_relative() - StartTime;
+
+        MutexLock(&Out->Lock);
+        if (Ret < 0 && Out->Error == 0)
+        {
+            DEBUG(stderr, "ERROR when write output: %s\n", strerror(Error));
+            Out->Error = Ret;
+        }
+        Out->WriteTime += Elapsed;
+        // A spliced buffer is only handed back when the next one went out.
+        Out->Held++;
+        while (Out->Held > Out->Splice)
+        {
+            Out->Fill[Out->Next] = 0;
+            Out->Next = (Out->Next + 1) % WRITER_BUFFER_COUNT;
+            Out->Queued--;
+            Out->Held--;
+        }
+        CondSignal(&Out->Free);
+    }
+    MutexUnlock(&Out->Lock);
+}
+
+int32 WriterOpen(Writer **Result, const char *FileName, int32 Flags, int64 SizeHint)
+{
+    Writer *Out = av_mallocz(sizeof(Writer));
+    if (Out == NULL) return MIXER_ERR_NOMEM;
+    Out->StartTime = av_gettime_relative();
+    for (int32 Index = 0; Index < WRITER_BUFFER_COUNT; Index++)
+    {
+        Out->Allocations[Index] = av_malloc(WRITER_BUFFER_SIZE + WRITER_ALIGN);
+        if (Out->Allocations[Index] == NULL)
+        {
+            while (--Index >= 0) av_free(Out->Allocations[Index]);
+            av_free(Out);
+            return MIXER_ERR_NOMEM;
+        }
+        Out->Buffers[Index] = (uint8_t *)(((uintptr_t)Out->Allocations[Index] + WRITER_ALIGN - 1) & ~(uintptr_t)(WRITER_ALIGN - 1));
+    }
+
+    Out->File = -1;
+    if (strcmp(FileName, WRITER_STDOUT) == 0)
+    {
+        Out->File = WriterReserveStdout();
+        Out->Stream = 1;
+        SizeHint = 0;
+#ifdef _WIN32
+        if (Out->File >= 0) _setmode(Out->File, _O_BINARY);
+#endif
+#ifdef SPLICE_F_GIFT
+        if (Out->File >= 0 && (Flags & WRITER_SPLICE)) Out->Splice = WriterSpliceSetup(Out->File);
+#endif
+    }
+#ifdef O_DIRECT
+    // File systems without direct I/O refuse the flag, write through the cache there.
+    else if (Flags & WRITER_DIRECT)
+    {
+        Out->File = WriterCreate(FileName, O_DIRECT);
+        Out->Direct = Out->File >= 0;
+    }
+#endif
+    if (Out->File < 0 && !Out->Stream) Out->File = WriterCreate(FileName, 0);
+    if (Out->File < 0)
+    {
+        DEBUG(stderr, "ERROR when open %s\n", FileName);
+        WriterClose(&Out, NULL, 0, NULL);
+        return MIXER_ERR_WRITE;
+    }
+#ifdef __linux__
+    // Reserve the blocks without growing the file, WriterClose() trims
+    // whatever the hint overestimated.
+    if (SizeHint > 0) fallocate(Out->File, FALLOC_FL_KEEP_SIZE, 0, SizeHint);
+#else
+    (void)SizeHint;
+#endif
+
+    MutexInit(&Out->Lock);
+    CondInit(&Out->Ready);
+    CondInit(&Out->Free);
+    if (ThreadCreate(&Out->Worker, WriterMain, Out) != 0)
+    {
+        MutexDestroy(&Out->Lock);
+        CondDestroy(&Out->Ready);
+        CondDestroy(&Out->Free);
+        WriterRawClose(Out->File);
+        Out->File = -1;
+        WriterClose(&Out, NULL, 0, NULL);
+        return MIXER_ERR_NOMEM;
+    }
+    *Result = Out;
+
+    return MIXER_OK;
+}
+
+// Hand the buffer being filled to the thread and wait until the next one is free.
+static void WriterQueue(Writer *Out)
+{
+    MutexLock(&Out->Lock);
+    Out->Queued++;
+    Out->Current = (Out->Current + 1) % WRITER_BUFFER_COUNT;
+    CondSignal(&Out->Ready);
+    if (Out->Queued == WRITER_BUFFER_COUNT)
+    {
+        int64 StartTime = av_gettime_relative();
+        while (Out->Queued == WRITER_BUFFER_COUNT) CondWait(&Out->Free, &Out->Lock);
+        Out->BlockedTime += av_gettime_relative() - StartTime;
+    }
+    MutexUnlock(&Out->Lock);
+}
+
+int32 WriterWrite(Writer *Out, const void *Data, int64 Size)
+{
+    const uint8_t *Bytes = Data;
+    while (Size > 0)
+    {
+        int32 Index = Out->Current;
+        int32 Room = WRITER_BUFFER_SIZE - Out->Fill[Index];
+        int32 Count = Size < Room ? (int32)Size : Room;
+        memcpy(Out->Buffers[Index] + Out->Fill[Index], Bytes, Count);
+        Out->Fill[Index] += Count;
+        Out->Bytes += Count;
+        Bytes += Count;
+        Size -= Count;
+        if (Out->Fill[Index] == WRITER_BUFFER_SIZE) WriterQueue(Out);
+    }
+    return Out->Error;
+}
+
+int32 WriterClose(Writer **Result, const void *Header, int32 HeaderSize, WriterStats *Stats)
+{
+    Writer *Out = *Result;
+    if (Out == NULL) return MIXER_OK;
+
+    int32 Ret = MIXER_OK;
+    if (Out->File >= 0)
+    {
+        MutexLock(&Out->Lock);
+        if (Out->Fill[Out->Current] > 0) Out->Queued++;
+        Out->Stop = 1;
+        CondSignal(&Out->Ready);
+        MutexUnlock(&Out->Lock);
+        ThreadJoin(Out->Worker);
+        MutexDestroy(&Out->Lock);
+        CondDestroy(&Out->Ready);
+        CondDestroy(&Out->Free);
+        Ret = Out->Error;
+
+#ifdef SPLICE_F_GIFT
+        // The reader may still be reading the pages of the last buffer.
+        if (Out->Splice && Ret == 0) WriterSpliceDrain(Out->File);
+#endif
+        if (Out->Stream) Header = NULL;
+#ifndef _WIN32
+        // Drop the padding of the last direct write and any preallocation left over.
+        if (!Out->Stream && ftruncate(Out->File, Out->Bytes) != 0 && Ret == 0) Ret = MIXER_ERR_WRITE;
+#ifdef O_DIRECT
+        if (Out->Direct) fcntl(Out->File, F_SETFL, fcntl(Out->File, F_GETFL) & ~O_DIRECT);
+#endif
+#endif
+        if (Header != NULL && Ret == 0)
+        {
+            int Error = 0;
+            if (WriterSeekStart(Out->File) != 0) Ret = MIXER_ERR_WRITE;
+            else Ret = WriterWriteAll(Out->File, Header, HeaderSize, &Error);
+        }
+        if (WriterRawClose(Out->File) != 0 && Ret == 0) Ret = MIXER_ERR_WRITE;
+    }
+
+    if (Stats != NULL)
+    {
+        Stats->Bytes = Out->Bytes;
+        Stats->Seconds = (av_gettime_relative() - Out->StartTime)/1e6;
+        Stats->BytesPerSecond = Stats->Seconds > 0 ? Out->Bytes/Stats->Seconds : 0.0;
+        Stats->BlockedSeconds = Out->BlockedTime/1e6;
+        Stats->WriteSeconds = Out->WriteTime/1e6;
+    }
+    for (int32 Index = 0; Index < WRITER_BUFFER_COUNT; Index++)
+    {
+        av_free(Out->Allocations[Index]);
+    }
+    av_freep(Result);
+
+    return Ret;
+}
@@ -0,0 +1,83 @@
+#ifndef MIXER_WRITER_H
+#define MIXER_WRITER_H
+
+#include "common.h"
+#include "thread.h"
+
+// Output file written by a thread of its own. The caller copies into one of
+// WRITER_BUFFER_COUNT large buffers and hands each full one to the thread,
+// so rendering only waits for the disk when every buffer is still being
+// written. Buffers are page aligned and written whole, which keeps every
+// write aligned, and with WRITER_DIRECT the file bypasses the page cache.
+
+#define WRITER_BUFFER_COUNT     3
+#define WRITER_BUFFER_SIZE      (1024*1024)
+
+// Open with O_DIRECT where the system and file system allow it, plain
+// buffered writes otherwise. Saves the page cache from holding a long render
+// nobody reads back soon.
+#define WRITER_DIRECT           1
+
+// When standard output is a pipe, vmsplice() the buffers into it instead of
+// copying them. The reader must read() the pipe: one that splices the pages
+// on to elsewhere would see them reused.
+#define WRITER_SPLICE           2
+
+// Name of the output that streams to standard output. Nothing can be seeked
+// there, so the header is never written, and stdout itself is pointed at
+// stderr so messages don't end up in the stream.
+#define WRITER_STDOUT           "-"
+
+typedef struct WriterStats
+{
+    int64 Bytes;
+    float64 Seconds;            // From open to closed.
+    float64 BytesPerSecond;
+    float64 BlockedSeconds;     // The caller waited for a free buffer.
+    float64 WriteSeconds;       // The thread spent in write().
+} WriterStats;
+
+typedef struct Writer
+{
+    int File;
+    int32 Direct;               // File is open with O_DIRECT.
+    int32 Stream;               // Standard output, not seekable.
+    int32 Splice;               // Buffers are spliced into a pipe.
+    int32 Error;
+
+    uint8_t *Buffers[WRITER_BUFFER_COUNT];
+    uint8_t *Allocations[WRITER_BUFFER_COUNT];
+    int32 Fill[WRITER_BUFFER_COUNT];
+    int32 Next;                 // Oldest buffer handed to the thread.
+    int32 Queued;               // Buffers handed to the thread.
+    int32 Held;                 // Of them already written, spliced pages the pipe still uses.
+    int32 Current;              // Buffer the caller fills, only the caller touches it.
+    int32 Stop;
+
+    Mutex Lock;
+    Cond Ready;                 // A buffer was queued or Stop set.
+    Cond Free;                  // The thread finished a buffer.
+    Thread Worker;
+
+    int64 Bytes;
+    int64 StartTime;
+    int64 BlockedTime;
+    int64 WriteTime;
+} Writer;
+
+// Keep the descriptor of standard output for a WRITER_STDOUT stream and
+// point stdout at stderr. WriterOpen() does it too, call it before anything
+// is printed to keep that out of the stream.
+int WriterReserveStdout(void);
+
+// Create FileName. SizeHint > 0 preallocates that many bytes, so a long
+// output is laid out in few extents and doesn't run out of space half way.
+int32 WriterOpen(Writer **Result, const char *FileName, int32 Flags, int64 SizeHint);
+
+int32 WriterWrite(Writer *Out, const void *Data, int64 Size);
+
+// Write what is left, then replace the first HeaderSize bytes with Header
+// unless it is NULL, and close. Returns the first error of any write.
+int32 WriterClose(Writer **Result, const void *Header, int32 HeaderSize, WriterStats *Stats);
+
+#endif